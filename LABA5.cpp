@@ -1,19 +1,584 @@
 ﻿#define _CRT_SECURE_NO_WARNINGS  // Отключаем предупреждения безопасности CRT
 #include <iostream>
 #include <cstring>
+#ifdef _WIN32
 #include <Windows.h>  // Для работы с консолью Windows
+#endif
 #include <cstdlib>
 #include <string>
 #include <vector>
 #include <memory> // Для умных указателей
 #include <algorithm> // Для алгоритмов STL
 #include <map> // Для ассоциативного массива
+#include <queue> // Для очереди с приоритетом по срокам возврата
+#include <unordered_map> // Для хеш-индексов
+#include <unordered_set> // Для выдач, которые уже закрываются
 #include <ctime> // Для работы с датами
+#include <cctype> // Для преобразования регистра
+#include <cstdint> // Для целых фиксированного размера в бинарном формате
+#include <cstdio> // Для записи файла снимка
+#include <stdexcept> // Для стандартных исключений
+#include <mutex> // Для синхронизации записи в журнал
+#include <shared_mutex> // Для разделяемой блокировки каталога
+#include <atomic> // Для атомарного учета экземпляров
+#include <random> // Для нагрузочной проверки выдачи
+#include <chrono> // Для группового сброса журнала по времени
+#include <thread> // Для параллельного разбора при импорте
+#include <condition_variable> // Для ожидания группового сброса журнала
+#include <new> // Для размещения объектов в блоках пула
+#include <type_traits> // Для выровненных ячеек пула
+#include <cmath> // Для порога похожести при нечетком поиске
+#include <functional> // Для источников кандидатов в планах запросов
+#include <iterator> // Для ленивых итераторов результатов запросов
+#include <climits> // Для проверки диапазона чисел во входных данных
+#include <numeric> // Для порядка слов запроса при нечетком поиске
+#include <cerrno> // Для проверки переполнения при разборе чисел
+#ifdef _MSC_VER
+#include <intrin.h> // Для _BitScanReverse64 в гистограммах задержек
+#endif
+#ifdef _WIN32
+#include <io.h> // Для _commit и _chsize_s
+#include <psapi.h> // Для пикового объема памяти в замерах
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
+#else
+#include <sys/mman.h> // Для отображения файла в память (POSIX)
+#include <sys/stat.h>
+#include <sys/resource.h> // Для пикового объема памяти в замерах
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h> // Для цикла событий сервера запросов
+#include <sys/socket.h>
+#include <sys/un.h> // Для локального сокета сервера запросов
+#include <csignal> // Для остановки сервера по SIGINT и SIGTERM
+#endif
 
 // Константы для ограничения размеров массивов (оставлены для совместимости)
 const int MAX_BORROWED_BOOKS = 100;
 const int MAX_NAME_LENGTH = 30;
 
+#ifdef _WIN32
+const char* const NULL_DEVICE = "NUL"; // Устройство, отбрасывающее вывод
+#else
+const char* const NULL_DEVICE = "/dev/null";
+#endif
+
+// ---------------------------------------------------------------------------
+// Счетчики и гистограммы задержек операций
+// ---------------------------------------------------------------------------
+// Каждый поток пишет замеры в свой набор гистограмм, без общих атомарных
+// операций и блокировок. При выводе наборы всех потоков суммируются.
+// Гистограмма логарифмически-линейная, как HDR: значения в наносекундах
+// делятся по степеням двойки, а каждая степень - еще на 8 равных частей.
+// Поэтому относительная погрешность процентилей не больше 1/8 на любом
+// масштабе, от наносекунд до минут. Один замер стоит двух чтений
+// steady_clock и нескольких записей в память своего потока. При сборке с
+// LIBRARY_NO_METRICS макрос LIBRARY_TIMED раскрывается в пустоту, и замеры
+// исчезают из кода полностью.
+
+// Замеряемые операции библиотеки
+enum LibraryOperation {
+    OP_ADD_AUTHOR,
+    OP_ADD_BOOK,
+    OP_ADD_READER,
+    OP_CHECKOUT,
+    OP_RETURN,
+    OP_RENEW,
+    OP_ADVANCE_CLOCK,
+    OP_FIND_BOOK_BY_TITLE,
+    OP_FIND_BOOKS_BY_TITLE_PREFIX,
+    OP_FIND_BOOK_BY_ISBN,
+    OP_FIND_READER_BY_CARD,
+    OP_FIND_READERS_BY_FIO,
+    OP_FIND_AUTHORS,
+    OP_FIND_BOOKS_BY_AUTHOR,
+    OP_SEARCH_BOOKS,
+    OP_FILTER_BOOKS,
+    OP_COUNT_BOOKS,
+    OP_FIND_LOANS,
+    OP_FIND_LOAN_BY_ID,
+    OP_QUERY,
+    OP_SORT,
+    OP_LIST_PAGE,
+    OP_PRINT_LIBRARY,
+    OP_EXPORT_REPORT,
+    OP_READ_VIEW,
+    OP_ANALYTICS,
+    OP_IMPORT,
+    OP_CHECKPOINT,
+    OP_SAVE,
+    OP_LOAD,
+    OP_COUNT
+};
+
+// Имена операций для вывода (совпадают с именами методов Library)
+const char* const OPERATION_NAMES[OP_COUNT] = {
+    "add_author", "add_book", "add_reader", "checkout_book", "return_loan", "renew_loan", "advance_clock",
+    "find_books_by_title", "find_books_by_title_prefix", "find_book_by_isbn", "find_reader_by_card",
+    "find_readers_by_fio", "find_authors", "find_books_by_author", "search_books", "filter_books", "count_books",
+    "find_loans", "find_loan_by_id", "query", "sort",
+    "list_page", "print_Library", "export_report", "read_view", "analytics", "import_file",
+    "checkpoint", "save_snapshot", "load"
+};
+
+// Сводка замеров одной операции (по всем потокам)
+struct OperationStats {
+    LibraryOperation operation;
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+};
+
+#ifndef LIBRARY_NO_METRICS
+
+const int LATENCY_SUB_BITS = 3; // 8 корзин на каждую степень двойки
+const int LATENCY_SUB_BUCKETS = 1 << LATENCY_SUB_BITS;
+const int LATENCY_BUCKETS = (64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS;
+
+// Номер старшего единичного бита (value > 0)
+inline int highest_bit(uint64_t value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+// Корзина гистограммы для значения
+inline int latency_bucket(uint64_t value) {
+    if (value < static_cast<uint64_t>(LATENCY_SUB_BUCKETS)) {
+        return static_cast<int>(value);
+    }
+    int shift = highest_bit(value) - LATENCY_SUB_BITS;
+    return (shift + 1) * LATENCY_SUB_BUCKETS + static_cast<int>((value >> shift) - LATENCY_SUB_BUCKETS);
+}
+
+// Наибольшее значение, попадающее в корзину
+inline uint64_t latency_bucket_upper(int bucket) {
+    if (bucket < LATENCY_SUB_BUCKETS) {
+        return static_cast<uint64_t>(bucket);
+    }
+    int shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    uint64_t lower = static_cast<uint64_t>(LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << shift;
+    return lower + ((uint64_t(1) << shift) - 1);
+}
+
+// Гистограмма задержек одного потока. Пишет только поток-владелец, поэтому
+// значения меняются обычными чтением и записью; атомарные типы нужны лишь
+// для того, чтобы сбор из другого потока не был гонкой данных
+struct LatencyHistogram {
+    std::atomic<uint64_t> buckets[LATENCY_BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> total_ns;
+    std::atomic<uint64_t> max_ns;
+
+    LatencyHistogram() : count(0), total_ns(0), max_ns(0) {
+        for (auto& bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    static void bump(std::atomic<uint64_t>& value, uint64_t delta) {
+        value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    void record(uint64_t ns) {
+        bump(buckets[latency_bucket(ns)], 1);
+        bump(count, 1);
+        bump(total_ns, ns);
+        if (ns > max_ns.load(std::memory_order_relaxed)) {
+            max_ns.store(ns, std::memory_order_relaxed);
+        }
+    }
+};
+
+// Замеры одного потока по всем операциям
+struct ThreadMetrics {
+    LatencyHistogram operations[OP_COUNT];
+};
+
+// Класс MetricsRegistry - наборы замеров всех потоков. Набор создается при
+// первом замере в потоке и живет до конца программы, поэтому замеры
+// завершившихся потоков тоже попадают в сводку
+class MetricsRegistry {
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadMetrics>> threads;
+
+public:
+    static MetricsRegistry& instance() {
+        static MetricsRegistry registry;
+        return registry;
+    }
+
+    ThreadMetrics* register_thread() {
+        std::lock_guard<std::mutex> lock(mutex);
+        threads.emplace_back(new ThreadMetrics());
+        return threads.back().get();
+    }
+
+    // Сводка по операциям, которые выполнялись хотя бы раз
+    std::vector<OperationStats> collect() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<OperationStats> result;
+        std::vector<uint64_t> buckets(LATENCY_BUCKETS);
+        for (int op = 0; op < OP_COUNT; op++) {
+            OperationStats stats = { static_cast<LibraryOperation>(op), 0, 0, 0, 0, 0, 0, 0 };
+            std::fill(buckets.begin(), buckets.end(), 0);
+            for (const auto& thread : threads) {
+                const LatencyHistogram& histogram = thread->operations[op];
+                stats.count += histogram.count.load(std::memory_order_relaxed);
+                stats.total_ns += histogram.total_ns.load(std::memory_order_relaxed);
+                stats.max_ns = std::max(stats.max_ns, histogram.max_ns.load(std::memory_order_relaxed));
+                for (int b = 0; b < LATENCY_BUCKETS; b++) {
+                    buckets[b] += histogram.buckets[b].load(std::memory_order_relaxed);
+                }
+            }
+            if (stats.count == 0) {
+                continue;
+            }
+            // Процентиль - верхняя граница корзины, в которой набирается нужная доля замеров
+            uint64_t* targets[] = { &stats.p50_ns, &stats.p90_ns, &stats.p99_ns, &stats.p999_ns };
+            const double shares[] = { 0.5, 0.9, 0.99, 0.999 };
+            uint64_t seen = 0;
+            size_t next = 0;
+            for (int b = 0; b < LATENCY_BUCKETS && next < 4; b++) {
+                seen += buckets[b];
+                while (next < 4 && seen > 0 && seen >= static_cast<uint64_t>(std::ceil(shares[next] * stats.count))) {
+                    *targets[next++] = std::min(latency_bucket_upper(b), stats.max_ns);
+                }
+            }
+            result.push_back(stats);
+        }
+        return result;
+    }
+};
+
+// Набор замеров текущего потока
+inline ThreadMetrics& thread_metrics() {
+    thread_local ThreadMetrics* metrics = MetricsRegistry::instance().register_thread();
+    return *metrics;
+}
+
+// Замер длительности области видимости
+class OperationTimer {
+    LibraryOperation operation;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit OperationTimer(LibraryOperation operation) : operation(operation), start(std::chrono::steady_clock::now()) {}
+
+    ~OperationTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        thread_metrics().operations[operation].record(
+            static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+};
+
+#define LIBRARY_TIMED(operation) OperationTimer operation_timer(operation)
+
+// Сводка замеров всех потоков
+inline std::vector<OperationStats> collect_operation_stats() {
+    return MetricsRegistry::instance().collect();
+}
+
+#else
+
+#define LIBRARY_TIMED(operation)
+
+inline std::vector<OperationStats> collect_operation_stats() {
+    return std::vector<OperationStats>();
+}
+
+#endif
+
+// Оценка памяти структуры: количество записей и байт (с учетом резерва векторов)
+struct MemoryStats {
+    std::string name;
+    size_t items;
+    size_t bytes;
+};
+
+// Память строки вне объекта (короткие строки хранятся внутри объекта)
+inline size_t string_heap_bytes(const std::string& value) {
+    const char* data = value.data();
+    const char* self = reinterpret_cast<const char*>(&value);
+    std::less<const char*> before;
+    bool inside = !before(data, self) && before(data, self + sizeof(value));
+    return inside ? 0 : value.capacity() + 1;
+}
+
+template <typename T>
+size_t vector_bytes(const std::vector<T>& items) {
+    return items.capacity() * sizeof(T);
+}
+
+// Оценка памяти дерева (map, multimap): узел с цветом и тремя указателями
+template <typename Map>
+size_t tree_bytes(const Map& map) {
+    return map.size() * (sizeof(typename Map::value_type) + 4 * sizeof(void*));
+}
+
+// Оценка памяти хеш-таблицы: узел с указателем и хешем, плюс массив корзин
+template <typename Map>
+size_t hash_bytes(const Map& map) {
+    return map.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void*)) + map.bucket_count() * sizeof(void*);
+}
+
+// Класс Date - дата как 32-битный номер дня (дней от 01.01.1970).
+// Строка "дд.мм.гггг" разбирается и проверяется один раз при вводе,
+// дальше даты сравниваются как целые числа.
+class Date {
+    int32_t day_number; // Номер дня
+
+    // Номер дня по году, месяцу и дню (алгоритм days_from_civil)
+    static int32_t days_from_civil(int year, int month, int day) {
+        year -= month <= 2;
+        int era = (year >= 0 ? year : year - 399) / 400;
+        int year_of_era = year - era * 400;
+        int day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+        return era * 146097 + day_of_era - 719468;
+    }
+
+public:
+    // Конструктор по умолчанию (01.01.1970)
+    Date() : day_number(0) {}
+
+    // Конструктор по номеру дня
+    explicit Date(int32_t days) : day_number(days) {}
+
+    // Проверка корректности календарной даты
+    static bool is_valid(int year, int month, int day) {
+        static const int days_in_month[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+        if (year < 1 || year > 9999 || month < 1 || month > 12 || day < 1) {
+            return false;
+        }
+        bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+        return day <= days_in_month[month - 1] + (month == 2 && leap ? 1 : 0);
+    }
+
+    // Создание даты по году, месяцу и дню
+    static Date from_ymd(int year, int month, int day) {
+        if (!is_valid(year, month, day)) {
+            throw std::invalid_argument("Некорректная дата.");
+        }
+        return Date(days_from_civil(year, month, day));
+    }
+
+    // Текущая дата по системным часам
+    static Date today() {
+        std::time_t now = std::time(nullptr);
+        std::tm* local = std::localtime(&now);
+        return from_ymd(local->tm_year + 1900, local->tm_mon + 1, local->tm_mday);
+    }
+
+    // Разбор строки формата дд.мм.гггг (ровно 10 символов: цифры и точки на своих местах)
+    static Date parse(const std::string& text) {
+        bool well_formed = text.size() == 10 && text[2] == '.' && text[5] == '.';
+        for (size_t i = 0; well_formed && i < text.size(); i++) {
+            well_formed = i == 2 || i == 5 || (text[i] >= '0' && text[i] <= '9');
+        }
+        if (!well_formed) {
+            throw std::invalid_argument("Дата должна быть в формате дд.мм.гггг: " + text);
+        }
+        auto number = [&text](size_t position, size_t length) {
+            int value = 0;
+            for (size_t i = position; i < position + length; i++) {
+                value = value * 10 + (text[i] - '0');
+            }
+            return value;
+        };
+        int day = number(0, 2), month = number(3, 2), year = number(6, 4);
+        if (!is_valid(year, month, day)) {
+            throw std::invalid_argument("Некорректная дата: " + text);
+        }
+        return Date(days_from_civil(year, month, day));
+    }
+
+    // Геттер для номера дня
+    int32_t get_day_number() const {
+        return day_number;
+    }
+
+    // Разложение на год, месяц и день (алгоритм civil_from_days)
+    void to_ymd(int& year, int& month, int& day) const {
+        int32_t z = day_number + 719468;
+        int era = (z >= 0 ? z : z - 146096) / 146097;
+        int day_of_era = z - era * 146097;
+        int year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+        int day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+        int mp = (5 * day_of_year + 2) / 153;
+        day = day_of_year - (153 * mp + 2) / 5 + 1;
+        month = mp < 10 ? mp + 3 : mp - 9;
+        year = year_of_era + era * 400 + (month <= 2);
+    }
+
+    // Преобразование в строку дд.мм.гггг
+    std::string to_string() const {
+        int year, month, day;
+        to_ymd(year, month, day);
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%02d.%02d.%04d", day, month, year);
+        return buffer;
+    }
+
+    // Сдвиг на заданное количество дней
+    Date operator+(int days) const {
+        return Date(day_number + days);
+    }
+
+    // Разность дат в днях
+    int operator-(const Date& other) const {
+        return day_number - other.day_number;
+    }
+
+    bool operator<(const Date& other) const { return day_number < other.day_number; }
+    bool operator>(const Date& other) const { return day_number > other.day_number; }
+    bool operator<=(const Date& other) const { return day_number <= other.day_number; }
+    bool operator>=(const Date& other) const { return day_number >= other.day_number; }
+    bool operator==(const Date& other) const { return day_number == other.day_number; }
+    bool operator!=(const Date& other) const { return day_number != other.day_number; }
+
+    // Перегрузка оператора вывода
+    friend std::ostream& operator<<(std::ostream& os, const Date& date) {
+        os << date.to_string();
+        return os;
+    }
+};
+
+static_assert(sizeof(Date) == 4, "Date должен занимать 32 бита");
+
+// ---------------------------------------------------------------------------
+// Сортировка строк по русскому алфавиту
+// ---------------------------------------------------------------------------
+// Для каждой строки один раз строится двоичный ключ сортировки: сравнение
+// ключей через memcmp (operator< у std::string) дает порядок по алфавиту,
+// и правила сравнения не выполняются заново при каждом сравнении.
+// Ключ состоит из двух уровней:
+//   основной - веса символов без учета регистра: пробелы < знаки < цифры <
+//              латиница < кириллица, буква ё стоит между е и ж;
+//   регистр  - после разделителя COLLATION_LEVEL_SEPARATOR по байту на
+//              букву (строчная раньше прописной), различает строки,
+//              совпавшие на основном уровне.
+// Основной уровень ключа строки-префикса является префиксом ключа строки.
+
+const char COLLATION_LEVEL_SEPARATOR = '\x01'; // Меньше любого веса основного уровня
+const char COLLATION_SPACE = '\x02';
+const char COLLATION_PUNCTUATION = '\x03'; // Первый из 32 весов знаков ASCII
+const char COLLATION_DIGIT = '\x23';
+const char COLLATION_LATIN = '\x2D';
+const char COLLATION_CYRILLIC = '\x47'; // 33 буквы: а..е, ё, ж..я
+const char COLLATION_OTHER = '\x70'; // Прочие символы: вес и 3 байта кода
+const char COLLATION_LOWER = '\x02';
+const char COLLATION_UPPER = '\x03';
+
+// Разбор строки UTF-8 в коды символов; false, если строка не является UTF-8
+bool decode_utf8(const std::string& text, std::vector<uint32_t>& codes) {
+    codes.clear();
+    for (size_t i = 0; i < text.size();) {
+        unsigned char lead = static_cast<unsigned char>(text[i]);
+        size_t length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xE ? 3 : (lead >> 3) == 0x1E ? 4 : 0;
+        if (length == 0 || i + length > text.size()) {
+            return false;
+        }
+        uint32_t code = length == 1 ? lead : lead & (0x7F >> length);
+        for (size_t k = 1; k < length; k++) {
+            unsigned char next = static_cast<unsigned char>(text[i + k]);
+            if ((next & 0xC0) != 0x80) {
+                return false;
+            }
+            code = (code << 6) | (next & 0x3F);
+        }
+        codes.push_back(code);
+        i += length;
+    }
+    return true;
+}
+
+// Разбор текста в коды символов. Строка читается как UTF-8, а если она им
+// не является - как CP1251 (так приходит ввод из консоли Windows)
+std::vector<uint32_t> decode_text(const std::string& text) {
+    std::vector<uint32_t> codes;
+    if (!decode_utf8(text, codes)) {
+        codes.clear();
+        for (char c : text) {
+            unsigned char byte = static_cast<unsigned char>(c);
+            codes.push_back(byte >= 0xC0 ? 0x410 + (byte - 0xC0) : byte == 0xA8 ? 0x401 : byte == 0xB8 ? 0x451 : byte);
+        }
+    }
+    return codes;
+}
+
+// Дополнение текста пробелами до width символов (для столбцов таблиц; printf считает байты)
+std::string pad_text(const std::string& text, size_t width, bool right_align = false) {
+    size_t length = decode_text(text).size();
+    std::string padding(length < width ? width - length : 0, ' ');
+    return right_align ? padding + text : text + padding;
+}
+
+// Номер буквы в русском алфавите (а = 0, ё = 6, я = 32) или -1; upper - прописная ли буква
+int russian_letter_index(uint32_t code, bool& upper) {
+    upper = (code >= 0x410 && code <= 0x42F) || code == 0x401;
+    if (code >= 0x410 && code <= 0x42F) {
+        code += 0x20;
+    }
+    if (code == 0x401 || code == 0x451) {
+        return 6;
+    }
+    if (code < 0x430 || code > 0x44F) {
+        return -1;
+    }
+    int index = static_cast<int>(code - 0x430);
+    return index < 6 ? index : index + 1; // После е идет ё
+}
+
+// Ключ сортировки строки; при ignore_case - только основной уровень
+std::string make_collation_key(const std::string& text, bool ignore_case = false) {
+    static const char punctuation[] = "!\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~";
+    std::string primary;
+    std::string cases;
+    for (uint32_t code : decode_text(text)) {
+        bool upper = false;
+        int letter = russian_letter_index(code, upper);
+        if (letter >= 0) {
+            primary += static_cast<char>(COLLATION_CYRILLIC + letter);
+            cases += upper ? COLLATION_UPPER : COLLATION_LOWER;
+        }
+        else if ((code >= 'a' && code <= 'z') || (code >= 'A' && code <= 'Z')) {
+            upper = code <= 'Z';
+            primary += static_cast<char>(COLLATION_LATIN + (upper ? code - 'A' : code - 'a'));
+            cases += upper ? COLLATION_UPPER : COLLATION_LOWER;
+        }
+        else if (code >= '0' && code <= '9') {
+            primary += static_cast<char>(COLLATION_DIGIT + (code - '0'));
+        }
+        else if (code == ' ' || code == '\t' || code == 0xA0) {
+            primary += COLLATION_SPACE;
+        }
+        else if (code > ' ' && code < 0x7F) {
+            primary += static_cast<char>(COLLATION_PUNCTUATION + (std::strchr(punctuation, static_cast<int>(code)) - punctuation));
+        }
+        else if (code > 0x9F) { // Управляющие символы пропускаются
+            primary += COLLATION_OTHER;
+            for (int shift = 14; shift >= 0; shift -= 7) {
+                primary += static_cast<char>(0x80 | ((code >> shift) & 0x7F));
+            }
+        }
+    }
+    if (ignore_case) {
+        return primary;
+    }
+    primary += COLLATION_LEVEL_SEPARATOR;
+    return primary + cases;
+}
+
 // Абстрактный базовый класс для персоналий
 class AbstractPerson {
 public:
@@ -27,9 +592,16 @@ public:
 class Author : public AbstractPerson {
 protected: // Модификатор protected для демонстрации
     std::string fio; // ФИО автора
+    std::string fio_key; // Ключ сортировки ФИО (make_collation_key)
     int birth_year; // Год рождения
     static int total_authors; // Статическая переменная для подсчета авторов
 
+    // Смена ФИО вместе с ключом сортировки
+    void set_fio(const std::string& value) {
+        fio = value;
+        fio_key = make_collation_key(fio);
+    }
+
 public:
     // Конструктор по умолчанию
     Author() : birth_year(0) {
@@ -37,7 +609,12 @@ public:
     }
 
     // Конструктор с параметрами
-    Author(const std::string& name, int year) : fio(name), birth_year(year) {
+    Author(const std::string& name, int year) : fio(name), fio_key(make_collation_key(name)), birth_year(year) {
+        total_authors++;
+    }
+
+    // Конструктор с готовым ключом сортировки (используется при загрузке снимка каталога)
+    Author(std::string name, std::string key, int year) : fio(std::move(name)), fio_key(std::move(key)), birth_year(year) {
         total_authors++;
     }
 
@@ -51,16 +628,28 @@ public:
         return fio;
     }
 
+    // Геттер для ключа сортировки ФИО
+    const std::string& get_fio_key() const {
+        return fio_key;
+    }
+
     // Геттер для года рождения
     int get_birth_year() const {
         return birth_year;
     }
 
+    // Оценка памяти автора в байтах
+    virtual size_t memory_usage() const {
+        return sizeof(Author) + string_heap_bytes(fio) + string_heap_bytes(fio_key);
+    }
+
     // Метод для добавления информации об авторе
     void add_Author() {
         printf("Введите ФИО автора: ");
         while (getchar() != '\n'); // Очистка буфера
-        std::getline(std::cin, this->fio);
+        std::string name;
+        std::getline(std::cin, name);
+        set_fio(name);
 
         printf("Введите год рождения автора: ");
         std::string year_str;
@@ -82,7 +671,7 @@ public:
     // Перегрузка оператора + для объединения авторов
     Author operator+(const Author& other) const {
         Author result;
-        result.fio = this->fio + " & " + other.fio;
+        result.set_fio(this->fio + " & " + other.fio);
         result.birth_year = (this->birth_year + other.birth_year) / 2;
         return result;
     }
@@ -106,9 +695,9 @@ public:
         return os;
     }
 
-    // Оператор сравнения для сортировки
+    // Оператор сравнения для сортировки (по алфавиту, через ключи сортировки)
     bool operator<(const Author& other) const {
-        return this->fio < other.fio;
+        return this->fio_key < other.fio_key;
     }
 };
 
@@ -126,6 +715,25 @@ public:
         : Author(name, year), most_famous_work(work), awards_count(awards) {
     }
 
+    // Конструктор с готовым ключом сортировки (используется при загрузке снимка каталога)
+    FamousAuthor(std::string name, std::string key, int year, std::string work, int awards)
+        : Author(std::move(name), std::move(key), year), most_famous_work(std::move(work)), awards_count(awards) {
+    }
+
+    // Геттер для самого известного произведения
+    const std::string& get_most_famous_work() const {
+        return most_famous_work;
+    }
+
+    // Геттер для количества наград
+    int get_awards_count() const {
+        return awards_count;
+    }
+
+    size_t memory_usage() const override {
+        return Author::memory_usage() - sizeof(Author) + sizeof(FamousAuthor) + string_heap_bytes(most_famous_work);
+    }
+
     // Перегрузка метода print_Author с вызовом базового метода
     void print_Author() const override {
         Author::print_Author(); // Вызов метода базового класса
@@ -143,7 +751,7 @@ public:
     // Перегрузка оператора присваивания для базового класса
     FamousAuthor& operator=(const Author& other) {
         if (this != &other) {
-            this->fio = other.get_fio();
+            set_fio(other.get_fio());
             this->birth_year = other.get_birth_year();
             this->most_famous_work = "Не указано";
             this->awards_count = 0;
@@ -164,11 +772,11 @@ public:
 template <typename T>
 class LibraryCard {
     T id; // Идентификатор карточки (может быть разного типа)
-    std::string issue_date; // Дата выдачи
-    std::string expire_date; // Дата истечения
+    Date issue_date; // Дата выдачи
+    Date expire_date; // Дата истечения
 public:
     // Конструктор
-    LibraryCard(T id, const std::string& issue, const std::string& expire)
+    LibraryCard(T id, const Date& issue, const Date& expire)
         : id(id), issue_date(issue), expire_date(expire) {
     }
 
@@ -180,134 +788,672 @@ public:
     }
 };
 
-// Класс Book для представления книг в библиотеке
-class Book {
-    std::string title; // Название книги
-    std::shared_ptr<Author> author; // Умный указатель на автора
-    int pub_year; // Год публикации
-    int copies; // Количество экземпляров
-    std::string isbn; // Уникальный идентификатор книги
+// ---------------------------------------------------------------------------
+// Пулы объектов и 32-битные дескрипторы
+// ---------------------------------------------------------------------------
+// Книги, читатели и выдачи хранятся в пулах Library блоками по
+// SLAB_CHUNK_SIZE объектов: при росте пула адреса не меняются, а связи
+// между объектами задаются 4-байтовыми дескрипторами вместо shared_ptr,
+// так что копирование связи не трогает атомарный счетчик ссылок.
+// Дескриптор содержит номер ячейки и ее поколение; при очистке пула
+// поколение растет, и оставшиеся снаружи ссылки распознаются как
+// устаревшие, а не указывают на новый объект в той же ячейке.
+
+const uint32_t SLAB_SLOT_BITS = 24; // Младшие биты дескриптора - номер ячейки
+const uint32_t SLAB_SLOT_MASK = (1u << SLAB_SLOT_BITS) - 1;
+const uint32_t SLAB_MAX_SLOTS = SLAB_SLOT_MASK; // Ячейка SLAB_SLOT_MASK не выдается: ее занимает NO_HANDLE
+const uint32_t SLAB_CHUNK_SIZE = 4096; // Объектов в одном блоке
+const uint32_t SLAB_MAX_CHUNKS = (SLAB_MAX_SLOTS + SLAB_CHUNK_SIZE - 1) / SLAB_CHUNK_SIZE;
+
+// Класс SlabHandle - дескриптор объекта в пуле (ячейка и поколение)
+class SlabHandle {
+    uint32_t value;
 
 public:
-    // Конструктор по умолчанию
-    Book() : pub_year(0), copies(0) {}
+    static const uint32_t NO_HANDLE = 0xFFFFFFFFu; // Пустой дескриптор
 
-    // Геттер для названия книги
-    const std::string& get_title() const {
-        return title;
+    SlabHandle() : value(NO_HANDLE) {}
+    SlabHandle(uint32_t slot, uint8_t generation)
+        : value(slot | (static_cast<uint32_t>(generation) << SLAB_SLOT_BITS)) {
     }
 
-    // Геттер для ISBN
-    const std::string& get_isbn() const {
-        return isbn;
-    }
+    uint32_t get_slot() const { return value & SLAB_SLOT_MASK; }
+    uint8_t get_generation() const { return static_cast<uint8_t>(value >> SLAB_SLOT_BITS); }
+    uint32_t get_value() const { return value; }
+    bool is_valid() const { return value != NO_HANDLE; }
 
-    // Метод для добавления книги
-    void add_Book(const std::vector<std::shared_ptr<Author>>& authors) {
-        printf("Введите название книги: \n");
-        while (getchar() != '\n'); // Очистка буфера
-        std::getline(std::cin, this->title);
+    bool operator==(const SlabHandle& other) const { return value == other.value; }
+    bool operator!=(const SlabHandle& other) const { return value != other.value; }
+    bool operator<(const SlabHandle& other) const { return value < other.value; }
+};
 
-        if (this->title.empty()) {
-            throw std::invalid_argument("Название книги не может быть пустым.");
-        }
+const uint32_t SlabHandle::NO_HANDLE;
 
-        printf("Введите ISBN книги: ");
-        std::getline(std::cin, this->isbn);
+static_assert(sizeof(SlabHandle) == 4, "Дескриптор должен занимать 4 байта");
 
-        printf("Выберите автора (введите номер): ");
-        for (size_t i = 0; i < authors.size(); i++) {
-            if (authors[i] != nullptr) {
-                printf("%zu. %s\n", i + 1, authors[i]->get_fio().c_str());
-            }
-        }
+// Класс SlabPool - пул объектов одного типа.
+// Объекты только добавляются (каталог библиотеки не удаляет записей) и
+// уничтожаются все сразу в clear(). Каталог блоков выделяется целиком
+// при создании пула, поэтому чтение уже созданных объектов безопасно
+// параллельно с добавлением новых; само добавление выполняется под
+// блокировкой владельца пула.
+// Пул, заполненный из снимка, может создавать объекты отложенно
+// (assign_lazy): блок создается целиком при первом обращении к любой его
+// ячейке, поэтому открытие каталога не зависит от числа записей.
+template <typename T>
+class SlabPool {
+    struct Chunk {
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type slots[SLAB_CHUNK_SIZE];
+        uint8_t generations[SLAB_CHUNK_SIZE];
+    };
 
-        int author_index;
-        scanf("%d", &author_index);
-        if (author_index < 1 || author_index > static_cast<int>(authors.size()) || authors[author_index - 1] == nullptr) {
-            throw std::out_of_range("Некорректный номер автора.");
-        }
-        this->author = authors[author_index - 1];
+    std::unique_ptr<std::unique_ptr<Chunk>[]> chunks; // Каталог блоков фиксированного размера
+    std::atomic<uint32_t> count; // Заняты ячейки [0, count)
+    std::atomic<uint32_t> lazy_count; // Ячейки [0, lazy_count) создаются при первом обращении к их блоку
+    std::unique_ptr<std::atomic<bool>[]> chunk_ready; // Отложенные объекты блока уже созданы
+    uint32_t lazy_chunks; // Блоков, у которых мог быть выставлен chunk_ready
+    std::function<void(uint32_t, void*)> construct_later; // Создание отложенного объекта ячейки в памяти
+    mutable std::mutex lazy_mutex; // Создание блока отложенных объектов (одним потоком)
 
-        printf("Введите дату публикации: ");
-        scanf("%d", &this->pub_year);
-        printf("Введите количество экземпляров: ");
-        scanf("%d", &this->copies);
+    T* slot_object(uint32_t slot) const {
+        return reinterpret_cast<T*>(&chunks[slot / SLAB_CHUNK_SIZE]->slots[slot % SLAB_CHUNK_SIZE]);
     }
 
-    // Виртуальный метод для вывода информации о книге
-    virtual void print_Book() const {
-        if (this->title.empty() || this->author == nullptr) {
-            printf("Ошибка: некорректные данные о книге.\n");
+    uint8_t& slot_generation(uint32_t slot) const {
+        return chunks[slot / SLAB_CHUNK_SIZE]->generations[slot % SLAB_CHUNK_SIZE];
+    }
+
+    // Создание отложенных объектов блока ячейки slot, если их еще нет.
+    // Вызывается и под разделяемой блокировкой владельца, поэтому блок
+    // создает один поток, а остальные видят его после chunk_ready
+    void load_slot(uint32_t slot) const {
+        uint32_t index = slot / SLAB_CHUNK_SIZE;
+        if (slot >= lazy_count.load(std::memory_order_acquire) || chunk_ready[index].load(std::memory_order_acquire)) {
             return;
         }
-        printf("Название книги: %s\n", this->title.c_str());
-        printf("ISBN: %s\n", this->isbn.c_str());
-        printf("Автор книги: %s\n", this->author->get_fio().c_str());
-        printf("Дата публикации: %d\n", this->pub_year);
-        printf("Количество экземпляров: %d\n", this->copies);
+        std::lock_guard<std::mutex> lock(lazy_mutex);
+        if (chunk_ready[index].load(std::memory_order_relaxed)) {
+            return;
+        }
+        std::unique_ptr<Chunk>& chunk = chunks[index];
+        if (!chunk) {
+            chunk.reset(new Chunk());
+        }
+        uint32_t first = index * SLAB_CHUNK_SIZE;
+        uint32_t last = std::min(lazy_count.load(std::memory_order_relaxed), first + SLAB_CHUNK_SIZE);
+        uint32_t current = first;
+        try {
+            for (; current < last; current++) {
+                construct_later(current, slot_object(current));
+            }
+        }
+        catch (...) {
+            while (current-- > first) {
+                slot_object(current)->~T();
+            }
+            throw;
+        }
+        chunk_ready[index].store(true, std::memory_order_release);
     }
 
-    // Не виртуальная функция, вызывающая виртуальную
-    void displayBookInfo() const {
-        print_Book();
+public:
+    SlabPool() : chunks(new std::unique_ptr<Chunk>[SLAB_MAX_CHUNKS]), count(0), lazy_count(0),
+        chunk_ready(new std::atomic<bool>[SLAB_MAX_CHUNKS]()), lazy_chunks(0) {
     }
 
-    // Оператор сравнения для сортировки книг по названию
-    bool operator<(const Book& other) const {
-        return this->title < other.title;
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    ~SlabPool() {
+        clear();
     }
 
-    // Дружественная функция для проверки доступности книги
-    friend bool is_book_available(const Book& book, int required_copies);
-    // Дружественная функция для перегрузки оператора вывода
-    friend std::ostream& operator<<(std::ostream& os, const Book& book);
-};
+    // Создание объекта в следующей свободной ячейке
+    template <typename... Args>
+    SlabHandle create(Args&&... args) {
+        uint32_t slot = count.load(std::memory_order_relaxed);
+        if (slot >= SLAB_MAX_SLOTS) {
+            throw std::length_error("Пул объектов переполнен.");
+        }
+        std::unique_ptr<Chunk>& chunk = chunks[slot / SLAB_CHUNK_SIZE];
+        if (!chunk) {
+            chunk.reset(new Chunk()); // Поколения ячеек нового блока начинаются с 0
+        }
+        new (slot_object(slot)) T(std::forward<Args>(args)...);
+        count.store(slot + 1, std::memory_order_release); // Объект виден читателям только после создания
+        return SlabHandle(slot, slot_generation(slot));
+    }
 
-// Функция проверки доступности книги
-bool is_book_available(const Book& book, int required_copies) {
-    return book.copies >= required_copies;
-}
+    // Отложенное создание count объектов в пустом пуле: объект ячейки
+    // создается вызовом construct(ячейка, память) вместе со всем своим блоком
+    void assign_lazy(uint32_t lazy, std::function<void(uint32_t, void*)> construct) {
+        if (lazy >= SLAB_MAX_SLOTS) {
+            throw std::length_error("Пул объектов переполнен.");
+        }
+        construct_later = std::move(construct);
+        lazy_chunks = (lazy + SLAB_CHUNK_SIZE - 1) / SLAB_CHUNK_SIZE;
+        lazy_count.store(lazy, std::memory_order_release);
+        count.store(lazy, std::memory_order_release);
+    }
 
-// Перегрузка оператора вывода для Book
-std::ostream& operator<<(std::ostream& os, const Book& book) {
-    os << "Книга: " << book.title
-        << "\nISBN: " << book.isbn
-        << "\nАвтор: " << book.author->get_fio()
-        << "\nГод публикации: " << book.pub_year
-        << "\nЭкземпляров: " << book.copies;
-    return os;
-}
+    // Создание всех отложенных объектов; дальше пул работает как обычный
+    void load_all() {
+        for (uint32_t slot = 0; slot < lazy_count.load(std::memory_order_acquire); slot += SLAB_CHUNK_SIZE) {
+            load_slot(slot);
+        }
+        lazy_count.store(0, std::memory_order_release);
+        construct_later = nullptr;
+    }
 
-// Класс Reader для представления читателей
-class Reader : public AbstractPerson {
-    std::string fio; // ФИО читателя
-    int card_number; // Номер читательского билета
-    std::vector<std::shared_ptr<Book>> borrowed_books; // Вектор взятых книг
-    std::map<std::string, std::string> borrowed_dates; // Дата взятия каждой книги (ISBN -> дата)
+    // Объект по дескриптору (nullptr, если дескриптор пустой или устарел)
+    T* get(SlabHandle handle) const {
+        uint32_t slot = handle.get_slot();
+        if (!handle.is_valid() || slot >= count.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        load_slot(slot);
+        if (slot_generation(slot) != handle.get_generation()) {
+            return nullptr;
+        }
+        return slot_object(slot);
+    }
 
-public:
-    // Конструктор по умолчанию
-    Reader() : card_number(0) {}
+    // Дескриптор занятой ячейки по ее номеру
+    SlabHandle handle_at(uint32_t slot) const {
+        load_slot(slot);
+        return SlabHandle(slot, slot_generation(slot));
+    }
 
-    // Установка количества взятых книг
-    void set_borrowed_count() {
-        borrowed_books.push_back(nullptr); // Просто для демонстрации
+    size_t size() const {
+        return count.load(std::memory_order_acquire);
     }
 
-    // Геттер для ФИО
-    const std::string& get_fio() const {
-        return fio;
+    // Память каталога и выделенных блоков
+    size_t memory_usage() const {
+        size_t chunk_count = (count.load(std::memory_order_acquire) + SLAB_CHUNK_SIZE - 1) / SLAB_CHUNK_SIZE;
+        return SLAB_MAX_CHUNKS * sizeof(std::unique_ptr<Chunk>) + chunk_count * sizeof(Chunk);
     }
 
-    // Геттер для номера билета
-    int get_card_number() const {
+    // Уничтожение всех объектов; блоки остаются для повторного использования.
+    // Несозданные отложенные объекты пропускаются
+    void clear() {
+        uint32_t used = count.load(std::memory_order_relaxed);
+        uint32_t lazy = lazy_count.load(std::memory_order_relaxed);
+        count.store(0, std::memory_order_release);
+        lazy_count.store(0, std::memory_order_release);
+        for (uint32_t slot = 0; slot < used; slot++) {
+            if (slot < lazy && !chunk_ready[slot / SLAB_CHUNK_SIZE].load(std::memory_order_relaxed)) {
+                slot += SLAB_CHUNK_SIZE - 1 - slot % SLAB_CHUNK_SIZE; // Блок не создавался
+                continue;
+            }
+            slot_object(slot)->~T();
+            slot_generation(slot)++;
+        }
+        for (uint32_t index = 0; index < lazy_chunks; index++) {
+            chunk_ready[index].store(false, std::memory_order_relaxed);
+        }
+        lazy_chunks = 0;
+        construct_later = nullptr;
+    }
+};
+
+// Класс SlabRef - ссылка на объект пула для внешнего кода.
+// Проверяет поколение при каждом обращении и, в отличие от shared_ptr,
+// копируется без атомарных операций. Действительна, пока жива библиотека.
+template <typename T>
+class SlabRef {
+    const SlabPool<T>* pool;
+    SlabHandle handle;
+
+public:
+    SlabRef() : pool(nullptr) {}
+    SlabRef(std::nullptr_t) : pool(nullptr) {}
+    SlabRef(const SlabPool<T>* pool, SlabHandle handle) : pool(pool), handle(handle) {}
+
+    // Объект или nullptr, если ссылка пуста или устарела
+    T* get() const {
+        return pool != nullptr ? pool->get(handle) : nullptr;
+    }
+
+    T* operator->() const {
+        T* object = get();
+        if (object == nullptr) {
+            throw std::logic_error("Обращение по пустой или устаревшей ссылке.");
+        }
+        return object;
+    }
+
+    T& operator*() const {
+        return *operator->();
+    }
+
+    explicit operator bool() const {
+        return get() != nullptr;
+    }
+
+    SlabHandle get_handle() const {
+        return handle;
+    }
+
+    // Проверка, что ссылка указывает в заданный пул
+    bool belongs_to(const SlabPool<T>& owner) const {
+        return pool == &owner;
+    }
+
+    bool operator==(const SlabRef& other) const { return pool == other.pool && handle == other.handle; }
+    bool operator!=(const SlabRef& other) const { return !(*this == other); }
+};
+
+class Book;
+class Reader;
+class Loan;
+
+typedef SlabRef<Book> BookRef; // Ссылка на книгу библиотеки
+typedef SlabRef<Reader> ReaderRef; // Ссылка на читателя библиотеки
+typedef SlabRef<Loan> LoanRef; // Ссылка на выдачу библиотеки
+
+// ---------------------------------------------------------------------------
+// Нормализованные ISBN и индекс книг по ISBN
+// ---------------------------------------------------------------------------
+// ISBN-10 и ISBN-13 приводятся к 13-значному числу (к ISBN-10 дописывается
+// префикс 978 и пересчитывается контрольная цифра), поэтому обе записи одной
+// книги дают один ключ. Дефисы и пробелы при разборе пропускаются.
+
+const uint64_t NO_ISBN = 0; // Ключ 0 не соответствует ни одному корректному ISBN
+const uint64_t ISBN13_MIN_BODY = 978000000000ull; // Первые 12 цифр наименьшего ISBN-13 (префикс 978)
+const uint64_t ISBN13_MAX_BODY = 979999999999ull; // Первые 12 цифр наибольшего ISBN-13 (префикс 979)
+
+// Контрольная цифра ISBN-13 по первым 12 цифрам (веса 1 и 3 по очереди)
+int isbn13_check_digit(uint64_t body) {
+    int sum = 0;
+    for (int i = 0; i < 12; i++, body /= 10) {
+        int digit = static_cast<int>(body % 10);
+        sum += (i % 2 == 0) ? digit * 3 : digit; // Справа налево: последняя из 12 цифр имеет вес 3
+    }
+    return (10 - sum % 10) % 10;
+}
+
+// Разбор ISBN-10 или ISBN-13 с проверкой контрольной цифры; key - число ISBN-13
+bool parse_isbn(const std::string& text, uint64_t& key) {
+    char digits[13];
+    size_t count = 0;
+    for (char c : text) {
+        if (c == '-' || c == ' ') {
+            continue;
+        }
+        bool is_digit = c >= '0' && c <= '9';
+        bool is_check_x = (c == 'X' || c == 'x') && count == 9; // X допустим только последней цифрой ISBN-10
+        if (count == 13 || !(is_digit || is_check_x)) {
+            return false;
+        }
+        digits[count++] = c;
+    }
+
+    uint64_t body = 0;
+    if (count == 10) {
+        int sum = 0;
+        for (int i = 0; i < 10; i++) {
+            int value = (digits[i] == 'X' || digits[i] == 'x') ? 10 : digits[i] - '0';
+            sum += value * (10 - i);
+        }
+        if (sum % 11 != 0) {
+            return false;
+        }
+        body = 978;
+        for (int i = 0; i < 9; i++) {
+            body = body * 10 + static_cast<uint64_t>(digits[i] - '0');
+        }
+    }
+    else if (count == 13) {
+        for (int i = 0; i < 12; i++) {
+            if (digits[i] == 'X' || digits[i] == 'x') {
+                return false;
+            }
+            body = body * 10 + static_cast<uint64_t>(digits[i] - '0');
+        }
+        if (digits[12] == 'X' || digits[12] == 'x' || body < ISBN13_MIN_BODY || body > ISBN13_MAX_BODY
+            || isbn13_check_digit(body) != digits[12] - '0') {
+            return false;
+        }
+    }
+    else {
+        return false;
+    }
+    key = body * 10 + static_cast<uint64_t>(isbn13_check_digit(body));
+    return true;
+}
+
+// Ключ ISBN в виде 13 цифр без дефисов
+std::string format_isbn(uint64_t key) {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%013llu", static_cast<unsigned long long>(key));
+    return buffer;
+}
+
+// Класс IsbnIndex - хеш-таблица с открытой адресацией (линейное пробирование).
+// Ячейка - одно 64-битное слово: в старших 32 битах сжатый ключ (12 цифр без
+// префикса 97x и контрольной цифры, плюс 1, чтобы 0 означал пустую ячейку), в
+// младших - дескриптор книги. В строку кэша помещается 8 ячеек, а заполнение
+// не превышает половины, так что поиск обычно читает одну строку кэша.
+// Записи только добавляются: каталог не удаляет книг.
+class IsbnIndex {
+    std::vector<uint64_t> slots; // Размер - степень двойки (или 0)
+    size_t count;
+    unsigned shift; // 64 - log2(slots.size())
+
+    // Сжатие ключа до 31 бита (контрольная цифра однозначно следует из остальных)
+    static uint32_t compact(uint64_t key) {
+        return static_cast<uint32_t>(key / 10 - ISBN13_MIN_BODY + 1);
+    }
+
+    // Начальная ячейка (мультипликативное хеширование Фибоначчи)
+    size_t home(uint32_t tag) const {
+        return static_cast<size_t>((static_cast<uint64_t>(tag) * 0x9E3779B97F4A7C15ull) >> shift);
+    }
+
+    // Вставка без проверки заполнения и повторов
+    void place(uint64_t slot) {
+        size_t mask = slots.size() - 1;
+        size_t i = home(static_cast<uint32_t>(slot >> 32));
+        while (slots[i] != 0) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = slot;
+    }
+
+    // Перераспределение ячеек по новой таблице
+    void rehash(size_t capacity) {
+        std::vector<uint64_t> old;
+        old.swap(slots);
+        slots.assign(capacity, 0);
+        shift = 64;
+        for (size_t n = capacity; n > 1; n >>= 1) {
+            shift--;
+        }
+        for (uint64_t slot : old) {
+            if (slot != 0) {
+                place(slot);
+            }
+        }
+    }
+
+public:
+    IsbnIndex() : count(0), shift(64) {}
+
+    // Поиск книги по ключу (пустой дескриптор, если не найдена)
+    SlabHandle find(uint64_t key) const {
+        if (count == 0 || key == NO_ISBN) {
+            return SlabHandle();
+        }
+        uint32_t tag = compact(key);
+        size_t mask = slots.size() - 1;
+        for (size_t i = home(tag);; i = (i + 1) & mask) {
+            uint64_t slot = slots[i];
+            if (slot == 0) {
+                return SlabHandle();
+            }
+            if (static_cast<uint32_t>(slot >> 32) == tag) {
+                uint32_t value = static_cast<uint32_t>(slot);
+                return SlabHandle(value & SLAB_SLOT_MASK, static_cast<uint8_t>(value >> SLAB_SLOT_BITS));
+            }
+        }
+    }
+
+    // Добавление книги; false, если ключ уже занят
+    bool insert(uint64_t key, SlabHandle book) {
+        if (find(key).is_valid()) {
+            return false;
+        }
+        reserve(count + 1);
+        place((static_cast<uint64_t>(compact(key)) << 32) | book.get_value());
+        count++;
+        return true;
+    }
+
+    // Подготовка таблицы к n записям без перераспределений
+    void reserve(size_t n) {
+        size_t capacity = slots.empty() ? 16 : slots.size();
+        while (n * 2 > capacity) {
+            capacity *= 2;
+        }
+        if (capacity != slots.size()) {
+            rehash(capacity);
+        }
+    }
+
+    void clear() {
+        std::vector<uint64_t>().swap(slots);
+        count = 0;
+        shift = 64;
+    }
+
+    size_t size() const { return count; }
+    size_t memory_usage() const { return slots.capacity() * sizeof(uint64_t); }
+};
+
+// Класс Book для представления книг в библиотеке
+class Book {
+    std::string title; // Название книги
+    std::string title_key; // Ключ сортировки названия (make_collation_key)
+    std::shared_ptr<Author> author; // Умный указатель на автора
+    int pub_year; // Год публикации
+    std::atomic<int> copies; // Количество доступных экземпляров (меняется атомарно при выдаче и возврате)
+    std::string isbn; // Уникальный идентификатор книги
+
+public:
+    // Конструктор по умолчанию
+    Book() : pub_year(0), copies(0) {}
+
+    // Конструктор с параметрами
+    Book(const std::string& title, const std::shared_ptr<Author>& author, int pub_year, int copies, const std::string& isbn)
+        : title(title), title_key(make_collation_key(title)), author(author), pub_year(pub_year), copies(copies), isbn(isbn) {
+    }
+
+    // Конструктор с готовым ключом сортировки (используется при загрузке снимка каталога)
+    Book(std::string title, std::string title_key, const std::shared_ptr<Author>& author, int pub_year, int copies, std::string isbn)
+        : title(std::move(title)), title_key(std::move(title_key)), author(author), pub_year(pub_year), copies(copies),
+        isbn(std::move(isbn)) {
+    }
+
+    // Конструктор копирования (std::atomic сам не копируется); используется при добавлении книги в пул
+    Book(const Book& other)
+        : title(other.title), title_key(other.title_key), author(other.author), pub_year(other.pub_year),
+        copies(other.get_copies()), isbn(other.isbn) {
+    }
+
+    // Геттер для названия книги
+    const std::string& get_title() const {
+        return title;
+    }
+
+    // Геттер для ключа сортировки названия
+    const std::string& get_title_key() const {
+        return title_key;
+    }
+
+    // Геттер для ISBN
+    const std::string& get_isbn() const {
+        return isbn;
+    }
+
+    // Память строк книги вне ячейки пула
+    size_t heap_usage() const {
+        return string_heap_bytes(title) + string_heap_bytes(title_key) + string_heap_bytes(isbn);
+    }
+
+    // Геттер для автора
+    const std::shared_ptr<Author>& get_author() const {
+        return author;
+    }
+
+    // Геттер для года публикации
+    int get_pub_year() const {
+        return pub_year;
+    }
+
+    // Геттер для количества экземпляров
+    int get_copies() const {
+        return copies.load(std::memory_order_acquire);
+    }
+
+    // Атомарное резервирование одного экземпляра (false, если свободных нет)
+    bool try_reserve_copy() {
+        int available = copies.load(std::memory_order_relaxed);
+        while (available > 0) {
+            if (copies.compare_exchange_weak(available, available - 1, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Возврат одного экземпляра
+    void release_copy() {
+        copies.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    // Метод для добавления книги
+    // Автор выбирается по ФИО или его началу: find_authors возвращает подходящих авторов
+    void add_Book(const std::function<std::vector<std::shared_ptr<Author>>(const std::string&)>& find_authors) {
+        printf("Введите название книги: \n");
+        while (getchar() != '\n'); // Очистка буфера
+        std::getline(std::cin, this->title);
+
+        if (this->title.empty()) {
+            throw std::invalid_argument("Название книги не может быть пустым.");
+        }
+        this->title_key = make_collation_key(this->title);
+
+        printf("Введите ISBN книги: ");
+        std::getline(std::cin, this->isbn);
+        uint64_t isbn_key = NO_ISBN;
+        if (!parse_isbn(this->isbn, isbn_key)) {
+            throw std::invalid_argument("Некорректный ISBN: нужен ISBN-10 или ISBN-13 с верной контрольной цифрой.");
+        }
+
+        printf("Введите ФИО автора или его начало: ");
+        std::string name;
+        std::getline(std::cin, name);
+        std::vector<std::shared_ptr<Author>> authors = find_authors(name);
+        if (authors.empty()) {
+            throw std::invalid_argument("Автор не найден: " + name);
+        }
+        if (authors.size() == 1) {
+            this->author = authors[0];
+            printf("Автор: %s\n", this->author->get_fio().c_str());
+        }
+        else {
+            printf("Выберите автора (введите номер):\n");
+            for (size_t i = 0; i < authors.size(); i++) {
+                printf("%zu. %s\n", i + 1, authors[i]->get_fio().c_str());
+            }
+            int author_index;
+            scanf("%d", &author_index);
+            if (author_index < 1 || author_index > static_cast<int>(authors.size())) {
+                throw std::out_of_range("Некорректный номер автора.");
+            }
+            this->author = authors[author_index - 1];
+        }
+
+        printf("Введите дату публикации: ");
+        scanf("%d", &this->pub_year);
+        printf("Введите количество экземпляров: ");
+        int copies_count = 0;
+        scanf("%d", &copies_count);
+        this->copies.store(copies_count);
+    }
+
+    // Виртуальный метод для вывода информации о книге
+    virtual void print_Book() const {
+        if (this->title.empty() || this->author == nullptr) {
+            printf("Ошибка: некорректные данные о книге.\n");
+            return;
+        }
+        printf("Название книги: %s\n", this->title.c_str());
+        printf("ISBN: %s\n", this->isbn.c_str());
+        printf("Автор книги: %s\n", this->author->get_fio().c_str());
+        printf("Дата публикации: %d\n", this->pub_year);
+        printf("Количество экземпляров: %d\n", this->get_copies());
+    }
+
+    // Не виртуальная функция, вызывающая виртуальную
+    void displayBookInfo() const {
+        print_Book();
+    }
+
+    // Оператор сравнения для сортировки книг по названию (по алфавиту, через ключи сортировки)
+    bool operator<(const Book& other) const {
+        return this->title_key < other.title_key;
+    }
+
+    // Дружественная функция для проверки доступности книги
+    friend bool is_book_available(const Book& book, int required_copies);
+    // Дружественная функция для перегрузки оператора вывода
+    friend std::ostream& operator<<(std::ostream& os, const Book& book);
+};
+
+// Функция проверки доступности книги
+bool is_book_available(const Book& book, int required_copies) {
+    return book.get_copies() >= required_copies;
+}
+
+// Перегрузка оператора вывода для Book
+std::ostream& operator<<(std::ostream& os, const Book& book) {
+    os << "Книга: " << book.title
+        << "\nISBN: " << book.isbn
+        << "\nАвтор: " << book.author->get_fio()
+        << "\nГод публикации: " << book.pub_year
+        << "\nЭкземпляров: " << book.get_copies();
+    return os;
+}
+
+// Класс Reader для представления читателей
+class Reader : public AbstractPerson {
+    std::string fio; // ФИО читателя
+    std::string fio_key; // Ключ сортировки ФИО (make_collation_key)
+    int card_number; // Номер читательского билета
+    std::vector<SlabHandle> open_loans; // Дескрипторы открытых выдач в пуле библиотеки; удаление за O(1)
+
+public:
+    // Конструктор по умолчанию
+    Reader() : card_number(0) {}
+
+    // Конструктор с параметрами
+    Reader(const std::string& fio, int card_number) : fio(fio), fio_key(make_collation_key(fio)), card_number(card_number) {}
+
+    // Конструктор с готовым ключом сортировки (используется при загрузке снимка каталога)
+    Reader(std::string fio, std::string fio_key, int card_number)
+        : fio(std::move(fio)), fio_key(std::move(fio_key)), card_number(card_number) {
+    }
+
+    // Геттер для ФИО
+    const std::string& get_fio() const {
+        return fio;
+    }
+
+    // Геттер для ключа сортировки ФИО
+    const std::string& get_fio_key() const {
+        return fio_key;
+    }
+
+    // Геттер для номера билета
+    int get_card_number() const {
         return card_number;
     }
 
     // Получение количества взятых книг
     size_t get_borrowed_count() const {
-        return borrowed_books.size();
+        return open_loans.size();
+    }
+
+    // Геттер для открытых выдач
+    const std::vector<SlabHandle>& get_open_loans() const {
+        return open_loans;
+    }
+
+    // Память строк и списка выдач читателя вне ячейки пула
+    size_t heap_usage() const {
+        return string_heap_bytes(fio) + string_heap_bytes(fio_key) + vector_bytes(open_loans);
     }
 
     // Метод для добавления читателя
@@ -315,15 +1461,28 @@ public:
         printf("Введите ФИО читателя: \n");
         while (getchar() != '\n'); // Очистка буфера
         std::getline(std::cin, this->fio);
+        this->fio_key = make_collation_key(this->fio);
 
         printf("Введите номер читательского билета: ");
         scanf("%d", &this->card_number);
     }
 
-    // Метод для добавления взятой книги
-    void add_borrowed_book(const std::shared_ptr<Book>& book, const std::string& date) {
-        borrowed_books.push_back(book);
-        borrowed_dates[book->get_isbn()] = date;
+    // Метод для добавления открытой выдачи; возвращает ее позицию в списке
+    uint32_t attach_loan(SlabHandle loan) {
+        open_loans.push_back(loan);
+        return static_cast<uint32_t>(open_loans.size() - 1);
+    }
+
+    // Метод для удаления выдачи за O(1): на ее место переносится последняя.
+    // Возвращает перенесенную выдачу (пустой дескриптор, если удалялась последняя)
+    SlabHandle detach_loan(uint32_t slot) {
+        SlabHandle moved;
+        if (slot + 1 != open_loans.size()) {
+            moved = open_loans.back();
+            open_loans[slot] = moved;
+        }
+        open_loans.pop_back();
+        return moved;
     }
 
     // Реализация чисто виртуальной функции из AbstractPerson
@@ -339,21 +1498,12 @@ public:
         }
         printf("ФИО читателя: %s\n", this->fio.c_str());
         printf("Номер читательского билета: %d\n", this->card_number);
-        printf("Количество взятых книг: %zu\n", this->borrowed_books.size());
-
-        // Вывод информации о взятых книгах
-        for (const auto& book : borrowed_books) {
-            if (book) {
-                auto it = borrowed_dates.find(book->get_isbn());
-                std::string date = (it != borrowed_dates.end()) ? it->second : "неизвестно";
-                printf(" - %s (взято: %s)\n", book->get_title().c_str(), date.c_str());
-            }
-        }
+        printf("Количество взятых книг: %zu\n", this->open_loans.size());
     }
 
-    // Оператор сравнения для сортировки читателей по ФИО
+    // Оператор сравнения для сортировки читателей по ФИО (по алфавиту, через ключи сортировки)
     bool operator<(const Reader& other) const {
-        return this->fio < other.fio;
+        return this->fio_key < other.fio_key;
     }
 
     // Дружественная функция для перегрузки оператора вывода
@@ -364,47 +1514,97 @@ public:
 std::ostream& operator<<(std::ostream& os, const Reader& reader) {
     os << "Читатель: " << reader.fio
         << "\nНомер билета: " << reader.card_number
-        << "\nВзято книг: " << reader.borrowed_books.size();
+        << "\nВзято книг: " << reader.open_loans.size();
     return os;
 }
 
 // Класс Loan для представления выдачи книг
 class Loan {
-    std::shared_ptr<Book> book; // Умный указатель на книгу
-    std::shared_ptr<Reader> reader; // Умный указатель на читателя
-    std::string issue_date; // Дата выдачи
-    std::string return_date; // Дата возврата
+    uint64_t id; // Номер выдачи (назначается библиотекой и не меняется)
+    SlabHandle book; // Дескриптор книги в пуле библиотеки
+    SlabHandle reader; // Дескриптор читателя в пуле библиотеки
+    Date issue_date; // Дата выдачи
+    Date return_date; // Дата возврата (срок, сдвигается при продлении)
+    Date returned_on; // Фактическая дата возврата
+    int32_t renew_count; // Количество продлений
+    uint32_t reader_slot; // Позиция в списке открытых выдач читателя
+    uint32_t library_slot; // Позиция в списке открытых выдач библиотеки
+    bool returned; // Книга возвращена
+
+    friend class Library;
 
 public:
     // Конструктор по умолчанию
-    Loan() {}
+    Loan() : id(0), renew_count(0), reader_slot(0), library_slot(0), returned(false) {}
 
     // Конструктор с параметрами
-    Loan(const std::shared_ptr<Book>& book, const std::shared_ptr<Reader>& reader,
-        const std::string& issue_date, const std::string& return_date)
-        : book(book), reader(reader), issue_date(issue_date), return_date(return_date) {
+    Loan(uint64_t id, SlabHandle book, SlabHandle reader, const Date& issue_date, const Date& return_date)
+        : id(id), book(book), reader(reader), issue_date(issue_date), return_date(return_date),
+        renew_count(0), reader_slot(0), library_slot(0), returned(false) {
+    }
+
+    // Геттер для номера выдачи
+    uint64_t get_id() const {
+        return id;
+    }
+
+    // Геттер для дескриптора книги (ссылку на книгу выдает Library::book_of)
+    SlabHandle get_book_handle() const {
+        return book;
+    }
+
+    // Геттер для дескриптора читателя (ссылку на читателя выдает Library::reader_of)
+    SlabHandle get_reader_handle() const {
+        return reader;
     }
 
     // Геттер для даты выдачи
-    const std::string& get_issue_date() const {
+    const Date& get_issue_date() const {
         return issue_date;
     }
 
     // Геттер для даты возврата
-    const std::string& get_return_date() const {
+    const Date& get_return_date() const {
         return return_date;
     }
 
-    // Метод для вывода информации о выдаче
-    void print_Loan() const {
-        if (!book || !reader || book->get_title().empty() || reader->get_fio().empty()) {
+    // Геттер для фактической даты возврата
+    const Date& get_returned_on() const {
+        return returned_on;
+    }
+
+    // Геттер для количества продлений
+    int get_renew_count() const {
+        return renew_count;
+    }
+
+    // Проверка, возвращена ли книга
+    bool is_returned() const {
+        return returned;
+    }
+
+    // Продление выдачи до новой даты
+    void renew(const Date& new_return_date) {
+        return_date = new_return_date;
+        renew_count++;
+    }
+
+    // Закрытие выдачи при возврате книги
+    void close(const Date& date) {
+        returned = true;
+        returned_on = date;
+    }
+
+    // Метод для вывода информации о выдаче (книга и читатель берутся из пулов библиотеки)
+    void print_Loan(const Book& book, const Reader& reader) const {
+        if (book.get_title().empty() || reader.get_fio().empty()) {
             printf("Ошибка: некорректные данные о выдаче.\n");
             return;
         }
-        printf("Название выданной книги: %s\n", book->get_title().c_str());
-        printf("Читатель: %s\n", reader->get_fio().c_str());
-        printf("Дата выдачи книги: %s\n", issue_date.c_str());
-        printf("Дата возврата книги: %s\n", return_date.c_str());
+        printf("Название выданной книги: %s\n", book.get_title().c_str());
+        printf("Читатель: %s\n", reader.get_fio().c_str());
+        printf("Дата выдачи книги: %s\n", issue_date.to_string().c_str());
+        printf("Дата возврата книги: %s\n", return_date.to_string().c_str());
     }
 
     // Оператор сравнения для сортировки выдач по дате
@@ -412,340 +1612,10307 @@ public:
         return this->issue_date < other.issue_date;
     }
 
-    // Дружественная функция для перегрузки оператора вывода
-    friend std::ostream& operator<<(std::ostream& os, const Loan& loan);
+    // Дружественная функция для вывода выдачи вместе с книгой и читателем
+    friend std::ostream& print_loan(std::ostream& os, const Loan& loan, const Book& book, const Reader& reader);
 };
 
-// Перегрузка оператора вывода для Loan
-std::ostream& operator<<(std::ostream& os, const Loan& loan) {
-    os << "Выдача книги:\n"
-        << "Книга: " << loan.book->get_title()
-        << "\nЧитатель: " << loan.reader->get_fio()
+// Вывод выдачи вместе с книгой и читателем
+std::ostream& print_loan(std::ostream& os, const Loan& loan, const Book& book, const Reader& reader) {
+    os << "Выдача книги №" << loan.id << ":\n"
+        << "Книга: " << book.get_title()
+        << "\nЧитатель: " << reader.get_fio()
         << "\nДата выдачи: " << loan.issue_date
         << "\nДата возврата: " << loan.return_date;
+    if (loan.renew_count > 0) {
+        os << "\nПродлений: " << loan.renew_count;
+    }
+    if (loan.returned) {
+        os << "\nВозвращена: " << loan.returned_on;
+    }
     return os;
 }
 
-// Класс Library - основной класс библиотеки
-class Library {
-    std::vector<std::shared_ptr<Author>> authors; // Вектор авторов
-    std::vector<std::shared_ptr<Book>> books; // Вектор книг
-    std::vector<std::shared_ptr<Reader>> readers; // Вектор читателей
-    std::vector<std::shared_ptr<Loan>> loans; // Вектор выдач
-    std::map<std::string, std::shared_ptr<Book>> isbn_index; // Индекс книг по ISBN для быстрого поиска
 
-public:
-    // Метод для сортировки книг по названию
-    void sort_books_by_title() {
-        std::sort(books.begin(), books.end(),
-            [](const std::shared_ptr<Book>& a, const std::shared_ptr<Book>& b) {
-                return *a < *b;
-            });
-    }
+// ---------------------------------------------------------------------------
+// Бинарный снимок каталога
+// ---------------------------------------------------------------------------
+// Формат файла (порядок байт платформы):
+//   SnapshotHeader
+//   SnapshotAuthor[author_count]
+//   SnapshotBook[book_count]
+//   SnapshotReader[reader_count]
+//   SnapshotLoan[loan_count]
+//   SnapshotIsbnEntry[isbn_count] (отсортированы по ключу ISBN)
+//   SnapshotCardEntry[reader_count] (отсортированы по номеру билета)
+//   SnapshotGram[title_gram_count], SnapshotGram[author_gram_count]
+//   uint32_t[book_count] - книги в порядке названий
+//   uint32_t[author_count] - авторы в порядке ФИО
+//   uint32_t[reader_count] - читатели в порядке ФИО
+//   uint32_t[loan_count] - выдачи в порядке дат выдачи
+//   uint32_t[postings_count] - списки документов триграмм
+//   пул строк
+// Связи между объектами хранятся как индексы записей вместо shared_ptr.
+// Все записи имеют фиксированный размер, поэтому после отображения файла
+// в память к ним можно обращаться напрямую, без разбора текста. Вместе с
+// записями хранятся ключи сортировки и готовые индексы: при загрузке
+// деревья и упорядоченные представления заполняются за один проход в
+// порядке файла, а триграммы не вычисляются заново.
+// Открытие снимка не разбирает записи: поиск по ISBN, билету и названию
+// идет прямо по секциям файла, книги и читатели создаются блоками пула при
+// первом обращении, а остальной каталог достраивается при первой
+// операции, которой секций мало (Library::build_mapped_catalog).
 
-    // Метод для сортировки читателей по ФИО
-    void sort_readers_by_name() {
-        std::sort(readers.begin(), readers.end(),
-            [](const std::shared_ptr<Reader>& a, const std::shared_ptr<Reader>& b) {
-                return *a < *b;
-            });
-    }
+const char SNAPSHOT_MAGIC[8] = { 'L', 'I', 'B', 'S', 'N', 'A', 'P', '\0' };
+const uint32_t SNAPSHOT_VERSION = 1;
+// Ключи сортировки лежат в снимке готовыми, поэтому любое изменение
+// make_collation_key или word_trigrams требует новой версии снимка
+const uint32_t SNAPSHOT_NO_ID = 0xFFFFFFFFu; // Отсутствующая ссылка
 
-    // Метод для сортировки выдач по дате
-    void sort_loans_by_date() {
-        std::sort(loans.begin(), loans.end(),
-            [](const std::shared_ptr<Loan>& a, const std::shared_ptr<Loan>& b) {
-                return *a < *b;
+// Ссылка на строку в пуле строк
+struct SnapshotStr {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t author_count;
+    uint64_t book_count;
+    uint64_t reader_count;
+    uint64_t loan_count;
+    uint64_t isbn_count;
+    uint64_t authors_offset;
+    uint64_t books_offset;
+    uint64_t readers_offset;
+    uint64_t loans_offset;
+    uint64_t isbn_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    uint64_t journal_lsn; // Номер последней записи журнала, вошедшей в снимок
+    uint64_t next_loan_id; // Номер следующей выдачи
+    uint64_t cards_offset;
+    uint64_t title_gram_count;
+    uint64_t title_grams_offset;
+    uint64_t author_gram_count;
+    uint64_t author_grams_offset;
+    uint64_t title_order_offset;
+    uint64_t author_order_offset;
+    uint64_t reader_order_offset;
+    uint64_t loan_order_offset;
+    uint64_t postings_count;
+    uint64_t postings_offset;
+    uint64_t reserved[5];
+};
+
+const uint32_t SNAPSHOT_AUTHOR_FAMOUS = 1; // Флаг: запись описывает FamousAuthor
+
+struct SnapshotAuthor {
+    SnapshotStr fio;
+    SnapshotStr fio_key; // Ключ сортировки ФИО
+    int32_t birth_year;
+    uint32_t flags;
+    SnapshotStr most_famous_work;
+    int32_t awards_count;
+    uint32_t reserved;
+};
+
+struct SnapshotBook {
+    SnapshotStr title;
+    SnapshotStr title_key; // Ключ сортировки названия
+    SnapshotStr isbn;
+    uint32_t author_id;
+    int32_t pub_year;
+    int32_t copies;
+    uint32_t reserved;
+};
+
+struct SnapshotReader {
+    SnapshotStr fio;
+    SnapshotStr fio_key; // Ключ сортировки ФИО
+    int32_t card_number;
+    uint32_t reserved;
+};
+
+struct SnapshotLoan {
+    uint64_t id;
+    uint32_t book_id;
+    uint32_t reader_id;
+    int32_t issue_day; // Date::get_day_number()
+    int32_t return_day;
+    int32_t returned_day; // Фактическая дата возврата (для закрытых выдач)
+    int32_t renew_count;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+const uint32_t SNAPSHOT_LOAN_RETURNED = 1; // Флаг: книга по выдаче возвращена
+
+struct SnapshotIsbnEntry {
+    uint64_t isbn_key; // Нормализованный ISBN-13 (parse_isbn)
+    uint32_t book_id;
+    uint32_t reserved;
+};
+
+struct SnapshotCardEntry {
+    int32_t card_number;
+    uint32_t reader_id;
+};
+
+// Триграмма и ее список документов: postings[first, first + count)
+struct SnapshotGram {
+    uint64_t key;
+    uint32_t first;
+    uint32_t count;
+};
+
+static_assert(sizeof(SnapshotHeader) == 256, "Неожиданный размер заголовка снимка");
+static_assert(sizeof(SnapshotAuthor) == 40, "Неожиданный размер записи автора");
+static_assert(sizeof(SnapshotBook) == 40, "Неожиданный размер записи книги");
+static_assert(sizeof(SnapshotReader) == 24, "Неожиданный размер записи читателя");
+static_assert(sizeof(SnapshotLoan) == 40, "Неожиданный размер записи выдачи");
+static_assert(sizeof(SnapshotIsbnEntry) == 16, "Неожиданный размер записи индекса ISBN");
+static_assert(sizeof(SnapshotCardEntry) == 8, "Неожиданный размер записи индекса билетов");
+static_assert(sizeof(SnapshotGram) == 16, "Неожиданный размер записи триграммы");
+
+// Секции снимка, подготовленные библиотекой для записи
+struct SnapshotSections {
+    std::vector<SnapshotAuthor> authors;
+    std::vector<SnapshotBook> books;
+    std::vector<SnapshotReader> readers;
+    std::vector<SnapshotLoan> loans;
+    std::vector<SnapshotIsbnEntry> isbn_entries;
+    std::vector<SnapshotCardEntry> card_entries;
+    std::vector<SnapshotGram> title_grams;
+    std::vector<SnapshotGram> author_grams;
+    std::vector<uint32_t> title_order;
+    std::vector<uint32_t> author_order;
+    std::vector<uint32_t> reader_order;
+    std::vector<uint32_t> loan_order;
+    std::vector<uint32_t> postings;
+};
+
+// Сброс буферов файла на диск (false при ошибке)
+bool sync_file(FILE* file) {
+    if (fflush(file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+// Атомарная замена файла path уже сброшенным на диск файлом tmp_path.
+// После возврата true замена переживет сбой питания
+bool replace_file_durably(const std::string& tmp_path, const std::string& path) {
+#ifdef _WIN32
+    return MoveFileExA(tmp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) { // Заменяет существующий файл атомарно
+        return false;
+    }
+    // Новая запись каталога тоже должна попасть на диск
+    size_t slash = path.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    int fd = ::open(directory.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+// Класс для отображения файла в память только для чтения
+class MappedFile {
+    const char* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+
+public:
+    MappedFile() : data(nullptr), size(0)
+#ifdef _WIN32
+        , file(INVALID_HANDLE_VALUE), mapping(nullptr)
+#endif
+    {
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        close();
+    }
+
+    // Открытие и отображение файла; false, если файл не удалось открыть
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+            close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) {
+            close();
+            return false;
+        }
+        data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (data == nullptr) {
+            close();
+            return false;
+        }
+        size = static_cast<size_t>(file_size.QuadPart);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // Отображение остается действительным после закрытия дескриптора
+        if (addr == MAP_FAILED) {
+            return false;
+        }
+        data = static_cast<const char*>(addr);
+        size = static_cast<size_t>(st.st_size);
+#endif
+        return true;
+    }
+
+    // Снятие отображения
+    void close() {
+#ifdef _WIN32
+        if (data != nullptr) {
+            UnmapViewOfFile(data);
+        }
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data != nullptr) {
+            munmap(const_cast<char*>(data), size);
+        }
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    const char* get_data() const {
+        return data;
+    }
+
+    size_t get_size() const {
+        return size;
+    }
+};
+
+// Класс для чтения снимка каталога напрямую из отображенного файла
+class CatalogSnapshot {
+    MappedFile file;
+    const SnapshotHeader* header;
+    const SnapshotAuthor* authors;
+    const SnapshotBook* books;
+    const SnapshotReader* readers;
+    const SnapshotLoan* loans;
+    const SnapshotIsbnEntry* isbn_entries;
+    const SnapshotCardEntry* card_entries;
+    const SnapshotGram* title_grams;
+    const SnapshotGram* author_grams;
+    const uint32_t* title_order;
+    const uint32_t* author_order;
+    const uint32_t* reader_order;
+    const uint32_t* loan_order;
+    const uint32_t* postings;
+    const char* strings;
+
+    // Сравнение начала ключа названия книги на позиции position порядка названий
+    // с prefix (как std::string::compare первых prefix.size() байт)
+    int compare_title_key(size_t position, const std::string& prefix) const {
+        uint32_t id = title_order[position];
+        if (id >= header->book_count) {
+            throw std::runtime_error("Поврежденный снимок каталога: нарушен порядок индекса.");
+        }
+        const SnapshotStr& key = books[id].title_key;
+        if (static_cast<uint64_t>(key.offset) + key.length > header->strings_size) {
+            throw std::runtime_error("Поврежденный снимок каталога: некорректная ссылка на строку.");
+        }
+        int order = std::memcmp(strings + key.offset, prefix.data(), std::min<size_t>(key.length, prefix.size()));
+        if (order != 0) {
+            return order;
+        }
+        return key.length < prefix.size() ? -1 : 0;
+    }
+
+    // Проверка, что секция из count записей размера record_size лежит внутри файла
+    void check_section(uint64_t offset, uint64_t count, uint64_t record_size) const {
+        uint64_t file_size = file.get_size();
+        if (offset > file_size || count > (file_size - offset) / record_size) {
+            throw std::runtime_error("Поврежденный снимок каталога: секция выходит за пределы файла.");
+        }
+    }
+
+public:
+    CatalogSnapshot() : header(nullptr), authors(nullptr), books(nullptr), readers(nullptr),
+        loans(nullptr), isbn_entries(nullptr), card_entries(nullptr), title_grams(nullptr), author_grams(nullptr),
+        title_order(nullptr), author_order(nullptr), reader_order(nullptr), loan_order(nullptr), postings(nullptr),
+        strings(nullptr) {
+    }
+
+    // Открытие снимка; false, если файла нет, исключение, если формат некорректен
+    bool open(const std::string& path) {
+        if (!file.open(path)) {
+            return false;
+        }
+        if (file.get_size() < sizeof(SnapshotHeader)) {
+            throw std::runtime_error("Поврежденный снимок каталога: файл слишком мал.");
+        }
+        header = reinterpret_cast<const SnapshotHeader*>(file.get_data());
+        if (std::memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+            throw std::runtime_error("Файл не является снимком каталога.");
+        }
+        if (header->version != SNAPSHOT_VERSION || header->header_size != sizeof(SnapshotHeader)) {
+            throw std::runtime_error("Неподдерживаемая версия снимка каталога.");
+        }
+        check_section(header->authors_offset, header->author_count, sizeof(SnapshotAuthor));
+        check_section(header->books_offset, header->book_count, sizeof(SnapshotBook));
+        check_section(header->readers_offset, header->reader_count, sizeof(SnapshotReader));
+        check_section(header->loans_offset, header->loan_count, sizeof(SnapshotLoan));
+        check_section(header->isbn_offset, header->isbn_count, sizeof(SnapshotIsbnEntry));
+        check_section(header->cards_offset, header->reader_count, sizeof(SnapshotCardEntry));
+        check_section(header->title_grams_offset, header->title_gram_count, sizeof(SnapshotGram));
+        check_section(header->author_grams_offset, header->author_gram_count, sizeof(SnapshotGram));
+        check_section(header->title_order_offset, header->book_count, sizeof(uint32_t));
+        check_section(header->author_order_offset, header->author_count, sizeof(uint32_t));
+        check_section(header->reader_order_offset, header->reader_count, sizeof(uint32_t));
+        check_section(header->loan_order_offset, header->loan_count, sizeof(uint32_t));
+        check_section(header->postings_offset, header->postings_count, sizeof(uint32_t));
+        check_section(header->strings_offset, header->strings_size, 1);
+
+        const char* base = file.get_data();
+        authors = reinterpret_cast<const SnapshotAuthor*>(base + header->authors_offset);
+        books = reinterpret_cast<const SnapshotBook*>(base + header->books_offset);
+        readers = reinterpret_cast<const SnapshotReader*>(base + header->readers_offset);
+        loans = reinterpret_cast<const SnapshotLoan*>(base + header->loans_offset);
+        isbn_entries = reinterpret_cast<const SnapshotIsbnEntry*>(base + header->isbn_offset);
+        card_entries = reinterpret_cast<const SnapshotCardEntry*>(base + header->cards_offset);
+        title_grams = reinterpret_cast<const SnapshotGram*>(base + header->title_grams_offset);
+        author_grams = reinterpret_cast<const SnapshotGram*>(base + header->author_grams_offset);
+        title_order = reinterpret_cast<const uint32_t*>(base + header->title_order_offset);
+        author_order = reinterpret_cast<const uint32_t*>(base + header->author_order_offset);
+        reader_order = reinterpret_cast<const uint32_t*>(base + header->reader_order_offset);
+        loan_order = reinterpret_cast<const uint32_t*>(base + header->loan_order_offset);
+        postings = reinterpret_cast<const uint32_t*>(base + header->postings_offset);
+        strings = base + header->strings_offset;
+        return true;
+    }
+
+    uint64_t journal_lsn() const { return header->journal_lsn; }
+    uint64_t next_loan_id() const { return header->next_loan_id; }
+    size_t author_count() const { return static_cast<size_t>(header->author_count); }
+    size_t book_count() const { return static_cast<size_t>(header->book_count); }
+    size_t reader_count() const { return static_cast<size_t>(header->reader_count); }
+    size_t loan_count() const { return static_cast<size_t>(header->loan_count); }
+    size_t isbn_count() const { return static_cast<size_t>(header->isbn_count); }
+    size_t title_gram_count() const { return static_cast<size_t>(header->title_gram_count); }
+    size_t author_gram_count() const { return static_cast<size_t>(header->author_gram_count); }
+    size_t postings_count() const { return static_cast<size_t>(header->postings_count); }
+
+    const SnapshotAuthor& author_at(size_t i) const { return authors[i]; }
+    const SnapshotBook& book_at(size_t i) const { return books[i]; }
+    const SnapshotReader& reader_at(size_t i) const { return readers[i]; }
+    const SnapshotLoan& loan_at(size_t i) const { return loans[i]; }
+    const SnapshotIsbnEntry& isbn_at(size_t i) const { return isbn_entries[i]; }
+    const SnapshotCardEntry& card_at(size_t i) const { return card_entries[i]; }
+    const SnapshotGram* get_title_grams() const { return title_grams; }
+    const SnapshotGram* get_author_grams() const { return author_grams; }
+    const uint32_t* get_postings() const { return postings; }
+
+    // Номера записей в порядке индексов: книги по названию, авторы и читатели по ФИО, выдачи по дате
+    const uint32_t* get_title_order() const { return title_order; }
+    const uint32_t* get_author_order() const { return author_order; }
+    const uint32_t* get_reader_order() const { return reader_order; }
+    const uint32_t* get_loan_order() const { return loan_order; }
+
+    // Получение строки из пула
+    std::string str(const SnapshotStr& ref) const {
+        if (static_cast<uint64_t>(ref.offset) + ref.length > header->strings_size) {
+            throw std::runtime_error("Поврежденный снимок каталога: некорректная ссылка на строку.");
+        }
+        return std::string(strings + ref.offset, ref.length);
+    }
+
+    // Поиск книги по ISBN прямо в отображенном файле (бинарный поиск по ключу)
+    uint32_t find_book_id_by_isbn(const std::string& isbn) const {
+        uint64_t key = NO_ISBN;
+        if (!parse_isbn(isbn, key)) {
+            return SNAPSHOT_NO_ID;
+        }
+        const SnapshotIsbnEntry* first = isbn_entries;
+        const SnapshotIsbnEntry* last = isbn_entries + header->isbn_count;
+        auto it = std::lower_bound(first, last, key,
+            [](const SnapshotIsbnEntry& entry, uint64_t value) {
+                return entry.isbn_key < value;
             });
+        if (it != last && it->isbn_key == key) {
+            return it->book_id;
+        }
+        return SNAPSHOT_NO_ID;
+    }
+
+    // Позиции [first, last) порядка названий, ключ названия которых начинается
+    // с prefix, - двоичный поиск прямо в отображенном файле
+    std::pair<size_t, size_t> find_title_key_range(const std::string& prefix) const {
+        size_t first = 0;
+        size_t count = book_count();
+        while (count > 0) {
+            size_t half = count / 2;
+            if (compare_title_key(first + half, prefix) < 0) {
+                first += half + 1;
+                count -= half + 1;
+            }
+            else {
+                count = half;
+            }
+        }
+        size_t last = first;
+        while (last < book_count() && compare_title_key(last, prefix) == 0) {
+            last++;
+        }
+        return std::make_pair(first, last);
     }
 
-    // Метод для поиска книги по названию (бинарный поиск после сортировки)
-    std::shared_ptr<Book> find_book_by_title(const std::string& title) {
-        sort_books_by_title(); // Сначала сортируем
-        auto it = std::lower_bound(books.begin(), books.end(), title,
-            [](const std::shared_ptr<Book>& book, const std::string& title) {
-                return book->get_title() < title;
+    // Поиск читателя по номеру билета прямо в отображенном файле
+    uint32_t find_reader_id_by_card(int card_number) const {
+        const SnapshotCardEntry* first = card_entries;
+        const SnapshotCardEntry* last = card_entries + header->reader_count;
+        auto it = std::lower_bound(first, last, card_number,
+            [](const SnapshotCardEntry& entry, int value) {
+                return entry.card_number < value;
             });
+        if (it != last && it->card_number == card_number) {
+            return it->reader_id;
+        }
+        return SNAPSHOT_NO_ID;
+    }
+};
+
+// Класс для построения снимка каталога и записи его в файл
+class SnapshotWriter {
+    std::string strings; // Пул строк
+
+public:
+    // Добавление строки в пул
+    SnapshotStr add_string(const std::string& value) {
+        if (strings.size() + value.size() > 0xFFFFFFFFull) {
+            throw std::runtime_error("Пул строк снимка превышает 4 ГБ.");
+        }
+        SnapshotStr ref;
+        ref.offset = static_cast<uint32_t>(strings.size());
+        ref.length = static_cast<uint32_t>(value.size());
+        strings += value;
+        return ref;
+    }
+
+    // Запись всех секций в файл: временный файл сбрасывается на диск и атомарно заменяет прежний снимок
+    void write(const std::string& path, uint64_t journal_lsn, uint64_t next_loan_id, const SnapshotSections& sections) const {
+        SnapshotHeader header = {};
+        std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        header.version = SNAPSHOT_VERSION;
+        header.header_size = sizeof(SnapshotHeader);
+        header.author_count = sections.authors.size();
+        header.book_count = sections.books.size();
+        header.reader_count = sections.readers.size();
+        header.loan_count = sections.loans.size();
+        header.isbn_count = sections.isbn_entries.size();
+        header.title_gram_count = sections.title_grams.size();
+        header.author_gram_count = sections.author_grams.size();
+        header.postings_count = sections.postings.size();
+        // Секции с 8-байтовыми полями идут раньше массивов uint32_t, чтобы остаться выровненными
+        uint64_t offset = sizeof(SnapshotHeader);
+        header.authors_offset = section_offset(offset, sections.authors);
+        header.books_offset = section_offset(offset, sections.books);
+        header.readers_offset = section_offset(offset, sections.readers);
+        header.loans_offset = section_offset(offset, sections.loans);
+        header.isbn_offset = section_offset(offset, sections.isbn_entries);
+        header.cards_offset = section_offset(offset, sections.card_entries);
+        header.title_grams_offset = section_offset(offset, sections.title_grams);
+        header.author_grams_offset = section_offset(offset, sections.author_grams);
+        header.title_order_offset = section_offset(offset, sections.title_order);
+        header.author_order_offset = section_offset(offset, sections.author_order);
+        header.reader_order_offset = section_offset(offset, sections.reader_order);
+        header.loan_order_offset = section_offset(offset, sections.loan_order);
+        header.postings_offset = section_offset(offset, sections.postings);
+        header.strings_offset = offset;
+        header.strings_size = strings.size();
+        header.journal_lsn = journal_lsn;
+        header.next_loan_id = next_loan_id;
+
+        std::string tmp_path = path + ".tmp";
+        FILE* out = fopen(tmp_path.c_str(), "wb");
+        if (out == nullptr) {
+            throw std::runtime_error("Не удалось создать файл снимка.");
+        }
+        bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+        ok = ok && write_section(out, sections.authors);
+        ok = ok && write_section(out, sections.books);
+        ok = ok && write_section(out, sections.readers);
+        ok = ok && write_section(out, sections.loans);
+        ok = ok && write_section(out, sections.isbn_entries);
+        ok = ok && write_section(out, sections.card_entries);
+        ok = ok && write_section(out, sections.title_grams);
+        ok = ok && write_section(out, sections.author_grams);
+        ok = ok && write_section(out, sections.title_order);
+        ok = ok && write_section(out, sections.author_order);
+        ok = ok && write_section(out, sections.reader_order);
+        ok = ok && write_section(out, sections.loan_order);
+        ok = ok && write_section(out, sections.postings);
+        ok = ok && (strings.empty() || fwrite(strings.data(), 1, strings.size(), out) == strings.size());
+        ok = ok && sync_file(out);
+        ok = (fclose(out) == 0) && ok;
+        if (!ok) {
+            std::remove(tmp_path.c_str());
+            throw std::runtime_error("Ошибка записи файла снимка.");
+        }
+        if (!replace_file_durably(tmp_path, path)) {
+            std::remove(tmp_path.c_str());
+            throw std::runtime_error("Не удалось заменить файл снимка.");
+        }
+    }
+
+private:
+    // Смещение секции и сдвиг позиции за ее конец
+    template <typename T>
+    static uint64_t section_offset(uint64_t& offset, const std::vector<T>& records) {
+        uint64_t start = offset;
+        offset += records.size() * sizeof(T);
+        return start;
+    }
+
+    template <typename T>
+    static bool write_section(FILE* out, const std::vector<T>& records) {
+        return records.empty() || fwrite(records.data(), sizeof(T), records.size(), out) == records.size();
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Журнал изменений (write-ahead log)
+// ---------------------------------------------------------------------------
+// Каждая запись журнала: JournalRecordHeader + полезная нагрузка.
+// Контрольная сумма покрывает номер записи, тип и нагрузку, поэтому
+// недописанный при сбое хвост журнала обнаруживается и отбрасывается.
+// Ссылки в записях стабильны между запусками: автор задается позицией
+// в списке авторов (он не переупорядочивается), книга - ISBN,
+// читатель - номером билета, выдача - номером, который назначается
+// по порядку записей выдачи и потому совпадает при повторе журнала.
+
+enum JournalRecordType : uint8_t {
+    JOURNAL_ADD_AUTHOR = 1,
+    JOURNAL_ADD_BOOK = 2,
+    JOURNAL_ADD_READER = 3,
+    JOURNAL_ADD_LOAN = 4,
+    JOURNAL_CLOSE_LOAN = 5,
+    JOURNAL_RENEW_LOAN = 6
+};
+
+struct JournalRecordHeader {
+    uint32_t payload_size;
+    uint32_t checksum;
+    uint64_t lsn; // Порядковый номер записи
+    uint8_t type;
+    uint8_t reserved[7];
+};
+
+static_assert(sizeof(JournalRecordHeader) == 24, "Неожиданный размер заголовка записи журнала");
+
+const uint32_t JOURNAL_MAX_PAYLOAD = 16 * 1024 * 1024; // Ограничение размера одной записи
+
+// Таблица для вычисления CRC-32 (полином 0xEDB88320)
+struct Crc32Table {
+    uint32_t values[256];
+
+    Crc32Table() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+            }
+            values[i] = c;
+        }
+    }
+};
+
+// Вычисление CRC-32
+uint32_t crc32_update(uint32_t crc, const void* data, size_t size) {
+    static const Crc32Table table; // Потокобезопасная инициализация при первом вызове
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table.values[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Контрольная сумма записи журнала
+uint32_t journal_checksum(uint64_t lsn, uint8_t type, const std::string& payload) {
+    uint32_t crc = crc32_update(0, &lsn, sizeof(lsn));
+    crc = crc32_update(crc, &type, sizeof(type));
+    return crc32_update(crc, payload.data(), payload.size());
+}
+
+// Класс для сборки полезной нагрузки записи журнала
+class JournalEncoder {
+    std::string payload;
+
+public:
+    JournalEncoder& put_int(int32_t value) {
+        payload.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        return *this;
+    }
+
+    JournalEncoder& put_uint64(uint64_t value) {
+        payload.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        return *this;
+    }
+
+    JournalEncoder& put_string(const std::string& value) {
+        uint32_t length = static_cast<uint32_t>(value.size());
+        payload.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        payload += value;
+        return *this;
+    }
+
+    const std::string& get_payload() const {
+        return payload;
+    }
+};
+
+// Класс для разбора полезной нагрузки записи журнала
+class JournalDecoder {
+    const std::string& payload;
+    size_t position;
+
+    void require(size_t size) const {
+        if (payload.size() - position < size) {
+            throw std::runtime_error("Поврежденная запись журнала.");
+        }
+    }
+
+public:
+    explicit JournalDecoder(const std::string& payload) : payload(payload), position(0) {}
+
+    int32_t get_int() {
+        int32_t value;
+        require(sizeof(value));
+        std::memcpy(&value, payload.data() + position, sizeof(value));
+        position += sizeof(value);
+        return value;
+    }
+
+    uint64_t get_uint64() {
+        uint64_t value;
+        require(sizeof(value));
+        std::memcpy(&value, payload.data() + position, sizeof(value));
+        position += sizeof(value);
+        return value;
+    }
+
+    std::string get_string() {
+        uint32_t length;
+        require(sizeof(length));
+        std::memcpy(&length, payload.data() + position, sizeof(length));
+        position += sizeof(length);
+        require(length);
+        std::string value = payload.substr(position, length);
+        position += length;
+        return value;
+    }
+};
+
+// Настройки журнала
+struct JournalOptions {
+    size_t group_commit_records; // Сброс на диск после стольких записей
+    unsigned group_commit_ms; // ... или не позже чем через столько миллисекунд после добавления (0 - без ограничения)
+    bool wait_for_sync; // Изменение возвращается только после сброса своей записи на диск
+    size_t checkpoint_records; // Контрольная точка после стольких записей (0 - отключено)
+
+    JournalOptions() : group_commit_records(64), group_commit_ms(5), wait_for_sync(true), checkpoint_records(10000) {}
+};
+
+// Обрезка файла до заданной длины
+bool truncate_file(const std::string& path, uint64_t size) {
+#ifdef _WIN32
+    FILE* file = fopen(path.c_str(), "r+b");
+    if (file == nullptr) {
+        return false;
+    }
+    bool ok = _chsize_s(_fileno(file), static_cast<long long>(size)) == 0;
+    fclose(file);
+    return ok;
+#else
+    return truncate(path.c_str(), static_cast<off_t>(size)) == 0;
+#endif
+}
+
+// Класс журнала изменений с групповой фиксацией. append только добавляет
+// запись в буфер (под блокировками библиотеки), а на диск буфер пишет один
+// ведущий поток: ожидающий commit или фоновый поток сброса. Пока ведущий
+// пишет пакет, новые записи копятся в буфере и уходят следующим пакетом
+class Journal {
+    std::string path;
+    JournalOptions options;
+    FILE* file;
+    std::string buffer; // Записи, еще не сброшенные на диск
+    size_t pending_records; // Количество записей в buffer
+    uint64_t next_lsn;
+    uint64_t durable_lsn; // Все записи до этого номера уже на диске
+    size_t records_since_checkpoint;
+    bool syncing; // Ведущий поток пишет пакет (файлом владеет он)
+    bool stopping;
+    std::string failure; // Ошибка записи; после нее журнал не принимает записей
+    std::mutex mutex;
+    std::condition_variable synced; // Пакет записан (или запись не удалась)
+    std::condition_variable flush_wanted; // Набрался полный пакет
+    std::thread flusher;
+
+    // Исключение, если запись на диск уже не удалась (под mutex)
+    void check_failure_locked() const {
+        if (!failure.empty()) {
+            throw std::runtime_error(failure);
+        }
+    }
+
+    // Запись буфера в файл и сброс на диск. Вызывается под mutex, но сама
+    // запись идет без него, чтобы append не ждал диска
+    void sync_locked(std::unique_lock<std::mutex>& lock) {
+        while (syncing) {
+            synced.wait(lock);
+        }
+        check_failure_locked();
+        if (buffer.empty()) {
+            return;
+        }
+        std::string batch;
+        batch.swap(buffer);
+        uint64_t batch_lsn = next_lsn - 1;
+        pending_records = 0;
+        syncing = true;
+        lock.unlock();
+        bool ok = fwrite(batch.data(), 1, batch.size(), file) == batch.size() && sync_file(file);
+        lock.lock();
+        syncing = false;
+        if (ok) {
+            durable_lsn = batch_lsn;
+        }
+        else {
+            // Неизвестно, какая часть пакета дошла до диска: продолжать журнал нельзя
+            failure = "Ошибка записи журнала.";
+        }
+        synced.notify_all();
+        check_failure_locked();
+    }
+
+    // Фоновый сброс: полный пакет или не реже чем раз в group_commit_ms
+    void flush_loop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping) {
+            if (options.group_commit_ms == 0) {
+                flush_wanted.wait(lock);
+            }
+            else {
+                flush_wanted.wait_for(lock, std::chrono::milliseconds(options.group_commit_ms));
+            }
+            if (!buffer.empty() && !syncing && failure.empty()) {
+                try {
+                    sync_locked(lock);
+                }
+                catch (const std::exception&) {
+                    // Ошибка сохранена в failure и вернется следующим вызовам
+                }
+            }
+        }
+    }
+
+public:
+    Journal(const std::string& path, const JournalOptions& options, uint64_t next_lsn)
+        : path(path), options(options), file(nullptr), pending_records(0), next_lsn(next_lsn), durable_lsn(next_lsn - 1),
+        records_since_checkpoint(0), syncing(false), stopping(false) {
+        file = fopen(path.c_str(), "ab");
+        if (file == nullptr) {
+            throw std::runtime_error("Не удалось открыть файл журнала.");
+        }
+        flusher = std::thread(&Journal::flush_loop, this);
+    }
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    ~Journal() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        flush_wanted.notify_one();
+        flusher.join();
+        try {
+            sync();
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Ошибка при закрытии журнала: " << e.what() << std::endl;
+        }
+        if (file != nullptr) {
+            fclose(file);
+        }
+    }
+
+    // Добавление записи в буфер; на диск она попадает пакетом вместе с соседними
+    uint64_t append(uint8_t type, const std::string& payload) {
+        std::lock_guard<std::mutex> lock(mutex);
+        check_failure_locked();
+        JournalRecordHeader header = {};
+        header.payload_size = static_cast<uint32_t>(payload.size());
+        header.lsn = next_lsn;
+        header.type = type;
+        header.checksum = journal_checksum(header.lsn, type, payload);
+        buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        buffer += payload;
+        next_lsn++;
+        pending_records++;
+        records_since_checkpoint++;
+        if (pending_records >= options.group_commit_records) {
+            flush_wanted.notify_one();
+        }
+        return header.lsn;
+    }
+
+    // Ожидание, пока все добавленные до вызова записи окажутся на диске
+    // (если так настроено). Вызывается без блокировок библиотеки: потоки,
+    // пришедшие во время записи пакета, сбрасываются следующим пакетом вместе
+    void commit() {
+        if (!options.wait_for_sync) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        uint64_t target = next_lsn - 1;
+        while (durable_lsn < target) {
+            check_failure_locked();
+            if (syncing) {
+                synced.wait(lock);
+            }
+            else {
+                sync_locked(lock);
+            }
+        }
+    }
+
+    // Принудительный сброс накопленных записей на диск
+    void sync() {
+        std::unique_lock<std::mutex> lock(mutex);
+        sync_locked(lock);
+    }
+
+    // Очистка журнала после записи контрольной точки
+    void truncate() {
+        std::unique_lock<std::mutex> lock(mutex);
+        sync_locked(lock); // После него никто не пишет в файл, пока удерживается mutex
+        file = freopen(path.c_str(), "wb", file);
+        if (file == nullptr) { // Прежний поток уже закрыт
+            failure = "Не удалось очистить файл журнала.";
+            throw std::runtime_error(failure);
+        }
+        records_since_checkpoint = 0;
+    }
+
+    // Пора ли делать контрольную точку
+    bool checkpoint_due() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return options.checkpoint_records != 0 && records_since_checkpoint >= options.checkpoint_records;
+    }
+
+    // Номер последней выданной записи
+    uint64_t last_lsn() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return next_lsn - 1;
+    }
+
+    // Чтение журнала: callback вызывается для каждой целой записи.
+    // Возвращает длину корректной части файла (поврежденный хвост не входит).
+    template <typename Callback>
+    static uint64_t read_all(const std::string& path, Callback callback) {
+        FILE* in = fopen(path.c_str(), "rb");
+        if (in == nullptr) {
+            return 0;
+        }
+        uint64_t valid_size = 0;
+        std::string payload;
+        JournalRecordHeader header;
+        while (fread(&header, sizeof(header), 1, in) == 1) {
+            if (header.payload_size > JOURNAL_MAX_PAYLOAD) {
+                break; // Заголовок поврежден
+            }
+            payload.resize(header.payload_size);
+            if (header.payload_size != 0 && fread(&payload[0], 1, header.payload_size, in) != header.payload_size) {
+                break; // Недописанная запись
+            }
+            if (journal_checksum(header.lsn, header.type, payload) != header.checksum) {
+                break; // Поврежденная запись
+            }
+            callback(header.lsn, header.type, payload);
+            valid_size += sizeof(header) + header.payload_size;
+        }
+        fclose(in);
+        return valid_size;
+    }
+};
 
-        if (it != books.end() && (*it)->get_title() == title) {
-            return *it;
+// Кодирование записей журнала для каждой операции Library
+std::string encode_author_record(const Author& author) {
+    JournalEncoder encoder;
+    encoder.put_string(author.get_fio()).put_int(author.get_birth_year());
+    auto famous = dynamic_cast<const FamousAuthor*>(&author);
+    encoder.put_int(famous != nullptr ? 1 : 0);
+    if (famous != nullptr) {
+        encoder.put_string(famous->get_most_famous_work()).put_int(famous->get_awards_count());
+    }
+    return encoder.get_payload();
+}
+
+std::string encode_book_record(const Book& book, uint32_t author_position) {
+    JournalEncoder encoder;
+    encoder.put_string(book.get_title()).put_string(book.get_isbn())
+        .put_int(static_cast<int32_t>(author_position)).put_int(book.get_pub_year()).put_int(book.get_copies());
+    return encoder.get_payload();
+}
+
+std::string encode_reader_record(const Reader& reader) {
+    JournalEncoder encoder;
+    encoder.put_string(reader.get_fio()).put_int(reader.get_card_number());
+    return encoder.get_payload();
+}
+
+std::string encode_loan_record(const std::string& isbn, int card_number, const Date& issue_date, const Date& return_date) {
+    JournalEncoder encoder;
+    encoder.put_string(isbn).put_int(card_number).put_int(issue_date.get_day_number()).put_int(return_date.get_day_number());
+    return encoder.get_payload();
+}
+
+std::string encode_loan_date_record(uint64_t loan_id, const Date& date) {
+    JournalEncoder encoder;
+    encoder.put_uint64(loan_id).put_int(date.get_day_number());
+    return encoder.get_payload();
+}
+
+// ---------------------------------------------------------------------------
+// Пакетный импорт из CSV и JSON Lines
+// ---------------------------------------------------------------------------
+// Файл читается блоками, строки каждого блока разбираются параллельно
+// несколькими потоками, затем разобранные записи по порядку передаются
+// в Library. В CSV первая строка - заголовок с именами столбцов,
+// в JSONL каждая строка - плоский объект с теми же именами полей.
+
+enum ImportFormat {
+    IMPORT_CSV,
+    IMPORT_JSONL
+};
+
+enum ImportEntity {
+    IMPORT_AUTHORS,
+    IMPORT_BOOKS,
+    IMPORT_READERS
+};
+
+// Итоги импорта
+struct ImportResult {
+    size_t imported; // Добавлено записей
+    size_t skipped; // Пропущено некорректных или повторяющихся записей
+    size_t created_authors; // Авторов, созданных по имени из файла книг
+
+    ImportResult() : imported(0), skipped(0), created_authors(0) {}
+};
+
+// Поля записи импорта по сущностям (порядок полей в разобранной записи)
+const std::vector<std::string>& import_columns(ImportEntity entity) {
+    static const std::vector<std::string> columns[] = {
+        { "fio", "birth_year", "most_famous_work", "awards_count" },
+        { "title", "isbn", "author", "pub_year", "copies" },
+        { "fio", "card_number" }
+    };
+    return columns[entity];
+}
+
+// Определение формата по расширению файла
+ImportFormat detect_import_format(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    std::string extension = (dot == std::string::npos) ? "" : path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+        [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return (extension == "jsonl" || extension == "json" || extension == "ndjson") ? IMPORT_JSONL : IMPORT_CSV;
+}
+
+// Разбор строки CSV (разделитель - запятая, поля в кавычках с удвоением кавычек)
+bool parse_csv_line(const char* begin, const char* end, std::vector<std::string>& fields) {
+    fields.clear();
+    const char* p = begin;
+    while (true) {
+        std::string field;
+        if (p < end && *p == '"') {
+            ++p;
+            while (true) {
+                if (p >= end) {
+                    return false; // Незакрытая кавычка
+                }
+                if (*p == '"') {
+                    if (p + 1 < end && p[1] == '"') {
+                        field += '"';
+                        p += 2;
+                        continue;
+                    }
+                    ++p;
+                    break;
+                }
+                field += *p++;
+            }
+            if (p < end && *p != ',') {
+                return false;
+            }
+        }
+        else {
+            const char* start = p;
+            while (p < end && *p != ',') {
+                ++p;
+            }
+            field.assign(start, p);
+        }
+        fields.push_back(std::move(field));
+        if (p >= end) {
+            return true;
+        }
+        ++p; // Пропускаем запятую
+    }
+}
+
+// Добавление символа Unicode в строку в кодировке UTF-8
+void append_utf8(std::string& out, uint32_t code) {
+    if (code < 0x80) {
+        out += static_cast<char>(code);
+    }
+    else if (code < 0x800) {
+        out += static_cast<char>(0xC0 | (code >> 6));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+    else if (code < 0x10000) {
+        out += static_cast<char>(0xE0 | (code >> 12));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+    else {
+        out += static_cast<char>(0xF0 | (code >> 18));
+        out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+}
+
+// Разбор четырех шестнадцатеричных цифр escape-последовательности \uXXXX
+bool parse_hex4(const char* p, const char* end, uint32_t& code) {
+    if (end - p < 4) {
+        return false;
+    }
+    code = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        uint32_t digit;
+        if (c >= '0' && c <= '9') {
+            digit = static_cast<uint32_t>(c - '0');
+        }
+        else if (c >= 'a' && c <= 'f') {
+            digit = static_cast<uint32_t>(c - 'a' + 10);
+        }
+        else if (c >= 'A' && c <= 'F') {
+            digit = static_cast<uint32_t>(c - 'A' + 10);
+        }
+        else {
+            return false;
+        }
+        code = (code << 4) | digit;
+    }
+    return true;
+}
+
+// Разбор строки JSON Lines: плоский объект со строковыми и числовыми значениями.
+// fields[i] получает значение ключа keys[i] (пустая строка, если ключа нет).
+bool parse_jsonl_line(const char* begin, const char* end, const std::vector<std::string>& keys, std::vector<std::string>& fields) {
+    fields.assign(keys.size(), std::string());
+    const char* p = begin;
+    auto skip_spaces = [&p, end]() {
+        while (p < end && (*p == ' ' || *p == '\t')) {
+            ++p;
+        }
+    };
+    auto parse_string = [&p, end](std::string& out) -> bool {
+        if (p >= end || *p != '"') {
+            return false;
+        }
+        ++p;
+        while (p < end && *p != '"') {
+            if (*p != '\\') {
+                out += *p++;
+                continue;
+            }
+            if (++p >= end) {
+                return false;
+            }
+            char escaped = *p++;
+            switch (escaped) {
+            case 'n': out += '\n'; break;
+            case 't': out += '\t'; break;
+            case 'r': out += '\r'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case '"': case '\\': case '/': out += escaped; break;
+            case 'u': {
+                uint32_t code;
+                if (!parse_hex4(p, end, code)) {
+                    return false;
+                }
+                p += 4;
+                if (code >= 0xDC00 && code <= 0xDFFF) {
+                    return false; // Младший суррогат без старшего
+                }
+                if (code >= 0xD800 && code <= 0xDBFF) {
+                    // Символ вне BMP записан парой суррогатов: \uD83D\uDE00
+                    uint32_t low;
+                    if (end - p < 6 || p[0] != '\\' || p[1] != 'u' || !parse_hex4(p + 2, end, low) || low < 0xDC00 || low > 0xDFFF) {
+                        return false;
+                    }
+                    p += 6;
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                append_utf8(out, code);
+                break;
+            }
+            default: return false; // Недопустимая escape-последовательность
+            }
+        }
+        if (p >= end) {
+            return false;
+        }
+        ++p; // Закрывающая кавычка
+        return true;
+    };
+
+    skip_spaces();
+    if (p >= end || *p++ != '{') {
+        return false;
+    }
+    skip_spaces();
+    if (p < end && *p == '}') {
+        return true;
+    }
+    while (true) {
+        skip_spaces();
+        std::string key;
+        if (!parse_string(key)) {
+            return false;
+        }
+        skip_spaces();
+        if (p >= end || *p++ != ':') {
+            return false;
+        }
+        skip_spaces();
+        std::string value;
+        if (p < end && *p == '"') {
+            if (!parse_string(value)) {
+                return false;
+            }
+        }
+        else {
+            const char* start = p;
+            while (p < end && *p != ',' && *p != '}' && *p != ' ' && *p != '\t') {
+                ++p;
+            }
+            value.assign(start, p);
+            if (value == "null") {
+                value.clear();
+            }
+        }
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (keys[i] == key) {
+                fields[i] = std::move(value);
+                break;
+            }
+        }
+        skip_spaces();
+        if (p >= end) {
+            return false;
+        }
+        if (*p == '}') {
+            return true;
+        }
+        if (*p++ != ',') {
+            return false;
+        }
+    }
+}
+
+// Преобразование поля в целое число (false, если поле не число или не помещается в int)
+bool parse_import_int(const std::string& field, int& value) {
+    if (field.empty()) {
+        return false;
+    }
+    char* parse_end = nullptr;
+    errno = 0;
+    long parsed = std::strtol(field.c_str(), &parse_end, 10);
+    if (*parse_end != '\0' || errno == ERANGE || parsed < INT_MIN || parsed > INT_MAX) {
+        return false;
+    }
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+// Класс потокового импорта: разбор блоков файла в несколько потоков
+class CatalogImporter {
+    std::vector<std::string> columns; // Ожидаемые столбцы (порядок полей в разобранной записи)
+    ImportFormat format;
+    unsigned thread_count;
+    std::vector<int> csv_mapping; // Номер столбца CSV -> номер поля (-1, если столбец не нужен)
+    size_t block_size;
+
+    // Разобранная строка
+    struct Row {
+        std::vector<std::string> fields;
+        bool valid;
+    };
+
+    // Разбор заголовка CSV
+    void read_csv_header(const char* begin, const char* end) {
+        std::vector<std::string> header;
+        if (!parse_csv_line(begin, end, header)) {
+            throw std::runtime_error("Некорректный заголовок CSV.");
+        }
+        csv_mapping.assign(header.size(), -1);
+        std::vector<bool> found(columns.size(), false);
+        for (size_t i = 0; i < header.size(); i++) {
+            for (size_t j = 0; j < columns.size(); j++) {
+                if (header[i] == columns[j]) {
+                    csv_mapping[i] = static_cast<int>(j);
+                    found[j] = true;
+                }
+            }
+        }
+        for (size_t j = 0; j < columns.size(); j++) {
+            if (!found[j]) {
+                throw std::runtime_error("В заголовке CSV нет столбца " + columns[j] + ".");
+            }
+        }
+    }
+
+    // Разбор одной строки в запись
+    void parse_row(const char* begin, const char* end, Row& row, std::vector<std::string>& scratch) const {
+        if (format == IMPORT_JSONL) {
+            row.valid = parse_jsonl_line(begin, end, columns, row.fields);
+            return;
+        }
+        row.valid = parse_csv_line(begin, end, scratch) && scratch.size() == csv_mapping.size();
+        row.fields.assign(columns.size(), std::string());
+        if (row.valid) {
+            for (size_t i = 0; i < scratch.size(); i++) {
+                if (csv_mapping[i] >= 0) {
+                    row.fields[csv_mapping[i]] = std::move(scratch[i]);
+                }
+            }
+        }
+    }
+
+    // Параллельный разбор строк блока; sink получает записи в исходном порядке
+    template <typename Sink>
+    void process_lines(const std::vector<std::pair<const char*, const char*>>& lines, Sink& sink, ImportResult& result) {
+        std::vector<Row> rows(lines.size());
+        unsigned workers = static_cast<unsigned>(std::min<size_t>(thread_count, lines.size() / 1024 + 1));
+        auto parse_range = [this, &lines, &rows](size_t from, size_t to) {
+            std::vector<std::string> scratch;
+            for (size_t i = from; i < to; i++) {
+                parse_row(lines[i].first, lines[i].second, rows[i], scratch);
+            }
+        };
+        std::vector<std::thread> threads;
+        size_t per_worker = (lines.size() + workers - 1) / workers;
+        for (unsigned w = 1; w < workers; w++) {
+            size_t from = std::min(lines.size(), w * per_worker);
+            size_t to = std::min(lines.size(), from + per_worker);
+            threads.emplace_back(parse_range, from, to);
+        }
+        parse_range(0, std::min(lines.size(), per_worker));
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        for (auto& row : rows) {
+            if (row.valid && sink(row.fields)) {
+                result.imported++;
+            }
+            else {
+                result.skipped++;
+            }
+        }
+    }
+
+public:
+    CatalogImporter(const std::vector<std::string>& columns, ImportFormat format, unsigned threads)
+        : columns(columns), format(format), thread_count(threads == 0 ? 1 : threads), block_size(8 * 1024 * 1024) {
+    }
+
+    // Импорт файла; sink(fields) возвращает false, если запись отвергнута
+    template <typename Sink>
+    ImportResult run(const std::string& path, Sink sink) {
+        FILE* in = fopen(path.c_str(), "rb");
+        if (in == nullptr) {
+            throw std::runtime_error("Не удалось открыть файл импорта " + path + ".");
+        }
+        ImportResult result;
+        std::string block;
+        std::vector<char> buffer(block_size);
+        std::vector<std::pair<const char*, const char*>> lines;
+        bool header_pending = (format == IMPORT_CSV);
+        bool first_block = true;
+        size_t read_size;
+        do {
+            read_size = fread(buffer.data(), 1, buffer.size(), in);
+            block.append(buffer.data(), read_size);
+            bool at_eof = read_size < buffer.size();
+            size_t limit = at_eof ? block.size() : block.rfind('\n') + 1; // Обрабатываем только целые строки
+            if (!at_eof && limit == 0) {
+                continue; // Строка длиннее блока, читаем дальше
+            }
+
+            lines.clear();
+            size_t start = 0;
+            if (first_block && block.compare(0, 3, "\xEF\xBB\xBF") == 0) {
+                start = 3; // Пропускаем BOM
+            }
+            first_block = false;
+            while (start < limit) {
+                size_t newline = block.find('\n', start);
+                size_t line_end = (newline == std::string::npos || newline >= limit) ? limit : newline;
+                size_t content_end = line_end;
+                if (content_end > start && block[content_end - 1] == '\r') {
+                    content_end--;
+                }
+                if (content_end > start) {
+                    const char* line_begin = block.data() + start;
+                    if (header_pending) {
+                        read_csv_header(line_begin, block.data() + content_end);
+                        header_pending = false;
+                    }
+                    else {
+                        lines.emplace_back(line_begin, block.data() + content_end);
+                    }
+                }
+                start = line_end + 1;
+            }
+            process_lines(lines, sink, result);
+            block.erase(0, limit);
+        } while (read_size == buffer.size());
+        fclose(in);
+        if (header_pending) {
+            throw std::runtime_error("Файл CSV пуст: нет заголовка.");
+        }
+        return result;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Колонки с копированием при записи
+// ---------------------------------------------------------------------------
+// Значения лежат сегментами по COLUMN_SEGMENT строк. Снимок колонки - это
+// копия указателей на сегменты, а не значений: 1 млн строк - 245 указателей.
+// Сегмент, попавший в снимок, при первой следующей записи копируется, и
+// снимок продолжает видеть прежние значения; остальные сегменты меняются
+// на месте. Какие сегменты разделены со снимками, определяет номер снятия
+// (счетчики ссылок shared_ptr при записи не читаются). Снятие и запись
+// выполняются под одной блокировкой владельца колонки, читать снимок
+// можно без блокировок.
+
+const size_t COLUMN_SEGMENT = 4096; // Строк в сегменте колонки
+
+template <typename T>
+class ColumnSnapshot {
+    std::vector<std::shared_ptr<const std::vector<T>>> segments;
+    size_t count;
+
+    template <typename U>
+    friend class CowColumn;
+
+public:
+    ColumnSnapshot() : count(0) {}
+
+    size_t size() const { return count; }
+    const T& operator[](size_t row) const { return (*segments[row / COLUMN_SEGMENT])[row % COLUMN_SEGMENT]; }
+};
+
+template <typename T>
+class CowColumn {
+    struct Segment {
+        std::shared_ptr<std::vector<T>> values;
+        uint64_t epoch; // Номер снятия, после которого сегмент создан или скопирован
+    };
+
+    std::vector<Segment> segments;
+    size_t count;
+    mutable uint64_t epoch; // Число снятий; сегмент с меньшим номером разделен со снимком
+
+    // Сегмент для записи: разделенный со снимком сначала копируется
+    std::vector<T>& writable(size_t index) {
+        Segment& segment = segments[index];
+        if (segment.epoch != epoch) {
+            segment.values = std::make_shared<std::vector<T>>(*segment.values);
+            segment.epoch = epoch;
+        }
+        return *segment.values;
+    }
+
+public:
+    CowColumn() : count(0), epoch(0) {}
+
+    void push_back(const T& value) {
+        if (count % COLUMN_SEGMENT == 0) {
+            segments.push_back(Segment{ std::make_shared<std::vector<T>>(), epoch });
+            segments.back().values->reserve(COLUMN_SEGMENT);
+        }
+        writable(segments.size() - 1).push_back(value);
+        count++;
+    }
+
+    // Запись значения; колонка дорастает до row + 1 строк значениями по умолчанию
+    void set(size_t row, const T& value) {
+        while (count <= row) {
+            push_back(T());
+        }
+        writable(row / COLUMN_SEGMENT)[row % COLUMN_SEGMENT] = value;
+    }
+
+    const T& operator[](size_t row) const { return (*segments[row / COLUMN_SEGMENT].values)[row % COLUMN_SEGMENT]; }
+
+    // Непрерывный участок с начала строки row до конца ее сегмента
+    const T* block(size_t row) const { return segments[row / COLUMN_SEGMENT].values->data() + row % COLUMN_SEGMENT; }
+
+    // Снимок за O(n / COLUMN_SEGMENT): сегменты разделяются, следующие записи в них копируют сегмент
+    ColumnSnapshot<T> capture() const {
+        ColumnSnapshot<T> snapshot;
+        snapshot.segments.reserve(segments.size());
+        for (const Segment& segment : segments) {
+            snapshot.segments.push_back(segment.values);
+        }
+        snapshot.count = count;
+        epoch++;
+        return snapshot;
+    }
+
+    void reserve(size_t rows) {
+        segments.reserve((rows + COLUMN_SEGMENT - 1) / COLUMN_SEGMENT);
+    }
+
+    void clear() {
+        segments.clear();
+        count = 0;
+    }
+
+    size_t size() const { return count; }
+    size_t memory_usage() const {
+        size_t bytes = vector_bytes(segments);
+        for (const Segment& segment : segments) {
+            bytes += vector_bytes(*segment.values);
+        }
+        return bytes;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Колоночное хранилище книг
+// ---------------------------------------------------------------------------
+// Числовые поля книг лежат в плотных массивах (по одному на поле).
+// Фильтры проходят по массивам простыми циклами без ветвлений, которые
+// компилятор векторизует; названия и ISBN остаются в объектах Book. Строки хранилища идут в порядке добавления книг и
+// совпадают с номерами ячеек книг в пуле библиотеки.
+
+const uint32_t NO_AUTHOR_ID = 0xFFFFFFFFu; // Книга без автора
+
+class BookColumns {
+    std::vector<int32_t> pub_year; // Год публикации
+    CowColumn<int32_t> copies; // Количество экземпляров (снимается для чтения без копирования)
+    std::vector<uint32_t> author_id; // Позиция автора в списке авторов
+
+    static const size_t FILTER_BLOCK = 4096; // Размер блока маски (помещается в кэш L1)
+    static_assert(COLUMN_SEGMENT % FILTER_BLOCK == 0, "Блок маски не должен пересекать сегменты колонки");
+
+    // Вычисление маски условия для строк [from, from + count)
+    void compute_mask(size_t from, size_t count, int min_copies, int year_from, int year_to, uint8_t* mask) const {
+        const int32_t* year = pub_year.data() + from;
+        const int32_t* available = copies.block(from);
+        for (size_t i = 0; i < count; i++) {
+            mask[i] = static_cast<uint8_t>((available[i] >= min_copies) & (year[i] >= year_from) & (year[i] <= year_to));
+        }
+    }
+
+public:
+    // Добавление строки для книги
+    void append(const Book& book, uint32_t author) {
+        pub_year.push_back(book.get_pub_year());
+        copies.push_back(book.get_copies());
+        author_id.push_back(author);
+    }
+
+    // Резервирование памяти под count строк
+    void reserve(size_t count) {
+        pub_year.reserve(count);
+        copies.reserve(count);
+        author_id.reserve(count);
+    }
+
+    void clear() {
+        pub_year.clear();
+        copies.clear();
+        author_id.clear();
+    }
+
+    size_t size() const { return pub_year.size(); }
+    size_t memory_usage() const {
+        return vector_bytes(pub_year) + copies.memory_usage() + vector_bytes(author_id);
+    }
+    int get_pub_year(size_t row) const { return pub_year[row]; }
+    int get_copies(size_t row) const { return copies[row]; }
+    void set_copies(size_t row, int value) { copies.set(row, value); }
+    ColumnSnapshot<int32_t> copies_column() const { return copies.capture(); }
+    uint32_t get_author_id(size_t row) const { return author_id[row]; }
+
+    // Маска строк с copies >= min_copies и pub_year в [year_from, year_to] (1 - строка подходит)
+    std::vector<uint8_t> filter(int min_copies, int year_from, int year_to) const {
+        std::vector<uint8_t> mask(size());
+        for (size_t from = 0; from < size(); from += FILTER_BLOCK) {
+            compute_mask(from, std::min(FILTER_BLOCK, size() - from), min_copies, year_from, year_to, mask.data() + from);
+        }
+        return mask;
+    }
+
+    // Количество строк, удовлетворяющих тому же условию
+    size_t count(int min_copies, int year_from, int year_to) const {
+        size_t total = 0;
+        uint8_t mask[FILTER_BLOCK];
+        for (size_t from = 0; from < size(); from += FILTER_BLOCK) {
+            size_t block = std::min(FILTER_BLOCK, size() - from);
+            compute_mask(from, block, min_copies, year_from, year_to, mask);
+            for (size_t i = 0; i < block; i++) {
+                total += mask[i];
+            }
+        }
+        return total;
+    }
+};
+
+const size_t BookColumns::FILTER_BLOCK;
+
+// ---------------------------------------------------------------------------
+// Справочник авторов
+// ---------------------------------------------------------------------------
+// Авторы ищутся по нормализованному ФИО: без учета регистра, с одним
+// пробелом между словами. Ключи лежат в упорядоченном дереве, поэтому
+// поиск по началу ФИО - это один lower_bound и проход по соседним узлам.
+// Справочник же хранит обратный индекс "автор -> строки его книг" (им
+// пользуются нечеткий поиск и планировщик запросов) и индексы по
+// известному произведению и числу наград FamousAuthor.
+
+// Ключ ФИО для справочника. Для начала ФИО (prefix = true) завершающий
+// пробел сохраняется, чтобы "Иван " не находило "Иванов"
+std::string make_fio_key(const std::string& fio, bool prefix = false) {
+    std::string key;
+    for (char c : make_collation_key(fio, true)) {
+        if (c == COLLATION_SPACE && (key.empty() || key.back() == COLLATION_SPACE)) {
+            continue;
+        }
+        key += c;
+    }
+    if (!prefix && !key.empty() && key.back() == COLLATION_SPACE) {
+        key.pop_back();
+    }
+    return key;
+}
+
+const size_t AUTHOR_CHOICE_LIMIT = 20; // Авторов в списке выбора при вводе книги
+
+// Класс AuthorDirectory - индексы авторов по позициям в списке авторов библиотеки
+class AuthorDirectory {
+    typedef std::multimap<std::string, uint32_t> KeyIndex;
+
+    KeyIndex by_fio; // Ключ ФИО -> позиции авторов (равные - в порядке добавления)
+    KeyIndex by_work; // Ключ известного произведения -> позиции авторов
+    std::multimap<int, uint32_t> by_awards; // Количество наград -> позиции известных авторов
+    std::vector<std::vector<uint32_t>> author_books; // Позиция автора -> строки его книг по возрастанию
+    std::vector<uint32_t> book_authors; // Строка книги -> позиция автора (NO_AUTHOR_ID - автор неизвестен)
+
+    static std::vector<uint32_t> positions(KeyIndex::const_iterator first, KeyIndex::const_iterator last, size_t limit) {
+        std::vector<uint32_t> result;
+        for (; first != last && result.size() < limit; ++first) {
+            result.push_back(first->second);
+        }
+        return result;
+    }
+
+public:
+    // Добавление автора (позиции идут по возрастанию)
+    void add_author(uint32_t author, const Author& value) {
+        by_fio.emplace(make_fio_key(value.get_fio()), author);
+        auto famous = dynamic_cast<const FamousAuthor*>(&value);
+        if (famous) {
+            if (!famous->get_most_famous_work().empty()) {
+                by_work.emplace(make_fio_key(famous->get_most_famous_work()), author);
+            }
+            by_awards.emplace(famous->get_awards_count(), author);
+        }
+        author_books.resize(std::max<size_t>(author_books.size(), author + 1));
+    }
+
+    // Добавление книги автора (строки идут по возрастанию)
+    void add_book(uint32_t row, uint32_t author) {
+        if (author != NO_AUTHOR_ID && author < author_books.size()) {
+            author_books[author].push_back(row);
+            book_authors.resize(std::max<size_t>(book_authors.size(), row + 1), NO_AUTHOR_ID);
+            book_authors[row] = author;
+        }
+    }
+
+    bool contains(const std::string& fio) const {
+        return by_fio.find(make_fio_key(fio)) != by_fio.end();
+    }
+
+    // Авторы с заданным ФИО
+    std::vector<uint32_t> find(const std::string& fio) const {
+        auto range = by_fio.equal_range(make_fio_key(fio));
+        return positions(range.first, range.second, by_fio.size());
+    }
+
+    // До limit авторов, ФИО которых начинается с prefix (в порядке ФИО)
+    std::vector<uint32_t> find_prefix(const std::string& prefix, size_t limit) const {
+        std::string key = make_fio_key(prefix, true);
+        auto first = by_fio.lower_bound(key);
+        auto last = first;
+        while (last != by_fio.end() && last->first.compare(0, key.size(), key) == 0) {
+            ++last;
+        }
+        return positions(first, last, limit);
+    }
+
+    // Известные авторы с заданным самым известным произведением
+    std::vector<uint32_t> find_by_work(const std::string& work) const {
+        auto range = by_work.equal_range(make_fio_key(work));
+        return positions(range.first, range.second, by_work.size());
+    }
+
+    // Известные авторы с не менее чем min_awards наградами (по убыванию наград)
+    std::vector<uint32_t> find_by_awards(int min_awards) const {
+        std::vector<uint32_t> result;
+        for (auto it = by_awards.rbegin(); it != by_awards.rend() && it->first >= min_awards; ++it) {
+            result.push_back(it->second);
+        }
+        return result;
+    }
+
+    // Строки книг автора по возрастанию
+    const std::vector<uint32_t>& books_of(uint32_t author) const {
+        return author_books[author];
+    }
+
+    // Позиция автора книги в строке row (NO_AUTHOR_ID, если автор неизвестен)
+    uint32_t author_of(uint32_t row) const {
+        return row < book_authors.size() ? book_authors[row] : NO_AUTHOR_ID;
+    }
+
+    size_t size() const { return author_books.size(); }
+
+    size_t memory_usage() const {
+        size_t bytes = tree_bytes(by_fio) + tree_bytes(by_work) + tree_bytes(by_awards) + vector_bytes(author_books)
+            + vector_bytes(book_authors);
+        for (const KeyIndex* index : { &by_fio, &by_work }) {
+            for (const auto& entry : *index) {
+                bytes += string_heap_bytes(entry.first);
+            }
+        }
+        for (const auto& books : author_books) {
+            bytes += vector_bytes(books);
+        }
+        return bytes;
+    }
+
+    void clear() {
+        by_fio.clear();
+        by_work.clear();
+        by_awards.clear();
+        author_books.clear();
+        book_authors.clear();
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Нечеткий поиск по названиям книг и ФИО авторов
+// ---------------------------------------------------------------------------
+// Текст делится на слова, буквы приводятся к нижнему регистру (ё -> е), и
+// каждое слово раскладывается на триграммы с границами ("  к", " кн",
+// "кни", ..., "га "). Инвертированный индекс хранит для каждой триграммы
+// возрастающий список документов: строк книг для названий и позиций авторов
+// для ФИО. Слово запроса совпадает с документом, если в документе есть не
+// меньше SEARCH_MIN_SIMILARITY его триграмм, поэтому находятся и слова с
+// опечатками, и части слов. Все слова запроса должны совпасть (И), причем
+// каждое - с названием книги или с ФИО ее автора.
+//
+// Предел скорости: списки триграмм первого слова (с наименьшей оценкой
+// числа совпадений) проходятся целиком по диапазону строк потока, остальные
+// слова проверяются только на отобранных строках. Поэтому время запроса
+// пропорционально длине этих списков: если триграммы слова встречаются в
+// заметной доле названий (короткие слова из частых слогов), это около
+// миллисекунды на каждые 100 тысяч строк потока, и задержку в несколько
+// миллисекунд на миллионах книг дает только деление строк между потоками
+// (с SEARCH_PARALLEL_MIN_ROWS строк).
+
+const float SEARCH_MIN_SIMILARITY = 0.4f; // Доля триграмм слова, которую должен содержать документ
+const uint32_t SEARCH_PARALLEL_MIN_ROWS = 200000; // С этого числа книг запрос делится между потоками
+const size_t SEARCH_DENSE_RATIO = 16; // Плотный массив счетчиков, если совпадений слова не меньше 1/16 строк
+
+// Приведение символа к виду для поиска: 0 - разделитель слов
+uint32_t fold_search_char(uint32_t code) {
+    if (code >= 'A' && code <= 'Z') {
+        return code + ('a' - 'A');
+    }
+    if (code < 0x80) {
+        return ((code >= 'a' && code <= 'z') || (code >= '0' && code <= '9')) ? code : 0;
+    }
+    if (code >= 0x410 && code <= 0x42F) { // А-Я
+        return code + 0x20;
+    }
+    if (code == 0x401 || code == 0x451) { // Ё, ё
+        return 0x435;
+    }
+    if (code <= 0xBF || (code >= 0x2000 && code <= 0x206F)) { // Пробелы, кавычки-елочки, тире
+        return 0;
+    }
+    return code;
+}
+
+// Разбор строки на слова для поиска
+std::vector<std::vector<uint32_t>> split_search_words(const std::string& text) {
+    std::vector<std::vector<uint32_t>> words(1);
+    for (uint32_t code : decode_text(text)) {
+        uint32_t folded = fold_search_char(code);
+        if (folded != 0) {
+            words.back().push_back(folded);
+        }
+        else if (!words.back().empty()) {
+            words.emplace_back();
+        }
+    }
+    if (words.back().empty()) {
+        words.pop_back();
+    }
+    return words;
+}
+
+// Триграммы слова (каждый символ - 21 бит, 0 - граница слова), отсортированы и без повторов
+std::vector<uint64_t> word_trigrams(const std::vector<uint32_t>& word) {
+    std::vector<uint32_t> padded(2, 0);
+    padded.insert(padded.end(), word.begin(), word.end());
+    padded.push_back(0);
+    std::vector<uint64_t> grams;
+    for (size_t i = 0; i + 2 < padded.size(); i++) {
+        grams.push_back((static_cast<uint64_t>(padded[i]) << 42) | (static_cast<uint64_t>(padded[i + 1]) << 21) | padded[i + 2]);
+    }
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+    return grams;
+}
+
+// Результат поиска: строка книги и сумма по словам запроса доли совпавших триграмм
+struct SearchHit {
+    uint32_t row;
+    float score;
+};
+
+// Класс FuzzySearchIndex - триграммный индекс названий книг и ФИО авторов.
+// Документы добавляются только по возрастанию номеров, поэтому списки
+// документов остаются упорядоченными без сортировки.
+class FuzzySearchIndex {
+    typedef std::vector<uint32_t> Postings;
+    typedef std::unordered_map<uint64_t, Postings> GramMap;
+    typedef std::vector<std::pair<uint32_t, float>> Matches; // Документ и доля совпавших триграмм
+
+    // Книги совпавшего автора в диапазоне строк и оценка совпадения по ФИО
+    struct AuthorRows {
+        const uint32_t* first;
+        const uint32_t* last;
+        float score;
+    };
+
+    GramMap title_grams; // Триграмма -> строки книг
+    GramMap author_grams; // Триграмма -> позиции авторов
+    const AuthorDirectory& directory; // Книги авторов (справочник библиотеки)
+    uint32_t row_count; // Строк книг в индексе
+
+    // Добавление документа во все списки его триграмм
+    static void add_document(GramMap& grams, uint32_t doc, const std::string& text) {
+        std::vector<uint64_t> keys;
+        for (const auto& word : split_search_words(text)) {
+            std::vector<uint64_t> word_grams = word_trigrams(word);
+            keys.insert(keys.end(), word_grams.begin(), word_grams.end());
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        for (uint64_t key : keys) {
+            grams[key].push_back(doc);
+        }
+    }
+
+    // Первый документ списка не меньше value, начиная с first: шаг удваивается,
+    // затем двоичный поиск, так что близкие кандидаты находятся за O(1)
+    static Postings::const_iterator gallop(Postings::const_iterator first, Postings::const_iterator last, uint32_t value) {
+        ptrdiff_t step = 1;
+        while (step < last - first && first[step] < value) {
+            first += step;
+            step *= 2;
+        }
+        return std::lower_bound(first, first + std::min(step + 1, last - first), value);
+    }
+
+    // Документы [from, to), содержащие не меньше порога триграмм слова, с долей
+    // совпавших триграмм (по возрастанию номера). Документ с need совпадениями
+    // есть хотя бы в одном из found - need + 1 самых коротких списков, поэтому
+    // кандидаты берутся только из них, а в длинных списках ищутся поиском с
+    // удвоением шага; кандидат отбрасывается, как только порог стал недостижим.
+    // Плотный массив по диапазону - только если списки покрывают большую его часть;
+    // counts - байтовые счетчики по диапазону, общие для слов одного запроса
+    // (после подсчета снова нулевые). within - строки, уже отобранные
+    // предыдущими словами: оцениваются только они
+    static Matches score_word(const GramMap& grams, const std::vector<uint64_t>& word_grams, uint32_t from, uint32_t to,
+        std::vector<uint8_t>& counts, const Matches* within = nullptr) {
+        typedef std::pair<Postings::const_iterator, Postings::const_iterator> Range;
+        size_t total = word_grams.size();
+        size_t need = std::max<size_t>(1, static_cast<size_t>(std::ceil(total * SEARCH_MIN_SIMILARITY)));
+        const float scale = 1.0f / total;
+        std::vector<Range> lists;
+        size_t postings = 0;
+        for (uint64_t key : word_grams) {
+            auto it = grams.find(key);
+            if (it == grams.end()) {
+                continue;
+            }
+            auto first = std::lower_bound(it->second.begin(), it->second.end(), from);
+            auto last = std::lower_bound(first, it->second.end(), to);
+            if (first != last) {
+                lists.push_back(Range(first, last));
+                postings += static_cast<size_t>(last - first);
+            }
+        }
+        Matches matches;
+        if (lists.size() < need) {
+            return matches; // Ни один документ не наберет нужного числа триграмм
+        }
+
+        std::sort(lists.begin(), lists.end(), [](const Range& a, const Range& b) {
+            return a.second - a.first < b.second - b.first;
+        });
+        std::vector<std::pair<uint32_t, uint32_t>> candidates; // Документ и число совпавших триграмм
+        size_t first_probe = 0;
+        if (within != nullptr && within->size() * lists.size() < postings) {
+            // Отобранных строк мало: дешевле проверить их по спискам, чем пройти списки целиком
+            candidates.reserve(within->size());
+            for (const auto& match : *within) {
+                candidates.push_back(std::make_pair(match.first, 0u));
+            }
+        }
+        else if (postings * SEARCH_DENSE_RATIO >= to - from && lists.size() <= UINT8_MAX) {
+            counts.resize(to - from);
+            uint8_t* count_of = counts.data() - from;
+            for (const Range& list : lists) {
+                for (auto it = list.first; it != list.second; ++it) {
+                    count_of[*it]++;
+                }
+            }
+            if (within != nullptr) {
+                for (const auto& match : *within) {
+                    uint8_t count = count_of[match.first];
+                    if (count >= need) {
+                        matches.emplace_back(match.first, count * scale);
+                    }
+                }
+                std::fill(counts.begin(), counts.end(), 0);
+                return matches;
+            }
+            for (size_t i = 0; i < counts.size(); i++) {
+                if (counts[i] >= need) {
+                    matches.emplace_back(static_cast<uint32_t>(from + i), counts[i] * scale);
+                }
+                counts[i] = 0;
+            }
+            return matches;
+        }
+        else {
+            first_probe = lists.size() - need + 1;
+            std::vector<uint32_t> seeds; // Слияние упорядоченных списков вместо сортировки
+            for (size_t i = 0; i < first_probe; i++) {
+                size_t middle = seeds.size();
+                seeds.insert(seeds.end(), lists[i].first, lists[i].second);
+                std::inplace_merge(seeds.begin(), seeds.begin() + middle, seeds.end());
+            }
+            for (size_t i = 0; i < seeds.size(); i++) {
+                if (i > 0 && seeds[i] == seeds[i - 1]) {
+                    candidates.back().second++;
+                }
+                else {
+                    candidates.push_back(std::make_pair(seeds[i], 1u));
+                }
+            }
+        }
+        for (size_t i = first_probe; i < lists.size() && !candidates.empty(); i++) {
+            auto cursor = lists[i].first;
+            for (auto& candidate : candidates) {
+                cursor = gallop(cursor, lists[i].second, candidate.first);
+                if (cursor == lists[i].second) {
+                    break;
+                }
+                if (*cursor == candidate.first) {
+                    candidate.second++;
+                }
+            }
+            size_t remaining = lists.size() - i - 1;
+            candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                [need, remaining](const std::pair<uint32_t, uint32_t>& candidate) { return candidate.second + remaining < need; }),
+                candidates.end());
+        }
+        for (const auto& candidate : candidates) {
+            if (candidate.second >= need) {
+                matches.emplace_back(candidate.first, candidate.second * scale);
+            }
+        }
+        return matches;
+    }
+
+    // Оценка сверху числа документов [from, to), совпавших со словом по триграммам:
+    // каждый такой документ есть в одном из found - need + 1 самых коротких списков
+    static size_t estimate_word(const GramMap& grams, const std::vector<uint64_t>& word_grams, uint32_t from, uint32_t to) {
+        size_t need = std::max<size_t>(1, static_cast<size_t>(std::ceil(word_grams.size() * SEARCH_MIN_SIMILARITY)));
+        std::vector<size_t> lengths;
+        for (uint64_t key : word_grams) {
+            auto it = grams.find(key);
+            if (it != grams.end()) {
+                auto first = std::lower_bound(it->second.begin(), it->second.end(), from);
+                lengths.push_back(static_cast<size_t>(std::lower_bound(first, it->second.end(), to) - first));
+            }
+        }
+        if (lengths.size() < need) {
+            return 0;
+        }
+        std::sort(lengths.begin(), lengths.end());
+        return std::accumulate(lengths.begin(), lengths.begin() + (lengths.size() - need + 1), size_t(0));
+    }
+
+    // Поиск в строках [from, to): слова запроса объединяются по И, результат - до limit лучших.
+    // Первым разбирается слово с наименьшей оценкой числа совпадений (по триграммам
+    // названий и книгам совпавших авторов), остальные проверяются только на уже
+    // отобранных строках. Совпадения слов - разреженные списки по возрастанию
+    // строки, пересекаемые слиянием
+    std::vector<SearchHit> search_rows(const std::vector<std::vector<uint64_t>>& words,
+        const std::vector<Matches>& authors, uint32_t from, uint32_t to, size_t limit) const {
+        std::vector<std::vector<AuthorRows>> author_rows(words.size()); // Книги совпавших авторов по словам
+        std::vector<size_t> author_row_counts(words.size(), 0);
+        std::vector<size_t> estimates(words.size());
+        for (size_t w = 0; w < words.size(); w++) {
+            for (const auto& author : authors[w]) {
+                const Postings& rows = directory.books_of(author.first);
+                auto first = std::lower_bound(rows.begin(), rows.end(), from);
+                auto last = std::lower_bound(first, rows.end(), to);
+                if (first != last) {
+                    author_rows[w].push_back(AuthorRows{ &*first, &*first + (last - first), author.second });
+                    author_row_counts[w] += static_cast<size_t>(last - first);
+                }
+            }
+            estimates[w] = estimate_word(title_grams, words[w], from, to) + author_row_counts[w];
+        }
+        std::vector<size_t> order(words.size());
+        std::iota(order.begin(), order.end(), size_t(0));
+        std::stable_sort(order.begin(), order.end(), [&estimates](size_t a, size_t b) { return estimates[a] < estimates[b]; });
+
+        Matches total;
+        std::vector<uint8_t> counts; // Счетчики триграмм по диапазону
+        std::vector<float> dense; // Оценки по диапазону для первого слова с большим числом совпадений
+        std::vector<float> author_scores; // Позиция автора -> оценка совпадения слова с ФИО
+        for (size_t step = 0; step < order.size(); step++) {
+            size_t w = order[step];
+            Matches word = score_word(title_grams, words[w], from, to, counts, step == 0 ? nullptr : &total);
+            // Книга, совпавшая и по названию, и по автору, получает лучшую из оценок
+            if (step != 0) {
+                // Остальные слова оцениваются только на отобранных строках: оценка
+                // по названию - слиянием с word, по автору - по позиции автора книги
+                author_scores.assign(directory.size(), 0.0f);
+                for (const auto& author : authors[w]) {
+                    author_scores[author.first] = std::max(author_scores[author.first], author.second);
+                }
+                Matches both;
+                auto title = word.begin();
+                for (const auto& match : total) {
+                    while (title != word.end() && title->first < match.first) {
+                        ++title;
+                    }
+                    float score = title != word.end() && title->first == match.first ? title->second : 0.0f;
+                    uint32_t author = directory.author_of(match.first);
+                    if (author != NO_AUTHOR_ID) {
+                        score = std::max(score, author_scores[author]);
+                    }
+                    if (score > 0.0f) {
+                        both.emplace_back(match.first, match.second + score);
+                    }
+                }
+                total.swap(both);
+            }
+            else if (author_row_counts[w] != 0 && (word.size() + author_row_counts[w]) * SEARCH_DENSE_RATIO >= to - from) {
+                dense.resize(to - from);
+                for (const auto& match : word) {
+                    dense[match.first - from] = match.second;
+                }
+                for (const AuthorRows& rows : author_rows[w]) {
+                    for (const uint32_t* row = rows.first; row != rows.last; ++row) {
+                        dense[*row - from] = std::max(dense[*row - from], rows.score);
+                    }
+                }
+                word.clear();
+                for (size_t i = 0; i < dense.size(); i++) {
+                    if (dense[i] > 0.0f) {
+                        word.emplace_back(static_cast<uint32_t>(from + i), dense[i]);
+                        dense[i] = 0.0f;
+                    }
+                }
+                total.swap(word);
+            }
+            else {
+                for (const AuthorRows& rows : author_rows[w]) {
+                    for (const uint32_t* row = rows.first; row != rows.last; ++row) {
+                        word.emplace_back(*row, rows.score);
+                    }
+                }
+                if (author_row_counts[w] != 0) {
+                    std::sort(word.begin(), word.end());
+                    // Повторы строки стоят рядом; остается лучшая оценка
+                    size_t kept = 0;
+                    for (size_t i = 0; i < word.size(); i++) {
+                        if (kept > 0 && word[kept - 1].first == word[i].first) {
+                            word[kept - 1].second = std::max(word[kept - 1].second, word[i].second);
+                        }
+                        else {
+                            word[kept++] = word[i];
+                        }
+                    }
+                    word.resize(kept);
+                }
+                total.swap(word);
+            }
+            if (total.empty()) {
+                break; // Следующие слова уже ничего не добавят
+            }
+        }
+
+        std::vector<SearchHit> hits;
+        hits.reserve(total.size());
+        for (const auto& match : total) {
+            hits.push_back(SearchHit{ match.first, match.second });
+        }
+        keep_best(hits, limit);
+        return hits;
+    }
+
+    // Выгрузка списков в секции снимка; триграммы идут по возрастанию ключа
+    static void save_grams(const GramMap& grams, std::vector<SnapshotGram>& table, std::vector<uint32_t>& postings) {
+        std::vector<uint64_t> keys;
+        keys.reserve(grams.size());
+        for (const auto& entry : grams) {
+            keys.push_back(entry.first);
+        }
+        std::sort(keys.begin(), keys.end());
+        table.reserve(keys.size());
+        for (uint64_t key : keys) {
+            const Postings& docs = grams.find(key)->second;
+            if (postings.size() + docs.size() > 0xFFFFFFFFull) {
+                throw std::runtime_error("Списки триграмм не помещаются в снимок.");
+            }
+            table.push_back(SnapshotGram{ key, static_cast<uint32_t>(postings.size()), static_cast<uint32_t>(docs.size()) });
+            postings.insert(postings.end(), docs.begin(), docs.end());
+        }
+    }
+
+    // Загрузка списков из снимка; документы должны возрастать и быть меньше limit
+    static void load_grams(GramMap& grams, const SnapshotGram* table, size_t count,
+        const CatalogSnapshot& snapshot, uint32_t limit) {
+        grams.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            const SnapshotGram& gram = table[i];
+            if (static_cast<uint64_t>(gram.first) + gram.count > snapshot.postings_count()) {
+                throw std::runtime_error("Поврежденный снимок каталога: список триграммы выходит за пределы секции.");
+            }
+            const uint32_t* first = snapshot.get_postings() + gram.first;
+            Postings docs(first, first + gram.count);
+            for (size_t d = 0; d < docs.size(); d++) {
+                if (docs[d] >= limit || (d > 0 && docs[d] <= docs[d - 1])) {
+                    throw std::runtime_error("Поврежденный снимок каталога: некорректный список триграммы.");
+                }
+            }
+            if (!grams.emplace(gram.key, std::move(docs)).second) {
+                throw std::runtime_error("Поврежденный снимок каталога: повторяющаяся триграмма.");
+            }
+        }
+    }
+
+    // Оставить limit лучших результатов (по убыванию оценки, затем по номеру строки)
+    static void keep_best(std::vector<SearchHit>& hits, size_t limit) {
+        auto better = [](const SearchHit& a, const SearchHit& b) {
+            return a.score > b.score || (a.score == b.score && a.row < b.row);
+        };
+        if (hits.size() > limit) {
+            std::partial_sort(hits.begin(), hits.begin() + limit, hits.end(), better);
+            hits.resize(limit);
+        }
+        else {
+            std::sort(hits.begin(), hits.end(), better);
+        }
+    }
+
+public:
+    explicit FuzzySearchIndex(const AuthorDirectory& directory) : directory(directory), row_count(0) {}
+
+    // Добавление автора (позиции идут по возрастанию)
+    void add_author(uint32_t author, const std::string& fio) {
+        add_document(author_grams, author, fio);
+    }
+
+    // Добавление книги (строки идут по возрастанию; автор книги - в справочнике)
+    void add_book(uint32_t row, const std::string& title) {
+        add_document(title_grams, row, title);
+        row_count = row + 1;
+    }
+
+    // Поиск до limit лучших книг; при большом каталоге строки делятся между threads потоками
+    std::vector<SearchHit> search(const std::string& query, size_t limit, unsigned threads) const {
+        std::vector<std::vector<uint64_t>> words;
+        for (const auto& word : split_search_words(query)) {
+            words.push_back(word_trigrams(word));
+        }
+        if (words.empty() || limit == 0) {
+            return std::vector<SearchHit>();
+        }
+        // Авторов немного, поэтому совпадения по ФИО ищутся один раз для всех потоков
+        std::vector<Matches> authors(words.size());
+        std::vector<uint8_t> counts;
+        for (size_t w = 0; w < words.size(); w++) {
+            authors[w] = score_word(author_grams, words[w], 0, static_cast<uint32_t>(directory.size()), counts);
+        }
+
+        unsigned workers = row_count < SEARCH_PARALLEL_MIN_ROWS ? 1 : std::max(1u, threads);
+        std::vector<std::vector<SearchHit>> partial(workers);
+        uint32_t per_worker = (row_count + workers - 1) / workers;
+        auto search_range = [this, &words, &authors, &partial, per_worker, limit](unsigned w) {
+            uint32_t from = std::min(row_count, w * per_worker);
+            uint32_t to = std::min(row_count, from + per_worker);
+            partial[w] = search_rows(words, authors, from, to, limit);
+        };
+        std::vector<std::thread> pool;
+        for (unsigned w = 1; w < workers; w++) {
+            pool.emplace_back(search_range, w);
+        }
+        search_range(0);
+        for (auto& thread : pool) {
+            thread.join();
+        }
+
+        std::vector<SearchHit> hits;
+        for (const auto& part : partial) {
+            hits.insert(hits.end(), part.begin(), part.end());
+        }
+        keep_best(hits, limit);
+        return hits;
+    }
+
+    // Выгрузка триграмм названий и ФИО в секции снимка
+    void save_to(SnapshotSections& sections) const {
+        save_grams(title_grams, sections.title_grams, sections.postings);
+        save_grams(author_grams, sections.author_grams, sections.postings);
+    }
+
+    // Загрузка триграмм из снимка вместо разбора текстов; книги и авторы
+    // того же снимка уже добавлены в библиотеку (book_rows строк, author_count авторов)
+    void load_from(const CatalogSnapshot& snapshot, uint32_t book_rows, uint32_t author_count) {
+        clear();
+        load_grams(title_grams, snapshot.get_title_grams(), snapshot.title_gram_count(), snapshot, book_rows);
+        load_grams(author_grams, snapshot.get_author_grams(), snapshot.author_gram_count(), snapshot, author_count);
+        row_count = book_rows;
+    }
+
+    // Количество различных триграмм названий и ФИО
+    size_t gram_count() const {
+        return title_grams.size() + author_grams.size();
+    }
+
+    size_t memory_usage() const {
+        size_t bytes = hash_bytes(title_grams) + hash_bytes(author_grams);
+        for (const GramMap* grams : { &title_grams, &author_grams }) {
+            for (const auto& entry : *grams) {
+                bytes += vector_bytes(entry.second);
+            }
+        }
+        return bytes;
+    }
+
+    void clear() {
+        title_grams.clear();
+        author_grams.clear();
+        row_count = 0;
+    }
+};
+
+// Класс OverdueTracker - отслеживание просроченных выдач.
+// Открытые выдачи лежат в куче с минимальным сроком возврата на вершине,
+// поэтому перевод часов на день D извлекает только k ставших
+// просроченными выдач за O(k log n) без просмотра остальных.
+class OverdueTracker {
+    // Элемент кучи: срок возврата и дескриптор выдачи
+    struct DueEntry {
+        Date due;
+        SlabHandle loan;
+    };
+
+    // Сравнение для кучи с минимальным сроком на вершине
+    struct LaterDue {
+        bool operator()(const DueEntry& a, const DueEntry& b) const {
+            return a.due > b.due;
+        }
+    };
+
+    const SlabPool<Loan>& loan_pool; // Пул выдач библиотеки
+    std::priority_queue<DueEntry, std::vector<DueEntry>, LaterDue> due_heap; // Еще не просроченные выдачи
+    std::unordered_map<uint32_t, std::vector<SlabHandle>> overdue_by_reader; // Просроченные выдачи по дескриптору читателя
+    size_t overdue_count; // Всего просроченных выдач
+    Date clock; // Текущий день
+
+    // Отметка выдачи как просроченной
+    void mark_overdue(SlabHandle loan) {
+        overdue_by_reader[loan_pool.get(loan)->get_reader_handle().get_value()].push_back(loan);
+        overdue_count++;
+    }
+
+public:
+    explicit OverdueTracker(const SlabPool<Loan>& loan_pool) : loan_pool(loan_pool), overdue_count(0) {}
+
+    // Постановка выдачи на контроль (выдача просрочена, если текущий день позже срока возврата)
+    void track(SlabHandle loan) {
+        const Date& due = loan_pool.get(loan)->get_return_date();
+        if (due < clock) {
+            mark_overdue(loan);
+        }
+        else {
+            due_heap.push(DueEntry{ due, loan });
+        }
+    }
+
+    // Перевод часов на день day; возвращает выдачи, ставшие просроченными
+    std::vector<SlabHandle> advance_to(const Date& day) {
+        std::vector<SlabHandle> newly_overdue;
+        if (day <= clock) {
+            clock = std::max(clock, day);
+            return newly_overdue; // Часы не идут назад
+        }
+        clock = day;
+        while (!due_heap.empty() && due_heap.top().due < clock) {
+            const DueEntry& top = due_heap.top();
+            const Loan* loan = loan_pool.get(top.loan);
+            // Возвращенные и продленные выдачи удаляются из кучи лениво
+            if (!loan->is_returned() && loan->get_return_date() == top.due) {
+                newly_overdue.push_back(top.loan);
+                mark_overdue(top.loan);
+            }
+            due_heap.pop();
+        }
+        return newly_overdue;
+    }
+
+    // Снятие выдачи с контроля (при возврате или продлении)
+    void untrack(SlabHandle loan) {
+        auto it = overdue_by_reader.find(loan_pool.get(loan)->get_reader_handle().get_value());
+        if (it == overdue_by_reader.end()) {
+            return; // Еще не просрочена: запись в куче будет пропущена
+        }
+        auto& reader_loans = it->second;
+        auto pos = std::find(reader_loans.begin(), reader_loans.end(), loan);
+        if (pos != reader_loans.end()) {
+            reader_loans.erase(pos);
+            overdue_count--;
+        }
+        if (reader_loans.empty()) {
+            overdue_by_reader.erase(it);
+        }
+    }
+
+    // Просроченные выдачи читателя
+    std::vector<SlabHandle> overdue_for(SlabHandle reader) const {
+        auto it = overdue_by_reader.find(reader.get_value());
+        if (it == overdue_by_reader.end()) {
+            return std::vector<SlabHandle>();
+        }
+        return it->second;
+    }
+
+    size_t get_overdue_count() const {
+        return overdue_count;
+    }
+
+    const Date& get_clock() const {
+        return clock;
+    }
+
+    // Оценка памяти кучи сроков и списков просроченных выдач
+    size_t memory_usage() const {
+        size_t bytes = due_heap.size() * sizeof(DueEntry) + hash_bytes(overdue_by_reader);
+        for (const auto& entry : overdue_by_reader) {
+            bytes += vector_bytes(entry.second);
+        }
+        return bytes;
+    }
+
+    // Сброс без изменения часов
+    void clear() {
+        due_heap = decltype(due_heap)();
+        overdue_by_reader.clear();
+        overdue_count = 0;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Аналитика выдач
+// ---------------------------------------------------------------------------
+// Счетчики (выдачи по книгам и авторам, открытые выдачи читателей, книги
+// по десятилетиям) обновляются при добавлении книг, выдаче и возврате,
+// поэтому сводка читается за O(k) без просмотра выдач. Пакетный расчет
+// тех же величин проходит по пулам в нескольких потоках: каждый поток
+// считает свою часть в локальные массивы, которые затем складываются.
+
+const size_t ANALYTICS_PARALLEL_MIN_ITEMS = 100000; // С этого числа записей пакетный расчет делится между потоками
+
+// Позиция в рейтинге: номер объекта и значение счетчика
+struct RankedCount {
+    uint32_t id;
+    uint32_t count;
+};
+
+// Класс RankedCounter - счетчики объектов с рейтингом по убыванию.
+// Номера объектов лежат в order по невозрастанию счетчика, а для каждого
+// значения c хранится граница: объекты со счетчиком >= c занимают
+// order[0, bounds[c]). Счетчик меняется только на единицу, поэтому объект
+// переходит в соседнюю группу одним обменом с ее крайним элементом - O(1),
+// а первые k объектов - это просто начало order.
+class RankedCounter {
+    std::vector<uint32_t> counts; // Значение счетчика по номеру объекта
+    std::vector<uint32_t> order; // Номера объектов по невозрастанию счетчика
+    std::vector<uint32_t> positions; // Позиция объекта в order
+    std::vector<uint32_t> bounds; // bounds[c] - число объектов со счетчиком >= c
+
+    // Обмен двух позиций order
+    void swap_positions(uint32_t a, uint32_t b) {
+        std::swap(order[a], order[b]);
+        positions[order[a]] = a;
+        positions[order[b]] = b;
+    }
+
+public:
+    RankedCounter() {
+        clear();
+    }
+
+    // Добавление объектов с нулевым счетчиком, пока номер id не станет допустимым
+    void grow(uint32_t id) {
+        while (counts.size() <= id) {
+            positions.push_back(static_cast<uint32_t>(order.size()));
+            order.push_back(static_cast<uint32_t>(counts.size()));
+            counts.push_back(0);
+            bounds[0]++; // Нулевые счетчики в конце order, порядок не нарушается
+        }
+    }
+
+    void increment(uint32_t id) {
+        uint32_t count = counts[id];
+        if (bounds.size() == count + 1) {
+            bounds.push_back(0);
+        }
+        swap_positions(positions[id], bounds[count + 1]); // Первый объект группы count
+        bounds[count + 1]++;
+        counts[id] = count + 1;
+    }
+
+    void decrement(uint32_t id) {
+        uint32_t count = counts[id];
+        swap_positions(positions[id], bounds[count] - 1); // Последний объект группы count
+        bounds[count]--;
+        counts[id] = count - 1;
+        if (bounds.back() == 0 && bounds.size() > 1) {
+            bounds.pop_back();
+        }
+    }
+
+    uint32_t get(uint32_t id) const {
+        return id < counts.size() ? counts[id] : 0;
+    }
+
+    // До k объектов с наибольшими ненулевыми счетчиками
+    std::vector<RankedCount> top(size_t k) const {
+        std::vector<RankedCount> result;
+        size_t limit = std::min(k, static_cast<size_t>(bounds.size() > 1 ? bounds[1] : 0));
+        for (size_t i = 0; i < limit; i++) {
+            result.push_back(RankedCount{ order[i], counts[order[i]] });
+        }
+        return result;
+    }
+
+    size_t memory_usage() const {
+        return vector_bytes(counts) + vector_bytes(order) + vector_bytes(positions) + vector_bytes(bounds);
+    }
+
+    void clear() {
+        counts.clear();
+        order.clear();
+        positions.clear();
+        bounds.assign(1, 0);
+    }
+};
+
+// До k наибольших ненулевых значений массива (при равенстве - меньший номер)
+std::vector<RankedCount> top_counts(const std::vector<uint32_t>& counts, size_t k) {
+    std::vector<RankedCount> result;
+    for (uint32_t id = 0; id < counts.size(); id++) {
+        if (counts[id] > 0) {
+            result.push_back(RankedCount{ id, counts[id] });
+        }
+    }
+    auto higher = [](const RankedCount& a, const RankedCount& b) {
+        return a.count != b.count ? a.count > b.count : a.id < b.id;
+    };
+    if (result.size() > k) {
+        std::nth_element(result.begin(), result.begin() + k, result.end(), higher);
+        result.resize(k);
+    }
+    std::sort(result.begin(), result.end(), higher);
+    return result;
+}
+
+// Десятилетие года публикации (1999 -> 1990, -5 -> -10)
+int publication_decade(int year) {
+    return year - ((year % 10) + 10) % 10;
+}
+
+// Вызов fn(worker, from, to) для частей [0, count); при большом count части считаются в threads потоках
+template <typename Fn>
+void parallel_ranges(size_t count, unsigned threads, Fn fn) {
+    unsigned workers = count < ANALYTICS_PARALLEL_MIN_ITEMS ? 1 : std::max(1u, threads);
+    size_t per_worker = (count + workers - 1) / workers;
+    std::vector<std::thread> pool;
+    for (unsigned w = 1; w < workers; w++) {
+        size_t from = std::min(count, w * per_worker);
+        pool.emplace_back(fn, w, from, std::min(count, from + per_worker));
+    }
+    fn(0u, size_t(0), std::min(count, per_worker));
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
+
+// Класс LoanAnalytics - счетчики библиотеки для сводки без просмотра выдач
+class LoanAnalytics {
+    RankedCounter book_loans; // Все выдачи по ячейке книги
+    RankedCounter author_loans; // Все выдачи по позиции автора
+    RankedCounter reader_open_loans; // Открытые выдачи по ячейке читателя
+    std::map<int, uint32_t> decade_books; // Книги по десятилетию публикации
+
+public:
+    void add_author(uint32_t author) {
+        author_loans.grow(author);
+    }
+
+    void add_book(uint32_t book, int pub_year) {
+        book_loans.grow(book);
+        decade_books[publication_decade(pub_year)]++;
+    }
+
+    void add_reader(uint32_t reader) {
+        reader_open_loans.grow(reader);
+    }
+
+    // Учет выдачи; закрытая выдача (из снимка) не считается открытой у читателя
+    void loan_added(uint32_t book, uint32_t author, uint32_t reader, bool open) {
+        book_loans.increment(book);
+        if (author != NO_AUTHOR_ID) {
+            author_loans.increment(author);
+        }
+        if (open) {
+            reader_open_loans.increment(reader);
+        }
+    }
+
+    void loan_closed(uint32_t reader) {
+        reader_open_loans.decrement(reader);
+    }
+
+    std::vector<RankedCount> top_books(size_t k) const { return book_loans.top(k); }
+    std::vector<RankedCount> top_authors(size_t k) const { return author_loans.top(k); }
+    std::vector<RankedCount> top_readers(size_t k) const { return reader_open_loans.top(k); }
+    uint32_t loans_of_book(uint32_t book) const { return book_loans.get(book); }
+    uint32_t loans_of_author(uint32_t author) const { return author_loans.get(author); }
+    const std::map<int, uint32_t>& books_per_decade() const { return decade_books; }
+    size_t memory_usage() const {
+        return book_loans.memory_usage() + author_loans.memory_usage() + reader_open_loans.memory_usage() +
+            tree_bytes(decade_books);
+    }
+
+    void clear() {
+        book_loans.clear();
+        author_loans.clear();
+        reader_open_loans.clear();
+        decade_books.clear();
+    }
+};
+
+// Сводка по выдачам и фонду
+struct LibraryAnalytics {
+    std::vector<std::pair<std::shared_ptr<Author>, size_t>> top_authors; // Авторы с наибольшим числом выдач
+    std::vector<std::pair<BookRef, size_t>> top_books; // Самые выдаваемые книги
+    std::vector<std::pair<ReaderRef, size_t>> top_readers; // Читатели с наибольшим числом открытых выдач
+    std::map<int, size_t> books_per_decade; // Количество книг по десятилетию публикации
+};
+
+// ---------------------------------------------------------------------------
+// Составные запросы к каталогу
+// ---------------------------------------------------------------------------
+// Запрос - это дерево условий на поля, соединенных через И/ИЛИ. Перед
+// выполнением планировщик спрашивает у индексов, сколько кандидатов
+// дало бы каждое условие, и берет самый узкий источник. ISBN и номер
+// билета дают одну запись, название - диапазон индекса названий, ФИО -
+// хеш-индекс, дата выдачи - диапазон индекса дат. Условия на год и
+// экземпляры проверяются векторизованным проходом по колонкам книг.
+// ИЛИ использует индексы, только если они есть у всех ветвей. Если
+// индекса нет, просматриваются все записи. Кандидаты из индекса
+// запоминаются как дескрипторы, а все условия проверяются для каждого
+// кандидата в момент обхода, поэтому результат ленивый: записи не
+// копируются в вектор.
+
+enum QueryField {
+    QUERY_TITLE, // Название целиком (без учета регистра)
+    QUERY_TITLE_PREFIX, // Начало названия (без учета регистра)
+    QUERY_ISBN, // ISBN (ISBN-10 и ISBN-13 одной книги равнозначны)
+    QUERY_AUTHOR, // ФИО автора книги
+    QUERY_PUB_YEAR, // Год публикации в диапазоне
+    QUERY_COPIES, // Свободные экземпляры в диапазоне
+    QUERY_FIO, // ФИО читателя
+    QUERY_CARD, // Номер читательского билета
+    QUERY_ISSUE_DATE, // Дата выдачи в диапазоне
+    QUERY_RETURN_DATE, // Срок возврата в диапазоне
+    QUERY_OPEN // Выдача еще не возвращена
+};
+
+// Узел дерева запроса: условие на поле или И/ИЛИ над дочерними узлами
+struct QueryNode {
+    enum Kind { LEAF, ALL, ANY };
+
+    Kind kind;
+    QueryField field;
+    std::string text; // Ключ сортировки названия или ФИО
+    uint64_t isbn_key;
+    int64_t low; // Границы диапазона (включительно)
+    int64_t high;
+    std::vector<std::shared_ptr<const QueryNode>> children;
+
+    QueryNode(Kind kind, QueryField field) : kind(kind), field(field), isbn_key(NO_ISBN), low(0), high(0) {}
+};
+
+// Класс Query - составной запрос; условия соединяются операторами && и ||
+class Query {
+    std::shared_ptr<const QueryNode> root;
+
+    explicit Query(std::shared_ptr<const QueryNode> root) : root(std::move(root)) {}
+
+    static Query leaf(QueryField field, const std::string& text, int64_t low, int64_t high) {
+        auto node = std::make_shared<QueryNode>(QueryNode::LEAF, field);
+        node->text = text;
+        node->low = low;
+        node->high = high;
+        return Query(node);
+    }
+
+    // Соединение двух запросов; вложенные узлы того же вида раскрываются
+    static Query combine(QueryNode::Kind kind, const Query& a, const Query& b) {
+        auto node = std::make_shared<QueryNode>(kind, QUERY_OPEN);
+        for (const Query* part : { &a, &b }) {
+            if (part->root->kind == kind) {
+                node->children.insert(node->children.end(), part->root->children.begin(), part->root->children.end());
+            }
+            else {
+                node->children.push_back(part->root);
+            }
+        }
+        return Query(node);
+    }
+
+public:
+    static Query title(const std::string& title) {
+        return leaf(QUERY_TITLE, make_collation_key(title, true) + COLLATION_LEVEL_SEPARATOR, 0, 0);
+    }
+
+    static Query title_prefix(const std::string& prefix) {
+        return leaf(QUERY_TITLE_PREFIX, make_collation_key(prefix, true), 0, 0);
+    }
+
+    static Query isbn(const std::string& isbn) {
+        uint64_t key = NO_ISBN;
+        if (!parse_isbn(isbn, key)) {
+            throw std::invalid_argument("Некорректный ISBN: " + isbn);
+        }
+        auto node = std::make_shared<QueryNode>(QueryNode::LEAF, QUERY_ISBN);
+        node->isbn_key = key;
+        return Query(node);
+    }
+
+    static Query author(const std::string& fio) {
+        return leaf(QUERY_AUTHOR, fio, 0, 0);
+    }
+
+    static Query pub_year(int from, int to) {
+        return leaf(QUERY_PUB_YEAR, std::string(), from, to);
+    }
+
+    static Query copies(int min_copies, int max_copies = INT32_MAX) {
+        return leaf(QUERY_COPIES, std::string(), min_copies, max_copies);
+    }
+
+    static Query fio(const std::string& fio) {
+        return leaf(QUERY_FIO, fio, 0, 0);
+    }
+
+    static Query card(int card_number) {
+        return leaf(QUERY_CARD, std::string(), card_number, card_number);
+    }
+
+    static Query issued(const Date& from, const Date& to) {
+        return leaf(QUERY_ISSUE_DATE, std::string(), from.get_day_number(), to.get_day_number());
+    }
+
+    static Query due(const Date& from, const Date& to) {
+        return leaf(QUERY_RETURN_DATE, std::string(), from.get_day_number(), to.get_day_number());
+    }
+
+    static Query open() {
+        return leaf(QUERY_OPEN, std::string(), 0, 0);
+    }
+
+    const QueryNode& get_root() const {
+        return *root;
+    }
+
+    friend Query operator&&(const Query& a, const Query& b) {
+        return combine(QueryNode::ALL, a, b);
+    }
+
+    friend Query operator||(const Query& a, const Query& b) {
+        return combine(QueryNode::ANY, a, b);
+    }
+};
+
+// Сущность, по которой выполняется запрос
+enum QueryTarget {
+    QUERY_BOOKS, // Условия на поля книги
+    QUERY_READERS, // Условия на поля читателя
+    QUERY_LOANS // Условия на поля выдачи, а также ее книги и читателя
+};
+
+const size_t QUERY_COLUMN_SCAN_RATIO = 16; // Индекс выгоднее прохода по колонкам, если дает меньше 1/16 строк
+
+// Сущность, к которой относится поле запроса
+QueryTarget query_field_target(QueryField field) {
+    switch (field) {
+    case QUERY_FIO:
+    case QUERY_CARD:
+        return QUERY_READERS;
+    case QUERY_ISSUE_DATE:
+    case QUERY_RETURN_DATE:
+    case QUERY_OPEN:
+        return QUERY_LOANS;
+    default:
+        return QUERY_BOOKS;
+    }
+}
+
+// Проверка, что все поля запроса применимы к сущности target
+void check_query_fields(const QueryNode& node, QueryTarget target) {
+    if (node.kind != QueryNode::LEAF) {
+        for (const auto& child : node.children) {
+            check_query_fields(*child, target);
+        }
+        return;
+    }
+    QueryTarget field_target = query_field_target(node.field);
+    if (field_target != target && target != QUERY_LOANS) {
+        throw std::invalid_argument(target == QUERY_BOOKS ? "Условие не относится к книгам." : "Условие не относится к читателям.");
+    }
+}
+
+// Есть ли в запросе условие на поле field
+bool query_uses_field(const QueryNode& node, QueryField field) {
+    if (node.kind == QueryNode::LEAF) {
+        return node.field == field;
+    }
+    for (const auto& child : node.children) {
+        if (query_uses_field(*child, field)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Источник кандидатов, выбранный планировщиком
+struct QueryPlan {
+    std::string description; // Описание для вывода ("индекс ISBN", "полный просмотр", ...)
+    size_t estimate; // Оценка числа кандидатов
+    std::function<bool(SlabHandle&)> next; // Следующий кандидат (false, когда кандидаты кончились)
+    bool ordered = false; // Кандидаты уже идут в порядке результата
+};
+
+// Класс QueryResult - ленивый результат запроса. Кандидаты выбираются по
+// плану при создании, а проверяются по мере обхода. Записи идут в порядке
+// сортировки сущности: книги по названию, читатели по ФИО, выдачи по дате
+// выдачи (равные - в порядке создания), независимо от выбранного плана. Изменяемые поля
+// (экземпляры, сроки и открытость выдач) проверяются по состоянию на момент
+// создания, поэтому блокировки каталога и учета выдач при обходе не нужны:
+// библиотеку можно менять, в том числе из того же потока. Как и снимок для
+// чтения, результат держит только блокировку сброса. Обход однократный
+// (входной итератор).
+template <typename T>
+class QueryResult {
+    std::shared_lock<std::shared_timed_mutex> reset_lock; // Не дает очистить пулы, пока результат жив
+    const SlabPool<T>* pool;
+    QueryPlan plan;
+    std::function<bool(SlabHandle)> matches; // Проверка всех условий запроса
+
+    // Следующий кандидат, удовлетворяющий запросу
+    bool advance(SlabHandle& handle) {
+        while (plan.next(handle)) {
+            if (matches(handle)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
+    class iterator {
+        QueryResult* result; // nullptr - конец результата
+        SlabHandle current;
+
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef SlabRef<T> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const SlabRef<T>* pointer;
+        typedef SlabRef<T> reference;
+
+        explicit iterator(QueryResult* result) : result(result) {
+            ++*this;
+        }
+
+        iterator() : result(nullptr) {}
+
+        SlabRef<T> operator*() const {
+            return SlabRef<T>(result->pool, current);
+        }
+
+        iterator& operator++() {
+            if (result != nullptr && !result->advance(current)) {
+                result = nullptr;
+            }
+            return *this;
+        }
+
+        bool operator==(const iterator& other) const { return result == other.result; }
+        bool operator!=(const iterator& other) const { return result != other.result; }
+    };
+
+    QueryResult(std::shared_lock<std::shared_timed_mutex>&& reset_lock, const SlabPool<T>* pool,
+        QueryPlan&& plan, std::function<bool(SlabHandle)>&& matches)
+        : reset_lock(std::move(reset_lock)), pool(pool), plan(std::move(plan)), matches(std::move(matches)) {
+    }
+
+    QueryResult(QueryResult&&) = default;
+
+    iterator begin() { return iterator(this); }
+    iterator end() { return iterator(); }
+
+    const std::string& get_plan() const { return plan.description; }
+    size_t get_estimate() const { return plan.estimate; }
+
+    // Выборка оставшихся записей в вектор
+    std::vector<SlabRef<T>> to_vector() {
+        std::vector<SlabRef<T>> result;
+        for (SlabRef<T> item : *this) {
+            result.push_back(item);
+        }
+        return result;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Упорядоченные представления для постраничного вывода
+// ---------------------------------------------------------------------------
+// Представление держит упорядоченный вектор элементов и два небольших
+// буфера: добавленные и удаленные после последнего обращения. При чтении
+// буфер добавленных сортируется и сливается с вектором за O(n + m log m),
+// удаленные отбрасываются за один проход; полной пересортировки не бывает.
+// После слияния страница - это просто срез вектора. Слияние строит новый
+// вектор, а прежний остается у снимков для чтения, которые его разделяют
+// (копирование при записи): снимок получает упорядоченную часть за O(1).
+
+const size_t VIEW_MIN_MERGE = 4096; // Буферы меньше этого размера сливаются только при чтении
+
+template <typename Id, typename Less>
+class OrderedView {
+public:
+    typedef std::shared_ptr<const std::vector<Id>> Segment;
+
+    // Состояние представления на момент снятия: упорядоченная часть разделяется, буферы копируются
+    struct Capture {
+        Segment sorted;
+        std::vector<Id> pending;
+        std::vector<Id> removed;
+    };
+
+private:
+    Less less;
+    // Слияние выполняется при чтении, в том числе под разделяемой блокировкой каталога
+    mutable Segment sorted; // Упорядоченная часть (не меняется после создания)
+    mutable std::vector<Id> pending; // Добавленные после последнего слияния
+    mutable std::vector<Id> removed; // Удаленные после последнего слияния
+    mutable std::mutex mutex;
+
+    // Новая упорядоченная часть: sorted без removed, слитая с отсортированными pending
+    static Segment merged(const std::vector<Id>& sorted, std::vector<Id> pending, std::vector<Id> removed, const Less& less) {
+        std::vector<Id> result;
+        result.reserve(sorted.size() + pending.size());
+        std::sort(removed.begin(), removed.end());
+        auto is_removed = [&removed](Id id) { return std::binary_search(removed.begin(), removed.end(), id); };
+        std::remove_copy_if(sorted.begin(), sorted.end(), std::back_inserter(result), is_removed);
+        pending.erase(std::remove_if(pending.begin(), pending.end(), is_removed), pending.end());
+        std::sort(pending.begin(), pending.end(), less);
+        size_t middle = result.size();
+        result.insert(result.end(), pending.begin(), pending.end());
+        std::inplace_merge(result.begin(), result.begin() + middle, result.end(), less);
+        return std::make_shared<const std::vector<Id>>(std::move(result));
+    }
+
+    // Слияние буферов с упорядоченной частью (вызывается под mutex)
+    void merge_pending() const {
+        if (!pending.empty() || !removed.empty()) {
+            sorted = merged(*sorted, std::move(pending), std::move(removed), less);
+            pending.clear();
+            removed.clear();
+        }
+    }
+
+    // Слияние, если буферы сравнялись с упорядоченной частью: без чтений они
+    // не растут бесконечно, а стоимость слияния распределяется по вставкам
+    void merge_if_large() {
+        if (pending.size() + removed.size() > std::max<size_t>(sorted->size(), VIEW_MIN_MERGE)) {
+            merge_pending();
+        }
+    }
+
+public:
+    explicit OrderedView(const Less& less) : less(less), sorted(std::make_shared<const std::vector<Id>>()) {}
+
+    OrderedView(const OrderedView&) = delete;
+    OrderedView& operator=(const OrderedView&) = delete;
+
+    void insert(Id id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(id);
+        merge_if_large();
+    }
+
+    void erase(Id id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        removed.push_back(id);
+        merge_if_large();
+    }
+
+    // Элементы [offset, offset + count) в порядке представления; первая страница - top-K
+    std::vector<Id> range(size_t offset, size_t count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        merge_pending();
+        if (offset >= sorted->size()) {
+            return std::vector<Id>();
+        }
+        auto first = sorted->begin() + offset;
+        return std::vector<Id>(first, first + std::min(count, sorted->size() - offset));
+    }
+
+    // Количество элементов (с учетом еще не слитых буферов)
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        merge_pending();
+        return sorted->size();
+    }
+
+    // Снятие состояния без слияния: O(1) плюс копия небольших буферов
+    Capture capture() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return Capture{ sorted, pending, removed };
+    }
+
+    // Текущий порядок; буферы сливаются с упорядоченной частью, как при чтении страницы
+    Segment ordered() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        merge_pending();
+        return sorted;
+    }
+
+    // Упорядоченный список по снятому состоянию; вызывается без блокировок,
+    // поэтому less должен читать только неизменяемые поля
+    static Segment resolve(const Capture& capture, const Less& less) {
+        if (capture.pending.empty() && capture.removed.empty()) {
+            return capture.sorted;
+        }
+        return merged(*capture.sorted, capture.pending, capture.removed, less);
+    }
+
+    // Сборка с нуля из готового набора (например, после загрузки снимка)
+    void assign(const std::vector<Id>& items) {
+        std::lock_guard<std::mutex> lock(mutex);
+        sorted = std::make_shared<const std::vector<Id>>();
+        removed.clear();
+        pending = items;
+    }
+
+    // Сборка из набора, уже упорядоченного по less (например, из готового индекса снимка)
+    void assign_sorted(std::vector<Id> items) {
+        std::lock_guard<std::mutex> lock(mutex);
+        sorted = std::make_shared<const std::vector<Id>>(std::move(items));
+        pending.clear();
+        removed.clear();
+    }
+
+    // Оценка памяти упорядоченной части и буферов
+    size_t memory_usage() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return vector_bytes(*sorted) + vector_bytes(pending) + vector_bytes(removed);
+    }
+
+    void clear() {
+        assign(std::vector<Id>());
+    }
+};
+
+// Порядок объектов пула по их operator< (равные - в порядке добавления)
+template <typename T>
+struct PoolOrder {
+    const SlabPool<T>* pool;
+
+    bool operator()(SlabHandle a, SlabHandle b) const {
+        const T& first = *pool->get(a);
+        const T& second = *pool->get(b);
+        if (first < second) {
+            return true;
+        }
+        return !(second < first) && a.get_slot() < b.get_slot();
+    }
+};
+
+// Порядок авторов по ФИО (одинаковые - в порядке добавления)
+struct AuthorOrder {
+    const std::vector<std::shared_ptr<Author>>* authors;
+
+    bool operator()(uint32_t a, uint32_t b) const {
+        const Author& first = *(*authors)[a];
+        const Author& second = *(*authors)[b];
+        if (first < second) {
+            return true;
+        }
+        return !(second < first) && a < b;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Снимки каталога для чтения
+// ---------------------------------------------------------------------------
+// Снимок фиксирует каталог на момент создания. Его читают без блокировок
+// каталога и учета выдач, поэтому выгрузка отчета или пакетная аналитика
+// не задерживают выдачу и добавление книг. Пулы только дописываются, а
+// объекты в них не перемещаются, поэтому снимку достаточно запомнить
+// число занятых ячеек: записи, созданные позже, в него не попадают.
+// Упорядоченные представления снимок разделяет с библиотекой, а
+// изменяемые данные - колонку свободных экземпляров и колонку состояний
+// выдач - снимает с копированием при записи: копируются только указатели
+// на сегменты. Блокировки удерживаются только на время этих снятий.
+// Дальше снимок держит лишь блокировку сброса: пока он жив, загрузка
+// снимка с диска ждет и не очищает пулы.
+
+// Изменяемые поля выдачи (строка колонки - ячейка выдачи в пуле)
+struct LoanState {
+    Date return_date;
+    int32_t renew_count;
+    bool open;
+
+    LoanState() : renew_count(0), open(false) {}
+    explicit LoanState(const Loan& loan)
+        : return_date(loan.get_return_date()), renew_count(loan.get_renew_count()), open(!loan.is_returned()) {
+    }
+};
+
+// Изменяемые поля на момент создания результата запроса. Снимаются только
+// те, на которые в запросе есть условия
+struct QueryState {
+    ColumnSnapshot<int32_t> copies; // Свободные экземпляры по строке книги
+    ColumnSnapshot<LoanState> loans; // Состояния выдач по ячейке пула
+
+    // Состояние выдачи, открытой на момент снятия (nullptr, если она уже была закрыта)
+    const LoanState* open_loan(SlabHandle loan) const {
+        return loan.get_slot() < loans.size() && loans[loan.get_slot()].open ? &loans[loan.get_slot()] : nullptr;
+    }
+};
+
+class Library;
+
+// Класс ReadView - согласованный снимок каталога для чтения (создается Library::read_view)
+class ReadView {
+    std::shared_lock<std::shared_timed_mutex> reset_lock; // Не дает очистить пулы, пока снимок жив
+    const SlabPool<Book>* book_pool;
+    const SlabPool<Reader>* reader_pool;
+    const SlabPool<Loan>* loan_pool;
+    std::vector<std::shared_ptr<Author>> authors; // Позиции совпадают с позициями в библиотеке
+    OrderedView<uint32_t, AuthorOrder>::Segment author_order; // Авторы по ФИО
+    OrderedView<SlabHandle, PoolOrder<Book>>::Segment book_order; // Книги по названию
+    OrderedView<SlabHandle, PoolOrder<Reader>>::Segment reader_order; // Читатели по ФИО
+    OrderedView<SlabHandle, PoolOrder<Loan>>::Segment open_loan_order; // Открытые выдачи по дате выдачи
+    ColumnSnapshot<int32_t> copies; // Свободные экземпляры по строке книги
+    ColumnSnapshot<LoanState> loan_states; // Состояния выдач по ячейке пула
+    std::vector<uint32_t> reader_open_loans; // Число открытых выдач по ячейке читателя
+    size_t loan_count; // Все выдачи (открытые и закрытые) - ячейки пула [0, loan_count)
+    size_t closed_loans; // Закрытые выдачи
+
+    friend class Library;
+
+    ReadView(const SlabPool<Book>* book_pool, const SlabPool<Reader>* reader_pool, const SlabPool<Loan>* loan_pool)
+        : book_pool(book_pool), reader_pool(reader_pool), loan_pool(loan_pool), loan_count(0), closed_loans(0) {
+    }
+
+public:
+    ReadView(ReadView&&) = default;
+
+    size_t author_count() const { return authors.size(); }
+    size_t book_count() const { return copies.size(); }
+    size_t reader_count() const { return reader_open_loans.size(); }
+    size_t open_loan_count() const { return open_loan_order->size(); }
+    size_t closed_loan_count() const { return closed_loans; }
+    size_t total_loan_count() const { return loan_count; }
+
+    const std::vector<std::shared_ptr<Author>>& get_authors() const { return authors; }
+    const std::vector<uint32_t>& get_reader_open_loans() const { return reader_open_loans; }
+
+    // Авторы по ФИО
+    template <typename Fn>
+    void for_each_author(Fn fn) const {
+        for (uint32_t position : *author_order) {
+            fn(*authors[position]);
+        }
+    }
+
+    // Книги по названию: fn(книга, свободные экземпляры)
+    template <typename Fn>
+    void for_each_book(Fn fn) const {
+        for (SlabHandle book : *book_order) {
+            fn(*book_pool->get(book), copies[book.get_slot()]);
+        }
+    }
+
+    // Читатели по ФИО: fn(читатель, число открытых выдач)
+    template <typename Fn>
+    void for_each_reader(Fn fn) const {
+        for (SlabHandle reader : *reader_order) {
+            fn(*reader_pool->get(reader), static_cast<size_t>(reader_open_loans[reader.get_slot()]));
+        }
+    }
+
+    // Открытые выдачи по дате выдачи: fn(выдача, ее состояние, книга, читатель)
+    template <typename Fn>
+    void for_each_open_loan(Fn fn) const {
+        for (SlabHandle handle : *open_loan_order) {
+            const Loan& loan = *loan_pool->get(handle);
+            fn(loan, loan_states[handle.get_slot()], *book_pool->get(loan.get_book_handle()), *reader_pool->get(loan.get_reader_handle()));
+        }
+    }
+
+    // Все выдачи в порядке создания (только неизменяемые поля: номер, книга, читатель, дата выдачи)
+    template <typename Fn>
+    void for_each_loan(size_t from, size_t to, Fn fn) const {
+        for (size_t slot = from; slot < std::min(to, loan_count); slot++) {
+            fn(*loan_pool->get(loan_pool->handle_at(static_cast<uint32_t>(slot))));
+        }
+    }
+
+    // Книга по строке (строки совпадают с ячейками пула)
+    const Book& book_at(size_t row) const {
+        return *book_pool->get(book_pool->handle_at(static_cast<uint32_t>(row)));
+    }
+
+    int copies_at(size_t row) const {
+        return copies[row];
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Выгрузка отчетов
+// ---------------------------------------------------------------------------
+// Записи каталога выводятся в текстовом виде (как в print_Library), в CSV
+// или в JSON Lines через один большой буфер: числа и даты форматируются
+// прямо в буфер без printf и временных строк, а в файл или stdout буфер
+// сбрасывается крупными блоками. Столбцы CSV совпадают со столбцами
+// импорта, поэтому выгрузку авторов, книг и читателей можно загрузить обратно.
+
+enum ReportFormat {
+    REPORT_TEXT,
+    REPORT_CSV,
+    REPORT_JSONL
+};
+
+enum ReportEntity {
+    REPORT_AUTHORS,
+    REPORT_BOOKS,
+    REPORT_READERS,
+    REPORT_LOANS,
+    REPORT_OPERATIONS, // Счетчики и задержки операций
+    REPORT_MEMORY // Память сущностей и индексов
+};
+
+// Имена сущностей и форматов отчета в запросах сервера и трассах (в порядке перечислений)
+const char* const REPORT_ENTITY_NAMES[] = { "authors", "books", "readers", "loans", "operations", "memory" };
+const char* const REPORT_FORMAT_NAMES[] = { "text", "csv", "jsonl" };
+
+const size_t REPORT_BUFFER_SIZE = 1 << 20; // Размер буфера вывода (1 МБ)
+
+// Класс OutputBuffer - буфер вывода с форматированием чисел без выделения памяти
+class OutputBuffer {
+    FILE* out;
+    std::vector<char> buffer;
+    size_t used;
+    bool failed; // Была ошибка записи
+    uint64_t written; // Байт передано в файл
+
+public:
+    explicit OutputBuffer(FILE* out, size_t capacity = REPORT_BUFFER_SIZE)
+        : out(out), buffer(capacity), used(0), failed(false), written(0) {
+    }
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    ~OutputBuffer() {
+        flush();
+    }
+
+    void write(const char* data, size_t length) {
+        if (length > buffer.size() - used) {
+            flush();
+            if (length > buffer.size()) { // Длинный блок пишется напрямую
+                failed = failed || fwrite(data, 1, length, out) != length;
+                written += length;
+                return;
+            }
+        }
+        std::memcpy(buffer.data() + used, data, length);
+        used += length;
+    }
+
+    void write(const std::string& text) {
+        write(text.data(), text.size());
+    }
+
+    void write(const char* text) {
+        write(text, std::strlen(text));
+    }
+
+    void put(char c) {
+        if (used == buffer.size()) {
+            flush();
+        }
+        buffer[used++] = c;
+    }
+
+    // Целое число в десятичной записи
+    void write_int(int64_t value) {
+        char digits[24];
+        char* end = digits + sizeof(digits);
+        char* p = end;
+        uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+        do {
+            *--p = static_cast<char>('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude != 0);
+        if (value < 0) {
+            *--p = '-';
+        }
+        write(p, static_cast<size_t>(end - p));
+    }
+
+    // Дата в виде дд.мм.гггг
+    void write_date(const Date& date) {
+        int year, month, day;
+        date.to_ymd(year, month, day);
+        char text[10] = {
+            static_cast<char>('0' + day / 10), static_cast<char>('0' + day % 10), '.',
+            static_cast<char>('0' + month / 10), static_cast<char>('0' + month % 10), '.',
+            static_cast<char>('0' + year / 1000 % 10), static_cast<char>('0' + year / 100 % 10),
+            static_cast<char>('0' + year / 10 % 10), static_cast<char>('0' + year % 10)
+        };
+        write(text, sizeof(text));
+    }
+
+    // Сброс буфера в файл; false, если запись не удалась
+    bool flush() {
+        if (used > 0) {
+            failed = failed || fwrite(buffer.data(), 1, used, out) != used;
+            written += used;
+            used = 0;
+        }
+        return !failed && fflush(out) == 0;
+    }
+
+    bool ok() const { return !failed; }
+    uint64_t bytes_written() const { return written + used; }
+};
+
+// Столбец отчета
+struct ReportColumn {
+    const char* name; // Заголовок CSV и ключ JSON
+    const char* label; // Подпись в текстовом виде (вместе с разделителем)
+};
+
+const ReportColumn AUTHOR_COLUMNS[] = {
+    { "fio", "ФИО автора: " }, { "birth_year", "Год рождения автора: " },
+    { "most_famous_work", "Самое известное произведение: " }, { "awards_count", "Количество наград: " }
+};
+const ReportColumn BOOK_COLUMNS[] = {
+    { "title", "Книга: " }, { "isbn", "ISBN: " }, { "author", "Автор: " },
+    { "pub_year", "Год публикации: " }, { "copies", "Экземпляров: " }
+};
+const ReportColumn READER_COLUMNS[] = {
+    { "fio", "Читатель: " }, { "card_number", "Номер билета: " }, { "borrowed", "Взято книг: " }
+};
+const ReportColumn LOAN_COLUMNS[] = {
+    { "id", "Выдача книги №" }, { "title", "Книга: " }, { "isbn", "ISBN: " }, { "reader", "Читатель: " },
+    { "card_number", "Номер билета: " }, { "issue_date", "Дата выдачи: " }, { "return_date", "Дата возврата: " },
+    { "renew_count", "Продлений: " }, { "returned_on", "Возвращена: " }
+};
+const ReportColumn OPERATION_COLUMNS[] = {
+    { "operation", "Операция: " }, { "count", "Вызовов: " }, { "total_ns", "Всего, нс: " }, { "mean_ns", "Среднее, нс: " },
+    { "p50_ns", "p50, нс: " }, { "p90_ns", "p90, нс: " }, { "p99_ns", "p99, нс: " }, { "p999_ns", "p99.9, нс: " },
+    { "max_ns", "Максимум, нс: " }
+};
+const ReportColumn MEMORY_COLUMNS[] = {
+    { "structure", "Структура: " }, { "items", "Записей: " }, { "bytes", "Байт: " }
+};
+
+// Класс ReportWriter - вывод записей в выбранном формате.
+// Поля записи передаются по порядку столбцов; поле с shown = false в
+// текстовом виде не выводится (CSV и JSON получают его всегда), а
+// missing() - отсутствующее значение (пусто в CSV, null в JSON).
+class ReportWriter {
+    OutputBuffer& out;
+    ReportFormat format;
+    const ReportColumn* columns;
+    size_t column_count;
+    size_t column; // Номер следующего поля записи
+
+    // Начало поля: разделитель и имя или подпись
+    void open_field(bool shown) {
+        const ReportColumn& current = columns[column];
+        switch (format) {
+        case REPORT_TEXT:
+            if (shown) {
+                out.write(current.label);
+            }
+            break;
+        case REPORT_CSV:
+            if (column > 0) {
+                out.put(',');
+            }
+            break;
+        case REPORT_JSONL:
+            out.write(column > 0 ? ",\"" : "{\"");
+            out.write(current.name);
+            out.write("\":");
+            break;
+        }
+    }
+
+    void close_field(bool shown) {
+        if (format == REPORT_TEXT && shown) {
+            out.put('\n');
+        }
+        column++;
+    }
+
+    void write_csv_string(const std::string& value) {
+        if (value.find_first_of(",\"\r\n") == std::string::npos) {
+            out.write(value);
+            return;
+        }
+        out.put('"');
+        for (char c : value) {
+            if (c == '"') {
+                out.put('"'); // Кавычка внутри поля удваивается
+            }
+            out.put(c);
+        }
+        out.put('"');
+    }
+
+    void write_json_string(const std::string& value) {
+        static const char hex[] = "0123456789abcdef";
+        out.put('"');
+        size_t plain = 0; // Начало еще не выведенного участка без экранирования
+        for (size_t i = 0; i < value.size(); i++) {
+            unsigned char c = static_cast<unsigned char>(value[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') {
+                continue;
+            }
+            out.write(value.data() + plain, i - plain);
+            plain = i + 1;
+            if (c == '"' || c == '\\') {
+                out.put('\\');
+                out.put(static_cast<char>(c));
+            }
+            else {
+                char escaped[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+                out.write(escaped, sizeof(escaped));
+            }
+        }
+        out.write(value.data() + plain, value.size() - plain);
+        out.put('"');
+    }
+
+public:
+    ReportWriter(OutputBuffer& out, ReportFormat format)
+        : out(out), format(format), columns(nullptr), column_count(0), column(0) {
+    }
+
+    // Начало таблицы: для CSV выводится строка заголовка
+    template <size_t N>
+    void begin_table(const ReportColumn (&table)[N]) {
+        columns = table;
+        column_count = N;
+        if (format == REPORT_CSV) {
+            for (size_t i = 0; i < N; i++) {
+                if (i > 0) {
+                    out.put(',');
+                }
+                out.write(table[i].name);
+            }
+            out.put('\n');
+        }
+    }
+
+    void begin_record() {
+        column = 0;
+    }
+
+    void end_record() {
+        switch (format) {
+        case REPORT_TEXT:
+            out.put('\n'); // Пустая строка между записями
+            break;
+        case REPORT_CSV:
+            out.put('\n');
+            break;
+        case REPORT_JSONL:
+            out.write("}\n");
+            break;
+        }
+    }
+
+    void string(const std::string& value, bool shown = true) {
+        open_field(shown);
+        if (format == REPORT_CSV) {
+            write_csv_string(value);
+        }
+        else if (format == REPORT_JSONL) {
+            write_json_string(value);
+        }
+        else if (shown) {
+            out.write(value);
+        }
+        close_field(shown);
+    }
+
+    void number(int64_t value, bool shown = true) {
+        open_field(shown);
+        if (format != REPORT_TEXT || shown) {
+            out.write_int(value);
+        }
+        close_field(shown);
+    }
+
+    void date(const Date& value, bool shown = true) {
+        open_field(shown);
+        if (format == REPORT_JSONL) {
+            out.put('"');
+            out.write_date(value);
+            out.put('"');
+        }
+        else if (format == REPORT_CSV || shown) {
+            out.write_date(value);
+        }
+        close_field(shown);
+    }
+
+    void missing() {
+        open_field(false);
+        if (format == REPORT_JSONL) {
+            out.write("null");
+        }
+        close_field(false);
+    }
+};
+
+// Запись автора (AUTHOR_COLUMNS)
+void report_author(ReportWriter& writer, const Author& author) {
+    auto famous = dynamic_cast<const FamousAuthor*>(&author);
+    writer.begin_record();
+    writer.string(author.get_fio());
+    writer.number(author.get_birth_year());
+    writer.string(famous ? famous->get_most_famous_work() : std::string(), famous != nullptr);
+    writer.number(famous ? famous->get_awards_count() : 0, famous != nullptr);
+    writer.end_record();
+}
+
+// Запись книги (BOOK_COLUMNS); свободные экземпляры берутся из снимка
+void report_book(ReportWriter& writer, const Book& book, int copies) {
+    static const std::string no_author;
+    writer.begin_record();
+    writer.string(book.get_title());
+    writer.string(book.get_isbn());
+    writer.string(book.get_author() ? book.get_author()->get_fio() : no_author);
+    writer.number(book.get_pub_year());
+    writer.number(copies);
+    writer.end_record();
+}
+
+// Запись читателя (READER_COLUMNS); число открытых выдач берется из снимка
+void report_reader(ReportWriter& writer, const Reader& reader, size_t open_loans) {
+    writer.begin_record();
+    writer.string(reader.get_fio());
+    writer.number(reader.get_card_number());
+    writer.number(static_cast<int64_t>(open_loans));
+    writer.end_record();
+}
+
+// Запись открытой выдачи (LOAN_COLUMNS); срок и продления берутся из снимка
+void report_loan(ReportWriter& writer, const Loan& loan, const LoanState& state, const Book& book, const Reader& reader) {
+    writer.begin_record();
+    writer.number(static_cast<int64_t>(loan.get_id()));
+    writer.string(book.get_title());
+    writer.string(book.get_isbn(), false);
+    writer.string(reader.get_fio());
+    writer.number(reader.get_card_number(), false);
+    writer.date(loan.get_issue_date());
+    writer.date(state.return_date);
+    writer.number(state.renew_count, state.renew_count > 0);
+    writer.missing(); // На момент снимка выдача открыта
+    writer.end_record();
+}
+
+// Запись сводки по операции (OPERATION_COLUMNS)
+void report_operation(ReportWriter& writer, const OperationStats& stats) {
+    writer.begin_record();
+    writer.string(OPERATION_NAMES[stats.operation]);
+    writer.number(static_cast<int64_t>(stats.count));
+    writer.number(static_cast<int64_t>(stats.total_ns));
+    writer.number(static_cast<int64_t>(stats.total_ns / stats.count));
+    writer.number(static_cast<int64_t>(stats.p50_ns));
+    writer.number(static_cast<int64_t>(stats.p90_ns));
+    writer.number(static_cast<int64_t>(stats.p99_ns));
+    writer.number(static_cast<int64_t>(stats.p999_ns));
+    writer.number(static_cast<int64_t>(stats.max_ns));
+    writer.end_record();
+}
+
+// Запись оценки памяти структуры (MEMORY_COLUMNS)
+void report_memory(ReportWriter& writer, const MemoryStats& stats) {
+    writer.begin_record();
+    writer.string(stats.name);
+    writer.number(static_cast<int64_t>(stats.items));
+    writer.number(static_cast<int64_t>(stats.bytes));
+    writer.end_record();
+}
+
+// Вывод таблицы отчета по снимку в порядке сортировки
+void write_report(const ReadView& view, ReportWriter& writer, ReportEntity entity) {
+    switch (entity) {
+    case REPORT_AUTHORS:
+        writer.begin_table(AUTHOR_COLUMNS);
+        view.for_each_author([&writer](const Author& author) { report_author(writer, author); });
+        break;
+    case REPORT_BOOKS:
+        writer.begin_table(BOOK_COLUMNS);
+        view.for_each_book([&writer](const Book& book, int copies) { report_book(writer, book, copies); });
+        break;
+    case REPORT_READERS:
+        writer.begin_table(READER_COLUMNS);
+        view.for_each_reader([&writer](const Reader& reader, size_t open_loans) { report_reader(writer, reader, open_loans); });
+        break;
+    case REPORT_LOANS:
+        writer.begin_table(LOAN_COLUMNS);
+        view.for_each_open_loan([&writer](const Loan& loan, const LoanState& state, const Book& book, const Reader& reader) {
+            report_loan(writer, loan, state, book, reader);
+        });
+        break;
+    case REPORT_OPERATIONS:
+    case REPORT_MEMORY:
+        break; // Не зависят от снимка (выводятся в Library::export_report)
+    }
+}
+
+// Результат выдачи книги
+enum CheckoutResult {
+    CHECKOUT_OK,
+    CHECKOUT_NO_BOOK, // Книга не найдена
+    CHECKOUT_NO_READER, // Читатель не найден
+    CHECKOUT_NO_COPIES, // Нет свободных экземпляров
+    CHECKOUT_BAD_DATES // Дата возврата раньше даты выдачи
+};
+
+// ---------------------------------------------------------------------------
+// Запись сеанса
+// ---------------------------------------------------------------------------
+// Сеанс меню можно записать в трассу: по строке на логическую операцию,
+// "смещение в микросекундах от начала<TAB>запрос". Запросы записываются на
+// языке сервера запросов (см. RequestHandler), поэтому трассу можно
+// воспроизвести тем же обработчиком без диалога меню.
+
+// Строка запроса из полей: поля через табуляцию, табуляции и переводы строк внутри полей - пробелы
+std::string make_request_line(std::initializer_list<std::string> fields) {
+    std::string line;
+    for (const std::string& field : fields) {
+        if (!line.empty()) {
+            line += '\t';
+        }
+        size_t start = line.size();
+        line += field;
+        std::replace_if(line.begin() + start, line.end(), [](char c) { return c == '\t' || c == '\n' || c == '\r'; }, ' ');
+    }
+    return line;
+}
+
+// Класс SessionRecorder - запись трассы сеанса в файл (каждая строка сбрасывается сразу)
+class SessionRecorder {
+    FILE* file;
+    std::chrono::steady_clock::time_point start;
+    std::mutex mutex;
+    size_t count; // Записано операций
+
+public:
+    explicit SessionRecorder(const std::string& path)
+        : file(fopen(path.c_str(), "wb")), start(std::chrono::steady_clock::now()), count(0) {
+        if (!file) {
+            throw std::runtime_error("Не удалось создать файл трассы " + path);
+        }
+    }
+
+    SessionRecorder(const SessionRecorder&) = delete;
+    SessionRecorder& operator=(const SessionRecorder&) = delete;
+
+    ~SessionRecorder() {
+        fclose(file);
+    }
+
+    void record(std::initializer_list<std::string> fields) {
+        std::string line = make_request_line(fields);
+        std::lock_guard<std::mutex> lock(mutex);
+        long long offset = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        fprintf(file, "%lld\t%s\n", offset, line.c_str());
+        fflush(file); // Трасса сохраняется, даже если сеанс прервется
+        count++;
+    }
+
+    size_t size() const {
+        return count;
+    }
+};
+
+// Количество сегментов индексов выдач и блокировок списков выдач читателей
+const size_t LOAN_INDEX_SHARDS = 16;
+const size_t READER_LOCK_STRIPES = 64;
+
+// Сегмент индексов выдач со своей блокировкой (выдача попадает в сегмент по номеру)
+struct LoanIndexShard {
+    std::mutex mutex;
+    std::unordered_map<uint64_t, SlabHandle> by_id; // Открытые выдачи по номеру
+    std::unordered_set<uint64_t> closing; // Открытые выдачи, которые уже закрывает какой-то поток
+    std::multimap<Date, SlabHandle> by_date; // Все выдачи сегмента по дате выдачи
+};
+
+// Класс CatalogMutex - блокировка состава каталога, которая достраивает
+// каталог, открытый из снимка без разбора (Library::build_mapped_catalog):
+// любой захват сначала один раз выполняет build под монопольной блокировкой.
+// Поиск прямо по отображенному снимку берет lock_shared_mapped, а замена
+// каталога целиком - lock_discarding: им достраивать каталог не нужно.
+class CatalogMutex {
+    std::shared_timed_mutex mutex;
+    std::atomic<bool> pending; // Каталог открыт из снимка и еще не достроен
+    std::function<void()> build; // Достраивание (под монопольной блокировкой; при успехе снимает pending)
+
+public:
+    explicit CatalogMutex(std::function<void()> build) : pending(false), build(std::move(build)) {}
+
+    void lock() {
+        mutex.lock();
+        if (pending.load(std::memory_order_relaxed)) {
+            try {
+                build();
+            }
+            catch (...) {
+                mutex.unlock();
+                throw;
+            }
+        }
+    }
+
+    void unlock() {
+        mutex.unlock();
+    }
+
+    void lock_shared() {
+        mutex.lock_shared();
+        while (pending.load(std::memory_order_acquire)) {
+            mutex.unlock_shared();
+            lock(); // Достраивает первый поток, остальные ждут его на монопольной блокировке
+            unlock();
+            mutex.lock_shared();
+        }
+    }
+
+    void unlock_shared() {
+        mutex.unlock_shared();
+    }
+
+    // Разделяемая блокировка без достраивания (для поиска по отображенному снимку)
+    void lock_shared_mapped() {
+        mutex.lock_shared();
+    }
+
+    // Монопольная блокировка без достраивания (каталог будет заменен целиком)
+    void lock_discarding() {
+        mutex.lock();
+    }
+
+    // Каталог еще не достроен (вызывается под блокировкой)
+    bool is_pending() const {
+        return pending.load(std::memory_order_relaxed);
+    }
+
+    // Отметка, что каталог нужно (или уже не нужно) достроить; вызывается под монопольной блокировкой
+    void set_pending(bool value) {
+        pending.store(value, std::memory_order_release);
+    }
+};
+
+// Класс Library - основной класс библиотеки.
+// Потокобезопасность: catalog_mutex берется монопольно при изменении состава
+// каталога (добавление, импорт, загрузка, контрольная точка) и разделяемо при
+// поиске, выдаче и возврате. Экземпляры резервируются атомарно в Book.
+// loan_mutex защищает только общий учет выдач (векторы выдач, очередь
+// сроков, счетчики, колонку экземпляров) и порядок записей в журнале.
+// Списки открытых выдач читателей защищены блокировками по ячейке читателя,
+// а индексы выдач по номеру и дате разбиты на сегменты со своими
+// блокировками. Порядок захвата: loan_mutex, читатель, сегмент индекса.
+// reset_mutex берется раньше catalog_mutex: снимки для чтения и результаты
+// запросов держат его разделяемо, а загрузка каталога - монопольно, поэтому
+// поток, у которого жив снимок, может менять библиотеку.
+// Выдача становится видна по номеру последней (после списка читателя), а
+// закрывает ее тот поток, который первым отметил ее в сегменте как
+// закрываемую; из индекса открытых выдач она уходит уже после попадания в историю.
+// Книги, читатели и выдачи живут в пулах библиотеки; внутри все связи и
+// индексы хранят 4-байтовые дескрипторы, а наружу выдаются SlabRef.
+class Library {
+    SlabPool<Book> book_pool; // Книги (ячейка пула совпадает со строкой book_columns)
+    SlabPool<Reader> reader_pool; // Читатели
+    SlabPool<Loan> loan_pool; // Выдачи (открытые и закрытые)
+    std::vector<std::shared_ptr<Author>> authors; // Вектор авторов
+    std::vector<SlabHandle> books; // Вектор книг
+    std::vector<SlabHandle> readers; // Вектор читателей
+    std::vector<SlabHandle> loans; // Вектор открытых выдач (удаление за O(1))
+    std::vector<SlabHandle> loan_history; // Закрытые выдачи в порядке возврата
+    std::unordered_map<uint64_t, SlabHandle> loan_history_index; // Закрытые выдачи по номеру
+    CowColumn<LoanState> loan_states; // Изменяемые поля выдач по ячейке пула (для снимков; под loan_mutex)
+    IsbnIndex isbn_index; // Индекс книг по нормализованному ISBN (повторы отклоняются)
+    std::multimap<std::string, SlabHandle> title_index; // Индекс книг по ключу сортировки названия (допускает одинаковые названия)
+    std::unordered_map<int, SlabHandle> reader_card_index; // Хеш-индекс читателей по номеру билета (уникальный)
+    std::unordered_multimap<std::string, SlabHandle> reader_fio_index; // Хеш-индекс читателей по ФИО
+    std::unordered_map<const Author*, uint32_t> author_positions; // Позиция автора в authors (для журнала)
+    BookColumns book_columns; // Колоночная копия данных книг для быстрых фильтров
+    AuthorDirectory author_directory; // Авторы по ФИО и книги каждого автора
+    FuzzySearchIndex search_index; // Триграммный индекс названий и ФИО авторов
+    OverdueTracker overdue; // Очередь сроков возврата и просроченные выдачи
+    LoanAnalytics analytics; // Счетчики выдач для сводки
+    OrderedView<uint32_t, AuthorOrder> authors_by_fio; // Авторы по ФИО
+    OrderedView<SlabHandle, PoolOrder<Book>> books_by_title; // Книги по названию
+    OrderedView<SlabHandle, PoolOrder<Reader>> readers_by_fio; // Читатели по ФИО
+    OrderedView<SlabHandle, PoolOrder<Loan>> open_loans_by_date; // Открытые выдачи по дате выдачи
+    mutable CatalogMutex catalog_mutex; // Блокировка состава каталога (достраивает каталог из снимка)
+    mutable std::mutex loan_mutex; // Блокировка общего учета выдач
+    mutable std::mutex reader_locks[READER_LOCK_STRIPES]; // Блокировки списков открытых выдач читателей
+    mutable LoanIndexShard loan_shards[LOAN_INDEX_SHARDS]; // Индексы выдач по номеру и дате
+    mutable std::shared_timed_mutex reset_mutex; // Разделяемая у живых снимков для чтения, монопольная при очистке пулов
+    std::unique_ptr<Journal> journal; // Журнал изменений (если хранилище открыто)
+    std::string snapshot_path; // Файл снимка для контрольных точек
+    std::unique_ptr<CatalogSnapshot> mapped_snapshot; // Снимок, из которого каталог еще не достроен
+    std::vector<std::shared_ptr<Author>> mapped_authors; // Авторы, уже созданные из mapped_snapshot (по номеру записи)
+    std::mutex mapped_mutex; // Создание авторов из снимка под разделяемой блокировкой
+    std::string storage_failure; // Причина отказа в изменениях (каталог не сохранен в хранилище)
+    uint64_t last_lsn; // Номер последней примененной записи журнала
+    uint64_t first_loan_id; // Номер первой выдачи
+    uint64_t loan_id_step; // Шаг номеров выдач (у шардов номера чередуются)
+    uint64_t next_loan_id; // Номер следующей выдачи
+    SessionRecorder* recorder; // Запись операций меню в трассу (если включена)
+
+    // Объекты по дескрипторам (дескриптор должен быть действительным)
+    Book& get_book(SlabHandle handle) const { return *book_pool.get(handle); }
+    Reader& get_reader(SlabHandle handle) const { return *reader_pool.get(handle); }
+    Loan& get_loan(SlabHandle handle) const { return *loan_pool.get(handle); }
+
+    // Ссылки для внешнего кода
+    BookRef book_ref(SlabHandle handle) const { return BookRef(&book_pool, handle); }
+    ReaderRef reader_ref(SlabHandle handle) const { return ReaderRef(&reader_pool, handle); }
+    LoanRef loan_ref(SlabHandle handle) const { return LoanRef(&loan_pool, handle); }
+
+    // Преобразование дескрипторов в ссылки
+    template <typename T>
+    static std::vector<SlabRef<T>> make_refs(const SlabPool<T>& pool, const std::vector<SlabHandle>& handles) {
+        std::vector<SlabRef<T>> result;
+        result.reserve(handles.size());
+        for (SlabHandle handle : handles) {
+            result.push_back(SlabRef<T>(&pool, handle));
+        }
+        return result;
+    }
+
+    // Авторы по позициям
+    std::vector<std::shared_ptr<Author>> authors_at(const std::vector<uint32_t>& positions) const {
+        std::vector<std::shared_ptr<Author>> result;
+        result.reserve(positions.size());
+        for (uint32_t position : positions) {
+            result.push_back(authors[position]);
+        }
+        return result;
+    }
+
+    // Регистрация автора без представления по ФИО и триграмм (их заполняет вызывающий)
+    uint32_t register_author(const std::shared_ptr<Author>& author) {
+        uint32_t position = static_cast<uint32_t>(authors.size());
+        author_positions[author.get()] = position;
+        authors.push_back(author);
+        author_directory.add_author(position, *author);
+        analytics.add_author(position);
+        return position;
+    }
+
+    // Регистрация автора
+    void insert_author(const std::shared_ptr<Author>& author) {
+        uint32_t position = register_author(author);
+        authors_by_fio.insert(position);
+        search_index.add_author(position, author->get_fio());
+    }
+
+    // Перестроение индекса названий по вектору books за один проход
+    void rebuild_title_index() {
+        std::vector<SlabHandle> ordered(books);
+        std::stable_sort(ordered.begin(), ordered.end(),
+            [this](SlabHandle a, SlabHandle b) {
+                return get_book(a).get_title_key() < get_book(b).get_title_key();
+            });
+        title_index.clear();
+        for (SlabHandle book : ordered) {
+            title_index.emplace_hint(title_index.end(), get_book(book).get_title_key(), book); // Вставка в конец - O(1)
+        }
+    }
+
+    // Создание книги в пуле, вектор и колоночное хранилище (без упорядоченных индексов)
+    template <typename... Args>
+    SlabHandle append_book(Args&&... args) {
+        SlabHandle handle = book_pool.create(std::forward<Args>(args)...);
+        const Book& book = get_book(handle);
+        books.push_back(handle);
+        books_by_title.insert(handle);
+        auto it = author_positions.find(book.get_author().get());
+        uint32_t author = it != author_positions.end() ? it->second : NO_AUTHOR_ID;
+        book_columns.append(book, author);
+        author_directory.add_book(handle.get_slot(), author);
+        search_index.add_book(handle.get_slot(), book.get_title());
+        analytics.add_book(handle.get_slot(), book.get_pub_year());
+        return handle;
+    }
+
+    // Регистрация книги в векторе и индексах (пустой дескриптор, если ISBN уже занят)
+    template <typename... Args>
+    SlabHandle insert_book(uint64_t isbn_key, Args&&... args) {
+        if (isbn_index.find(isbn_key).is_valid()) {
+            return SlabHandle();
+        }
+        SlabHandle handle = append_book(std::forward<Args>(args)...);
+        isbn_index.insert(isbn_key, handle);
+        title_index.emplace(get_book(handle).get_title_key(), handle); // Название после добавления не меняется
+        return handle;
+    }
+
+    // Регистрация читателя в пуле и индексах (пустой дескриптор, если номер билета занят)
+    SlabHandle insert_reader(const std::string& fio, int card_number) {
+        if (reader_card_index.count(card_number) != 0) {
+            return SlabHandle();
+        }
+        SlabHandle handle = reader_pool.create(fio, card_number);
+        readers.push_back(handle);
+        readers_by_fio.insert(handle);
+        reader_card_index[card_number] = handle;
+        reader_fio_index.emplace(fio, handle);
+        analytics.add_reader(handle.get_slot());
+        return handle;
+    }
+
+    // Сегмент индексов выдач по номеру выдачи
+    LoanIndexShard& loan_shard(uint64_t loan_id) const {
+        return loan_shards[(loan_id / loan_id_step) % LOAN_INDEX_SHARDS];
+    }
+
+    // Блокировка списка открытых выдач читателя
+    std::mutex& reader_lock(SlabHandle reader) const {
+        return reader_locks[reader.get_slot() % READER_LOCK_STRIPES];
+    }
+
+    // Регистрация выдачи из снимка без индекса дат и представления открытых
+    // выдач (их заполняет вызывающий); вызывается под монопольной блокировкой
+    void register_loan(SlabHandle handle) {
+        Loan& loan = get_loan(handle);
+        loan_states.set(handle.get_slot(), LoanState(loan));
+        analytics.loan_added(loan.book.get_slot(), book_columns.get_author_id(loan.book.get_slot()),
+            loan.reader.get_slot(), !loan.is_returned());
+        if (loan.is_returned()) {
+            loan_history.push_back(handle);
+            loan_history_index.emplace(loan.get_id(), handle);
+            return;
+        }
+        loan.library_slot = static_cast<uint32_t>(loans.size());
+        loans.push_back(handle);
+        overdue.track(handle);
+        loan.reader_slot = get_reader(loan.reader).attach_loan(handle);
+        loan_shard(loan.get_id()).by_id.emplace(loan.get_id(), handle);
+    }
+
+    // Учет новой открытой выдачи; вызывается под loan_mutex
+    void add_open_loan_unlocked(SlabHandle handle) {
+        Loan& loan = get_loan(handle);
+        analytics.loan_added(loan.book.get_slot(), book_columns.get_author_id(loan.book.get_slot()), loan.reader.get_slot(), true);
+        loan.library_slot = static_cast<uint32_t>(loans.size());
+        loans.push_back(handle);
+        open_loans_by_date.insert(handle);
+        loan_states.set(handle.get_slot(), LoanState(loan));
+        overdue.track(handle);
+        book_columns.set_copies(loan.book.get_slot(), book_columns.get_copies(loan.book.get_slot()) - 1);
+    }
+
+    // Публикация открытой выдачи: сначала в списке читателя, затем в индексах.
+    // Блокировка читателя удерживается до появления в индексе по номеру,
+    // поэтому у выдачи, найденной по номеру, позиция в списке уже известна
+    void publish_loan(SlabHandle handle) {
+        Loan& loan = get_loan(handle);
+        std::lock_guard<std::mutex> reader_guard(reader_lock(loan.reader));
+        loan.reader_slot = get_reader(loan.reader).attach_loan(handle);
+        LoanIndexShard& shard = loan_shard(loan.get_id());
+        std::lock_guard<std::mutex> shard_guard(shard.mutex);
+        shard.by_id.emplace(loan.get_id(), handle);
+        shard.by_date.emplace_hint(shard.by_date.end(), loan.get_issue_date(), handle); // Новые выдачи обычно самые поздние
+    }
+
+    // Открытая выдача по номеру (пустой дескриптор, если ее нет)
+    SlabHandle find_open_loan(uint64_t loan_id) const {
+        LoanIndexShard& shard = loan_shard(loan_id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.by_id.find(loan_id);
+        return it != shard.by_id.end() ? it->second : SlabHandle();
+    }
+
+    // Отметка открытой выдачи как закрываемой. Закрыть выдачу может только
+    // получивший ее дескриптор поток; пустой дескриптор, если выдачи уже нет
+    // или ее закрывает другой поток
+    SlabHandle claim_loan(uint64_t loan_id) {
+        LoanIndexShard& shard = loan_shard(loan_id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.by_id.find(loan_id);
+        if (it == shard.by_id.end() || !shard.closing.insert(loan_id).second) {
+            return SlabHandle();
+        }
+        return it->second;
+    }
+
+    // Снятие отметки, если закрыть выдачу не удалось
+    void release_claim(SlabHandle handle) {
+        uint64_t loan_id = get_loan(handle).get_id();
+        LoanIndexShard& shard = loan_shard(loan_id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.closing.erase(loan_id);
+    }
+
+    // Самая ранняя открытая выдача книги читателю, отмеченная как закрываемая
+    // (выдачи, которые уже закрывают другие потоки, пропускаются)
+    SlabHandle claim_earliest_open_loan(SlabHandle book, SlabHandle reader) {
+        std::lock_guard<std::mutex> reader_guard(reader_lock(reader));
+        std::vector<uint64_t> candidates;
+        for (SlabHandle handle : get_reader(reader).get_open_loans()) {
+            if (get_loan(handle).book == book) {
+                candidates.push_back(get_loan(handle).get_id());
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+        for (uint64_t loan_id : candidates) {
+            SlabHandle claimed = claim_loan(loan_id);
+            if (claimed.is_valid()) {
+                return claimed;
+            }
+        }
+        return SlabHandle();
+    }
+
+    // Закрытие отмеченных выдач (claim_loan) и перенос их в историю. Сначала
+    // в журнал добавляются все записи о возврате, затем применяются изменения;
+    // на диск записи попадают одним пакетом в commit_mutation
+    void close_claimed_loans(const std::vector<SlabHandle>& handles, const Date& returned_on) {
+        std::lock_guard<std::mutex> lock(loan_mutex);
+        // Записи в журнал до освобождения экземпляров: выдача, получившая
+        // такой экземпляр, окажется в журнале после возврата
+        size_t logged = 0;
+        try {
+            for (; logged < handles.size(); logged++) {
+                log_mutation(JOURNAL_CLOSE_LOAN, encode_loan_date_record(get_loan(handles[logged]).get_id(), returned_on));
+            }
+        }
+        catch (...) {
+            for (size_t i = 0; i < handles.size(); i++) {
+                if (i < logged) {
+                    close_loan_unlocked(handles[i], returned_on); // Запись уже в журнале
+                }
+                else {
+                    release_claim(handles[i]); // Выдача остается открытой
+                }
+            }
+            throw;
+        }
+        for (SlabHandle handle : handles) {
+            close_loan_unlocked(handle, returned_on);
+        }
+    }
+
+    // Закрытие одной отмеченной выдачи
+    void close_claimed_loan(SlabHandle handle, const Date& returned_on) {
+        close_claimed_loans(std::vector<SlabHandle>{ handle }, returned_on);
+    }
+
+    // Применение возврата уже записанной в журнал выдачи; вызывается под loan_mutex
+    void close_loan_unlocked(SlabHandle handle, const Date& returned_on) {
+        Loan& loan = get_loan(handle);
+        {
+            std::lock_guard<std::mutex> reader_guard(reader_lock(loan.reader));
+            SlabHandle moved = get_reader(loan.reader).detach_loan(loan.reader_slot);
+            if (moved.is_valid()) {
+                get_loan(moved).reader_slot = loan.reader_slot;
+            }
+        }
+        uint32_t slot = loan.library_slot; // Последняя выдача переносится на место закрываемой
+        loans[slot] = loans.back();
+        get_loan(loans[slot]).library_slot = slot;
+        loans.pop_back();
+        open_loans_by_date.erase(handle);
+        loan.close(returned_on);
+        loan_states.set(handle.get_slot(), LoanState(loan));
+        overdue.untrack(handle);
+        analytics.loan_closed(loan.reader.get_slot());
+        loan_history.push_back(handle);
+        loan_history_index.emplace(loan.get_id(), handle);
+        {
+            // Из индекса открытых выдач - только после попадания в историю,
+            // чтобы поиск по номеру находил выдачу в одном из индексов
+            LoanIndexShard& shard = loan_shard(loan.get_id());
+            std::lock_guard<std::mutex> shard_guard(shard.mutex);
+            shard.by_id.erase(loan.get_id());
+            shard.closing.erase(loan.get_id());
+        }
+        Book& book = get_book(loan.book);
+        book.release_copy();
+        // Колонка меняется вместе с записями выдач под loan_mutex и потому всегда согласована с ними
+        book_columns.set_copies(loan.book.get_slot(), book_columns.get_copies(loan.book.get_slot()) + 1);
+    }
+
+    // Выдачи с датой выдачи в [from, to] из всех сегментов в порядке даты (равные - в порядке создания)
+    std::vector<SlabHandle> loans_issued_between(const Date& from, const Date& to) const {
+        std::vector<SlabHandle> result;
+        for (LoanIndexShard& shard : loan_shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto last = shard.by_date.upper_bound(to);
+            for (auto it = shard.by_date.lower_bound(from); it != last; ++it) {
+                result.push_back(it->second);
+            }
+        }
+        std::sort(result.begin(), result.end(), PoolOrder<Loan>{ &loan_pool });
+        return result;
+    }
+
+    // Копия списка открытых выдач читателя
+    std::vector<SlabHandle> open_loans_of(SlabHandle reader) const {
+        std::lock_guard<std::mutex> lock(reader_lock(reader));
+        return get_reader(reader).get_open_loans();
+    }
+
+    // Восстановление номеров позиций после пересортировки открытых выдач
+    void renumber_loan_slots() {
+        for (size_t i = 0; i < loans.size(); i++) {
+            get_loan(loans[i]).library_slot = static_cast<uint32_t>(i);
+        }
+    }
+
+    // Очистка всех данных библиотеки (вызывающий держит reset_mutex монопольно,
+    // то есть живых снимков для чтения нет)
+    void clear() {
+        authors.clear();
+        books.clear();
+        readers.clear();
+        loans.clear();
+        loan_history.clear();
+        loan_history_index.clear();
+        loan_states.clear();
+        for (LoanIndexShard& shard : loan_shards) {
+            shard.by_id.clear();
+            shard.by_date.clear();
+        }
+        isbn_index.clear();
+        title_index.clear();
+        reader_card_index.clear();
+        reader_fio_index.clear();
+        author_positions.clear();
+        book_columns.clear();
+        author_directory.clear();
+        search_index.clear();
+        overdue.clear();
+        analytics.clear();
+        authors_by_fio.clear();
+        books_by_title.clear();
+        readers_by_fio.clear();
+        open_loans_by_date.clear();
+        loan_pool.clear(); // Пулы очищаются последними: выше еще читаются их объекты
+        reader_pool.clear();
+        book_pool.clear();
+        mapped_authors.clear();
+        mapped_snapshot.reset();
+        catalog_mutex.set_pending(false);
+        last_lsn = 0;
+        next_loan_id = first_loan_id;
+    }
+
+    // Запись операции в журнал до ее применения (вызывается под блокировкой,
+    // исключающей другие изменения); на диск запись попадает в commit_mutation
+    void log_mutation(uint8_t type, const std::string& payload) {
+        if (!journal) {
+            return;
+        }
+        if (!storage_failure.empty()) {
+            throw std::runtime_error(storage_failure);
+        }
+        last_lsn = journal->append(type, payload);
+    }
+
+    // Завершение изменения без удерживаемых блокировок: ожидание сброса
+    // журнала на диск и контрольная точка, если журнал разросся
+    void commit_mutation() {
+        if (journal) {
+            journal->commit();
+        }
+        checkpoint_if_due();
+    }
+
+    // Контрольная точка, если журнал разросся (вызывается без удерживаемых блокировок)
+    void checkpoint_if_due() {
+        if (!journal || !journal->checkpoint_due()) {
+            return;
+        }
+        std::unique_lock<CatalogMutex> lock(catalog_mutex);
+        if (journal && journal->checkpoint_due()) { // Другой поток мог успеть раньше
+            checkpoint_unlocked();
+        }
+    }
+
+    // Контрольная точка под монопольной блокировкой
+    void checkpoint_unlocked() {
+        LIBRARY_TIMED(OP_CHECKPOINT);
+        if (!journal) {
+            throw std::runtime_error("Хранилище не открыто.");
+        }
+        journal->sync();
+        write_snapshot(snapshot_path); // Снимок на диске до очистки журнала
+        journal->truncate();
+        storage_failure.clear(); // Снимок содержит весь каталог
+    }
+
+    // Сводка из номеров объектов (блокировки удерживает вызывающий)
+    LibraryAnalytics make_analytics(const std::vector<std::shared_ptr<Author>>& author_list,
+        const std::vector<RankedCount>& top_authors, const std::vector<RankedCount>& top_books,
+        const std::vector<RankedCount>& top_readers, const std::map<int, uint32_t>& decades) const {
+        LibraryAnalytics result;
+        for (const RankedCount& entry : top_authors) {
+            result.top_authors.push_back(std::make_pair(author_list[entry.id], static_cast<size_t>(entry.count)));
+        }
+        for (const RankedCount& entry : top_books) {
+            result.top_books.push_back(std::make_pair(book_ref(book_pool.handle_at(entry.id)), static_cast<size_t>(entry.count)));
+        }
+        for (const RankedCount& entry : top_readers) {
+            result.top_readers.push_back(std::make_pair(reader_ref(reader_pool.handle_at(entry.id)), static_cast<size_t>(entry.count)));
+        }
+        result.books_per_decade.insert(decades.begin(), decades.end());
+        return result;
+    }
+
+    // Проверка условий запроса для книги, читателя и выдачи (для запросов книг и читателей
+    // лишние аргументы пустые: поля, которых нет у сущности, отсеяны check_query_fields).
+    // Читаются только неизменяемые поля объектов, изменяемые - из state; блокировки не нужны
+    bool query_matches(const QueryNode& node, SlabHandle book, SlabHandle reader, SlabHandle loan, const QueryState& state) const {
+        if (node.kind != QueryNode::LEAF) {
+            bool all = node.kind == QueryNode::ALL;
+            for (const auto& child : node.children) {
+                if (query_matches(*child, book, reader, loan, state) != all) {
+                    return !all; // И: первое ложное условие, ИЛИ: первое истинное
+                }
+            }
+            return all;
+        }
+        auto in_range = [&node](int64_t value) { return value >= node.low && value <= node.high; };
+        switch (node.field) {
+        case QUERY_TITLE:
+        case QUERY_TITLE_PREFIX:
+            return get_book(book).get_title_key().compare(0, node.text.size(), node.text) == 0;
+        case QUERY_ISBN: {
+            uint64_t key = NO_ISBN;
+            return parse_isbn(get_book(book).get_isbn(), key) && key == node.isbn_key;
+        }
+        case QUERY_AUTHOR:
+            return get_book(book).get_author() && get_book(book).get_author()->get_fio() == node.text;
+        case QUERY_PUB_YEAR:
+            return in_range(get_book(book).get_pub_year());
+        case QUERY_COPIES:
+            return in_range(state.copies[book.get_slot()]);
+        case QUERY_FIO:
+            return get_reader(reader).get_fio() == node.text;
+        case QUERY_CARD:
+            return in_range(get_reader(reader).get_card_number());
+        case QUERY_ISSUE_DATE:
+            return in_range(get_loan(loan).get_issue_date().get_day_number());
+        case QUERY_RETURN_DATE: {
+            const LoanState* open = state.open_loan(loan); // Срок закрытой выдачи больше не меняется
+            return in_range((open != nullptr ? open->return_date : get_loan(loan).get_return_date()).get_day_number());
+        }
+        case QUERY_OPEN:
+            return state.open_loan(loan) != nullptr;
+        }
+        return false;
+    }
+
+    // Выбор кандидатов и снятие изменяемых полей под блокировками; проверка
+    // кандидатов при обходе результата идет уже без них
+    template <typename T>
+    QueryResult<T> execute_query(const Query& query, QueryTarget target, const SlabPool<T>& pool, bool use_indexes) const {
+        check_query_fields(query.get_root(), target);
+        auto state = std::make_shared<QueryState>();
+        std::shared_lock<std::shared_timed_mutex> reset_lock(reset_mutex);
+        QueryPlan plan;
+        std::vector<SlabHandle> candidates; // Кандидаты плана, идущего не в порядке результата
+        {
+            std::shared_lock<CatalogMutex> lock(catalog_mutex);
+            std::lock_guard<std::mutex> loan_lock(loan_mutex); // Экземпляры и выдачи - на тот же момент, что и кандидаты
+            if (!use_indexes || !plan_node(query.get_root(), target, plan)) {
+                plan = scan_plan(target, pool);
+            }
+            if (!plan.ordered) {
+                SlabHandle handle;
+                while (plan.next(handle)) {
+                    candidates.push_back(handle);
+                }
+            }
+            if (query_uses_field(query.get_root(), QUERY_COPIES)) {
+                state->copies = book_columns.copies_column();
+            }
+            if (query_uses_field(query.get_root(), QUERY_OPEN) || query_uses_field(query.get_root(), QUERY_RETURN_DATE)) {
+                state->loans = loan_states.capture();
+            }
+        }
+        if (!plan.ordered) {
+            // Ключи порядка не меняются, поэтому сортировка идет без блокировок
+            std::sort(candidates.begin(), candidates.end(), PoolOrder<T>{ &pool });
+            plan = list_plan(plan.description, std::move(candidates), true);
+        }
+        return QueryResult<T>(std::move(reset_lock), &pool, std::move(plan), [this, query, target, state](SlabHandle handle) {
+            if (target == QUERY_BOOKS) {
+                return query_matches(query.get_root(), handle, SlabHandle(), SlabHandle(), *state);
+            }
+            if (target == QUERY_READERS) {
+                return query_matches(query.get_root(), SlabHandle(), handle, SlabHandle(), *state);
+            }
+            const Loan& loan = get_loan(handle);
+            return query_matches(query.get_root(), loan.book, loan.reader, handle, *state);
+        });
+    }
+
+    // План полного просмотра: книги и читатели - по упорядоченным представлениям,
+    // выдачи - по ячейкам пула (их порядок восстанавливает execute_query)
+    template <typename T>
+    QueryPlan scan_plan(QueryTarget target, const SlabPool<T>& pool) const {
+        if (target == QUERY_BOOKS) {
+            return segment_plan("полный просмотр", books_by_title.ordered());
+        }
+        if (target == QUERY_READERS) {
+            return segment_plan("полный просмотр", readers_by_fio.ordered());
+        }
+        uint32_t slot = 0;
+        uint32_t count = static_cast<uint32_t>(pool.size());
+        return QueryPlan{ "полный просмотр", count, [&pool, slot, count](SlabHandle& handle) mutable {
+            if (slot >= count) {
+                return false;
+            }
+            handle = pool.handle_at(slot++);
+            return true;
+        } };
+    }
+
+    // План по готовому списку дескрипторов (ordered - список уже в порядке результата)
+    static QueryPlan list_plan(const std::string& description, std::vector<SlabHandle> handles, bool ordered = false) {
+        size_t estimate = handles.size();
+        size_t position = 0;
+        return QueryPlan{ description, estimate, [handles, position](SlabHandle& handle) mutable {
+            if (position >= handles.size()) {
+                return false;
+            }
+            handle = handles[position++];
+            return true;
+        }, ordered };
+    }
+
+    // План по упорядоченной части представления (разделяется без копирования)
+    static QueryPlan segment_plan(const std::string& description, std::shared_ptr<const std::vector<SlabHandle>> segment) {
+        size_t estimate = segment->size();
+        size_t position = 0;
+        return QueryPlan{ description, estimate, [segment, position](SlabHandle& handle) mutable {
+            if (position >= segment->size()) {
+                return false;
+            }
+            handle = (*segment)[position++];
+            return true;
+        }, true };
+    }
+
+    // Дескриптор из элемента индекса или вектора
+    template <typename Key>
+    static SlabHandle plan_handle(const std::pair<const Key, SlabHandle>& entry) { return entry.second; }
+    static SlabHandle plan_handle(SlabHandle handle) { return handle; }
+
+    // План по диапазону индекса [first, last). Дескрипторы копируются: после
+    // создания результата индекс меняется без ожидания его обхода
+    template <typename Iterator>
+    static QueryPlan range_plan(const std::string& description, Iterator first, Iterator last, bool ordered = false) {
+        std::vector<SlabHandle> handles;
+        for (; first != last; ++first) {
+            handles.push_back(plan_handle(*first));
+        }
+        return list_plan(description, std::move(handles), ordered);
+    }
+
+    // Книги, подходящие по колонкам, в порядке названий: маска считается по
+    // колонкам, затем отбираются подходящие строки упорядоченного представления
+    // (вызывается под catalog_mutex и loan_mutex)
+    std::vector<SlabHandle> books_matching_columns(int min_copies, int year_from, int year_to) const {
+        std::vector<uint8_t> mask = book_columns.filter(min_copies, year_from, year_to);
+        std::shared_ptr<const std::vector<SlabHandle>> ordered = books_by_title.ordered();
+        std::vector<SlabHandle> result;
+        for (SlabHandle book : *ordered) {
+            if (mask[book.get_slot()]) {
+                result.push_back(book);
+            }
+        }
+        return result;
+    }
+
+    // План прохода по колонкам книг для условий на год и экземпляры из списка conditions
+    QueryPlan column_plan(const std::vector<const QueryNode*>& conditions) const {
+        int min_copies = INT32_MIN, year_from = INT32_MIN, year_to = INT32_MAX;
+        for (const QueryNode* node : conditions) {
+            if (node->field == QUERY_COPIES) {
+                min_copies = std::max(min_copies, static_cast<int>(std::max<int64_t>(node->low, INT32_MIN)));
+            }
+            else {
+                year_from = std::max(year_from, static_cast<int>(std::max<int64_t>(node->low, INT32_MIN)));
+                year_to = std::min(year_to, static_cast<int>(std::min<int64_t>(node->high, INT32_MAX)));
+            }
+        }
+        return list_plan("проход по колонкам книг", books_matching_columns(min_copies, year_from, year_to), true);
+    }
+
+    // План по индексу для одного условия (false, если индекса для него нет)
+    bool plan_leaf(const QueryNode& node, QueryTarget target, QueryPlan& plan) const {
+        if (query_field_target(node.field) != target) {
+            return false; // Условия на книгу или читателя в запросе выдач проверяются для кандидатов
+        }
+        switch (node.field) {
+        case QUERY_ISBN: {
+            SlabHandle book = isbn_index.find(node.isbn_key);
+            plan = list_plan("индекс ISBN", book.is_valid() ? std::vector<SlabHandle>{ book } : std::vector<SlabHandle>(), true);
+            return true;
+        }
+        case QUERY_TITLE:
+        case QUERY_TITLE_PREFIX: {
+            auto first = title_index.lower_bound(node.text);
+            auto last = first;
+            while (last != title_index.end() && last->first.compare(0, node.text.size(), node.text) == 0) {
+                ++last;
+            }
+            plan = range_plan("индекс названий", first, last, true); // Равные названия - в порядке добавления
+            return true;
+        }
+        case QUERY_AUTHOR: {
+            std::vector<SlabHandle> rows;
+            for (uint32_t position : author_directory.find(node.text)) {
+                if (authors[position]->get_fio() == node.text) { // Условие запроса - точное ФИО
+                    for (uint32_t row : author_directory.books_of(position)) {
+                        rows.push_back(book_pool.handle_at(row));
+                    }
+                }
+            }
+            plan = list_plan("справочник авторов", std::move(rows));
+            return true;
+        }
+        case QUERY_PUB_YEAR:
+        case QUERY_COPIES:
+            plan = column_plan(std::vector<const QueryNode*>{ &node });
+            return true;
+        case QUERY_CARD: {
+            SlabHandle reader = reader_by_card(static_cast<int>(node.low)); // Условие на билет - точное совпадение
+            plan = list_plan("индекс билетов", reader.is_valid() ? std::vector<SlabHandle>{ reader } : std::vector<SlabHandle>(), true);
+            return true;
+        }
+        case QUERY_FIO: {
+            auto range = reader_fio_index.equal_range(node.text);
+            plan = range_plan("индекс ФИО", range.first, range.second);
+            return true;
+        }
+        case QUERY_ISSUE_DATE:
+            plan = list_plan("индекс дат выдачи", loans_issued_between(
+                Date(static_cast<int32_t>(std::max<int64_t>(node.low, INT32_MIN))),
+                Date(static_cast<int32_t>(std::min<int64_t>(node.high, INT32_MAX)))), true);
+            return true;
+        case QUERY_OPEN:
+            plan = segment_plan("открытые выдачи", open_loans_by_date.ordered());
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Выбор источника кандидатов для узла запроса (false, если подходящего индекса нет)
+    bool plan_node(const QueryNode& node, QueryTarget target, QueryPlan& plan) const {
+        if (node.kind == QueryNode::LEAF) {
+            return plan_leaf(node, target, plan);
+        }
+        if (node.kind == QueryNode::ANY) {
+            // ИЛИ: объединение кандидатов всех ветвей; без индекса хотя бы у одной - просмотр
+            std::vector<SlabHandle> handles;
+            std::string description;
+            for (const auto& child : node.children) {
+                QueryPlan child_plan;
+                if (!plan_node(*child, target, child_plan)) {
+                    return false;
+                }
+                description += (description.empty() ? "" : " + ") + child_plan.description;
+                SlabHandle handle;
+                while (child_plan.next(handle)) {
+                    handles.push_back(handle);
+                }
+            }
+            std::sort(handles.begin(), handles.end());
+            handles.erase(std::unique(handles.begin(), handles.end()), handles.end());
+            plan = list_plan("объединение (" + description + ")", std::move(handles));
+            return true;
+        }
+        // И: самый узкий из индексов ветвей; условия на год и экземпляры - одним проходом по колонкам
+        bool found = false;
+        if (target == QUERY_LOANS) {
+            // Открытые выдачи читателя с известным билетом лежат в списке читателя
+            const QueryNode* open = nullptr;
+            const QueryNode* card = nullptr;
+            for (const auto& child : node.children) {
+                if (child->kind == QueryNode::LEAF && child->field == QUERY_OPEN) {
+                    open = child.get();
+                }
+                else if (child->kind == QueryNode::LEAF && child->field == QUERY_CARD) {
+                    card = child.get();
+                }
+            }
+            if (open != nullptr && card != nullptr) {
+                SlabHandle reader = reader_by_card(static_cast<int>(card->low));
+                plan = list_plan("открытые выдачи читателя", reader.is_valid() ? open_loans_of(reader) : std::vector<SlabHandle>());
+                found = true;
+            }
+        }
+        std::vector<const QueryNode*> column_conditions;
+        for (const auto& child : node.children) {
+            if (target == QUERY_BOOKS && child->kind == QueryNode::LEAF
+                && (child->field == QUERY_PUB_YEAR || child->field == QUERY_COPIES)) {
+                column_conditions.push_back(child.get());
+                continue;
+            }
+            QueryPlan child_plan;
+            if (plan_node(*child, target, child_plan) && (!found || child_plan.estimate < plan.estimate)) {
+                plan = std::move(child_plan);
+                found = true;
+            }
+        }
+        if (!column_conditions.empty() && (!found || plan.estimate * QUERY_COLUMN_SCAN_RATIO > books.size())) {
+            QueryPlan columns = column_plan(column_conditions);
+            if (!found || columns.estimate < plan.estimate) {
+                plan = std::move(columns);
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    // Книги, ключ названия которых начинается с key, по алфавиту (без блокировки)
+    std::vector<BookRef> books_by_title_key_prefix(const std::string& key) const {
+        std::vector<BookRef> result;
+        if (catalog_mutex.is_pending()) { // Каталог не достроен: поиск по порядку названий в файле снимка
+            std::pair<size_t, size_t> range = mapped_snapshot->find_title_key_range(key);
+            for (size_t i = range.first; i < range.second; i++) {
+                result.push_back(book_ref(book_pool.handle_at(mapped_snapshot->get_title_order()[i])));
+            }
+            return result;
+        }
+        for (auto it = title_index.lower_bound(key); it != title_index.end(); ++it) {
+            if (it->first.compare(0, key.size(), key) != 0) {
+                break; // Ключи упорядочены, дальше совпадений по префиксу нет
+            }
+            result.push_back(book_ref(it->second));
+        }
+        return result;
+    }
+
+    // Разделяемая блокировка для поиска, который умеет работать прямо по
+    // отображенному снимку: каталог при этом не достраивается
+    std::shared_lock<CatalogMutex> lock_mapped() const {
+        catalog_mutex.lock_shared_mapped();
+        return std::shared_lock<CatalogMutex>(catalog_mutex, std::adopt_lock);
+    }
+
+    // Поиск книги по ISBN без блокировки (запись ISBN нормализуется)
+    SlabHandle book_by_isbn(const std::string& isbn) const {
+        uint64_t key = NO_ISBN;
+        return parse_isbn(isbn, key) ? isbn_index.find(key) : SlabHandle();
+    }
+
+    // Поиск читателя по номеру билета без блокировки
+    SlabHandle reader_by_card(int card_number) const {
+        auto it = reader_card_index.find(card_number);
+        return it != reader_card_index.end() ? it->second : SlabHandle();
+    }
+
+    // Выдача книги; вызывается под catalog_mutex (разделяемой или монопольной)
+    CheckoutResult checkout_unlocked(SlabHandle book, SlabHandle reader,
+        const Date& issue_date, const Date& return_date, LoanRef* created) {
+        if (return_date < issue_date) {
+            return CHECKOUT_BAD_DATES;
+        }
+        Book& book_object = get_book(book);
+        if (!book_object.try_reserve_copy()) { // Без блокировок: свободный экземпляр достается одному потоку
+            return CHECKOUT_NO_COPIES;
+        }
+        std::unique_lock<std::mutex> lock(loan_mutex);
+        SlabHandle loan;
+        try {
+            loan = loan_pool.create(next_loan_id, book, reader, issue_date, return_date);
+            // Номер выдачи при восстановлении определяется порядком записей, поэтому запись идет под loan_mutex
+            log_mutation(JOURNAL_ADD_LOAN, encode_loan_record(book_object.get_isbn(), get_reader(reader).get_card_number(), issue_date, return_date));
+        }
+        catch (...) {
+            book_object.release_copy(); // Пул переполнен или журнал недоступен: экземпляр возвращается
+            throw; // Созданная, но не зарегистрированная выдача нигде не видна
+        }
+        next_loan_id += loan_id_step;
+        add_open_loan_unlocked(loan);
+        lock.unlock();
+        publish_loan(loan);
+        if (created != nullptr) {
+            *created = loan_ref(loan);
+        }
+        return CHECKOUT_OK;
+    }
+
+    // Возврат по номеру выдачи; вызывается под catalog_mutex
+    bool return_unlocked(uint64_t loan_id, const Date& returned_on) {
+        SlabHandle loan = claim_loan(loan_id);
+        if (!loan.is_valid()) {
+            return false;
+        }
+        close_claimed_loan(loan, returned_on);
+        return true;
+    }
+
+    // Продление выдачи; вызывается под catalog_mutex
+    bool renew_unlocked(uint64_t loan_id, const Date& new_return_date) {
+        SlabHandle loan = find_open_loan(loan_id);
+        if (!loan.is_valid()) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(loan_mutex);
+        Loan& object = get_loan(loan);
+        if (object.is_returned() || !(object.get_return_date() < new_return_date)) {
+            return false; // Выдачу успели закрыть или срок не позже текущего
+        }
+        log_mutation(JOURNAL_RENEW_LOAN, encode_loan_date_record(loan_id, new_return_date));
+        overdue.untrack(loan);
+        object.renew(new_return_date);
+        loan_states.set(loan.get_slot(), LoanState(object));
+        overdue.track(loan); // Прежняя запись в куче будет пропущена как устаревшая
+        return true;
+    }
+
+    // Сортировка вектора дескрипторов по значениям объектов в пуле
+    template <typename T>
+    static void sort_pointees(const SlabPool<T>& pool, std::vector<SlabHandle>& items) {
+        std::sort(items.begin(), items.end(),
+            [&pool](SlabHandle a, SlabHandle b) {
+                return *pool.get(a) < *pool.get(b);
+            });
+    }
+
+    // Применение одной записи журнала при восстановлении
+    void apply_journal_record(uint8_t type, const std::string& payload) {
+        JournalDecoder decoder(payload);
+        switch (type) {
+        case JOURNAL_ADD_AUTHOR: {
+            std::string fio = decoder.get_string();
+            int birth_year = decoder.get_int();
+            if (author_directory.contains(fio)) {
+                throw std::runtime_error("Журнал содержит повторяющееся ФИО автора.");
+            }
+            if (decoder.get_int() != 0) {
+                std::string work = decoder.get_string();
+                int awards = decoder.get_int();
+                insert_author(std::make_shared<FamousAuthor>(fio, birth_year, work, awards));
+            }
+            else {
+                insert_author(std::make_shared<Author>(fio, birth_year));
+            }
+            break;
+        }
+        case JOURNAL_ADD_BOOK: {
+            std::string title = decoder.get_string();
+            std::string isbn = decoder.get_string();
+            int author_position = decoder.get_int();
+            int pub_year = decoder.get_int();
+            int copies = decoder.get_int();
+            uint64_t isbn_key = NO_ISBN;
+            if (!parse_isbn(isbn, isbn_key)) {
+                throw std::runtime_error("Журнал содержит некорректный ISBN.");
+            }
+            if (!insert_book(isbn_key, title, authors.at(author_position), pub_year, copies, isbn).is_valid()) {
+                throw std::runtime_error("Журнал содержит повторяющийся ISBN.");
+            }
+            break;
+        }
+        case JOURNAL_ADD_READER: {
+            std::string fio = decoder.get_string();
+            int card_number = decoder.get_int();
+            if (!insert_reader(fio, card_number).is_valid()) {
+                throw std::runtime_error("Журнал содержит повторяющийся номер билета.");
+            }
+            break;
+        }
+        case JOURNAL_ADD_LOAN: {
+            std::string isbn = decoder.get_string();
+            int card_number = decoder.get_int();
+            Date issue_date(decoder.get_int());
+            Date return_date(decoder.get_int());
+            SlabHandle book = book_by_isbn(isbn);
+            SlabHandle reader = reader_by_card(card_number);
+            if (!book.is_valid() || !reader.is_valid()) {
+                throw std::runtime_error("Журнал ссылается на отсутствующую книгу или читателя.");
+            }
+            if (checkout_unlocked(book, reader, issue_date, return_date, nullptr) != CHECKOUT_OK) {
+                throw std::runtime_error("Журнал содержит выдачу, которую нельзя повторить.");
+            }
+            break;
+        }
+        case JOURNAL_CLOSE_LOAN: {
+            uint64_t loan_id = decoder.get_uint64();
+            Date returned_on(decoder.get_int());
+            if (!return_unlocked(loan_id, returned_on)) {
+                throw std::runtime_error("Журнал содержит возврат без открытой выдачи.");
+            }
+            break;
+        }
+        case JOURNAL_RENEW_LOAN: {
+            uint64_t loan_id = decoder.get_uint64();
+            Date new_return_date(decoder.get_int());
+            if (!renew_unlocked(loan_id, new_return_date)) {
+                throw std::runtime_error("Журнал содержит недопустимое продление выдачи.");
+            }
+            break;
+        }
+        default:
+            throw std::runtime_error("Неизвестный тип записи журнала.");
+        }
+    }
+
+public:
+    // Конструктор; выдачи нумеруются first_loan_id, first_loan_id + loan_id_step, ...
+    explicit Library(uint64_t first_loan_id = 1, uint64_t loan_id_step = 1)
+        : search_index(author_directory), overdue(loan_pool), authors_by_fio(AuthorOrder{ &authors }), books_by_title(PoolOrder<Book>{ &book_pool }),
+        readers_by_fio(PoolOrder<Reader>{ &reader_pool }), open_loans_by_date(PoolOrder<Loan>{ &loan_pool }),
+        catalog_mutex([this] { build_mapped_catalog(); }), last_lsn(0), first_loan_id(first_loan_id), loan_id_step(loan_id_step), next_loan_id(first_loan_id), recorder(nullptr) {
+    }
+
+    // Метод для включения записи операций меню в трассу (nullptr - выключить)
+    void set_recorder(SessionRecorder* session) {
+        recorder = session;
+    }
+
+    // Запись операции меню в трассу в виде запроса сервера (если запись включена)
+    void record_request(std::initializer_list<std::string> fields) {
+        if (recorder) {
+            recorder->record(fields);
+        }
+    }
+
+    // Метод для сортировки книг по названию
+    void sort_books_by_title() {
+        LIBRARY_TIMED(OP_SORT);
+        std::unique_lock<CatalogMutex> lock(catalog_mutex);
+        sort_pointees(book_pool, books);
+    }
+
+    // Метод для сортировки читателей по ФИО
+    void sort_readers_by_name() {
+        LIBRARY_TIMED(OP_SORT);
+        std::unique_lock<CatalogMutex> lock(catalog_mutex);
+        sort_pointees(reader_pool, readers);
+    }
+
+    // Метод для сортировки выдач по дате
+    void sort_loans_by_date() {
+        LIBRARY_TIMED(OP_SORT);
+        std::unique_lock<CatalogMutex> lock(catalog_mutex);
+        sort_pointees(loan_pool, loans);
+        renumber_loan_slots();
+    }
+
+    // Метод для поиска книги по названию без учета регистра (через индекс, без пересортировки вектора книг)
+    BookRef find_book_by_title(const std::string& title) {
+        std::vector<BookRef> found = find_books_by_title(title);
+        return found.empty() ? nullptr : found.front();
+    }
+
+    // Метод для поиска всех книг с названием, совпадающим без учета регистра
+    // (строчные написания раньше прописных, одинаковые - в порядке добавления)
+    std::vector<BookRef> find_books_by_title(const std::string& title) {
+        LIBRARY_TIMED(OP_FIND_BOOK_BY_TITLE);
+        std::shared_lock<CatalogMutex> lock = lock_mapped();
+        return books_by_title_key_prefix(make_collation_key(title, true) + COLLATION_LEVEL_SEPARATOR);
+    }
+
+    // Метод для поиска всех книг, название которых начинается с заданного префикса (без учета регистра)
+    std::vector<BookRef> find_books_by_title_prefix(const std::string& prefix) {
+        LIBRARY_TIMED(OP_FIND_BOOKS_BY_TITLE_PREFIX);
+        std::shared_lock<CatalogMutex> lock = lock_mapped();
+        return books_by_title_key_prefix(make_collation_key(prefix, true));
+    }
+
+    // Метод для нечеткого поиска книг по словам из названия и ФИО автора (лучшие limit совпадений)
+    std::vector<BookRef> search_books(const std::string& query, size_t limit = 20) const {
+        std::vector<BookRef> result;
+        for (const auto& hit : search_books_scored(query, limit)) {
+            result.push_back(hit.first);
+        }
+        return result;
+    }
+
+    // То же с оценкой совпадения (по убыванию оценки) - для слияния результатов нескольких библиотек
+    std::vector<std::pair<BookRef, float>> search_books_scored(const std::string& query, size_t limit = 20,
+        unsigned threads = std::thread::hardware_concurrency()) const {
+        LIBRARY_TIMED(OP_SEARCH_BOOKS);
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        std::vector<std::pair<BookRef, float>> result;
+        for (const SearchHit& hit : search_index.search(query, limit, threads)) {
+            result.emplace_back(book_ref(book_pool.handle_at(hit.row)), hit.score);
+        }
+        return result;
+    }
+
+    // Метод для поиска выдач с датой выдачи в диапазоне [from, to] (по возрастанию даты)
+    std::vector<LoanRef> find_loans_issued_between(const Date& from, const Date& to) const {
+        LIBRARY_TIMED(OP_FIND_LOANS);
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        return make_refs(loan_pool, loans_issued_between(from, to));
+    }
+
+    // Метод для перевода часов библиотеки на заданный день; возвращает ставшие просроченными выдачи
+    std::vector<LoanRef> advance_clock(const Date& day) {
+        LIBRARY_TIMED(OP_ADVANCE_CLOCK);
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        std::lock_guard<std::mutex> loan_lock(loan_mutex);
+        return make_refs(loan_pool, overdue.advance_to(day));
+    }
+
+    // Метод для получения текущей даты библиотеки
+    Date get_clock() const {
+        std::lock_guard<std::mutex> loan_lock(loan_mutex);
+        return overdue.get_clock();
+    }
+
+    // Метод для получения общего количества просроченных выдач
+    size_t count_overdue_loans() const {
+        std::lock_guard<std::mutex> loan_lock(loan_mutex);
+        return overdue.get_overdue_count();
+    }
+
+    // Метод для получения просроченных выдач читателя
+    std::vector<LoanRef> find_overdue_loans(const ReaderRef& reader) const {
+        LIBRARY_TIMED(OP_FIND_LOANS);
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        std::lock_guard<std::mutex> loan_lock(loan_mutex);
+        return make_refs(loan_pool, overdue.overdue_for(reader.get_handle()));
+    }
+
+    // Метод для получения открытых выдач читателя
+    std::vector<LoanRef> find_open_loans(const ReaderRef& reader) const {
+        LIBRARY_TIMED(OP_FIND_LOANS);
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        if (!reader.belongs_to(reader_pool) || !reader) {
+            return std::vector<LoanRef>();
+        }
+        return make_refs(loan_pool, open_loans_of(reader.get_handle()));
+    }
+
+    // Метод для получения книги выдачи
+    BookRef book_of(const Loan& loan) const {
+        return book_ref(loan.get_book_handle());
+    }
+
+    // Метод для получения читателя выдачи
+    ReaderRef reader_of(const Loan& loan) const {
+        return reader_ref(loan.get_reader_handle());
+    }
+
+    // Метод для вывода выдачи вместе с книгой и читателем
+    void print_loan(const Loan& loan) const {
+        ::print_loan(std::cout, loan, get_book(loan.get_book_handle()), get_reader(loan.get_reader_handle()));
+    }
+
+    // Метод для отбора книг с не менее чем min_copies экземплярами и годом публикации в [year_from, year_to]
+    // (в порядке названий, как и результаты запросов)
+    std::vector<BookRef> filter_books(int min_copies, int year_from, int year_to) const {
+        LIBRARY_TIMED(OP_FILTER_BOOKS);
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        std::lock_guard<std::mutex> loan_lock(loan_mutex); // Колонка экземпляров меняется при выдаче
+        return make_refs(book_pool, books_matching_columns(min_copies, year_from, year_to));
+    }
+
+    // Метод для подсчета книг по тому же условию без выборки
+    size_t count_books(int min_copies, int year_from, int year_to) const {
+        LIBRARY_TIMED(OP_COUNT_BOOKS);
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        std::lock_guard<std::mutex> loan_lock(loan_mutex);
+        return book_columns.count(min_copies, year_from, year_to);
+    }
+
+    // Метод для поиска книги по ISBN (ISBN-10 и ISBN-13 одной книги равнозначны)
+    BookRef find_book_by_isbn(const std::string& isbn) {
+        LIBRARY_TIMED(OP_FIND_BOOK_BY_ISBN);
+        std::shared_lock<CatalogMutex> lock = lock_mapped();
+        if (catalog_mutex.is_pending()) { // Каталог не достроен: двоичный поиск в секции ISBN снимка
+            uint32_t id = mapped_snapshot->find_book_id_by_isbn(isbn);
+            return id == SNAPSHOT_NO_ID ? nullptr : book_ref(book_pool.handle_at(mapped_id(id, book_pool.size())));
+        }
+        return book_ref(book_by_isbn(isbn));
+    }
+
+    // Метод для поиска читателя по номеру билета (через хеш-индекс)
+    ReaderRef find_reader_by_card(int card_number) {
+        LIBRARY_TIMED(OP_FIND_READER_BY_CARD);
+        std::shared_lock<CatalogMutex> lock = lock_mapped();
+        if (catalog_mutex.is_pending()) { // Каталог не достроен: двоичный поиск в секции билетов снимка
+            uint32_t id = mapped_snapshot->find_reader_id_by_card(card_number);
+            return id == SNAPSHOT_NO_ID ? nullptr : reader_ref(reader_pool.handle_at(mapped_id(id, reader_pool.size())));
+        }
+        return reader_ref(reader_by_card(card_number));
+    }
+
+    // Метод для поиска всех читателей с заданным ФИО
+    std::vector<ReaderRef> find_readers_by_fio(const std::string& fio) {
+        LIBRARY_TIMED(OP_FIND_READERS_BY_FIO);
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        std::vector<ReaderRef> result;
+        auto range = reader_fio_index.equal_range(fio);
+        for (auto it = range.first; it != range.second; ++it) {
+            result.push_back(reader_ref(it->second));
+        }
+        return result;
+    }
+
+    // Методы для поиска авторов через справочник: по ФИО, по началу ФИО
+    // (до limit авторов в порядке ФИО), по самому известному произведению
+    // и по числу наград (по убыванию наград). Регистр и лишние пробелы не учитываются
+    std::shared_ptr<Author> find_author_by_fio(const std::string& fio) const {
+        LIBRARY_TIMED(OP_FIND_AUTHORS);
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        std::vector<uint32_t> found = author_directory.find(fio);
+        return found.empty() ? nullptr : authors[found.front()];
+    }
+
+    std::vector<std::shared_ptr<Author>> find_authors_by_fio_prefix(const std::string& prefix, size_t limit) const {
+        LIBRARY_TIMED(OP_FIND_AUTHORS);
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        return authors_at(author_directory.find_prefix(prefix, limit));
+    }
+
+    std::vector<std::shared_ptr<Author>> find_authors_by_famous_work(const std::string& work) const {
+        LIBRARY_TIMED(OP_FIND_AUTHORS);
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        return authors_at(author_directory.find_by_work(work));
+    }
+
+    std::vector<std::shared_ptr<Author>> find_authors_with_awards(int min_awards) const {
+        LIBRARY_TIMED(OP_FIND_AUTHORS);
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        return authors_at(author_directory.find_by_awards(min_awards));
+    }
+
+    // Метод для получения книг автора в порядке добавления (через обратный индекс справочника)
+    std::vector<BookRef> find_books_by_author(const std::shared_ptr<Author>& author) const {
+        LIBRARY_TIMED(OP_FIND_BOOKS_BY_AUTHOR);
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        std::vector<BookRef> result;
+        auto it = author_positions.find(author.get());
+        if (it != author_positions.end()) {
+            for (uint32_t row : author_directory.books_of(it->second)) {
+                result.push_back(book_ref(book_pool.handle_at(row)));
+            }
+        }
+        return result;
+    }
+
+    // Метод для вывода всей информации о библиотеке (по умолчанию на экран)
+    void print_Library(FILE* file = stdout) const {
+        LIBRARY_TIMED(OP_PRINT_LIBRARY);
+        ReadView view = read_view(); // Вывод идет по снимку и не задерживает выдачу книг
+        OutputBuffer out(file);
+        ReportWriter writer(out, REPORT_TEXT);
+        out.write("Общее количество авторов: ");
+        out.write_int(static_cast<int64_t>(view.author_count()));
+        out.write("\n\nСписок авторов (отсортированный по ФИО):\n");
+        write_report(view, writer, REPORT_AUTHORS);
+        out.write("\nСписок книг (отсортированный по названию):\n");
+        write_report(view, writer, REPORT_BOOKS);
+        out.write("\nСписок читателей (отсортированный по ФИО):\n");
+        write_report(view, writer, REPORT_READERS);
+        out.write("\nСписок открытых выдач (отсортированный по дате):\n");
+        write_report(view, writer, REPORT_LOANS);
+        out.write("Закрытых выдач в истории: ");
+        out.write_int(static_cast<int64_t>(view.closed_loan_count()));
+        out.put('\n');
+    }
+
+    // Метод для выгрузки отчета в открытый файл (в порядке сортировки); возвращает число байт
+    uint64_t export_report(ReportEntity entity, ReportFormat format, FILE* file) const {
+        LIBRARY_TIMED(OP_EXPORT_REPORT);
+        OutputBuffer out(file);
+        ReportWriter writer(out, format);
+        if (entity == REPORT_OPERATIONS) {
+            writer.begin_table(OPERATION_COLUMNS);
+            for (const OperationStats& stats : collect_operation_stats()) {
+                report_operation(writer, stats);
+            }
+        }
+        else if (entity == REPORT_MEMORY) {
+            writer.begin_table(MEMORY_COLUMNS);
+            for (const MemoryStats& stats : memory_stats()) {
+                report_memory(writer, stats);
+            }
+        }
+        else {
+            write_report(read_view(), writer, entity);
+        }
+        if (!out.flush()) {
+            throw std::runtime_error("Ошибка записи отчета.");
+        }
+        return out.bytes_written();
+    }
+
+    // Метод для получения снимка каталога для чтения. Блокировки каталога и учета
+    // выдач удерживаются только на время снятия представлений и колонок (копируются
+    // указатели на сегменты); пока снимок жив, загрузка каталога с диска ждет его освобождения
+    ReadView read_view() const {
+        LIBRARY_TIMED(OP_READ_VIEW);
+        ReadView view(&book_pool, &reader_pool, &loan_pool);
+        OrderedView<uint32_t, AuthorOrder>::Capture author_capture;
+        OrderedView<SlabHandle, PoolOrder<Book>>::Capture book_capture;
+        OrderedView<SlabHandle, PoolOrder<Reader>>::Capture reader_capture;
+        OrderedView<SlabHandle, PoolOrder<Loan>>::Capture loan_capture;
+        size_t reader_count = 0;
+        {
+            view.reset_lock = std::shared_lock<std::shared_timed_mutex>(reset_mutex);
+            std::shared_lock<CatalogMutex> lock(catalog_mutex);
+            view.authors = authors;
+            author_capture = authors_by_fio.capture();
+            book_capture = books_by_title.capture();
+            reader_capture = readers_by_fio.capture();
+            reader_count = reader_pool.size();
+            std::lock_guard<std::mutex> loan_lock(loan_mutex);
+            view.copies = book_columns.copies_column();
+            view.loan_states = loan_states.capture();
+            loan_capture = open_loans_by_date.capture();
+            view.loan_count = loan_pool.size();
+            view.closed_loans = loan_history.size();
+        }
+        // Дальше без блокировок: порядок строится по неизменяемым ключам
+        view.author_order = OrderedView<uint32_t, AuthorOrder>::resolve(author_capture, AuthorOrder{ &view.authors });
+        view.book_order = OrderedView<SlabHandle, PoolOrder<Book>>::resolve(book_capture, PoolOrder<Book>{ &book_pool });
+        view.reader_order = OrderedView<SlabHandle, PoolOrder<Reader>>::resolve(reader_capture, PoolOrder<Reader>{ &reader_pool });
+        view.open_loan_order = OrderedView<SlabHandle, PoolOrder<Loan>>::resolve(loan_capture, PoolOrder<Loan>{ &loan_pool });
+        view.reader_open_loans.assign(reader_count, 0);
+        for (SlabHandle loan : *view.open_loan_order) {
+            view.reader_open_loans[get_loan(loan).get_reader_handle().get_slot()]++;
+        }
+        return view;
+    }
+
+    // Методы постраничного просмотра: страница page (с нуля) из page_size записей
+    // в порядке сортировки; страница 0 - первые page_size записей (top-K)
+    std::vector<std::shared_ptr<Author>> list_authors_by_fio(size_t page, size_t page_size) {
+        LIBRARY_TIMED(OP_LIST_PAGE);
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        std::vector<std::shared_ptr<Author>> result;
+        for (uint32_t position : authors_by_fio.range(page * page_size, page_size)) {
+            result.push_back(authors[position]);
+        }
+        return result;
+    }
+
+    std::vector<BookRef> list_books_by_title(size_t page, size_t page_size) {
+        LIBRARY_TIMED(OP_LIST_PAGE);
+        std::shared_lock<CatalogMutex> lock = lock_mapped();
+        if (catalog_mutex.is_pending()) { // Каталог не достроен: страница порядка названий из файла снимка
+            std::vector<BookRef> result;
+            size_t count = mapped_snapshot->book_count();
+            for (size_t i = std::min(page * page_size, count); i < count && result.size() < page_size; i++) {
+                uint32_t id = mapped_id(mapped_snapshot->get_title_order()[i], book_pool.size());
+                result.push_back(book_ref(book_pool.handle_at(id)));
+            }
+            return result;
+        }
+        return make_refs(book_pool, books_by_title.range(page * page_size, page_size));
+    }
+
+    std::vector<ReaderRef> list_readers_by_fio(size_t page, size_t page_size) {
+        LIBRARY_TIMED(OP_LIST_PAGE);
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        return make_refs(reader_pool, readers_by_fio.range(page * page_size, page_size));
+    }
+
+    std::vector<LoanRef> list_open_loans_by_date(size_t page, size_t page_size) {
+        LIBRARY_TIMED(OP_LIST_PAGE);
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        return make_refs(loan_pool, open_loans_by_date.range(page * page_size, page_size));
+    }
+
+    // Методы для выполнения составного запроса. Результат ленивый; блокировки
+    // удерживаются только на время выбора кандидатов и снятия изменяемых полей.
+    // use_indexes = false - полный просмотр (для сверки планов)
+    QueryResult<Book> query_books(const Query& query, bool use_indexes = true) const {
+        LIBRARY_TIMED(OP_QUERY);
+        return execute_query(query, QUERY_BOOKS, book_pool, use_indexes);
+    }
+
+    QueryResult<Reader> query_readers(const Query& query, bool use_indexes = true) const {
+        LIBRARY_TIMED(OP_QUERY);
+        return execute_query(query, QUERY_READERS, reader_pool, use_indexes);
+    }
+
+    QueryResult<Loan> query_loans(const Query& query, bool use_indexes = true) const {
+        LIBRARY_TIMED(OP_QUERY);
+        return execute_query(query, QUERY_LOANS, loan_pool, use_indexes);
+    }
+
+    // Метод для получения сводки (первые k в каждом рейтинге) из счетчиков за O(k)
+    LibraryAnalytics get_analytics(size_t k) const {
+        return get_analytics(k, k, k);
+    }
+
+    // То же с отдельной длиной рейтингов авторов, книг и читателей
+    LibraryAnalytics get_analytics(size_t author_k, size_t book_k, size_t reader_k) const {
+        LIBRARY_TIMED(OP_ANALYTICS);
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        std::lock_guard<std::mutex> loan_lock(loan_mutex);
+        return make_analytics(authors, analytics.top_authors(author_k), analytics.top_books(book_k), analytics.top_readers(reader_k),
+            analytics.books_per_decade());
+    }
+
+    // Метод для пакетного расчета той же сводки по всем выдачам, книгам и читателям.
+    // Расчет идет по снимку для чтения и не задерживает выдачу книг.
+    // При равных значениях порядок в рейтинге может отличаться от счетчиков
+    LibraryAnalytics compute_analytics(size_t k, unsigned threads = std::thread::hardware_concurrency()) const {
+        LIBRARY_TIMED(OP_ANALYTICS);
+        ReadView view = read_view();
+        unsigned workers = std::max(1u, threads);
+        size_t book_count = view.book_count();
+        const auto& author_list = view.get_authors();
+
+        // Выдачи по книгам: у каждого потока свои счетчики, затем сумма
+        std::vector<std::vector<uint32_t>> book_parts(workers);
+        parallel_ranges(view.total_loan_count(), workers, [&](unsigned w, size_t from, size_t to) {
+            std::vector<uint32_t>& counts = book_parts[w];
+            counts.assign(book_count, 0);
+            view.for_each_loan(from, to, [&counts](const Loan& loan) { counts[loan.get_book_handle().get_slot()]++; });
+        });
+        std::vector<uint32_t> book_loans(book_count);
+        for (const auto& part : book_parts) {
+            for (size_t book = 0; book < part.size(); book++) {
+                book_loans[book] += part[book];
+            }
+        }
+
+        // Выдачи по авторам и книги по десятилетиям - один проход по книгам
+        std::unordered_map<const Author*, uint32_t> positions;
+        for (uint32_t position = 0; position < author_list.size(); position++) {
+            positions[author_list[position].get()] = position;
+        }
+        std::vector<std::vector<uint32_t>> author_parts(workers);
+        std::vector<std::map<int, uint32_t>> decade_parts(workers);
+        parallel_ranges(book_count, workers, [&](unsigned w, size_t from, size_t to) {
+            std::vector<uint32_t>& counts = author_parts[w];
+            counts.assign(author_list.size(), 0);
+            for (size_t row = from; row < to; row++) {
+                const Book& book = view.book_at(row);
+                auto it = positions.find(book.get_author().get());
+                if (it != positions.end()) {
+                    counts[it->second] += book_loans[row];
+                }
+                decade_parts[w][publication_decade(book.get_pub_year())]++;
+            }
+        });
+        std::vector<uint32_t> author_loans(author_list.size());
+        std::map<int, uint32_t> decades;
+        for (unsigned w = 0; w < workers; w++) {
+            for (size_t author = 0; author < author_parts[w].size(); author++) {
+                author_loans[author] += author_parts[w][author];
+            }
+            for (const auto& decade : decade_parts[w]) {
+                decades[decade.first] += decade.second;
+            }
+        }
+
+        return make_analytics(author_list, top_counts(author_loans, k), top_counts(book_loans, k),
+            top_counts(view.get_reader_open_loans(), k), decades);
+    }
+
+    // Метод для добавления готового автора. Пустой указатель, если автор с таким
+    // ФИО уже есть (регистр и лишние пробелы не учитываются)
+    std::shared_ptr<Author> add_author(const std::shared_ptr<Author>& author) {
+        LIBRARY_TIMED(OP_ADD_AUTHOR);
+        {
+            std::unique_lock<CatalogMutex> lock(catalog_mutex);
+            if (author_directory.contains(author->get_fio())) {
+                return nullptr;
+            }
+            log_mutation(JOURNAL_ADD_AUTHOR, encode_author_record(*author));
+            insert_author(author);
+        }
+        commit_mutation();
+        return author;
+    }
+
+    // Метод для добавления книги (автор должен быть уже добавлен); книга копируется в пул.
+    // Пустая ссылка, если книга с таким ISBN уже есть
+    BookRef add_book(const Book& book) {
+        LIBRARY_TIMED(OP_ADD_BOOK);
+        uint64_t isbn_key = NO_ISBN;
+        if (!parse_isbn(book.get_isbn(), isbn_key)) {
+            throw std::invalid_argument("Некорректный ISBN: " + book.get_isbn());
+        }
+        SlabHandle handle;
+        {
+            std::unique_lock<CatalogMutex> lock(catalog_mutex);
+            auto it = author_positions.find(book.get_author().get());
+            if (it == author_positions.end()) {
+                throw std::invalid_argument("Автор книги не найден в библиотеке.");
+            }
+            if (isbn_index.find(isbn_key).is_valid()) {
+                return nullptr;
+            }
+            log_mutation(JOURNAL_ADD_BOOK, encode_book_record(book, it->second));
+            handle = insert_book(isbn_key, book);
+        }
+        commit_mutation();
+        return book_ref(handle);
+    }
+
+    // Метод для добавления читателя (пустая ссылка, если номер билета занят)
+    ReaderRef add_reader(const Reader& reader) {
+        LIBRARY_TIMED(OP_ADD_READER);
+        SlabHandle handle;
+        {
+            std::unique_lock<CatalogMutex> lock(catalog_mutex);
+            if (reader_card_index.count(reader.get_card_number()) != 0) {
+                return nullptr;
+            }
+            log_mutation(JOURNAL_ADD_READER, encode_reader_record(reader));
+            handle = insert_reader(reader.get_fio(), reader.get_card_number());
+        }
+        commit_mutation();
+        return reader_ref(handle);
+    }
+
+    // Метод для выдачи книги; безопасен при одновременном вызове из нескольких потоков
+    CheckoutResult checkout_book(const BookRef& book, const ReaderRef& reader,
+        const Date& issue_date, const Date& return_date, LoanRef* created = nullptr) {
+        LIBRARY_TIMED(OP_CHECKOUT);
+        CheckoutResult result;
+        {
+            std::shared_lock<CatalogMutex> lock(catalog_mutex);
+            if (!book.belongs_to(book_pool) || !book) {
+                return CHECKOUT_NO_BOOK;
+            }
+            if (!reader.belongs_to(reader_pool) || !reader) {
+                return CHECKOUT_NO_READER;
+            }
+            result = checkout_unlocked(book.get_handle(), reader.get_handle(), issue_date, return_date, created);
+        }
+        commit_mutation();
+        return result;
+    }
+
+    // Метод для выдачи книги по ISBN и номеру билета
+    CheckoutResult checkout_book(const std::string& isbn, int card_number,
+        const Date& issue_date, const Date& return_date, LoanRef* created = nullptr) {
+        LIBRARY_TIMED(OP_CHECKOUT);
+        CheckoutResult result;
+        {
+            std::shared_lock<CatalogMutex> lock(catalog_mutex);
+            SlabHandle book = book_by_isbn(isbn);
+            SlabHandle reader = reader_by_card(card_number);
+            if (!book.is_valid()) {
+                return CHECKOUT_NO_BOOK;
+            }
+            if (!reader.is_valid()) {
+                return CHECKOUT_NO_READER;
+            }
+            result = checkout_unlocked(book, reader, issue_date, return_date, created);
+        }
+        commit_mutation();
+        return result;
+    }
+
+    // Метод для возврата книги по номеру выдачи (false, если открытой выдачи нет);
+    // безопасен при одновременном вызове из нескольких потоков
+    bool return_loan(uint64_t loan_id, const Date& returned_on) {
+        LIBRARY_TIMED(OP_RETURN);
+        bool returned;
+        {
+            std::shared_lock<CatalogMutex> lock(catalog_mutex);
+            returned = return_unlocked(loan_id, returned_on);
+        }
+        commit_mutation();
+        return returned;
+    }
+
+    // Метод для пакетного возврата: все выдачи закрываются под одной блокировкой,
+    // а их записи журнала сбрасываются на диск одним пакетом. Возвращает количество закрытых выдач (неизвестные номера пропускаются)
+    size_t return_loans(const std::vector<uint64_t>& loan_ids, const Date& returned_on) {
+        LIBRARY_TIMED(OP_RETURN);
+        size_t returned = 0;
+        {
+            std::shared_lock<CatalogMutex> lock(catalog_mutex);
+            std::vector<SlabHandle> claimed;
+            claimed.reserve(loan_ids.size());
+            for (uint64_t loan_id : loan_ids) {
+                SlabHandle loan = claim_loan(loan_id);
+                if (loan.is_valid()) {
+                    claimed.push_back(loan);
+                }
+            }
+            close_claimed_loans(claimed, returned_on);
+            returned = claimed.size();
+        }
+        commit_mutation();
+        return returned;
+    }
+
+    // Метод для возврата самой ранней открытой выдачи книги читателем
+    bool return_book(const std::string& isbn, int card_number, const Date& returned_on) {
+        LIBRARY_TIMED(OP_RETURN);
+        bool returned = false;
+        {
+            std::shared_lock<CatalogMutex> lock(catalog_mutex);
+            SlabHandle book = book_by_isbn(isbn);
+            SlabHandle reader = reader_by_card(card_number);
+            if (book.is_valid() && reader.is_valid()) {
+                SlabHandle loan = claim_earliest_open_loan(book, reader);
+                if (loan.is_valid()) {
+                    close_claimed_loan(loan, returned_on);
+                    returned = true;
+                }
+            }
+        }
+        commit_mutation();
+        return returned;
+    }
+
+    // Метод для продления выдачи до новой даты (false, если выдача закрыта или срок не позже текущего)
+    bool renew_loan(uint64_t loan_id, const Date& new_return_date) {
+        LIBRARY_TIMED(OP_RENEW);
+        bool renewed;
+        {
+            std::shared_lock<CatalogMutex> lock(catalog_mutex);
+            renewed = renew_unlocked(loan_id, new_return_date);
+        }
+        commit_mutation();
+        return renewed;
+    }
+
+    // Метод для поиска выдачи по номеру (открытой, затем в истории)
+    LoanRef find_loan_by_id(uint64_t loan_id) const {
+        LIBRARY_TIMED(OP_FIND_LOAN_BY_ID);
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        SlabHandle open = find_open_loan(loan_id);
+        if (open.is_valid()) {
+            return loan_ref(open);
+        }
+        // Закрываемая выдача уходит из индекса открытых только после попадания в историю
+        std::lock_guard<std::mutex> loan_lock(loan_mutex);
+        auto it = loan_history_index.find(loan_id);
+        return it != loan_history_index.end() ? loan_ref(it->second) : nullptr;
+    }
+
+    // Метод для подсчета открытых выдач книги (для проверки согласованности учета)
+    size_t count_open_loans(const BookRef& book) const {
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        std::lock_guard<std::mutex> loan_lock(loan_mutex);
+        SlabHandle handle = book.get_handle();
+        return static_cast<size_t>(std::count_if(loans.begin(), loans.end(),
+            [this, handle](SlabHandle loan) {
+                return get_loan(loan).get_book_handle() == handle;
+            }));
+    }
+
+    // Метод для подсчета закрытых выдач
+    size_t count_closed_loans() const {
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        std::lock_guard<std::mutex> loan_lock(loan_mutex);
+        return loan_history.size();
+    }
+
+    // Метод для оценки памяти индекса ISBN в байтах
+    size_t isbn_index_memory() const {
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        return isbn_index.memory_usage();
+    }
+
+    // Метод для оценки памяти сущностей и индексов (количество записей и байт)
+    std::vector<MemoryStats> memory_stats() const {
+        std::shared_lock<CatalogMutex> lock(catalog_mutex);
+        std::lock_guard<std::mutex> loan_lock(loan_mutex);
+        std::vector<MemoryStats> result;
+
+        size_t bytes = vector_bytes(authors);
+        for (const auto& author : authors) {
+            bytes += author->memory_usage();
+        }
+        result.push_back(MemoryStats{ "authors", authors.size(), bytes });
+        bytes = book_pool.memory_usage() + vector_bytes(books);
+        for (uint32_t slot = 0; slot < book_pool.size(); slot++) {
+            bytes += get_book(book_pool.handle_at(slot)).heap_usage();
+        }
+        result.push_back(MemoryStats{ "books", book_pool.size(), bytes });
+        bytes = reader_pool.memory_usage() + vector_bytes(readers);
+        for (uint32_t slot = 0; slot < reader_pool.size(); slot++) {
+            SlabHandle reader = reader_pool.handle_at(slot);
+            std::lock_guard<std::mutex> reader_guard(reader_lock(reader)); // Список выдач меняется при выдаче
+            bytes += get_reader(reader).heap_usage();
+        }
+        result.push_back(MemoryStats{ "readers", reader_pool.size(), bytes });
+        result.push_back(MemoryStats{ "loans", loan_pool.size(),
+            loan_pool.memory_usage() + vector_bytes(loans) + vector_bytes(loan_history) + loan_states.memory_usage() });
+
+        bytes = tree_bytes(title_index);
+        for (const auto& entry : title_index) {
+            bytes += string_heap_bytes(entry.first);
+        }
+        result.push_back(MemoryStats{ "title_index", title_index.size(), bytes });
+        result.push_back(MemoryStats{ "isbn_index", isbn_index.size(), isbn_index.memory_usage() });
+        result.push_back(MemoryStats{ "reader_card_index", reader_card_index.size(), hash_bytes(reader_card_index) });
+        bytes = hash_bytes(reader_fio_index);
+        for (const auto& entry : reader_fio_index) {
+            bytes += string_heap_bytes(entry.first);
+        }
+        result.push_back(MemoryStats{ "reader_fio_index", reader_fio_index.size(), bytes });
+        result.push_back(MemoryStats{ "author_positions", author_positions.size(), hash_bytes(author_positions) });
+        size_t id_count = 0, id_bytes = 0, date_count = 0, date_bytes = 0;
+        for (LoanIndexShard& shard : loan_shards) {
+            std::lock_guard<std::mutex> shard_lock(shard.mutex);
+            id_count += shard.by_id.size();
+            id_bytes += hash_bytes(shard.by_id);
+            date_count += shard.by_date.size();
+            date_bytes += tree_bytes(shard.by_date);
+        }
+        result.push_back(MemoryStats{ "loan_index", id_count, id_bytes });
+        result.push_back(MemoryStats{ "loan_date_index", date_count, date_bytes });
+        result.push_back(MemoryStats{ "loan_history_index", loan_history_index.size(), hash_bytes(loan_history_index) });
+        result.push_back(MemoryStats{ "book_columns", book_columns.size(), book_columns.memory_usage() });
+        result.push_back(MemoryStats{ "author_directory", author_directory.size(), author_directory.memory_usage() });
+        result.push_back(MemoryStats{ "search_index", search_index.gram_count(), search_index.memory_usage() });
+        result.push_back(MemoryStats{ "ordered_views", authors.size() + books.size() + readers.size() + loans.size(),
+            authors_by_fio.memory_usage() + books_by_title.memory_usage() + readers_by_fio.memory_usage() +
+            open_loans_by_date.memory_usage() });
+        result.push_back(MemoryStats{ "overdue", overdue.get_overdue_count(), overdue.memory_usage() });
+        result.push_back(MemoryStats{ "analytics", book_pool.size() + authors.size() + reader_pool.size(),
+            analytics.memory_usage() });
+        return result;
+    }
+
+    // Метод для добавления автора
+    void add_Author() {
+        // Создаем FamousAuthor вместо обычного Author для демонстрации
+        auto newAuthor = std::make_shared<FamousAuthor>("", 0, "", 0);
+        newAuthor->add_Author();
+        record_request({ "ADD_AUTHOR", newAuthor->get_fio(), std::to_string(newAuthor->get_birth_year()),
+            newAuthor->get_most_famous_work(), std::to_string(newAuthor->get_awards_count()) });
+        if (!add_author(newAuthor)) {
+            printf("Ошибка: автор %s уже существует.\n", newAuthor->get_fio().c_str());
+        }
+    }
+
+    // Метод для добавления книги
+    void add_Book() {
+        {
+            std::shared_lock<CatalogMutex> lock(catalog_mutex);
+            if (authors.empty()) {
+                printf("Ошибка: сначала добавьте хотя бы одного автора.\n");
+                return;
+            }
+        }
+
+        Book newBook;
+        try {
+            // Автор с точно совпавшим ФИО выбирается сразу, иначе предлагаются первые авторы по началу ФИО
+            newBook.add_Book([this](const std::string& name) {
+                std::shared_ptr<Author> exact = find_author_by_fio(name);
+                return exact ? std::vector<std::shared_ptr<Author>>{ exact } : find_authors_by_fio_prefix(name, AUTHOR_CHOICE_LIMIT);
+            });
+        }
+        catch (const std::exception& e) {
+            printf("Ошибка: %s\n", e.what());
+            return;
+        }
+        record_request({ "ADD_BOOK", newBook.get_title(), newBook.get_author()->get_fio(), std::to_string(newBook.get_pub_year()),
+            std::to_string(newBook.get_copies()), newBook.get_isbn() });
+        if (!add_book(newBook)) {
+            printf("Ошибка: книга с ISBN %s уже существует.\n", newBook.get_isbn().c_str());
+        }
+    }
+
+    // Метод для добавления читателя
+    void add_Reader() {
+        Reader newReader;
+        newReader.add_Reader();
+        record_request({ "ADD_READER", newReader.get_fio(), std::to_string(newReader.get_card_number()) });
+        if (!add_reader(newReader)) {
+            printf("Ошибка: читатель с билетом %d уже существует.\n", newReader.get_card_number());
+        }
+    }
+
+    // Метод для добавления выдачи книги
+    void add_Loan() {
+        std::vector<BookRef> book_list;
+        std::vector<ReaderRef> reader_list;
+        {
+            std::shared_lock<CatalogMutex> lock(catalog_mutex);
+            book_list = make_refs(book_pool, books); // Копии, чтобы не держать блокировку во время ввода
+            reader_list = make_refs(reader_pool, readers);
+        }
+
+        if (book_list.empty()) {
+            printf("Ошибка: нет книг в библиотеке.\n");
+            return;
+        }
+
+        if (reader_list.empty()) {
+            printf("Ошибка: нет читателей в библиотеке.\n");
+            return;
+        }
+
+        try {
+            printf("Выберите книгу (введите номер): ");
+            for (size_t i = 0; i < book_list.size(); i++) {
+                if (book_list[i]) {
+                    printf("%zu. %s\n", i + 1, book_list[i]->get_title().c_str());
+                }
+            }
+            int book_index;
+            scanf("%d", &book_index);
+            if (book_index < 1 || book_index > static_cast<int>(book_list.size()) || !book_list[book_index - 1])
+                throw std::out_of_range("Некорректный номер книги.");
+
+            printf("Выберите читателя (введите номер): ");
+            for (size_t i = 0; i < reader_list.size(); i++) {
+                if (reader_list[i]) {
+                    printf("%zu. %s\n", i + 1, reader_list[i]->get_fio().c_str());
+                }
+            }
+            int reader_index;
+            scanf("%d", &reader_index);
+            if (reader_index < 1 || reader_index > static_cast<int>(reader_list.size()) || !reader_list[reader_index - 1])
+                throw std::out_of_range("Некорректный номер читателя.");
+
+            std::string issue_text, return_text;
+            printf("Введите дату выдачи книги (дд.мм.гггг): ");
+            std::cin >> issue_text;
+            printf("Введите дату возврата книги (дд.мм.гггг): ");
+            std::cin >> return_text;
+            Date issue_date = Date::parse(issue_text);
+            Date return_date = Date::parse(return_text);
+            record_request({ "CHECKOUT", book_list[book_index - 1]->get_isbn(), std::to_string(reader_list[reader_index - 1]->get_card_number()),
+                issue_text, return_text });
+
+            LoanRef loan;
+            switch (checkout_book(book_list[book_index - 1], reader_list[reader_index - 1], issue_date, return_date, &loan)) {
+            case CHECKOUT_NO_COPIES:
+                throw std::runtime_error("Недостаточно экземпляров книги.");
+            case CHECKOUT_BAD_DATES:
+                throw std::invalid_argument("Дата возврата раньше даты выдачи.");
+            default:
+                printf("Книга выдана, номер выдачи: %llu\n", static_cast<unsigned long long>(loan->get_id()));
+                break;
+            }
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Ошибка при создании выдачи: " << e.what() << std::endl;
+        }
+    }
+
+    // Метод для возврата книги через меню (датой возврата считается текущий день библиотеки)
+    void return_Loan() {
+        printf("Введите номер выдачи: ");
+        unsigned long long loan_id;
+        if (scanf("%llu", &loan_id) != 1) {
+            while (getchar() != '\n'); // Очистка буфера
+            printf("Ошибка: некорректный номер выдачи.\n");
+            return;
+        }
+        Date today = get_clock();
+        record_request({ "RETURN", std::to_string(loan_id), today.to_string() });
+        if (return_loan(loan_id, today)) {
+            printf("Книга возвращена.\n");
+        }
+        else {
+            printf("Ошибка: открытой выдачи с таким номером нет.\n");
+        }
+    }
+
+    // Метод для продления выдачи через меню
+    void renew_Loan() {
+        printf("Введите номер выдачи: ");
+        unsigned long long loan_id;
+        if (scanf("%llu", &loan_id) != 1) {
+            while (getchar() != '\n'); // Очистка буфера
+            printf("Ошибка: некорректный номер выдачи.\n");
+            return;
+        }
+        printf("Введите новую дату возврата (дд.мм.гггг): ");
+        std::string date_text;
+        std::cin >> date_text;
+        record_request({ "RENEW", std::to_string(loan_id), date_text });
+        try {
+            if (renew_loan(loan_id, Date::parse(date_text))) {
+                printf("Выдача продлена.\n");
+            }
+            else {
+                printf("Ошибка: выдача не найдена или новая дата не позже текущего срока.\n");
+            }
+        }
+        catch (const std::exception& e) {
+            printf("Ошибка: %s\n", e.what());
+        }
+    }
+
+    // Метод для постраничного просмотра каталога через меню
+    void browse_Catalog() {
+        printf("Что просматривать:\n");
+        printf("1. Авторов (по ФИО)\n");
+        printf("2. Книги (по названию)\n");
+        printf("3. Читателей (по ФИО)\n");
+        printf("4. Открытые выдачи (по дате)\n");
+        int choice = 0, page_size = 0, page = 0;
+        scanf("%d", &choice);
+        printf("Введите размер страницы: ");
+        scanf("%d", &page_size);
+        printf("Введите номер страницы (с 1): ");
+        if (scanf("%d", &page) != 1 || choice < 1 || choice > 4 || page_size < 1 || page < 1) {
+            printf("Ошибка: некорректные параметры просмотра.\n");
+            return;
+        }
+
+        static const char* const entities[] = { "authors", "books", "readers", "loans" };
+        record_request({ "PAGE", entities[choice - 1], std::to_string(page), std::to_string(page_size) });
+        size_t index = static_cast<size_t>(page - 1);
+        size_t size = static_cast<size_t>(page_size);
+        size_t shown = 0;
+        switch (choice) {
+        case 1:
+            for (const auto& author : list_authors_by_fio(index, size)) {
+                author->displayInfo();
+                std::cout << std::endl;
+                shown++;
+            }
+            break;
+        case 2:
+            for (const auto& book : list_books_by_title(index, size)) {
+                std::cout << *book << "\n\n";
+                shown++;
+            }
+            break;
+        case 3:
+            for (const auto& reader : list_readers_by_fio(index, size)) {
+                std::cout << *reader << "\n\n";
+                shown++;
+            }
+            break;
+        default:
+            for (const auto& loan : list_open_loans_by_date(index, size)) {
+                print_loan(*loan);
+                std::cout << "\n\n";
+                shown++;
+            }
+            break;
+        }
+        printf("Страница %d: записей %zu\n", page, shown);
+    }
+
+    // Метод для выгрузки отчета через меню
+    void export_Report() {
+        printf("Что выгрузить:\n");
+        printf("1. Авторов\n");
+        printf("2. Книги\n");
+        printf("3. Читателей\n");
+        printf("4. Открытые выдачи\n");
+        printf("5. Счетчики и задержки операций\n");
+        printf("6. Память сущностей и индексов\n");
+        int entity = 0, format = 0;
+        scanf("%d", &entity);
+        printf("Формат (1 - текст, 2 - CSV, 3 - JSON Lines): ");
+        if (scanf("%d", &format) != 1 || entity < 1 || entity > 6 || format < 1 || format > 3) {
+            printf("Ошибка: некорректные параметры выгрузки.\n");
+            return;
+        }
+
+        printf("Введите путь к файлу (пусто - на экран): ");
+        std::string path;
+        while (getchar() != '\n'); // Очистка буфера
+        std::getline(std::cin, path);
+
+        FILE* file = path.empty() ? stdout : fopen(path.c_str(), "wb");
+        if (!file) {
+            printf("Ошибка: не удалось открыть файл %s\n", path.c_str());
+            return;
+        }
+        record_request({ "REPORT", REPORT_ENTITY_NAMES[entity - 1], REPORT_FORMAT_NAMES[format - 1] }); // Путь не записывается
+        try {
+            auto start = std::chrono::steady_clock::now();
+            uint64_t bytes = export_report(static_cast<ReportEntity>(entity - 1), static_cast<ReportFormat>(format - 1), file);
+            double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (file != stdout && fclose(file) != 0) {
+                file = nullptr;
+                throw std::runtime_error("Ошибка записи отчета.");
+            }
+            file = nullptr;
+            printf("Выгружено %llu байт (%.1f мс)\n", static_cast<unsigned long long>(bytes), elapsed_ms);
+        }
+        catch (const std::exception& e) {
+            if (file && file != stdout) {
+                fclose(file);
+            }
+            printf("Ошибка: %s\n", e.what());
+        }
+    }
+
+    // Метод для вывода сводки по выдачам через меню
+    void print_Analytics() {
+        const size_t top_size = 5;
+        record_request({ "ANALYTICS", std::to_string(top_size) });
+        LibraryAnalytics summary = get_analytics(top_size);
+        printf("Авторы с наибольшим числом выдач:\n");
+        for (const auto& entry : summary.top_authors) {
+            printf("  %s - %zu\n", entry.first->get_fio().c_str(), entry.second);
+        }
+        printf("Самые выдаваемые книги:\n");
+        for (const auto& entry : summary.top_books) {
+            printf("  %s (ISBN %s) - %zu\n", entry.first->get_title().c_str(), entry.first->get_isbn().c_str(), entry.second);
+        }
+        printf("Читатели с наибольшим числом открытых выдач:\n");
+        for (const auto& entry : summary.top_readers) {
+            printf("  %s (билет %d) - %zu\n", entry.first->get_fio().c_str(), entry.first->get_card_number(), entry.second);
+        }
+        printf("Книги по десятилетиям публикации:\n");
+        for (const auto& decade : summary.books_per_decade) {
+            printf("  %d-е - %zu\n", decade.first, decade.second);
+        }
+    }
+
+    // Метод для вывода счетчиков, задержек операций и оценки памяти через меню
+    void print_Metrics() const {
+        std::vector<OperationStats> operations = collect_operation_stats();
+        if (operations.empty()) {
+            printf("Замеров операций нет (сборка без метрик или операции не вызывались).\n");
+        }
+        else {
+            printf("%s %s %s %s %s %s %s\n", pad_text("Операция", 28).c_str(), pad_text("Вызовов", 10, true).c_str(),
+                pad_text("Сред., мкс", 10, true).c_str(), pad_text("p50, мкс", 10, true).c_str(), pad_text("p99, мкс", 10, true).c_str(),
+                pad_text("p99.9, мкс", 10, true).c_str(), pad_text("Макс., мкс", 12, true).c_str());
+            for (const OperationStats& stats : operations) {
+                printf("%-28s %10llu %10.1f %10.1f %10.1f %10.1f %12.1f\n", OPERATION_NAMES[stats.operation],
+                    static_cast<unsigned long long>(stats.count), stats.total_ns / 1000.0 / stats.count,
+                    stats.p50_ns / 1000.0, stats.p99_ns / 1000.0, stats.p999_ns / 1000.0, stats.max_ns / 1000.0);
+            }
+        }
+        size_t total_bytes = 0;
+        printf("\n%s %s %s\n", pad_text("Структура", 28).c_str(), pad_text("Записей", 10, true).c_str(), pad_text("КБ", 12, true).c_str());
+        for (const MemoryStats& stats : memory_stats()) {
+            printf("%-28s %10zu %12.1f\n", stats.name.c_str(), stats.items, stats.bytes / 1024.0);
+            total_bytes += stats.bytes;
+        }
+        printf("Всего: %.1f МБ\n", total_bytes / (1024.0 * 1024.0));
+    }
+
+    // Метод для сохранения каталога в бинарный снимок
+    void save_snapshot(const std::string& path) {
+        LIBRARY_TIMED(OP_SAVE);
+        std::unique_lock<CatalogMutex> lock(catalog_mutex);
+        write_snapshot(path);
+    }
+
+private:
+    // Номера записей в порядке представления; группы равных объектов сортируются по номеру
+    template <typename T>
+    static std::vector<uint32_t> snapshot_order_ids(const std::vector<SlabHandle>& ordered,
+        const std::vector<uint32_t>& ids, const SlabPool<T>& pool) {
+        std::vector<uint32_t> result;
+        result.reserve(ordered.size());
+        size_t group = 0;
+        for (size_t i = 0; i < ordered.size(); i++) {
+            if (i > 0 && *pool.get(ordered[i - 1]) < *pool.get(ordered[i])) {
+                std::sort(result.begin() + group, result.end());
+                group = i;
+            }
+            result.push_back(ids[ordered[i].get_slot()]);
+        }
+        std::sort(result.begin() + group, result.end());
+        return result;
+    }
+
+    // Запись снимка под монопольной блокировкой
+    void write_snapshot(const std::string& path) const {
+        SnapshotWriter writer;
+        SnapshotSections sections;
+        std::vector<uint32_t> book_ids(book_pool.size()); // Номер записи по ячейке пула
+        std::vector<uint32_t> reader_ids(reader_pool.size());
+
+        // Номер записи автора совпадает с его позицией в authors
+        sections.authors.reserve(authors.size());
+        for (const auto& author : authors) {
+            SnapshotAuthor record = {};
+            record.fio = writer.add_string(author->get_fio());
+            record.fio_key = writer.add_string(author->get_fio_key());
+            record.birth_year = author->get_birth_year();
+            auto famous = dynamic_cast<const FamousAuthor*>(author.get());
+            if (famous != nullptr) {
+                record.flags = SNAPSHOT_AUTHOR_FAMOUS;
+                record.most_famous_work = writer.add_string(famous->get_most_famous_work());
+                record.awards_count = famous->get_awards_count();
+            }
+            sections.authors.push_back(record);
+        }
+
+        sections.books.reserve(books.size());
+        for (SlabHandle handle : books) {
+            const Book& book = get_book(handle);
+            SnapshotBook record = {};
+            record.title = writer.add_string(book.get_title());
+            record.title_key = writer.add_string(book.get_title_key());
+            record.isbn = writer.add_string(book.get_isbn());
+            auto it = author_positions.find(book.get_author().get());
+            record.author_id = (it != author_positions.end()) ? it->second : SNAPSHOT_NO_ID;
+            record.pub_year = book.get_pub_year();
+            record.copies = book.get_copies();
+            book_ids[handle.get_slot()] = static_cast<uint32_t>(sections.books.size());
+            sections.books.push_back(record);
+        }
+
+        sections.readers.reserve(readers.size());
+        sections.card_entries.reserve(readers.size());
+        for (SlabHandle handle : readers) {
+            const Reader& reader = get_reader(handle);
+            SnapshotReader record = {};
+            record.fio = writer.add_string(reader.get_fio());
+            record.fio_key = writer.add_string(reader.get_fio_key());
+            record.card_number = reader.get_card_number();
+            reader_ids[handle.get_slot()] = static_cast<uint32_t>(sections.readers.size());
+            sections.card_entries.push_back(SnapshotCardEntry{ record.card_number, reader_ids[handle.get_slot()] });
+            sections.readers.push_back(record);
+        }
+        std::sort(sections.card_entries.begin(), sections.card_entries.end(),
+            [](const SnapshotCardEntry& a, const SnapshotCardEntry& b) {
+                return a.card_number < b.card_number;
+            });
+
+        // Сначала история закрытых выдач, затем открытые
+        sections.loans.reserve(loan_history.size() + loans.size());
+        auto add_loan_record = [&](SlabHandle handle) {
+            const Loan& loan = get_loan(handle);
+            SnapshotLoan record = {};
+            record.id = loan.get_id();
+            record.book_id = book_ids[loan.get_book_handle().get_slot()];
+            record.reader_id = reader_ids[loan.get_reader_handle().get_slot()];
+            record.issue_day = loan.get_issue_date().get_day_number();
+            record.return_day = loan.get_return_date().get_day_number();
+            record.returned_day = loan.get_returned_on().get_day_number();
+            record.renew_count = loan.get_renew_count();
+            record.flags = loan.is_returned() ? SNAPSHOT_LOAN_RETURNED : 0;
+            sections.loans.push_back(record);
+        };
+        for (SlabHandle loan : loan_history) {
+            add_loan_record(loan);
+        }
+        for (SlabHandle loan : loans) {
+            add_loan_record(loan);
+        }
+
+        // Записи индекса упорядочены по ключу ISBN, что позволяет искать прямо в файле
+        sections.isbn_entries.reserve(books.size());
+        for (SlabHandle book : books) {
+            SnapshotIsbnEntry record = {};
+            parse_isbn(get_book(book).get_isbn(), record.isbn_key); // Некорректные ISBN в каталог не попадают
+            record.book_id = book_ids[book.get_slot()];
+            sections.isbn_entries.push_back(record);
+        }
+        std::sort(sections.isbn_entries.begin(), sections.isbn_entries.end(),
+            [](const SnapshotIsbnEntry& a, const SnapshotIsbnEntry& b) {
+                return a.isbn_key < b.isbn_key;
+            });
+
+        // Порядки представлений; после загрузки ячейка пула совпадает с номером записи,
+        // поэтому равные ключи переупорядочиваются по номеру
+        sections.title_order = snapshot_order_ids(*books_by_title.ordered(), book_ids, book_pool);
+        sections.author_order = *authors_by_fio.ordered();
+        sections.reader_order = snapshot_order_ids(*readers_by_fio.ordered(), reader_ids, reader_pool);
+        sections.loan_order.resize(sections.loans.size());
+        for (size_t i = 0; i < sections.loan_order.size(); i++) {
+            sections.loan_order[i] = static_cast<uint32_t>(i);
+        }
+        std::stable_sort(sections.loan_order.begin(), sections.loan_order.end(),
+            [&sections](uint32_t a, uint32_t b) {
+                return sections.loans[a].issue_day < sections.loans[b].issue_day;
+            });
+        search_index.save_to(sections);
+
+        writer.write(path, last_lsn, next_loan_id, sections);
+    }
+
+    // Проверка, что order - номера count записей, строго возрастающие по less
+    // (значит, каждая запись встречается ровно один раз); возвращает их дескрипторы
+    template <typename Less>
+    static std::vector<SlabHandle> snapshot_order(const uint32_t* order, const std::vector<SlabHandle>& handles, Less less) {
+        std::vector<SlabHandle> result(handles.size());
+        for (size_t i = 0; i < result.size(); i++) {
+            if (order[i] >= handles.size() || (i > 0 && !less(handles[order[i - 1]], handles[order[i]]))) {
+                throw std::runtime_error("Поврежденный снимок каталога: нарушен порядок индекса.");
+            }
+            result[i] = handles[order[i]];
+        }
+        return result;
+    }
+
+    // Открытие снимка под монопольной блокировкой без разбора записей: файл
+    // отображается в память, книги и читатели создаются в пулах блоками при
+    // первом обращении, поиск по ISBN, билету и названию и страницы списка
+    // книг идут по готовым секциям файла, а остальной каталог достраивается
+    // при первой другой операции (build_mapped_catalog). Поэтому открытие
+    // занимает время чтения заголовка при любом числе записей
+    bool read_snapshot(const std::string& path) {
+        std::unique_ptr<CatalogSnapshot> snapshot(new CatalogSnapshot());
+        if (!snapshot->open(path)) {
+            return false;
+        }
+        clear();
+        attach_snapshot(std::move(snapshot));
+        return true;
+    }
+
+    // Подключение открытого снимка к пустой библиотеке (ячейка пула совпадает с номером записи)
+    void attach_snapshot(std::unique_ptr<CatalogSnapshot> snapshot) {
+        const CatalogSnapshot& mapped = *snapshot;
+        if (mapped.book_count() >= SLAB_MAX_SLOTS || mapped.reader_count() >= SLAB_MAX_SLOTS) {
+            throw std::length_error("Пул объектов переполнен.");
+        }
+        mapped_authors.assign(mapped.author_count(), nullptr);
+        book_pool.assign_lazy(static_cast<uint32_t>(mapped.book_count()),
+            [this, &mapped](uint32_t slot, void* memory) {
+                const SnapshotBook& record = mapped.book_at(slot);
+                new (memory) Book(mapped.str(record.title), mapped.str(record.title_key), mapped_author(record.author_id),
+                    record.pub_year, record.copies, mapped.str(record.isbn));
+            });
+        reader_pool.assign_lazy(static_cast<uint32_t>(mapped.reader_count()),
+            [&mapped](uint32_t slot, void* memory) {
+                const SnapshotReader& record = mapped.reader_at(slot);
+                new (memory) Reader(mapped.str(record.fio), mapped.str(record.fio_key), record.card_number);
+            });
+        mapped_snapshot = std::move(snapshot);
+        next_loan_id = mapped.next_loan_id();
+        last_lsn = mapped.journal_lsn();
+        catalog_mutex.set_pending(true);
+    }
+
+    // Автор записи id снимка (nullptr для SNAPSHOT_NO_ID); создается при первом обращении
+    std::shared_ptr<Author> mapped_author(uint32_t id) {
+        if (id == SNAPSHOT_NO_ID) {
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> lock(mapped_mutex);
+        if (id >= mapped_authors.size()) {
+            throw std::runtime_error("Поврежденный снимок каталога: некорректная ссылка на автора.");
+        }
+        std::shared_ptr<Author>& author = mapped_authors[id];
+        if (!author) {
+            const SnapshotAuthor& record = mapped_snapshot->author_at(id);
+            if (record.flags & SNAPSHOT_AUTHOR_FAMOUS) {
+                author = std::make_shared<FamousAuthor>(mapped_snapshot->str(record.fio), mapped_snapshot->str(record.fio_key),
+                    record.birth_year, mapped_snapshot->str(record.most_famous_work), record.awards_count);
+            }
+            else {
+                author = std::make_shared<Author>(mapped_snapshot->str(record.fio), mapped_snapshot->str(record.fio_key), record.birth_year);
+            }
+        }
+        return author;
+    }
+
+    // Номер записи книги или читателя из секции снимка (проверяется, что запись существует)
+    static uint32_t mapped_id(uint32_t id, size_t count) {
+        if (id >= count) {
+            throw std::runtime_error("Поврежденный снимок каталога: некорректный номер записи в индексе.");
+        }
+        return id;
+    }
+
+    // Достраивание каталога из mapped_snapshot; вызывается из catalog_mutex под
+    // монопольной блокировкой перед первой операцией, которой мало секций файла.
+    // Если снимок поврежден, каталог снова открывается из файла без разбора,
+    // и ту же ошибку получает каждая следующая такая операция
+    void build_mapped_catalog() {
+        try {
+            fill_from_snapshot(*mapped_snapshot);
+        }
+        catch (...) {
+            std::unique_ptr<CatalogSnapshot> snapshot = std::move(mapped_snapshot);
+            clear();
+            attach_snapshot(std::move(snapshot));
+            throw;
+        }
+        mapped_authors.clear();
+        mapped_snapshot.reset(); // Строки уже скопированы в объекты, файл больше не нужен
+        catalog_mutex.set_pending(false);
+    }
+
+    // Заполнение каталога из снимка. Объекты создаются из записей, а индексы
+    // заполняются в готовом порядке из файла: ключи сортировки не вычисляются,
+    // деревья растут вставками в конец, а упорядоченные представления и
+    // триграммы не строятся заново
+    void fill_from_snapshot(const CatalogSnapshot& snapshot) {
+        authors.reserve(snapshot.author_count());
+        for (size_t i = 0; i < snapshot.author_count(); i++) {
+            const SnapshotAuthor& record = snapshot.author_at(i);
+            if (author_directory.contains(snapshot.str(record.fio))) {
+                throw std::runtime_error("Поврежденный снимок каталога: повторяющееся ФИО автора.");
+            }
+            register_author(mapped_author(static_cast<uint32_t>(i)));
+        }
+        std::vector<uint32_t> author_order(snapshot.get_author_order(), snapshot.get_author_order() + authors.size());
+        AuthorOrder author_less{ &authors };
+        for (size_t i = 0; i < author_order.size(); i++) {
+            if (author_order[i] >= authors.size() || (i > 0 && !author_less(author_order[i - 1], author_order[i]))) {
+                throw std::runtime_error("Поврежденный снимок каталога: нарушен порядок индекса.");
+            }
+        }
+        authors_by_fio.assign_sorted(std::move(author_order));
+
+        book_pool.load_all();
+        books.reserve(snapshot.book_count());
+        book_columns.reserve(snapshot.book_count());
+        for (size_t i = 0; i < snapshot.book_count(); i++) {
+            const SnapshotBook& record = snapshot.book_at(i);
+            SlabHandle handle = book_pool.handle_at(static_cast<uint32_t>(i));
+            books.push_back(handle);
+            book_columns.append(get_book(handle), record.author_id); // SNAPSHOT_NO_ID совпадает с NO_AUTHOR_ID
+            author_directory.add_book(handle.get_slot(), record.author_id);
+            analytics.add_book(handle.get_slot(), record.pub_year);
+        }
+        if (snapshot.isbn_count() != books.size()) {
+            throw std::runtime_error("Поврежденный снимок каталога: индекс ISBN не совпадает с книгами.");
+        }
+        isbn_index.reserve(books.size());
+        std::vector<bool> has_isbn(books.size());
+        for (size_t i = 0; i < snapshot.isbn_count(); i++) {
+            const SnapshotIsbnEntry& entry = snapshot.isbn_at(i);
+            uint64_t body = entry.isbn_key / 10;
+            if (entry.book_id >= books.size() || has_isbn[entry.book_id] || body < ISBN13_MIN_BODY || body > ISBN13_MAX_BODY
+                || !isbn_index.insert(entry.isbn_key, books[entry.book_id])) {
+                throw std::runtime_error("Поврежденный снимок каталога: некорректный или повторяющийся ISBN.");
+            }
+            has_isbn[entry.book_id] = true;
+        }
+        std::vector<SlabHandle> by_title = snapshot_order(snapshot.get_title_order(), books, PoolOrder<Book>{ &book_pool });
+        for (SlabHandle handle : by_title) {
+            title_index.emplace_hint(title_index.end(), get_book(handle).get_title_key(), handle); // Вставка в конец - O(1)
+        }
+        books_by_title.assign_sorted(std::move(by_title));
+        search_index.load_from(snapshot, static_cast<uint32_t>(books.size()), static_cast<uint32_t>(authors.size()));
+
+        reader_pool.load_all();
+        readers.reserve(snapshot.reader_count());
+        reader_card_index.reserve(snapshot.reader_count());
+        reader_fio_index.reserve(snapshot.reader_count());
+        for (size_t i = 0; i < snapshot.reader_count(); i++) {
+            SlabHandle handle = reader_pool.handle_at(static_cast<uint32_t>(i));
+            readers.push_back(handle);
+            reader_fio_index.emplace(get_reader(handle).get_fio(), handle);
+            analytics.add_reader(handle.get_slot());
+        }
+        // Записи билетов строго возрастают и совпадают с билетами читателей, поэтому повторов нет
+        for (size_t i = 0; i < snapshot.reader_count(); i++) {
+            const SnapshotCardEntry& entry = snapshot.card_at(i);
+            if (entry.reader_id >= readers.size() || (i > 0 && entry.card_number <= snapshot.card_at(i - 1).card_number)
+                || get_reader(readers[entry.reader_id]).get_card_number() != entry.card_number) {
+                throw std::runtime_error("Поврежденный снимок каталога: некорректный или повторяющийся номер билета.");
+            }
+            reader_card_index.emplace(entry.card_number, readers[entry.reader_id]);
+        }
+        readers_by_fio.assign_sorted(snapshot_order(snapshot.get_reader_order(), readers, PoolOrder<Reader>{ &reader_pool }));
+
+        std::vector<SlabHandle> loan_handles;
+        loan_handles.reserve(snapshot.loan_count());
+        for (size_t i = 0; i < snapshot.loan_count(); i++) {
+            const SnapshotLoan& record = snapshot.loan_at(i);
+            SlabHandle loan = loan_pool.create(record.id, books.at(record.book_id), readers.at(record.reader_id),
+                Date(record.issue_day), Date(record.return_day));
+            get_loan(loan).renew_count = record.renew_count;
+            if (record.flags & SNAPSHOT_LOAN_RETURNED) {
+                get_loan(loan).close(Date(record.returned_day));
+            }
+            register_loan(loan); // Экземпляры в снимке уже учитывают открытые выдачи
+            loan_handles.push_back(loan);
+        }
+        std::vector<SlabHandle> open_by_date;
+        open_by_date.reserve(loans.size());
+        for (SlabHandle loan : snapshot_order(snapshot.get_loan_order(), loan_handles, PoolOrder<Loan>{ &loan_pool })) {
+            std::multimap<Date, SlabHandle>& by_date = loan_shard(get_loan(loan).get_id()).by_date;
+            by_date.emplace_hint(by_date.end(), get_loan(loan).get_issue_date(), loan);
+            if (!get_loan(loan).is_returned()) {
+                open_by_date.push_back(loan);
+            }
+        }
+        open_loans_by_date.assign_sorted(std::move(open_by_date));
+    }
+
+public:
+    // Метод для загрузки каталога из бинарного снимка (false, если файла нет).
+    // Записи разбираются при первой операции, которой мало секций файла
+    bool load_snapshot(const std::string& path) {
+        LIBRARY_TIMED(OP_LOAD);
+        std::unique_lock<std::shared_timed_mutex> reset_lock(reset_mutex); // Ждет освобождения снимков для чтения
+        catalog_mutex.lock_discarding(); // Прежний каталог заменяется, достраивать его незачем
+        std::unique_lock<CatalogMutex> lock(catalog_mutex, std::adopt_lock);
+        try {
+            return read_snapshot(path);
+        }
+        catch (...) {
+            clear();
+            throw;
+        }
+    }
+
+    // Метод для открытия хранилища: загрузка снимка, воспроизведение журнала
+    // поверх него и открытие журнала для новых записей.
+    // Возвращает количество воспроизведенных записей журнала.
+    size_t open_storage(const std::string& snapshot_file, const std::string& journal_file,
+        const JournalOptions& options = JournalOptions()) {
+        LIBRARY_TIMED(OP_LOAD);
+        std::unique_lock<std::shared_timed_mutex> reset_lock(reset_mutex);
+        catalog_mutex.lock_discarding();
+        std::unique_lock<CatalogMutex> lock(catalog_mutex, std::adopt_lock);
+        journal.reset();
+        clear();
+        try {
+            return open_storage_unlocked(snapshot_file, journal_file, options);
+        }
+        catch (...) {
+            journal.reset();
+            clear(); // Не оставляем частично загруженный каталог
+            throw;
+        }
+    }
+
+    // Метод для создания контрольной точки: снимок каталога и очистка журнала
+    void checkpoint() {
+        std::unique_lock<CatalogMutex> lock(catalog_mutex);
+        checkpoint_unlocked();
+    }
+
+    // Метод для сброса журнала на диск; нужен, когда изменения не ждут сброса
+    // (JournalOptions::wait_for_sync = false), перед подтверждением их клиентам
+    void sync_journal() {
+        if (journal) {
+            journal->sync();
+        }
+    }
+
+private:
+    // Вставка одной записи импорта под монопольной блокировкой; false - запись отвергнута
+    bool import_record(ImportEntity entity, std::vector<std::string>& fields, size_t& created_authors) {
+        switch (entity) {
+        case IMPORT_AUTHORS: {
+            int birth_year = 0, awards = 0;
+            if (fields[0].empty() || !parse_import_int(fields[1], birth_year) || author_directory.contains(fields[0])) {
+                return false; // Пустое ФИО, некорректный год или автор уже есть
+            }
+            parse_import_int(fields[3], awards);
+            insert_author(std::make_shared<FamousAuthor>(fields[0], birth_year, fields[2], awards));
+            return true;
+        }
+        case IMPORT_BOOKS: {
+            int pub_year = 0, copies = 0;
+            if (fields[0].empty() || fields[2].empty() || !parse_import_int(fields[3], pub_year) || !parse_import_int(fields[4], copies)) {
+                return false;
+            }
+            uint64_t isbn_key = NO_ISBN;
+            if (!parse_isbn(fields[1], isbn_key) || isbn_index.find(isbn_key).is_valid()) {
+                return false; // Некорректный или уже занятый ISBN
+            }
+            std::vector<uint32_t> found = author_directory.find(fields[2]); // При совпадении ФИО берется первый
+            if (found.empty()) {
+                found.push_back(static_cast<uint32_t>(authors.size()));
+                insert_author(std::make_shared<Author>(fields[2], 0));
+                created_authors++;
+            }
+            isbn_index.insert(isbn_key, append_book(std::move(fields[0]), authors[found.front()], pub_year, copies, std::move(fields[1])));
+            return true;
+        }
+        case IMPORT_READERS: {
+            int card_number = 0;
+            if (fields[0].empty() || !parse_import_int(fields[1], card_number)) {
+                return false;
+            }
+            return insert_reader(fields[0], card_number).is_valid();
+        }
+        }
+        return false;
+    }
+
+    // Завершение импорта под монопольной блокировкой: перестройка индекса
+    // названий и контрольная точка. Импорт не журналируется, поэтому снимок
+    // пишется до снятия блокировки - иначе журнал может сослаться на еще
+    // не сохраненные записи. Если снимок записать не удалось, каталог
+    // расходится с хранилищем и изменения отклоняются до успешной контрольной точки
+    void finish_import(ImportEntity entity, const ImportResult& result) {
+        if (entity == IMPORT_BOOKS) {
+            rebuild_title_index();
+        }
+        if (!journal || result.imported == 0) {
+            return;
+        }
+        try {
+            checkpoint_unlocked();
+        }
+        catch (const std::exception& error) {
+            storage_failure = std::string("Импорт не сохранен (") + error.what() + "), изменения отклоняются до успешной контрольной точки.";
+            throw std::runtime_error(storage_failure);
+        }
+    }
+
+    // Открытие хранилища под монопольной блокировкой
+    size_t open_storage_unlocked(const std::string& snapshot_file, const std::string& journal_file,
+        const JournalOptions& options) {
+        read_snapshot(snapshot_file);
+        snapshot_path = snapshot_file;
+
+        size_t replayed = 0;
+        uint64_t valid_size = Journal::read_all(journal_file,
+            [this, &replayed](uint64_t lsn, uint8_t type, const std::string& payload) {
+                if (lsn <= last_lsn) {
+                    return; // Запись уже вошла в снимок
+                }
+                if (catalog_mutex.is_pending()) {
+                    build_mapped_catalog(); // Записи журнала применяются к полному каталогу
+                }
+                apply_journal_record(type, payload);
+                last_lsn = lsn;
+                replayed++;
+            });
+        truncate_file(journal_file, valid_size); // Отбрасываем недописанный хвост, если он есть
+
+        journal.reset(new Journal(journal_file, options, last_lsn + 1));
+        storage_failure.clear();
+        return replayed;
+    }
+
+public:
+    // Метод для пакетного импорта авторов, книг или читателей из CSV/JSONL.
+    // Авторы книг ищутся по ФИО; неизвестные авторы создаются.
+    // Упорядоченные индексы перестраиваются один раз в конце, а вместо
+    // журналирования каждой записи делается одна контрольная точка.
+    ImportResult import_file(const std::string& path, ImportEntity entity, unsigned threads = std::thread::hardware_concurrency()) {
+        LIBRARY_TIMED(OP_IMPORT);
+        CatalogImporter importer(import_columns(entity), detect_import_format(path), threads);
+        size_t created_authors = 0;
+        std::unique_lock<CatalogMutex> lock(catalog_mutex);
+        ImportResult result = importer.run(path, [this, entity, &created_authors](std::vector<std::string>& fields) {
+            return import_record(entity, fields, created_authors);
+        });
+        result.created_authors = created_authors;
+        finish_import(entity, result);
+        return result;
+    }
+
+    // Метод для импорта уже разобранных записей (поля в порядке import_columns) -
+    // так шардированная библиотека передает шарду его часть файла
+    ImportResult import_records(ImportEntity entity, std::vector<std::vector<std::string>>& records) {
+        LIBRARY_TIMED(OP_IMPORT);
+        ImportResult result;
+        std::unique_lock<CatalogMutex> lock(catalog_mutex);
+        for (std::vector<std::string>& fields : records) {
+            if (import_record(entity, fields, result.created_authors)) {
+                result.imported++;
+            }
+            else {
+                result.skipped++;
+            }
+        }
+        finish_import(entity, result);
+        return result;
+    }
+
+    // Метод для импорта из файла через меню
+    void import_from_file() {
+        printf("Что импортировать:\n");
+        printf("1. Авторов (fio, birth_year, most_famous_work, awards_count)\n");
+        printf("2. Книги (title, isbn, author, pub_year, copies)\n");
+        printf("3. Читателей (fio, card_number)\n");
+        int choice;
+        scanf("%d", &choice);
+        if (choice < 1 || choice > 3) {
+            printf("Неверный выбор.\n");
+            return;
+        }
+
+        printf("Введите путь к файлу (.csv или .jsonl): ");
+        std::string path;
+        while (getchar() != '\n'); // Очистка буфера
+        std::getline(std::cin, path);
+        static const char* const entities[] = { "authors", "books", "readers" };
+        record_request({ "IMPORT", entities[choice - 1], path });
+
+        try {
+            auto start = std::chrono::steady_clock::now();
+            ImportResult result = import_file(path, static_cast<ImportEntity>(choice - 1));
+            double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            printf("Импортировано: %zu, пропущено: %zu, создано авторов: %zu (%.1f мс)\n",
+                result.imported, result.skipped, result.created_authors, elapsed_ms);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Ошибка при импорте: " << e.what() << std::endl;
+        }
+    }
+
+    // Метод для поиска и вывода информации о книге
+    void search_and_print_book() {
+        printf("Выберите тип поиска:\n");
+        printf("1. По названию\n");
+        printf("2. По ISBN\n");
+        printf("3. По началу названия\n");
+        printf("4. По году публикации и наличию\n");
+        printf("5. Нечеткий поиск по названию и автору\n");
+        printf("6. По нескольким условиям\n");
+        printf("7. По автору\n");
+        int choice;
+        scanf("%d", &choice);
+
+        if (choice == 6) {
+            search_and_print_books_by_query();
+            return;
+        }
+
+        if (choice == 7) {
+            search_and_print_author_books();
+            return;
+        }
+
+        if (choice == 4) {
+            int year_from, year_to, min_copies;
+            printf("Введите диапазон годов публикации (от и до): ");
+            scanf("%d %d", &year_from, &year_to);
+            printf("Введите минимальное количество экземпляров: ");
+            scanf("%d", &min_copies);
+            record_request({ "FILTER", std::to_string(min_copies), std::to_string(year_from), std::to_string(year_to) });
+            auto found_books = filter_books(min_copies, year_from, year_to);
+            printf("\nНайдено книг: %zu\n", found_books.size());
+            for (const auto& book : found_books) {
+                std::cout << "\n" << *book << std::endl;
+            }
+            return;
+        }
+
+        std::string search_term;
+        printf("Введите поисковый запрос: ");
+        while (getchar() != '\n'); // Очистка буфера
+        std::getline(std::cin, search_term);
+
+        if (choice >= 1 && choice <= 5) {
+            static const char* const commands[] = { "TITLE", "BOOK", "PREFIX", "", "SEARCH" };
+            record_request({ commands[choice - 1], search_term });
+        }
+        std::vector<BookRef> found_books;
+        switch (choice) {
+        case 1:
+            found_books = find_books_by_title(search_term);
+            break;
+        case 2: {
+            auto found_book = find_book_by_isbn(search_term);
+            if (found_book) {
+                found_books.push_back(found_book);
+            }
+            break;
+        }
+        case 3:
+            found_books = find_books_by_title_prefix(search_term);
+            break;
+        case 5:
+            found_books = search_books(search_term);
+            break;
+        default:
+            printf("Неверный выбор.\n");
+            return;
+        }
+
+        if (found_books.empty()) {
+            printf("Книга не найдена.\n");
+            return;
+        }
+        printf("\nНайдено книг: %zu\n", found_books.size());
+        for (const auto& book : found_books) {
+            std::cout << "\nНайдена книга:\n" << *book << std::endl;
+        }
+    }
+
+    // Метод для поиска авторов (по ФИО или его началу, произведению, наградам) и вывода их книг
+    void search_and_print_author_books() {
+        printf("Искать автора:\n");
+        printf("1. По ФИО или его началу\n");
+        printf("2. По самому известному произведению\n");
+        printf("3. По количеству наград (не меньше)\n");
+        int choice;
+        scanf("%d", &choice);
+
+        std::vector<std::shared_ptr<Author>> found_authors;
+        if (choice == 3) {
+            int min_awards;
+            printf("Введите минимальное количество наград: ");
+            scanf("%d", &min_awards);
+            record_request({ "AUTHOR_BOOKS", "awards", std::to_string(min_awards) });
+            found_authors = find_authors_with_awards(min_awards);
+        }
+        else if (choice == 1 || choice == 2) {
+            std::string search_term;
+            printf(choice == 1 ? "Введите ФИО или начало ФИО: " : "Введите название произведения: ");
+            while (getchar() != '\n'); // Очистка буфера
+            std::getline(std::cin, search_term);
+            record_request({ "AUTHOR_BOOKS", choice == 1 ? "fio" : "work", search_term });
+            found_authors = choice == 1 ? find_authors_by_fio_prefix(search_term, AUTHOR_CHOICE_LIMIT)
+                : find_authors_by_famous_work(search_term);
+        }
+        else {
+            printf("Неверный выбор.\n");
+            return;
+        }
+
+        if (found_authors.empty()) {
+            printf("Автор не найден.\n");
+            return;
+        }
+        for (const auto& author : found_authors) {
+            printf("\n");
+            author->print_Author();
+            std::vector<BookRef> author_books = find_books_by_author(author);
+            printf("Книг в библиотеке: %zu\n", author_books.size());
+            for (const auto& book : author_books) {
+                printf("  %s (ISBN %s, %d)\n", book->get_title().c_str(), book->get_isbn().c_str(), book->get_pub_year());
+            }
+        }
+    }
+
+    // Метод для поиска книг по сочетанию условий (пустой ввод - условие не задано)
+    void search_and_print_books_by_query() {
+        std::string prefix, author;
+        int year_from, year_to, min_copies;
+        printf("Введите начало названия (пусто - любое): ");
+        while (getchar() != '\n'); // Очистка буфера
+        std::getline(std::cin, prefix);
+        printf("Введите ФИО автора (пусто - любой): ");
+        std::getline(std::cin, author);
+        printf("Введите диапазон годов публикации (от и до): ");
+        scanf("%d %d", &year_from, &year_to);
+        printf("Введите минимальное количество экземпляров: ");
+        scanf("%d", &min_copies);
+        record_request({ "QUERY", prefix, author, std::to_string(year_from), std::to_string(year_to), std::to_string(min_copies) });
+
+        Query query = Query::pub_year(year_from, year_to) && Query::copies(min_copies);
+        if (!prefix.empty()) {
+            query = query && Query::title_prefix(prefix);
+        }
+        if (!author.empty()) {
+            query = query && Query::author(author);
+        }
+        auto start = std::chrono::steady_clock::now();
+        QueryResult<Book> found_books = query_books(query);
+        size_t found = 0;
+        for (BookRef book : found_books) {
+            std::cout << "\nНайдена книга:\n" << *book << std::endl;
+            found++;
+        }
+        double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        printf("\nНайдено книг: %zu (план: %s, кандидатов: %zu, %.1f мс)\n",
+            found, found_books.get_plan().c_str(), found_books.get_estimate(), elapsed_ms);
+    }
+
+    // Метод для поиска и вывода выдач за период
+    void search_and_print_loans() {
+        std::string from_text, to_text;
+        printf("Введите начальную дату периода (дд.мм.гггг): ");
+        std::cin >> from_text;
+        printf("Введите конечную дату периода (дд.мм.гггг): ");
+        std::cin >> to_text;
+        record_request({ "LOANS_BETWEEN", from_text, to_text });
+        try {
+            auto found_loans = find_loans_issued_between(Date::parse(from_text), Date::parse(to_text));
+            printf("\nНайдено выдач: %zu\n", found_loans.size());
+            for (const auto& loan : found_loans) {
+                std::cout << "\n";
+                print_loan(*loan);
+                std::cout << std::endl;
+            }
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Ошибка: " << e.what() << std::endl;
+        }
+    }
+
+    // Метод для перевода часов и вывода ставших просроченными выдач
+    void advance_clock_and_print_overdue() {
+        printf("Текущая дата: %s\n", get_clock().to_string().c_str());
+        printf("Введите новую дату (дд.мм.гггг): ");
+        std::string day_text;
+        std::cin >> day_text;
+        record_request({ "CLOCK", day_text });
+        try {
+            auto newly_overdue = advance_clock(Date::parse(day_text));
+            printf("\nНовых просроченных выдач: %zu (всего: %zu)\n", newly_overdue.size(), count_overdue_loans());
+            for (const auto& loan : newly_overdue) {
+                std::cout << "\n";
+                print_loan(*loan);
+                std::cout << std::endl;
+            }
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Ошибка: " << e.what() << std::endl;
+        }
+    }
+
+    // Метод для вывода читателя вместе с его открытыми и просроченными выдачами
+    void print_reader_with_overdue(const ReaderRef& reader) const {
+        std::cout << "\nНайден читатель:\n" << *reader << std::endl;
+        for (const auto& loan : find_open_loans(reader)) {
+            printf(" - %s (взято: %s, выдача №%llu)\n", book_of(*loan)->get_title().c_str(),
+                loan->get_issue_date().to_string().c_str(), static_cast<unsigned long long>(loan->get_id()));
+        }
+        auto overdue_loans = find_overdue_loans(reader);
+        if (!overdue_loans.empty()) {
+            printf("Просрочено выдач: %zu\n", overdue_loans.size());
+            for (const auto& loan : overdue_loans) {
+                printf(" - %s (вернуть до: %s)\n", book_of(*loan)->get_title().c_str(),
+                    loan->get_return_date().to_string().c_str());
+            }
+        }
+    }
+
+    // Метод для поиска и вывода информации о читателе
+    void search_and_print_reader() {
+        printf("Выберите тип поиска:\n");
+        printf("1. По номеру билета\n");
+        printf("2. По ФИО\n");
+        int choice;
+        scanf("%d", &choice);
+
+        if (choice == 1) {
+            printf("Введите номер читательского билета: ");
+            int card_number;
+            scanf("%d", &card_number);
+            record_request({ "READER", std::to_string(card_number) });
+            auto reader = find_reader_by_card(card_number);
+            if (reader) {
+                print_reader_with_overdue(reader);
+            }
+            else {
+                printf("Читатель не найден.\n");
+            }
+        }
+        else if (choice == 2) {
+            printf("Введите ФИО читателя: ");
+            std::string name;
+            while (getchar() != '\n'); // Очистка буфера
+            std::getline(std::cin, name);
+            record_request({ "READERS", name });
+
+            // Поиск по хеш-индексу, выводим всех однофамильцев
+            auto found_readers = find_readers_by_fio(name);
+            for (const auto& reader : found_readers) {
+                print_reader_with_overdue(reader);
+            }
+            if (found_readers.empty()) {
+                printf("Читатель не найден.\n");
+            }
+        }
+        else {
+            printf("Неверный выбор.\n");
+        }
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Шардированная библиотека
+// ---------------------------------------------------------------------------
+// Книги делятся между шардами по хешу ISBN, читатели - по хешу номера
+// билета. Каждый шард - самостоятельная Library со своими пулами, индексами,
+// журналом и блокировками, поэтому изменения в разных шардах не ждут друг
+// друга. Поиск по ключу идет в один шард; просмотры, поиск по названию и
+// отчеты рассылаются всем шардам, а упорядоченные части сливаются.
+// Авторы повторяются в каждом шарде: книга ссылается на автора своего шарда.
+// Выдача целиком живет в шарде книги: если билет читателя относится к
+// другому шарду, в шарде книги заводится гостевая запись читателя с тем же
+// ФИО и билетом. Поэтому выдача, возврат и продление меняют ровно один шард
+// и не требуют распределенной транзакции. Номера выдач не пересекаются:
+// шард s из N выдает номера s + 1, s + 1 + N, s + 1 + 2N, ...
+
+const uint64_t SHARD_HASH_MULTIPLIER = 0x9E3779B97F4A7C15ULL; // 2^64 / золотое сечение
+
+// Номер шарда для ключа (старшие биты произведения перемешаны лучше младших)
+size_t shard_of_key(uint64_t key, size_t shard_count) {
+    return static_cast<size_t>(((key * SHARD_HASH_MULTIPLIER) >> 32) % shard_count);
+}
+
+// Слияние упорядоченных частей: fn(элемент) в порядке less, равные элементы - в порядке частей.
+// fn возвращает false, чтобы остановить слияние
+template <typename T, typename Less, typename Fn>
+void merge_ordered(const std::vector<std::vector<T>>& parts, Less less, Fn fn) {
+    typedef std::pair<size_t, size_t> Cursor; // Часть и позиция в ней
+    auto later = [&parts, &less](const Cursor& a, const Cursor& b) {
+        const T& first = parts[a.first][a.second];
+        const T& second = parts[b.first][b.second];
+        if (less(second, first)) {
+            return true;
+        }
+        return !less(first, second) && b.first < a.first;
+    };
+    std::priority_queue<Cursor, std::vector<Cursor>, decltype(later)> heap(later);
+    for (size_t part = 0; part < parts.size(); part++) {
+        if (!parts[part].empty()) {
+            heap.push(Cursor(part, 0));
+        }
+    }
+    while (!heap.empty()) {
+        Cursor top = heap.top();
+        heap.pop();
+        if (!fn(parts[top.first][top.second])) {
+            return;
+        }
+        if (++top.second < parts[top.first].size()) {
+            heap.push(top);
+        }
+    }
+}
+
+// Слияние упорядоченных частей в один вектор (не более limit элементов)
+template <typename T, typename Less>
+std::vector<T> merge_ordered(const std::vector<std::vector<T>>& parts, Less less, size_t limit = SIZE_MAX) {
+    std::vector<T> result;
+    if (limit == 0) {
+        return result;
+    }
+    merge_ordered(parts, less, [&result, limit](const T& item) {
+        result.push_back(item);
+        return result.size() < limit;
+    });
+    return result;
+}
+
+bool loan_before(const Loan& a, const Loan& b) {
+    return a.get_issue_date() < b.get_issue_date()
+        || (!(b.get_issue_date() < a.get_issue_date()) && a.get_id() < b.get_id());
+}
+
+// Дописывание числа в ключ старшими байтами вперед (порядок байтов совпадает с порядком чисел)
+void append_order_bytes(std::string& key, uint64_t value, size_t bytes) {
+    for (size_t i = bytes; i-- > 0;) {
+        key += static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+// Ключи слияния результатов шардов: байтовые строки, которые при сравнении
+// как беззнаковые байты упорядочены так же, как объекты (книги - по названию,
+// читатели - по ФИО, выдачи - по дате выдачи и номеру)
+struct BookMergeOrder {
+    static void append_key(const Book& book, std::string& keys) { keys += book.get_title_key(); }
+};
+
+struct ReaderMergeOrder {
+    static void append_key(const Reader& reader, std::string& keys) { keys += reader.get_fio_key(); }
+};
+
+struct LoanMergeOrder {
+    static void append_key(const Loan& loan, std::string& keys) {
+        append_order_bytes(keys, static_cast<uint64_t>(static_cast<int64_t>(loan.get_issue_date().get_day_number()) - INT32_MIN), 4);
+        append_order_bytes(keys, loan.get_id(), 8);
+    }
+};
+
+// Слияние упорядоченных частей ссылок (по одной части на шард) в порядке
+// Order, не более limit элементов. Сначала ключи элементов каждой части
+// выписываются подряд в один буфер - объекты читаются независимыми
+// обращениями, и задержки памяти перекрываются. Слияние затем сравнивает
+// только ключи первых элементов частей (частей немного - они перебираются
+// подряд), а буферы читаются последовательно. Равные - в порядке частей
+template <typename Order, typename T>
+std::vector<SlabRef<T>> merge_refs(const std::vector<std::vector<SlabRef<T>>>& parts, size_t limit = SIZE_MAX) {
+    struct PartKeys {
+        std::string bytes; // Ключи элементов подряд
+        std::vector<size_t> ends; // Конец ключа каждого элемента в bytes
+    };
+    std::vector<PartKeys> keys(parts.size());
+    size_t total = 0;
+    for (size_t part = 0; part < parts.size(); part++) {
+        keys[part].ends.reserve(parts[part].size());
+        for (const SlabRef<T>& item : parts[part]) {
+            Order::append_key(*item, keys[part].bytes);
+            keys[part].ends.push_back(keys[part].bytes.size());
+        }
+        total += parts[part].size();
+    }
+    // Ключ элемента position части part как указатель и длина
+    auto key_of = [&keys](size_t part, size_t position, size_t& length) {
+        size_t begin = position > 0 ? keys[part].ends[position - 1] : 0;
+        length = keys[part].ends[position] - begin;
+        return reinterpret_cast<const unsigned char*>(keys[part].bytes.data()) + begin;
+    };
+    std::vector<size_t> positions(parts.size(), 0);
+    std::vector<SlabRef<T>> result;
+    result.reserve(std::min(total, limit));
+    while (result.size() < limit) {
+        size_t best = parts.size();
+        const unsigned char* best_key = nullptr;
+        size_t best_length = 0;
+        for (size_t part = 0; part < parts.size(); part++) {
+            if (positions[part] >= parts[part].size()) {
+                continue;
+            }
+            size_t length = 0;
+            const unsigned char* key = key_of(part, positions[part], length);
+            if (best != parts.size()) {
+                int order = std::memcmp(key, best_key, std::min(length, best_length));
+                if (order > 0 || (order == 0 && length >= best_length)) {
+                    continue;
+                }
+            }
+            best = part;
+            best_key = key;
+            best_length = length;
+        }
+        if (best == parts.size()) {
+            break;
+        }
+        result.push_back(parts[best][positions[best]++]);
+    }
+    return result;
+}
+
+// Порядок ссылок на книги по названию и открытых выдач по дате выдачи и номеру
+bool book_ref_before(const BookRef& a, const BookRef& b) {
+    return *a < *b;
+}
+
+bool loan_ref_before(const LoanRef& a, const LoanRef& b) {
+    return loan_before(*a, *b);
+}
+
+// Класс ShardWorkers - постоянные потоки для рассылки по шардам (запуск
+// потоков на каждый запрос стоил дороже самого запроса)
+class ShardWorkers {
+    std::vector<std::thread> threads;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable task_ready;
+    bool stopping;
+
+    // Рабочий поток: задачи из очереди до остановки
+    void work() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            task_ready.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (tasks.empty()) {
+                return;
+            }
+            std::function<void()> task = std::move(tasks.front());
+            tasks.pop();
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    }
+
+public:
+    explicit ShardWorkers(size_t count) : stopping(false) {
+        for (size_t i = 0; i < count; i++) {
+            threads.emplace_back(&ShardWorkers::work, this);
+        }
+    }
+
+    ShardWorkers(const ShardWorkers&) = delete;
+    ShardWorkers& operator=(const ShardWorkers&) = delete;
+
+    ~ShardWorkers() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        task_ready.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    // Постановка задачи в очередь
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push(std::move(task));
+        }
+        task_ready.notify_one();
+    }
+};
+
+// Класс ShardedLibrary - библиотека из нескольких шардов Library
+class ShardedLibrary {
+    std::vector<std::unique_ptr<Library>> shards;
+    mutable ShardWorkers workers; // Потоки для шардов 1..N-1 (шард 0 - в вызывающем потоке)
+    std::mutex author_mutex; // Автор добавляется во все шарды целиком
+
+    // Записи шарда для слияния отчетов (указывают в объекты снимка шарда)
+    struct BookRow {
+        const Book* book;
+        int copies;
+    };
+
+    struct ReaderRow {
+        const Reader* reader;
+        size_t open_loans;
+    };
+
+    struct LoanRow {
+        const Loan* loan;
+        const LoanState* state;
+        const Book* book;
+        const Reader* reader;
+    };
+
+    // Вызов fn(номер шарда, шард) для всех шардов по очереди - для быстрых запросов
+    // через индексы, где запуск потоков дороже самого поиска
+    template <typename Fn>
+    void for_each_shard(Fn fn) const {
+        for (size_t s = 0; s < shards.size(); s++) {
+            fn(s, *shards[s]);
+        }
+    }
+
+    // Состояние одной рассылки: какие шарды уже взяты и сколько из них еще выполняют потоки
+    struct ScatterState {
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::vector<bool> claimed;
+        size_t running = 0;
+    };
+
+    // Вызов fn(номер шарда, шард) для всех шардов параллельно на постоянных потоках
+    // (шард 0 - в текущем потоке). Шарды, до которых потоки не дошли (они заняты
+    // другими рассылками), вызывающий выполняет сам, поэтому рассылка не ждет
+    // очереди и рассылки не блокируют друг друга. Исключение первого по номеру
+    // шарда передается вызывающему после завершения всех шардов
+    template <typename Fn>
+    void scatter(Fn fn) const {
+        std::vector<std::exception_ptr> errors(shards.size());
+        auto run = [this, &fn, &errors](size_t s) {
+            try {
+                fn(s, *shards[s]);
+            }
+            catch (...) {
+                errors[s] = std::current_exception();
+            }
+        };
+        auto state = std::make_shared<ScatterState>();
+        state->claimed.assign(shards.size(), false);
+        for (size_t s = 1; s < shards.size(); s++) {
+            // Задача держит состояние и после возврата из scatter; run вызывается только до него
+            workers.submit([state, &run, s]() {
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (state->claimed[s]) {
+                        return;
+                    }
+                    state->claimed[s] = true;
+                    state->running++;
+                }
+                run(s);
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->running--;
+                state->finished.notify_all();
+            });
+        }
+        run(0);
+        for (size_t s = 1; s < shards.size(); s++) {
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (state->claimed[s]) {
+                    continue;
+                }
+                state->claimed[s] = true;
+            }
+            run(s);
+        }
+        {
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->finished.wait(lock, [&state]() { return state->running == 0; });
+        }
+        for (const auto& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+    // Потоков на шард для внутреннего распараллеливания при рассылке
+    unsigned threads_per_shard() const {
+        return std::max(1u, std::thread::hardware_concurrency() / static_cast<unsigned>(shards.size()));
+    }
+
+    // Снимки всех шардов, снятые параллельно. Каждый снимок согласован внутри шарда;
+    // общего момента для всех шардов нет, но выдача не пересекает границу шардов
+    std::vector<std::unique_ptr<ReadView>> read_views() const {
+        std::vector<std::unique_ptr<ReadView>> views(shards.size());
+        scatter([&views](size_t s, const Library& library) {
+            views[s].reset(new ReadView(library.read_view()));
+        });
+        return views;
+    }
+
+    // Составной запрос во всех шардах параллельно: run(шард) возвращает QueryResult,
+    // уже упорядоченный по Order; записи, прошедшие keep(номер шарда, ссылка), сливаются
+    template <typename Order, typename Ref, typename Run, typename Keep>
+    std::vector<Ref> gather_query(Run run, Keep keep) const {
+        std::vector<std::vector<Ref>> parts(shards.size());
+        scatter([&](size_t s, const Library& library) {
+            auto found = run(library);
+            for (const Ref& item : found) {
+                if (keep(s, item)) {
+                    parts[s].push_back(item);
+                }
+            }
+        });
+        return merge_refs<Order>(parts);
+    }
+
+    // Слияние таблицы отчета из снимков шардов в порядке сортировки
+    void write_report(const std::vector<std::unique_ptr<ReadView>>& views, ReportWriter& writer, ReportEntity entity) const {
+        switch (entity) {
+        case REPORT_AUTHORS:
+            ::write_report(*views[0], writer, REPORT_AUTHORS); // Авторы одинаковы во всех шардах
+            break;
+        case REPORT_BOOKS: {
+            std::vector<std::vector<BookRow>> parts(views.size());
+            scatter([&](size_t s, const Library&) {
+                parts[s].reserve(views[s]->book_count());
+                views[s]->for_each_book([&parts, s](const Book& book, int copies) { parts[s].push_back(BookRow{ &book, copies }); });
+            });
+            writer.begin_table(BOOK_COLUMNS);
+            merge_ordered(parts, [](const BookRow& a, const BookRow& b) { return *a.book < *b.book; },
+                [&writer](const BookRow& row) { report_book(writer, *row.book, row.copies); return true; });
+            break;
+        }
+        case REPORT_READERS: {
+            // Открытые выдачи гостевых записей добавляются к записи читателя в его шарде
+            std::vector<std::vector<ReaderRow>> parts(views.size());
+            std::vector<std::unordered_map<int, size_t>> guest_loans(views.size());
+            scatter([&](size_t s, const Library&) {
+                views[s]->for_each_reader([&, s](const Reader& reader, size_t open_loans) {
+                    if (reader_shard(reader.get_card_number()) == s) {
+                        parts[s].push_back(ReaderRow{ &reader, open_loans });
+                    }
+                    else if (open_loans > 0) {
+                        guest_loans[s][reader.get_card_number()] += open_loans;
+                    }
+                });
+            });
+            writer.begin_table(READER_COLUMNS);
+            merge_ordered(parts, [](const ReaderRow& a, const ReaderRow& b) { return *a.reader < *b.reader; },
+                [&writer, &guest_loans](const ReaderRow& row) {
+                    size_t open_loans = row.open_loans;
+                    for (const auto& guests : guest_loans) {
+                        auto it = guests.find(row.reader->get_card_number());
+                        open_loans += it != guests.end() ? it->second : 0;
+                    }
+                    report_reader(writer, *row.reader, open_loans);
+                    return true;
+                });
+            break;
+        }
+        case REPORT_LOANS: {
+            std::vector<std::vector<LoanRow>> parts(views.size());
+            scatter([&](size_t s, const Library&) {
+                parts[s].reserve(views[s]->open_loan_count());
+                views[s]->for_each_open_loan([&parts, s](const Loan& loan, const LoanState& state, const Book& book, const Reader& reader) {
+                    parts[s].push_back(LoanRow{ &loan, &state, &book, &reader });
+                });
+            });
+            writer.begin_table(LOAN_COLUMNS);
+            merge_ordered(parts, [](const LoanRow& a, const LoanRow& b) {
+                    return *a.loan < *b.loan || (!(*b.loan < *a.loan) && a.loan->get_id() < b.loan->get_id());
+                },
+                [&writer](const LoanRow& row) { report_loan(writer, *row.loan, *row.state, *row.book, *row.reader); return true; });
+            break;
+        }
+        case REPORT_OPERATIONS:
+        case REPORT_MEMORY:
+            break; // Не зависят от снимков (выводятся в export_report)
+        }
+    }
+
+public:
+    // Конструктор: shard_count пустых шардов
+    explicit ShardedLibrary(size_t shard_count) : workers(shard_count > 0 ? shard_count - 1 : 0) {
+        if (shard_count == 0) {
+            throw std::invalid_argument("Число шардов должно быть положительным.");
+        }
+        for (size_t s = 0; s < shard_count; s++) {
+            shards.emplace_back(new Library(s + 1, shard_count));
+        }
+    }
+
+    size_t shard_count() const {
+        return shards.size();
+    }
+
+    Library& shard(size_t s) const {
+        return *shards[s];
+    }
+
+    // Шард книги (книги с некорректным ISBN не добавляются, запросы по ним идут в шард 0)
+    size_t book_shard(const std::string& isbn) const {
+        uint64_t key = NO_ISBN;
+        return parse_isbn(isbn, key) ? shard_of_key(key, shards.size()) : 0;
+    }
+
+    // Шард читателя (здесь хранится его основная запись)
+    size_t reader_shard(int card_number) const {
+        return shard_of_key(static_cast<uint32_t>(card_number), shards.size());
+    }
+
+    // Шард выдачи по ее номеру
+    size_t loan_shard(uint64_t loan_id) const {
+        return loan_id == 0 ? 0 : static_cast<size_t>((loan_id - 1) % shards.size());
+    }
+
+    // Открытие хранилища: у шарда i свои файлы <снимок>.i и <журнал>.i.
+    // Возвращает общее число воспроизведенных записей журналов
+    size_t open_storage(const std::string& snapshot_path, const std::string& journal_path,
+        const JournalOptions& options = JournalOptions()) {
+        std::vector<size_t> replayed(shards.size());
+        scatter([&](size_t s, Library& library) {
+            replayed[s] = library.open_storage(snapshot_path + "." + std::to_string(s), journal_path + "." + std::to_string(s), options);
+        });
+        size_t total = 0;
+        for (size_t count : replayed) {
+            total += count;
+        }
+        return total;
+    }
+
+    void checkpoint() {
+        scatter([](size_t, Library& library) { library.checkpoint(); });
+    }
+
+    // Сброс журналов всех шардов на диск (параллельно: каждый шард ждет своего диска)
+    void sync_journal() {
+        scatter([](size_t, Library& library) { library.sync_journal(); });
+    }
+
+    // Метод для добавления автора во все шарды (nullptr, если автор с таким ФИО уже есть).
+    // Автор добавляется в каждый шард, где его нет, даже если шард 0 его уже знает:
+    // так повторный вызов достраивает шарды, которые пропустило прерванное добавление
+    // (шард, отвергший автора, уже знает это ФИО). Ошибка записи в шард передается
+    // вызывающему после обхода остальных шардов
+    std::shared_ptr<Author> add_author(const std::shared_ptr<Author>& author) {
+        std::lock_guard<std::mutex> lock(author_mutex);
+        std::shared_ptr<Author> added;
+        std::exception_ptr error;
+        for (size_t s = 0; s < shards.size(); s++) {
+            try {
+                std::shared_ptr<Author> result = shards[s]->add_author(author);
+                if (s == 0) {
+                    added = result;
+                }
+            }
+            catch (...) {
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return added;
+    }
+
+    // Метод для добавления книги в ее шард (пустая ссылка, если ISBN занят).
+    // После загрузки с диска у шардов свои объекты авторов - автор ищется по ФИО
+    BookRef add_book(const Book& book) {
+        Library& library = *shards[book_shard(book.get_isbn())];
+        if (book.get_author()) {
+            std::shared_ptr<Author> author = library.find_author_by_fio(book.get_author()->get_fio());
+            if (author && author != book.get_author()) {
+                return library.add_book(Book(book.get_title(), author, book.get_pub_year(), book.get_copies(), book.get_isbn()));
+            }
+        }
+        return library.add_book(book);
+    }
+
+    // Метод для добавления читателя в его шард (пустая ссылка, если номер билета занят)
+    ReaderRef add_reader(const Reader& reader) {
+        return shards[reader_shard(reader.get_card_number())]->add_reader(reader);
+    }
+
+    // Метод для импорта из CSV/JSONL. Файл авторов загружается во все шарды; книги
+    // и читатели разбираются один раз и передаются своим шардам. Неизвестные авторы
+    // книг сначала добавляются во все шарды, чтобы шард не создал их только у себя
+    ImportResult import_file(const std::string& path, ImportEntity entity) {
+        std::vector<ImportResult> results(shards.size());
+        if (entity == IMPORT_AUTHORS) {
+            std::lock_guard<std::mutex> lock(author_mutex);
+            unsigned threads = threads_per_shard();
+            scatter([&](size_t s, Library& library) { results[s] = library.import_file(path, entity, threads); });
+            return results[0];
+        }
+        std::vector<std::vector<std::vector<std::string>>> parts(shards.size());
+        std::vector<std::string> new_authors;
+        std::unordered_set<std::string> seen_authors;
+        CatalogImporter importer(import_columns(entity), detect_import_format(path), std::thread::hardware_concurrency());
+        ImportResult result = importer.run(path, [&](std::vector<std::string>& fields) {
+            size_t s = 0;
+            if (entity == IMPORT_BOOKS) {
+                uint64_t isbn_key = NO_ISBN;
+                s = parse_isbn(fields[1], isbn_key) ? shard_of_key(isbn_key, shards.size()) : 0;
+                if (isbn_key != NO_ISBN && !fields[0].empty() && !fields[2].empty()
+                    && seen_authors.insert(fields[2]).second && !find_author_by_fio(fields[2])) {
+                    new_authors.push_back(fields[2]);
+                }
+            }
+            else {
+                int card_number = 0;
+                s = parse_import_int(fields[1], card_number) ? reader_shard(card_number) : 0;
+            }
+            parts[s].push_back(std::move(fields));
+            return true;
+        });
+        result.imported = 0; // Пока посчитаны разобранные строки; пропущены - неразобранные
+        for (const std::string& fio : new_authors) {
+            if (add_author(std::make_shared<Author>(fio, 0))) {
+                result.created_authors++;
+            }
+        }
+        scatter([&](size_t s, Library& library) { results[s] = library.import_records(entity, parts[s]); });
+        for (const ImportResult& part : results) {
+            result.imported += part.imported;
+            result.skipped += part.skipped;
+        }
+        return result;
+    }
+
+    // Методы для поиска по ключу - в одном шарде
+    std::shared_ptr<Author> find_author_by_fio(const std::string& fio) const {
+        return shards[0]->find_author_by_fio(fio);
+    }
+
+    // Методы для поиска авторов - в шарде 0 (авторы одинаковы во всех шардах)
+    std::vector<std::shared_ptr<Author>> find_authors_by_fio_prefix(const std::string& prefix, size_t limit) const {
+        return shards[0]->find_authors_by_fio_prefix(prefix, limit);
+    }
+
+    std::vector<std::shared_ptr<Author>> find_authors_by_famous_work(const std::string& work) const {
+        return shards[0]->find_authors_by_famous_work(work);
+    }
+
+    std::vector<std::shared_ptr<Author>> find_authors_with_awards(int min_awards) const {
+        return shards[0]->find_authors_with_awards(min_awards);
+    }
+
+    // Метод для получения книг автора из всех шардов (по названию). Автор ищется
+    // в каждом шарде по ФИО: после загрузки с диска объекты авторов у шардов свои
+    std::vector<BookRef> find_books_by_author(const std::shared_ptr<Author>& author) const {
+        std::vector<std::vector<BookRef>> parts(shards.size());
+        for_each_shard([&](size_t s, const Library& library) {
+            std::shared_ptr<Author> own = library.find_author_by_fio(author->get_fio());
+            if (own) {
+                parts[s] = library.find_books_by_author(own);
+                std::sort(parts[s].begin(), parts[s].end(), book_ref_before);
+            }
+        });
+        return merge_ordered(parts, book_ref_before);
+    }
+
+    BookRef find_book_by_isbn(const std::string& isbn) const {
+        return shards[book_shard(isbn)]->find_book_by_isbn(isbn);
+    }
+
+    ReaderRef find_reader_by_card(int card_number) const {
+        return shards[reader_shard(card_number)]->find_reader_by_card(card_number);
+    }
+
+    LoanRef find_loan_by_id(uint64_t loan_id) const {
+        return shards[loan_shard(loan_id)]->find_loan_by_id(loan_id);
+    }
+
+    // Метод для подсчета открытых выдач книги
+    size_t count_open_loans(const BookRef& book) const {
+        return shards[book_shard(book->get_isbn())]->count_open_loans(book);
+    }
+
+    // Метод для поиска всех читателей с заданным ФИО (без гостевых записей)
+    std::vector<ReaderRef> find_readers_by_fio(const std::string& fio) const {
+        std::vector<ReaderRef> result;
+        for_each_shard([this, &fio, &result](size_t s, Library& library) {
+            for (const ReaderRef& reader : library.find_readers_by_fio(fio)) {
+                if (reader_shard(reader->get_card_number()) == s) {
+                    result.push_back(reader);
+                }
+            }
+        });
+        return result;
+    }
+
+    // Методы для поиска книг по названию и началу названия (слияние по названию)
+    std::vector<BookRef> find_books_by_title(const std::string& title) const {
+        std::vector<std::vector<BookRef>> parts(shards.size());
+        for_each_shard([&parts, &title](size_t s, Library& library) { parts[s] = library.find_books_by_title(title); });
+        return merge_ordered(parts, book_ref_before);
+    }
+
+    std::vector<BookRef> find_books_by_title_prefix(const std::string& prefix) const {
+        std::vector<std::vector<BookRef>> parts(shards.size());
+        for_each_shard([&parts, &prefix](size_t s, Library& library) { parts[s] = library.find_books_by_title_prefix(prefix); });
+        return merge_ordered(parts, book_ref_before);
+    }
+
+    // Метод для нечеткого поиска во всех шардах параллельно (лучшие limit совпадений)
+    std::vector<BookRef> search_books(const std::string& query, size_t limit = 20) const {
+        typedef std::pair<BookRef, float> ScoredBook;
+        std::vector<std::vector<ScoredBook>> parts(shards.size());
+        unsigned threads = threads_per_shard();
+        scatter([&](size_t s, const Library& library) { parts[s] = library.search_books_scored(query, limit, threads); });
+        std::vector<BookRef> result;
+        for (const ScoredBook& hit : merge_ordered(parts, [](const ScoredBook& a, const ScoredBook& b) { return a.second > b.second; }, limit)) {
+            result.push_back(hit.first);
+        }
+        return result;
+    }
+
+    // Метод для отбора книг по экземплярам и году (параллельно; шарды отдают
+    // книги по названию, и их списки сливаются)
+    std::vector<BookRef> filter_books(int min_copies, int year_from, int year_to) const {
+        std::vector<std::vector<BookRef>> parts(shards.size());
+        scatter([&](size_t s, const Library& library) { parts[s] = library.filter_books(min_copies, year_from, year_to); });
+        return merge_refs<BookMergeOrder>(parts);
+    }
+
+    size_t count_books(int min_copies, int year_from, int year_to) const {
+        size_t count = 0;
+        for_each_shard([&](size_t, const Library& library) { count += library.count_books(min_copies, year_from, year_to); });
+        return count;
+    }
+
+    // Страница книг по названию: из каждого шарда берется начало до конца страницы
+    std::vector<BookRef> list_books_by_title(size_t page, size_t page_size) const {
+        std::vector<std::vector<BookRef>> parts(shards.size());
+        for_each_shard([&](size_t s, Library& library) { parts[s] = library.list_books_by_title(0, (page + 1) * page_size); });
+        std::vector<BookRef> merged = merge_refs<BookMergeOrder>(parts, (page + 1) * page_size);
+        return std::vector<BookRef>(merged.begin() + std::min(merged.size(), page * page_size), merged.end());
+    }
+
+    // Страница читателей по ФИО (гостевые записи пропускаются)
+    std::vector<ReaderRef> list_readers_by_fio(size_t page, size_t page_size) const {
+        const size_t needed = (page + 1) * page_size;
+        std::vector<std::vector<ReaderRef>> parts(shards.size());
+        for_each_shard([&](size_t s, Library& library) {
+            for (size_t chunk = 0; parts[s].size() < needed; chunk++) {
+                std::vector<ReaderRef> readers = library.list_readers_by_fio(chunk, needed);
+                for (const ReaderRef& reader : readers) {
+                    if (reader_shard(reader->get_card_number()) == s && parts[s].size() < needed) {
+                        parts[s].push_back(reader);
+                    }
+                }
+                if (readers.size() < needed) {
+                    break;
+                }
+            }
+        });
+        std::vector<ReaderRef> merged = merge_refs<ReaderMergeOrder>(parts, needed);
+        return std::vector<ReaderRef>(merged.begin() + std::min(merged.size(), page * page_size), merged.end());
+    }
+
+    // Страница авторов по ФИО - из шарда 0
+    std::vector<std::shared_ptr<Author>> list_authors_by_fio(size_t page, size_t page_size) const {
+        return shards[0]->list_authors_by_fio(page, page_size);
+    }
+
+    // Страница открытых выдач по дате выдачи (слияние начал списков шардов)
+    std::vector<LoanRef> list_open_loans_by_date(size_t page, size_t page_size) const {
+        std::vector<std::vector<LoanRef>> parts(shards.size());
+        for_each_shard([&](size_t s, Library& library) { parts[s] = library.list_open_loans_by_date(0, (page + 1) * page_size); });
+        std::vector<LoanRef> merged = merge_refs<LoanMergeOrder>(parts, (page + 1) * page_size);
+        return std::vector<LoanRef>(merged.begin() + std::min(merged.size(), page * page_size), merged.end());
+    }
+
+    // Методы для выполнения составного запроса во всех шардах параллельно. Результат
+    // шарда переносится в вектор, пока удерживает свой снимок; книги сливаются по
+    // названию, читатели - по ФИО (без гостевых записей), выдачи - по дате выдачи
+    std::vector<BookRef> query_books(const Query& query) const {
+        return gather_query<BookMergeOrder, BookRef>([&query](const Library& library) { return library.query_books(query); },
+            [](size_t, const BookRef&) { return true; });
+    }
+
+    std::vector<ReaderRef> query_readers(const Query& query) const {
+        return gather_query<ReaderMergeOrder, ReaderRef>([&query](const Library& library) { return library.query_readers(query); },
+            [this](size_t s, const ReaderRef& reader) { return reader_shard(reader->get_card_number()) == s; });
+    }
+
+    std::vector<LoanRef> query_loans(const Query& query) const {
+        return gather_query<LoanMergeOrder, LoanRef>([&query](const Library& library) { return library.query_loans(query); },
+            [](size_t, const LoanRef&) { return true; });
+    }
+
+    // Метод для получения сводки по всем шардам. Книга лежит в одном шарде, поэтому
+    // первые k книг есть среди первых k каждого шарда. Выдачи автора и открытые
+    // выдачи читателя разнесены по шардам: их ненулевые счетчики берутся целиком
+    // и суммируются, поэтому сводка точная, но занимает O(авторов + читателей с выдачами)
+    LibraryAnalytics get_analytics(size_t k) const {
+        std::vector<LibraryAnalytics> parts(shards.size());
+        for_each_shard([&parts, k](size_t s, const Library& library) { parts[s] = library.get_analytics(SIZE_MAX, k, SIZE_MAX); });
+        std::map<std::string, std::pair<std::shared_ptr<Author>, size_t>> author_loans;
+        std::map<int, size_t> reader_loans;
+        LibraryAnalytics result;
+        for (const LibraryAnalytics& part : parts) {
+            for (const auto& entry : part.top_authors) {
+                auto& total = author_loans[entry.first->get_fio()];
+                if (!total.first) {
+                    total.first = entry.first;
+                }
+                total.second += entry.second;
+            }
+            result.top_books.insert(result.top_books.end(), part.top_books.begin(), part.top_books.end());
+            for (const auto& entry : part.top_readers) {
+                reader_loans[entry.first->get_card_number()] += entry.second;
+            }
+            for (const auto& decade : part.books_per_decade) {
+                result.books_per_decade[decade.first] += decade.second;
+            }
+        }
+        // Рейтинг: по убыванию счетчика, при равенстве - по ФИО, названию или номеру билета
+        for (const auto& entry : author_loans) {
+            result.top_authors.push_back(entry.second);
+        }
+        std::stable_sort(result.top_authors.begin(), result.top_authors.end(),
+            [](const std::pair<std::shared_ptr<Author>, size_t>& a, const std::pair<std::shared_ptr<Author>, size_t>& b) { return a.second > b.second; });
+        result.top_authors.resize(std::min(k, result.top_authors.size()));
+        std::sort(result.top_books.begin(), result.top_books.end(), [](const std::pair<BookRef, size_t>& a, const std::pair<BookRef, size_t>& b) {
+            return a.second != b.second ? a.second > b.second : book_ref_before(a.first, b.first);
+        });
+        result.top_books.resize(std::min(k, result.top_books.size()));
+        std::vector<std::pair<int, size_t>> readers(reader_loans.begin(), reader_loans.end());
+        std::stable_sort(readers.begin(), readers.end(),
+            [](const std::pair<int, size_t>& a, const std::pair<int, size_t>& b) { return a.second > b.second; });
+        for (size_t i = 0; i < readers.size() && result.top_readers.size() < k; i++) {
+            ReaderRef reader = find_reader_by_card(readers[i].first); // Основная запись, а не гостевая
+            if (reader) {
+                result.top_readers.push_back(std::make_pair(reader, readers[i].second));
+            }
+        }
+        return result;
+    }
+
+    // Метод для выдачи книги по ISBN и номеру билета. Выдача создается в шарде
+    // книги; читателю из другого шарда там сначала заводится гостевая запись
+    CheckoutResult checkout_book(const std::string& isbn, int card_number,
+        const Date& issue_date, const Date& return_date, LoanRef* created = nullptr) {
+        Library& library = *shards[book_shard(isbn)];
+        size_t home = reader_shard(card_number);
+        if (&library != shards[home].get() && !library.find_reader_by_card(card_number)) {
+            if (!library.find_book_by_isbn(isbn)) {
+                return CHECKOUT_NO_BOOK;
+            }
+            ReaderRef reader = shards[home]->find_reader_by_card(card_number);
+            if (!reader) {
+                return CHECKOUT_NO_READER;
+            }
+            library.add_reader(Reader(reader->get_fio(), card_number)); // Пусто, если гостя уже завел другой поток
+        }
+        return library.checkout_book(isbn, card_number, issue_date, return_date, created);
+    }
+
+    // Методы для возврата и продления - в шарде выдачи или книги
+    bool return_loan(uint64_t loan_id, const Date& returned_on) {
+        return shards[loan_shard(loan_id)]->return_loan(loan_id, returned_on);
+    }
+
+    bool return_book(const std::string& isbn, int card_number, const Date& returned_on) {
+        return shards[book_shard(isbn)]->return_book(isbn, card_number, returned_on);
+    }
+
+    bool renew_loan(uint64_t loan_id, const Date& new_return_date) {
+        return shards[loan_shard(loan_id)]->renew_loan(loan_id, new_return_date);
+    }
+
+    // Метод для получения открытых выдач читателя из всех шардов (по дате выдачи)
+    std::vector<LoanRef> find_open_loans(int card_number) const {
+        std::vector<std::vector<LoanRef>> parts(shards.size());
+        for_each_shard([&](size_t s, Library& library) {
+            ReaderRef reader = library.find_reader_by_card(card_number);
+            if (reader) {
+                parts[s] = library.find_open_loans(reader);
+                std::sort(parts[s].begin(), parts[s].end(), loan_ref_before);
+            }
+        });
+        return merge_ordered(parts, loan_ref_before);
+    }
+
+    std::vector<LoanRef> find_open_loans(const ReaderRef& reader) const {
+        return reader ? find_open_loans(reader->get_card_number()) : std::vector<LoanRef>();
+    }
+
+    // Метод для получения книги выдачи - в шарде выдачи
+    BookRef book_of(const Loan& loan) const {
+        return shards[loan_shard(loan.get_id())]->book_of(loan);
+    }
+
+    // Метод для поиска выдач с датой выдачи в диапазоне [from, to] (по дате выдачи и номеру)
+    std::vector<LoanRef> find_loans_issued_between(const Date& from, const Date& to) const {
+        std::vector<std::vector<LoanRef>> parts(shards.size());
+        for_each_shard([&](size_t s, const Library& library) {
+            parts[s] = library.find_loans_issued_between(from, to);
+            std::sort(parts[s].begin(), parts[s].end(), loan_ref_before);
+        });
+        return merge_ordered(parts, loan_ref_before);
+    }
+
+    // Метод для перевода часов всех шардов; ставшие просроченными выдачи - по дате выдачи
+    std::vector<LoanRef> advance_clock(const Date& day) {
+        std::vector<std::vector<LoanRef>> parts(shards.size());
+        for_each_shard([&](size_t s, Library& library) {
+            parts[s] = library.advance_clock(day);
+            std::sort(parts[s].begin(), parts[s].end(), loan_ref_before);
+        });
+        return merge_ordered(parts, loan_ref_before);
+    }
+
+    // Часы шардов переводятся вместе, поэтому дата берется из шарда 0
+    Date get_clock() const {
+        return shards[0]->get_clock();
+    }
+
+    size_t count_overdue_loans() const {
+        size_t count = 0;
+        for_each_shard([&count](size_t, const Library& library) { count += library.count_overdue_loans(); });
+        return count;
+    }
+
+    // Метод для получения просроченных выдач читателя из всех шардов (по дате выдачи)
+    std::vector<LoanRef> find_overdue_loans(const ReaderRef& reader) const {
+        std::vector<std::vector<LoanRef>> parts(shards.size());
+        for_each_shard([&](size_t s, Library& library) {
+            ReaderRef own = reader ? library.find_reader_by_card(reader->get_card_number()) : ReaderRef();
+            if (own) {
+                parts[s] = library.find_overdue_loans(own);
+                std::sort(parts[s].begin(), parts[s].end(), loan_ref_before);
+            }
+        });
+        return merge_ordered(parts, loan_ref_before);
+    }
+
+    // Метод для вывода всей информации о библиотеке (по снимкам шардов)
+    void print_Library(FILE* file = stdout) const {
+        std::vector<std::unique_ptr<ReadView>> views = read_views();
+        OutputBuffer out(file);
+        ReportWriter writer(out, REPORT_TEXT);
+        out.write("Общее количество авторов: ");
+        out.write_int(static_cast<int64_t>(views[0]->author_count()));
+        out.write("\n\nСписок авторов (отсортированный по ФИО):\n");
+        write_report(views, writer, REPORT_AUTHORS);
+        out.write("\nСписок книг (отсортированный по названию):\n");
+        write_report(views, writer, REPORT_BOOKS);
+        out.write("\nСписок читателей (отсортированный по ФИО):\n");
+        write_report(views, writer, REPORT_READERS);
+        out.write("\nСписок открытых выдач (отсортированный по дате):\n");
+        write_report(views, writer, REPORT_LOANS);
+        size_t closed_loans = 0;
+        for (const auto& view : views) {
+            closed_loans += view->closed_loan_count();
+        }
+        out.write("Закрытых выдач в истории: ");
+        out.write_int(static_cast<int64_t>(closed_loans));
+        out.put('\n');
+    }
+
+    // Метод для выгрузки отчета в открытый файл; возвращает число байт.
+    // Память суммируется по шардам, счетчики операций общие для процесса
+    uint64_t export_report(ReportEntity entity, ReportFormat format, FILE* file) const {
+        OutputBuffer out(file);
+        ReportWriter writer(out, format);
+        if (entity == REPORT_OPERATIONS) {
+            writer.begin_table(OPERATION_COLUMNS);
+            for (const OperationStats& stats : collect_operation_stats()) {
+                report_operation(writer, stats);
+            }
+        }
+        else if (entity == REPORT_MEMORY) {
+            std::vector<MemoryStats> total = shards[0]->memory_stats();
+            for (size_t s = 1; s < shards.size(); s++) {
+                std::vector<MemoryStats> stats = shards[s]->memory_stats();
+                for (size_t i = 0; i < total.size() && i < stats.size(); i++) {
+                    total[i].items += stats[i].items;
+                    total[i].bytes += stats[i].bytes;
+                }
+            }
+            writer.begin_table(MEMORY_COLUMNS);
+            for (const MemoryStats& stats : total) {
+                report_memory(writer, stats);
+            }
+        }
+        else {
+            write_report(read_views(), writer, entity);
+        }
+        if (!out.flush()) {
+            throw std::runtime_error("Ошибка записи отчета.");
+        }
+        return out.bytes_written();
+    }
+};
+
+// Функция для демонстрации виртуальных функций
+void demonstrateVirtualFunctions() {
+    // Создаем объекты базового и производного классов
+    Author* author = new Author("Лев Толстой", 1828);
+    FamousAuthor* famousAuthor = new FamousAuthor("Фёдор Достоевский", 1821, "Преступление и наказание", 5);
+
+    // Демонстрация работы виртуальной функции
+    std::cout << "\nДемонстрация виртуальных функций:\n";
+    Author* ptr = author;
+    ptr->displayInfo(); // Вызовется Author::print_Author()
+
+    ptr = famousAuthor;
+    ptr->displayInfo(); // Вызовется FamousAuthor::print_Author()
+
+    // Демонстрация без виртуальной функции
+    std::cout << "\nДемонстрация без виртуальной функции:\n";
+    ptr = author;
+    ptr->print_Author(); // Вызовется Author::print_Author()
+
+    ptr = famousAuthor;
+    ptr->print_Author(); // Вызовется FamousAuthor::print_Author()
+
+    // Освобождение памяти
+    delete author;
+    delete famousAuthor;
+}
+
+// Функция для демонстрации абстрактного класса
+void demonstrateAbstractClass() {
+    // AbstractPerson* person = new AbstractPerson(); // Ошибка - нельзя создать экземпляр абстрактного класса
+    AbstractPerson* person = new Reader();
+    person->displayInfo(); // Вызовется Reader::print_Reader()
+    delete person;
+}
+
+// Функция для демонстрации шаблона класса
+void demonstrateTemplateClass() {
+    // Создаем карточки с разными типами идентификаторов
+    LibraryCard<int> intCard(12345, Date::parse("01.01.2023"), Date::parse("31.12.2025"));
+    LibraryCard<std::string> stringCard("ABC-123", Date::parse("01.01.2023"), Date::parse("31.12.2025"));
+
+    std::cout << "\nДемонстрация шаблонного класса:\n";
+    std::cout << "Карточка с числовым ID:\n";
+    intCard.display();
+    std::cout << "\nКарточка со строковым ID:\n";
+    stringCard.display();
+}
+
+// Синтетический корректный ISBN-13 с порядковым номером n (для замеров и нагрузочной проверки)
+std::string make_test_isbn(size_t n) {
+    uint64_t body = 979000000000ull + n;
+    return format_isbn(body * 10 + static_cast<uint64_t>(isbn13_check_digit(body)));
+}
+
+// Замер скорости восстановления: журнал из record_count записей воспроизводится в пустую библиотеку
+void benchmarkJournalRecovery(size_t record_count) {
+    const std::string snapshot_file = "bench_recovery.snap";
+    const std::string journal_file = "bench_recovery.journal";
+    std::remove(snapshot_file.c_str());
+    std::remove(journal_file.c_str());
+
+    JournalOptions options;
+    options.group_commit_records = 4096;
+    options.group_commit_ms = 1000;
+    options.checkpoint_records = 0;
+
+    auto write_start = std::chrono::steady_clock::now();
+    {
+        Journal journal(journal_file, options, 1);
+        journal.append(JOURNAL_ADD_AUTHOR, encode_author_record(FamousAuthor("Автор", 1900, "Произведение", 1)));
+        // Записи чередуются: книга, читатель, выдача
+        for (size_t i = 1; i < record_count; i++) {
+            int n = static_cast<int>(i / 3);
+            std::string isbn = make_test_isbn(n);
+            switch (i % 3) {
+            case 1:
+                journal.append(JOURNAL_ADD_BOOK, encode_book_record(Book("Книга " + std::to_string(n), nullptr, 2000, 5, isbn), 0));
+                break;
+            case 2:
+                journal.append(JOURNAL_ADD_READER, encode_reader_record(Reader("Читатель " + std::to_string(n), n)));
+                break;
+            default:
+                journal.append(JOURNAL_ADD_LOAN, encode_loan_record(make_test_isbn(n - 1), n - 1, Date::from_ymd(2026, 1, 1), Date::from_ymd(2026, 2, 1)));
+                break;
+            }
+        }
+    }
+    double write_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - write_start).count();
+
+    Library library;
+    auto replay_start = std::chrono::steady_clock::now();
+    size_t replayed = library.open_storage(snapshot_file, journal_file, options);
+    double replay_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - replay_start).count();
+
+    printf("Запись журнала: %zu записей за %.1f мс\n", record_count, write_ms);
+    printf("Восстановление: %zu записей за %.1f мс (%.0f записей/с)\n",
+        replayed, replay_ms, replay_ms > 0 ? replayed * 1000.0 / replay_ms : 0.0);
+
+    std::remove(snapshot_file.c_str());
+    std::remove(journal_file.c_str());
+}
+
+// Замер поиска по ISBN: book_count книг, затем столько же поисков в случайном порядке
+void benchmarkIsbnLookup(size_t book_count) {
+    Library library;
+    auto author = std::make_shared<Author>("Автор", 1900);
+    library.add_author(author);
+    std::vector<std::string> isbns;
+    isbns.reserve(book_count);
+    for (size_t i = 0; i < book_count; i++) {
+        isbns.push_back(make_test_isbn(i));
+        library.add_book(Book("Книга " + std::to_string(i), author, 2000, 1, isbns.back()));
+    }
+    std::shuffle(isbns.begin(), isbns.end(), std::mt19937(42));
+
+    size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const std::string& isbn : isbns) {
+        if (library.find_book_by_isbn(isbn)) {
+            found++;
+        }
+    }
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    size_t index_bytes = library.isbn_index_memory();
+    printf("Поиск по ISBN: найдено %zu из %zu за %.1f мс (%.0f поисков/с)\n",
+        found, isbns.size(), elapsed_ms, elapsed_ms > 0 ? isbns.size() * 1000.0 / elapsed_ms : 0.0);
+    printf("Индекс ISBN: %zu байт (%.1f байт на книгу)\n",
+        index_bytes, book_count > 0 ? static_cast<double>(index_bytes) / book_count : 0.0);
+}
+
+// Замер выгрузки: каталог из book_count книг выгружается в CSV во временный файл
+void benchmarkReportExport(size_t book_count) {
+    Library library;
+    auto author = std::make_shared<Author>("Автор", 1900);
+    library.add_author(author);
+    for (size_t i = 0; i < book_count; i++) {
+        library.add_book(Book("Книга " + std::to_string(i), author, 2000, 1, make_test_isbn(i)));
+    }
+
+    const char* path = "bench_export.csv";
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        printf("Ошибка: не удалось открыть файл %s\n", path);
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    uint64_t bytes = library.export_report(REPORT_BOOKS, REPORT_CSV, file);
+    fclose(file);
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::remove(path);
+
+    printf("Выгрузка CSV: %zu книг, %llu байт за %.1f мс (%.1f МБ/с)\n",
+        book_count, static_cast<unsigned long long>(bytes), elapsed_ms,
+        elapsed_ms > 0 ? bytes / 1048.576 / elapsed_ms : 0.0);
+}
+
+// Замер нечеткого поиска: каталог из book_count книг со словами из случайных слогов,
+// затем query_count запросов из двух слов случайной книги с опечаткой в первом
+void benchmarkFuzzySearch(size_t book_count, size_t query_count) {
+    const char* syllables[] = { "ка", "ро", "ми", "ле", "ту", "на", "во", "зе", "ши", "до", "бу", "па",
+        "ст", "гр", "ль", "ев", "ой", "ан", "ск", "ий", "ор", "ёл", "ря", "ющ" };
+    const size_t syllable_count = sizeof(syllables) / sizeof(syllables[0]);
+    std::mt19937 rng(42);
+    auto make_word = [&](size_t length) {
+        std::string word;
+        for (size_t i = 0; i < length; i++) {
+            word += syllables[rng() % syllable_count];
+        }
+        return word;
+    };
+    std::vector<std::string> vocabulary;
+    for (size_t i = 0; i < 20000; i++) {
+        vocabulary.push_back(make_word(2 + rng() % 3));
+    }
+
+    Library library;
+    std::vector<std::shared_ptr<Author>> authors;
+    while (authors.size() < std::max<size_t>(1, book_count / 50)) {
+        auto author = library.add_author(std::make_shared<Author>(make_word(3) + " " + make_word(2), 1900));
+        if (author) { // Случайное ФИО может повториться - повтор не добавляется
+            authors.push_back(author);
+        }
+    }
+    std::vector<std::string> titles;
+    titles.reserve(book_count);
+    auto build_start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < book_count; i++) {
+        std::string title = vocabulary[rng() % vocabulary.size()];
+        for (size_t w = 1 + rng() % 3; w > 0; w--) {
+            title += " " + vocabulary[rng() % vocabulary.size()];
+        }
+        library.add_book(Book(title, authors[rng() % authors.size()], 2000, 1, make_test_isbn(i)));
+        titles.push_back(std::move(title));
+    }
+    double build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - build_start).count();
+
+    std::vector<double> latencies;
+    size_t found = 0;
+    for (size_t q = 0; q < query_count; q++) {
+        const std::string& title = titles[rng() % titles.size()];
+        std::string query = title.substr(0, title.find(' ', title.find(' ') + 1)); // Два первых слова
+        size_t typo = (rng() % (query.find(' ') / 2)) * 2; // Замена одной буквы первого слова (2 байта UTF-8)
+        query.replace(typo, 2, "ы");
+        auto start = std::chrono::steady_clock::now();
+        auto result = library.search_books(query, 20);
+        latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        for (const auto& book : result) {
+            if (book->get_title() == title) {
+                found++;
+                break;
+            }
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+    };
+    printf("Каталог: %zu книг, построение индекса за %.1f мс\n", book_count, build_ms);
+    printf("Запросов: %zu, искомая книга в первых 20: %zu\n", query_count, found);
+    printf("Задержка: p50 %.3f мс, p99 %.3f мс, максимум %.3f мс\n", percentile(0.5), percentile(0.99), percentile(1.0));
+}
+
+// Замер скорости возврата: loan_count выдач закрываются пакетами по batch_size
+void benchmarkBatchReturns(size_t loan_count, size_t batch_size) {
+    const int reader_count = 10000;
+
+    Library library;
+    auto author = std::make_shared<Author>("Автор", 1900);
+    library.add_author(author);
+    BookRef book = library.add_book(Book("Книга", author, 2000, static_cast<int>(loan_count), make_test_isbn(0)));
+    for (int i = 0; i < reader_count; i++) {
+        library.add_reader(Reader("Читатель " + std::to_string(i), i));
+    }
+
+    std::vector<uint64_t> loan_ids;
+    loan_ids.reserve(loan_count);
+    const Date issue_date = Date::from_ymd(2026, 1, 1);
+    for (size_t i = 0; i < loan_count; i++) {
+        LoanRef loan;
+        library.checkout_book(book, library.find_reader_by_card(static_cast<int>(i % reader_count)),
+            issue_date + static_cast<int>(i % 365), issue_date + 400, &loan);
+        loan_ids.push_back(loan->get_id());
+    }
+    std::shuffle(loan_ids.begin(), loan_ids.end(), std::mt19937(12345)); // Возвраты в случайном порядке
+
+    auto start = std::chrono::steady_clock::now();
+    size_t returned = 0;
+    for (size_t i = 0; i < loan_ids.size(); i += batch_size) {
+        std::vector<uint64_t> batch(loan_ids.begin() + i, loan_ids.begin() + std::min(loan_ids.size(), i + batch_size));
+        returned += library.return_loans(batch, issue_date + 400);
+    }
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    printf("Возвращено: %zu из %zu выдач пакетами по %zu за %.1f мс (%.0f возвратов/с)\n", returned, loan_count,
+        batch_size, elapsed_ms, elapsed_ms > 0 ? returned * 1000.0 / elapsed_ms : 0.0);
+    printf("Свободных экземпляров: %d, закрытых выдач: %zu\n", book->get_copies(), library.count_closed_loans());
+}
+
+// Выполнение запроса с индексами и полным просмотром; false, если результаты различаются
+template <typename Run>
+bool compare_query_plans(const char* name, Run run) {
+    std::vector<uint32_t> indexed, scanned;
+    std::string plan;
+    auto start = std::chrono::steady_clock::now();
+    {
+        auto result = run(true);
+        plan = result.get_plan();
+        for (const auto& item : result) {
+            indexed.push_back(item.get_handle().get_value());
+        }
+    }
+    double indexed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    for (const auto& item : run(false)) {
+        scanned.push_back(item.get_handle().get_value());
+    }
+    double scanned_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%s: найдено %zu, план: %s, %.3f мс (полный просмотр %.3f мс)\n",
+        name, indexed.size(), plan.c_str(), indexed_ms, scanned_ms);
+    return indexed == scanned;
+}
+
+// Каталог для замеров: book_count / 50 авторов "Автор N", книги "Книга N" со случайным
+// автором и годом публикации и book_count / 10 читателей "Читатель N" (билет N)
+struct BenchCatalog {
+    std::vector<std::shared_ptr<Author>> authors;
+    std::vector<BookRef> books;
+    std::vector<ReaderRef> readers;
+};
+
+BenchCatalog fill_bench_catalog(Library& library, size_t book_count, std::mt19937& rng, const std::function<int()>& copies) {
+    BenchCatalog catalog;
+    for (size_t i = 0; i < std::max<size_t>(1, book_count / 50); i++) {
+        catalog.authors.push_back(std::make_shared<Author>("Автор " + std::to_string(i), 1900));
+        library.add_author(catalog.authors.back());
+    }
+    for (size_t i = 0; i < book_count; i++) {
+        const std::shared_ptr<Author>& author = catalog.authors[rng() % catalog.authors.size()];
+        int pub_year = 1900 + static_cast<int>(rng() % 125);
+        catalog.books.push_back(library.add_book(Book("Книга " + std::to_string(i), author, pub_year, copies(), make_test_isbn(i))));
+    }
+    for (size_t i = 0; i < std::max<size_t>(1, book_count / 10); i++) {
+        catalog.readers.push_back(library.add_reader(Reader("Читатель " + std::to_string(i), static_cast<int>(i))));
+    }
+    return catalog;
+}
+
+// Замер составных запросов: каталог из book_count книг, читатели и выдачи; каждый запрос
+// выполняется по плану и полным просмотром, результаты сверяются
+void benchmarkQueries(size_t book_count) {
+    std::mt19937 rng(11);
+    Library library;
+    BenchCatalog catalog = fill_bench_catalog(library, book_count, rng, [&rng]() { return 1 + static_cast<int>(rng() % 5); });
+    const std::vector<std::shared_ptr<Author>>& authors = catalog.authors;
+    const std::vector<BookRef>& books = catalog.books;
+    const std::vector<ReaderRef>& readers = catalog.readers;
+    const Date first_day = Date::from_ymd(2025, 1, 1);
+    std::vector<uint64_t> returned_ids;
+    for (size_t i = 0; i < book_count; i++) {
+        LoanRef loan;
+        Date issue_date = first_day + static_cast<int>(rng() % 365);
+        if (library.checkout_book(books[rng() % books.size()], readers[rng() % readers.size()],
+            issue_date, issue_date + 30, &loan) == CHECKOUT_OK && rng() % 2 == 0) {
+            returned_ids.push_back(loan->get_id());
+        }
+    }
+    library.return_loans(returned_ids, first_day + 400);
+
+    const std::string middle_author = authors[authors.size() / 2]->get_fio();
+    const Date week = first_day + 100;
+    bool same = true;
+    same &= compare_query_plans("ISBN и год", [&](bool use_indexes) {
+        return library.query_books(Query::isbn(make_test_isbn(book_count / 2)) && Query::pub_year(1900, 2100), use_indexes);
+    });
+    same &= compare_query_plans("начало названия и экземпляры", [&](bool use_indexes) {
+        return library.query_books(Query::title_prefix("Книга 12") && Query::copies(2), use_indexes);
+    });
+    same &= compare_query_plans("годы и экземпляры", [&](bool use_indexes) {
+        return library.query_books(Query::pub_year(1950, 1954) && Query::copies(4), use_indexes);
+    });
+    same &= compare_query_plans("автор и годы", [&](bool use_indexes) {
+        return library.query_books(Query::author(middle_author) && Query::pub_year(2000, 2024), use_indexes);
+    });
+    same &= compare_query_plans("название или автор", [&](bool use_indexes) {
+        return library.query_books(Query::title("книга 7") || Query::author(middle_author), use_indexes);
+    });
+    same &= compare_query_plans("название или годы и экземпляры", [&](bool use_indexes) {
+        return library.query_books(Query::title("Книга 7") || (Query::pub_year(2000, 2001) && Query::copies(5)), use_indexes);
+    });
+    same &= compare_query_plans("билет или ФИО", [&](bool use_indexes) {
+        return library.query_readers(Query::card(5) || Query::fio("Читатель 7"), use_indexes);
+    });
+    same &= compare_query_plans("выдачи за неделю, открытые", [&](bool use_indexes) {
+        return library.query_loans(Query::issued(week, week + 6) && Query::open(), use_indexes);
+    });
+    same &= compare_query_plans("открытые выдачи читателя", [&](bool use_indexes) {
+        return library.query_loans(Query::open() && Query::card(42), use_indexes);
+    });
+    same &= compare_query_plans("выдачи книг по названию и сроку", [&](bool use_indexes) {
+        return library.query_loans(Query::title_prefix("Книга 1") && Query::due(week, week + 30), use_indexes);
+    });
+    printf(same ? "Результаты планов совпадают с полным просмотром.\n" : "ОШИБКА: план и полный просмотр дали разные результаты.\n");
+}
+
+// Замер открытия снимка: каталог из book_count книг с читателями и выдачами
+// сохраняется и открывается заново. Поиски по ISBN, билету и названию идут
+// прямо по файлу, а первая операция, которой мало секций файла, достраивает каталог
+void benchmarkSnapshotOpen(size_t book_count) {
+    const std::string snapshot_file = "bench_snapshot.snap";
+    std::mt19937 rng(5);
+    {
+        Library library;
+        BenchCatalog catalog = fill_bench_catalog(library, book_count, rng, []() { return 2; });
+        for (const ReaderRef& reader : catalog.readers) {
+            library.checkout_book(catalog.books[rng() % catalog.books.size()], reader, Date::from_ymd(2025, 1, 1), Date::from_ymd(2025, 2, 1));
+        }
+        library.save_snapshot(snapshot_file);
+    }
+    auto elapsed_ms = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    Library library;
+    auto start = std::chrono::steady_clock::now();
+    library.load_snapshot(snapshot_file);
+    double open_ms = elapsed_ms(start);
+
+    const std::string isbn = make_test_isbn(book_count / 2);
+    const int card = static_cast<int>(book_count / 20);
+    const std::string title = "Книга " + std::to_string(book_count / 3);
+    start = std::chrono::steady_clock::now();
+    BookRef by_isbn = library.find_book_by_isbn(isbn);
+    ReaderRef by_card = library.find_reader_by_card(card);
+    std::vector<BookRef> by_title = library.find_books_by_title(title);
+    double lookup_ms = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    size_t readers_found = library.find_readers_by_fio("Читатель 1").size(); // Индекса ФИО читателей в файле нет
+    double build_ms = elapsed_ms(start);
+
+    // Ссылки, полученные по файлу, остаются действительными и совпадают с поиском по индексам
+    bool same = by_isbn && by_isbn->get_isbn() == isbn && by_isbn == library.find_book_by_isbn(isbn)
+        && by_card && by_card->get_card_number() == card && by_card == library.find_reader_by_card(card)
+        && by_title.size() == 1 && by_title == library.find_books_by_title(title) && readers_found == 1;
+    printf("Открытие снимка: %zu книг за %.3f мс\n", book_count, open_ms);
+    printf("Поиск по ISBN, билету и названию до разбора записей: %.3f мс\n", lookup_ms);
+    printf("Достраивание каталога при первой другой операции: %.1f мс\n", build_ms);
+    printf(same ? "Результаты поиска по файлу совпадают с индексами.\n" : "ОШИБКА: поиск по файлу и по индексам дал разные результаты.\n");
+    std::remove(snapshot_file.c_str());
+}
+
+// Совпадение значений двух сводок (объекты с равными значениями могут идти в разном порядке)
+bool same_analytics(const LibraryAnalytics& a, const LibraryAnalytics& b) {
+    auto same_counts = [](const auto& x, const auto& y) {
+        return std::equal(x.begin(), x.end(), y.begin(), y.end(),
+            [](const auto& p, const auto& q) { return p.second == q.second; });
+    };
+    return same_counts(a.top_authors, b.top_authors) && same_counts(a.top_books, b.top_books)
+        && same_counts(a.top_readers, b.top_readers) && a.books_per_decade == b.books_per_decade;
+}
+
+// Замер сводки: book_count книг, loan_count случайных выдач, половина из них возвращается;
+// сводка из счетчиков сравнивается с пакетным расчетом
+void benchmarkAnalytics(size_t book_count, size_t loan_count) {
+    const size_t top_size = 10;
+    std::mt19937 rng(7);
+    Library library;
+    BenchCatalog catalog = fill_bench_catalog(library, book_count, rng, [loan_count]() { return static_cast<int>(loan_count); });
+    const std::vector<BookRef>& books = catalog.books;
+    const std::vector<ReaderRef>& readers = catalog.readers;
+
+    const Date issue_date = Date::from_ymd(2026, 1, 1);
+    std::vector<uint64_t> returned_ids;
+    for (size_t i = 0; i < loan_count; i++) {
+        // Квадрат случайного числа смещает спрос к началу каталога, как у популярных книг
+        size_t book = static_cast<size_t>(std::pow(std::uniform_real_distribution<double>(0, 1)(rng), 2) * book_count);
+        LoanRef loan;
+        library.checkout_book(books[std::min(book, book_count - 1)], readers[rng() % readers.size()],
+            issue_date, issue_date + 30, &loan);
+        if (rng() % 2 == 0) {
+            returned_ids.push_back(loan->get_id());
+        }
+    }
+    library.return_loans(returned_ids, issue_date + 10);
+
+    const size_t repeats = 1000;
+    auto start = std::chrono::steady_clock::now();
+    LibraryAnalytics incremental;
+    for (size_t i = 0; i < repeats; i++) {
+        incremental = library.get_analytics(top_size);
+    }
+    double incremental_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / repeats;
+
+    start = std::chrono::steady_clock::now();
+    LibraryAnalytics batch = library.compute_analytics(top_size);
+    double batch_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    printf("Сводка по счетчикам: %.1f мкс, пакетный расчет (%u потоков): %.1f мс\n",
+        incremental_us, std::max(1u, std::thread::hardware_concurrency()), batch_ms);
+    if (!incremental.top_books.empty()) {
+        printf("Самая выдаваемая книга: %s - %zu выдач\n",
+            incremental.top_books[0].first->get_title().c_str(), incremental.top_books[0].second);
+    }
+    printf(same_analytics(incremental, batch) ? "Счетчики совпадают с пакетным расчетом.\n"
+        : "ОШИБКА: счетчики расходятся с пакетным расчетом.\n");
+}
+
+// Замер справочника авторов: поиск по началу ФИО и книги автора через
+// индексы против полного просмотра авторов и книг, с проверкой совпадения
+void benchmarkAuthorDirectory(size_t author_count) {
+    std::mt19937 rng(5);
+    Library library;
+    std::vector<std::shared_ptr<Author>> authors;
+    for (size_t i = 0; i < author_count; i++) {
+        authors.push_back(std::make_shared<FamousAuthor>("Автор " + std::to_string(i) + " Иванович", 1900,
+            "Роман " + std::to_string(i % 100), static_cast<int>(i % 7)));
+        library.add_author(authors.back());
+    }
+    size_t book_count = author_count * 3;
+    for (size_t i = 0; i < book_count; i++) {
+        library.add_book(Book("Книга " + std::to_string(i), authors[rng() % author_count], 2000, 1, make_test_isbn(i)));
+    }
+    size_t duplicates = 0;
+    for (size_t i = 0; i < 100; i++) {
+        duplicates += library.add_author(std::make_shared<Author>("  автор " + std::to_string(i) + "   ИВАНОВИЧ ", 1900)) ? 0 : 1;
+    }
+
+    const size_t queries = 1000;
+    std::vector<std::string> prefixes;
+    for (size_t q = 0; q < queries; q++) {
+        prefixes.push_back("Автор " + std::to_string(rng() % author_count));
+    }
+    auto start = std::chrono::steady_clock::now();
+    size_t found_index = 0;
+    for (const auto& prefix : prefixes) {
+        found_index += library.find_authors_by_fio_prefix(prefix, author_count).size();
+    }
+    double index_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / queries;
+
+    std::vector<std::string> keys; // Ключи ФИО для просмотра строятся заранее, как в справочнике
+    for (const auto& author : authors) {
+        keys.push_back(make_fio_key(author->get_fio()));
+    }
+    start = std::chrono::steady_clock::now();
+    size_t found_scan = 0;
+    for (size_t q = 0; q < queries / 10; q++) {
+        std::string key = make_fio_key(prefixes[q], true);
+        for (const auto& author_key : keys) {
+            found_scan += author_key.compare(0, key.size(), key) == 0 ? 1 : 0;
+        }
+    }
+    double scan_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / (queries / 10);
+    size_t found_index_part = 0;
+    for (size_t q = 0; q < queries / 10; q++) {
+        found_index_part += library.find_authors_by_fio_prefix(prefixes[q], author_count).size();
+    }
+
+    start = std::chrono::steady_clock::now();
+    size_t books_index = 0;
+    for (size_t q = 0; q < queries; q++) {
+        books_index += library.find_books_by_author(authors[q % author_count]).size();
+    }
+    double books_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / queries;
+    std::vector<BookRef> all_books = library.list_books_by_title(0, book_count);
+    start = std::chrono::steady_clock::now();
+    size_t books_scan = 0;
+    for (size_t q = 0; q < queries / 10; q++) {
+        for (const auto& book : all_books) {
+            books_scan += book->get_author() == authors[q % author_count] ? 1 : 0;
+        }
+    }
+    double books_scan_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / (queries / 10);
+    size_t books_index_part = 0;
+    for (size_t q = 0; q < queries / 10; q++) {
+        books_index_part += library.find_books_by_author(authors[q % author_count]).size();
+    }
+
+    printf("Авторов: %zu, книг: %zu, отклонено повторов ФИО: %zu из 100\n", author_count, book_count, duplicates);
+    printf("Поиск по началу ФИО: справочник %.2f мкс, просмотр всех авторов %.1f мкс (найдено в среднем %.1f)\n",
+        index_us, scan_us, static_cast<double>(found_index) / queries);
+    printf("Книги автора: обратный индекс %.2f мкс, просмотр всех книг %.1f мкс\n", books_us, books_scan_us);
+    printf("Авторов с 6 наградами: %zu, авторов \"Роман 7\": %zu\n", library.find_authors_with_awards(6).size(),
+        library.find_authors_by_famous_work("роман 7").size());
+    printf(found_scan == found_index_part && books_scan == books_index_part ? "Результаты совпадают с полным просмотром.\n"
+        : "ОШИБКА: результаты расходятся с полным просмотром.\n");
+}
+
+// Замер операций со встроенными счетчиками: смешанная нагрузка на каталог
+// из book_count книг, затем таблица задержек и памяти и стоимость одного замера
+void benchmarkMetrics(size_t book_count) {
+    std::mt19937 rng(11);
+    Library library;
+    size_t reader_count = fill_bench_catalog(library, book_count, rng, []() { return 3; }).readers.size();
+
+    const Date issue_date = Date::from_ymd(2026, 1, 1);
+    for (size_t i = 0; i < book_count; i++) {
+        std::string isbn = make_test_isbn(rng() % book_count);
+        int card = static_cast<int>(rng() % reader_count);
+        library.find_book_by_isbn(isbn);
+        library.find_reader_by_card(card);
+        library.find_books_by_title_prefix("Книга " + std::to_string(rng() % book_count));
+        LoanRef loan;
+        if (library.checkout_book(isbn, card, issue_date, issue_date + 30, &loan) == CHECKOUT_OK) {
+            library.find_loan_by_id(loan->get_id());
+            if (rng() % 2 == 0) {
+                library.return_loan(loan->get_id(), issue_date + 10);
+            }
+        }
+    }
+    for (size_t i = 0; i < 100; i++) {
+        library.search_books("Книга " + std::to_string(rng() % book_count), 10);
+        library.filter_books(1, 1950, 1960);
+        library.count_books(1, 1950, 1960);
+        library.advance_clock(issue_date + static_cast<int>(i));
+        library.get_analytics(10);
+    }
+    library.print_Metrics();
+
+#ifndef LIBRARY_NO_METRICS
+    const size_t repeats = 1000000;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repeats; i++) {
+        LIBRARY_TIMED(OP_LIST_PAGE);
+    }
+    double timer_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / repeats;
+    // Для сравнения: два чтения часов, без которых замер невозможен
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repeats; i++) {
+        std::chrono::steady_clock::now();
+        std::chrono::steady_clock::now();
+    }
+    double clock_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / repeats;
+    printf("Стоимость одного замера: %.1f нс (из них два чтения часов: %.1f нс)\n", timer_ns, clock_ns);
+#else
+    printf("Сборка без метрик (LIBRARY_NO_METRICS): замеры не выполняются.\n");
+#endif
+}
+
+// Нагрузочная проверка выдачи: несколько потоков одновременно выдают и
+// возвращают книги, после чего проверяется, что ни одна книга не выдана
+// сверх имеющихся экземпляров. Возвращает 0, если учет согласован.
+int stressTestCheckout(unsigned thread_count, size_t operations_per_thread) {
+    const int book_count = 64;
+    const int reader_count = 512;
+    const int copies_per_book = 3;
+
+    Library library;
+    auto author = std::make_shared<Author>("Автор", 1900);
+    library.add_author(author);
+    std::vector<BookRef> books;
+    for (int i = 0; i < book_count; i++) {
+        books.push_back(library.add_book(Book("Книга " + std::to_string(i), author, 2000, copies_per_book, make_test_isbn(i))));
+    }
+    for (int i = 0; i < reader_count; i++) {
+        library.add_reader(Reader("Читатель " + std::to_string(i), i));
+    }
+
+    std::atomic<size_t> checkouts(0), refusals(0), returns(0), views(0);
+    std::atomic<bool> negative_seen(false), view_mismatch(false), workers_done(false);
+    const Date issue_date = Date::from_ymd(2026, 1, 1);
+    const Date return_date = Date::from_ymd(2026, 2, 1);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < thread_count; t++) {
+        threads.emplace_back([&, t]() {
+            std::mt19937 rng(12345 + t);
+            std::uniform_int_distribution<int> pick_book(0, book_count - 1);
+            std::uniform_int_distribution<int> pick_reader(0, reader_count - 1);
+            std::uniform_int_distribution<int> pick_action(0, 9);
+            std::vector<LoanRef> issued; // Выдачи этого потока, которые можно вернуть
+            for (size_t i = 0; i < operations_per_thread; i++) {
+                std::string isbn = make_test_isbn(pick_book(rng));
+                int card_number = pick_reader(rng);
+                if (pick_action(rng) < 5 || issued.empty()) {
+                    LoanRef loan;
+                    if (library.checkout_book(isbn, card_number, issue_date, return_date, &loan) == CHECKOUT_OK) {
+                        issued.push_back(loan);
+                        checkouts++;
+                    }
+                    else {
+                        refusals++;
+                    }
+                }
+                else {
+                    std::swap(issued[rng() % issued.size()], issued.back());
+                    isbn = library.book_of(*issued.back())->get_isbn();
+                    if (library.return_loan(issued.back()->get_id(), return_date)) {
+                        returns++;
+                    }
+                    issued.pop_back();
+                }
+                if (library.find_book_by_isbn(isbn)->get_copies() < 0) {
+                    negative_seen = true;
+                }
+            }
+        });
+    }
+    // Параллельно с выдачами снимаются снимки для чтения: в каждом свободные
+    // экземпляры книги вместе с ее открытыми выдачами дают полный фонд
+    std::thread reporter([&]() {
+        while (!workers_done) {
+            ReadView view = library.read_view();
+            std::vector<int> open(view.book_count());
+            view.for_each_open_loan([&open](const Loan& loan, const LoanState&, const Book&, const Reader&) {
+                open[loan.get_book_handle().get_slot()]++;
+            });
+            for (size_t row = 0; row < view.book_count(); row++) {
+                if (view.copies_at(row) + open[row] != copies_per_book) {
+                    view_mismatch = true;
+                }
+            }
+            views++;
+            collect_operation_stats(); // Сбор замеров идет одновременно с их записью
+        }
+    });
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    workers_done = true;
+    reporter.join();
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    bool consistent = !negative_seen && !view_mismatch;
+    size_t open_total = 0;
+    for (const auto& book : books) {
+        size_t open = library.count_open_loans(book);
+        open_total += open;
+        if (book->get_copies() < 0 || book->get_copies() + static_cast<int>(open) != copies_per_book) {
+            printf("Несогласованный учет: %s, свободно %d, выдано %zu\n", book->get_isbn().c_str(), book->get_copies(), open);
+            consistent = false;
+        }
+    }
+    if (open_total != checkouts - returns || library.count_closed_loans() != returns) {
+        consistent = false;
+    }
+    // Представление открытых выдач должно совпасть с учетом и идти по дате выдачи
+    std::vector<LoanRef> listed = library.list_open_loans_by_date(0, open_total + 1);
+    if (listed.size() != open_total) {
+        consistent = false;
+    }
+    for (size_t i = 1; i < listed.size(); i++) {
+        if (listed[i]->get_issue_date() < listed[i - 1]->get_issue_date()) {
+            consistent = false;
+        }
+    }
+    // Счетчики сводки, обновлявшиеся при конкурентных выдачах, должны совпасть с пакетным расчетом
+    if (!same_analytics(library.get_analytics(reader_count), library.compute_analytics(reader_count))) {
+        consistent = false;
+    }
+#ifndef LIBRARY_NO_METRICS
+    // Счетчик выдач из всех потоков должен совпасть с числом попыток выдачи
+    for (const OperationStats& stats : collect_operation_stats()) {
+        if (stats.operation == OP_CHECKOUT && stats.count != checkouts + refusals) {
+            printf("Счетчик выдач расходится: %llu вместо %zu\n", static_cast<unsigned long long>(stats.count),
+                checkouts + refusals);
+            consistent = false;
+        }
+    }
+#endif
+
+    size_t total_operations = thread_count * operations_per_thread;
+    printf("Потоков: %u, операций: %zu за %.1f мс (%.0f операций/с)\n", thread_count, total_operations,
+        elapsed_ms, elapsed_ms > 0 ? total_operations * 1000.0 / elapsed_ms : 0.0);
+    printf("Выдач: %zu, отказов: %zu, возвратов: %zu, открыто: %zu\n",
+        checkouts.load(), refusals.load(), returns.load(), open_total);
+    printf("Снимков для чтения во время выдач: %zu%s\n", views.load(), view_mismatch ? " (ОШИБКА: снимок несогласован)" : "");
+    printf(consistent ? "Учет экземпляров согласован.\n" : "ОШИБКА: выдано больше экземпляров, чем есть.\n");
+    return consistent ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// Синтетическая нагрузка и набор замеров
+// ---------------------------------------------------------------------------
+// Генератор строит каталог из N книг (от 10^3 до 10^7), N/20 авторов и N/10
+// читателей с правдоподобными русскими ФИО и названиями. Спрос на книги
+// неравномерный: вероятность ранга r пропорциональна 1/r (закон Ципфа),
+// а ранги разбросаны по каталогу, чтобы популярные книги не шли подряд.
+// Все случайные числа берутся из std::mt19937_64 без стандартных
+// распределений, поэтому при одном seed данные совпадают на любой платформе.
+//
+// Набор запускается флагом --bench-suite N [seed]. Сборка без консольного
+// меню и демонстраций (например, на Linux):
+//     g++ -std=c++14 -O2 -pthread -DLIBRARY_BENCH_ONLY LABA5.cpp -o library_bench
+//     ./library_bench 1000000
+
+const uint64_t WORKLOAD_SCATTER = 2654435761ull; // Простой множитель для разброса рангов популярности
+
+const char* const WORKLOAD_SURNAMES[] = {
+    "Иванов", "Смирнов", "Кузнецов", "Попов", "Васильев", "Петров", "Соколов", "Михайлов", "Новиков", "Федоров",
+    "Морозов", "Волков", "Алексеев", "Лебедев", "Семенов", "Егоров", "Павлов", "Козлов", "Степанов", "Николаев",
+    "Орлов", "Андреев", "Макаров", "Никитин", "Захаров", "Зайцев", "Соловьев", "Борисов", "Яковлев", "Григорьев",
+    "Романов", "Воробьев", "Сергеев", "Кузьмин", "Фролов", "Александров", "Дмитриев", "Королев", "Гусев", "Киселев"
+};
+const char* const WORKLOAD_MALE_NAMES[] = {
+    "Александр", "Сергей", "Дмитрий", "Андрей", "Алексей", "Максим", "Евгений", "Иван", "Михаил", "Артем",
+    "Николай", "Владимир", "Павел", "Константин", "Олег", "Юрий", "Виктор", "Григорий", "Лев", "Федор"
+};
+const char* const WORKLOAD_FEMALE_NAMES[] = {
+    "Анна", "Мария", "Елена", "Ольга", "Наталья", "Татьяна", "Ирина", "Екатерина", "Светлана", "Юлия",
+    "Анастасия", "Дарья", "Марина", "Людмила", "Вера", "Ксения", "Софья", "Надежда", "Полина", "Алла"
+};
+// Отчества: мужская и женская форма
+const char* const WORKLOAD_PATRONYMICS[][2] = {
+    { "Александрович", "Александровна" }, { "Сергеевич", "Сергеевна" }, { "Дмитриевич", "Дмитриевна" },
+    { "Андреевич", "Андреевна" }, { "Алексеевич", "Алексеевна" }, { "Иванович", "Ивановна" },
+    { "Михайлович", "Михайловна" }, { "Николаевич", "Николаевна" }, { "Владимирович", "Владимировна" },
+    { "Павлович", "Павловна" }, { "Петрович", "Петровна" }, { "Викторович", "Викторовна" }
+};
+// Прилагательные в мужском, женском и среднем роде
+const char* const WORKLOAD_ADJECTIVES[][3] = {
+    { "Тихий", "Тихая", "Тихое" }, { "Белый", "Белая", "Белое" }, { "Последний", "Последняя", "Последнее" },
+    { "Старый", "Старая", "Старое" }, { "Золотой", "Золотая", "Золотое" }, { "Далекий", "Далекая", "Далекое" },
+    { "Северный", "Северная", "Северное" }, { "Тайный", "Тайная", "Тайное" }, { "Черный", "Черная", "Черное" },
+    { "Горький", "Горькая", "Горькое" }, { "Летний", "Летняя", "Летнее" }, { "Забытый", "Забытая", "Забытое" },
+    { "Долгий", "Долгая", "Долгое" }, { "Синий", "Синяя", "Синее" }, { "Новый", "Новая", "Новое" },
+    { "Живой", "Живая", "Живое" }, { "Чужой", "Чужая", "Чужое" }, { "Вечный", "Вечная", "Вечное" }
+};
+// Существительные и их род (0 - мужской, 1 - женский, 2 - средний)
+const std::pair<const char*, int> WORKLOAD_NOUNS[] = {
+    { "Дон", 0 }, { "сад", 0 }, { "ветер", 0 }, { "город", 0 }, { "берег", 0 }, { "дом", 0 },
+    { "гвардия", 1 }, { "река", 1 }, { "дорога", 1 }, { "осень", 1 }, { "звезда", 1 }, { "тайна", 1 },
+    { "море", 2 }, { "лето", 2 }, { "утро", 2 }, { "письмо", 2 }, { "небо", 2 }, { "поле", 2 }
+};
+// Продолжения названий в родительном падеже
+const char* const WORKLOAD_GENITIVES[] = {
+    "старого замка", "северного ветра", "забытой реки", "капитана", "ночного города", "белой ночи",
+    "последнего лета", "горной деревни", "детства", "дальних странствий", "одной семьи", "морской бездны",
+    "старого моряка", "первой любви", "тихой гавани", "большой войны", "маленького принца", "лесной сторожки"
+};
+
+// Класс WorkloadGenerator - детерминированный генератор данных каталога
+class WorkloadGenerator {
+    std::mt19937_64 rng;
+
+    template <typename T, size_t N>
+    const T& pick(const T (&items)[N]) {
+        return items[uniform(N)];
+    }
+
+public:
+    explicit WorkloadGenerator(uint64_t seed) : rng(seed) {}
+
+    // Равномерное число в [0, n)
+    size_t uniform(size_t n) {
+        return static_cast<size_t>(rng() % n);
+    }
+
+    // Равномерное число в [0, 1)
+    double unit() {
+        return static_cast<double>(rng() >> 11) / 9007199254740992.0; // 2^53
+    }
+
+    // Номер объекта из n по закону Ципфа: ранг r выпадает с вероятностью ~1/r
+    size_t popular(size_t n) {
+        size_t rank = static_cast<size_t>(std::exp(unit() * std::log(static_cast<double>(n) + 1.0))) - 1;
+        return static_cast<size_t>((std::min(rank, n - 1) * WORKLOAD_SCATTER) % n);
+    }
+
+    // ФИО: фамилия, имя и отчество одного рода
+    std::string person_fio() {
+        bool female = uniform(2) == 1;
+        std::string fio = pick(WORKLOAD_SURNAMES);
+        if (female) {
+            fio += "а"; // Все фамилии таблицы на -ов, -ев, -ин
+        }
+        fio += ' ';
+        fio += female ? pick(WORKLOAD_FEMALE_NAMES) : pick(WORKLOAD_MALE_NAMES);
+        fio += ' ';
+        fio += pick(WORKLOAD_PATRONYMICS)[female ? 1 : 0];
+        return fio;
+    }
+
+    // Название книги по одному из шаблонов: "Тихий Дон", "Тайна капитана",
+    // "Море и звезда", "Белая гвардия старого замка"; треть названий -
+    // части серий ("Тихий Дон. Книга 3"), как в настоящих каталогах
+    std::string book_title() {
+        const auto& noun = pick(WORKLOAD_NOUNS);
+        std::string title;
+        switch (uniform(4)) {
+        case 0:
+            title = std::string(pick(WORKLOAD_ADJECTIVES)[noun.second]) + ' ' + noun.first;
+            break;
+        case 1:
+            title = capitalized(noun.first) + ' ' + pick(WORKLOAD_GENITIVES);
+            break;
+        case 2:
+            title = capitalized(noun.first) + " и " + pick(WORKLOAD_NOUNS).first;
+            break;
+        default:
+            title = std::string(pick(WORKLOAD_ADJECTIVES)[noun.second]) + ' ' + noun.first + ' ' + pick(WORKLOAD_GENITIVES);
+            break;
+        }
+        if (uniform(3) == 0) {
+            title += ". Книга " + std::to_string(1 + uniform(12));
+        }
+        return title;
+    }
+
+    // Слово с прописной первой буквой (латиница и кириллица в UTF-8)
+    static std::string capitalized(const std::string& word) {
+        std::string result = word;
+        unsigned char lead = static_cast<unsigned char>(result[0]);
+        if (lead >= 'a' && lead <= 'z') {
+            result[0] = static_cast<char>(lead - 'a' + 'A');
+        }
+        else if (lead == 0xD0 && result.size() > 1) {
+            unsigned char next = static_cast<unsigned char>(result[1]);
+            if (next >= 0xB0 && next <= 0xBF) {
+                result[1] = static_cast<char>(next - 0x20); // а-п -> А-П
+            }
+        }
+        else if (lead == 0xD1 && result.size() > 1) {
+            unsigned char next = static_cast<unsigned char>(result[1]);
+            if (next >= 0x80 && next <= 0x8F) {
+                result[0] = static_cast<char>(0xD0);
+                result[1] = static_cast<char>(next + 0x20); // р-я -> Р-Я
+            }
+        }
+        return result;
+    }
+
+    int year(int from, int to) {
+        return from + static_cast<int>(uniform(static_cast<size_t>(to - from + 1)));
+    }
+};
+
+// Пиковый объем резидентной памяти процесса в байтах (0, если недоступен)
+size_t peak_rss_bytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss); // На macOS - в байтах
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024; // На Linux - в килобайтах
+#endif
+#endif
+}
+
+// Замер операции: count вызовов fn(i), каждый вызов замеряется отдельно.
+// Выводит строку таблицы: пропускную способность, процентили и пиковую память
+template <typename Operation>
+void bench_operation(const char* name, size_t count, Operation&& fn) {
+    std::vector<uint64_t> samples(count);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; i++) {
+        auto call_start = std::chrono::steady_clock::now();
+        fn(i);
+        samples[i] = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - call_start).count());
+    }
+    double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&samples](double share) {
+        return samples.empty() ? 0.0 : samples[std::min(samples.size() - 1, static_cast<size_t>(share * samples.size()))] / 1000.0;
+    };
+    printf("%s %9zu %11.1f %12.1f %10.2f %10.2f %10.2f %11.2f %9.1f\n", pad_text(name, 26).c_str(), count, total_ms,
+        total_ms > 0 ? count * 1000.0 / total_ms : 0.0, percentile(0.5), percentile(0.99), percentile(0.999),
+        samples.empty() ? 0.0 : samples.back() / 1000.0, peak_rss_bytes() / (1024.0 * 1024.0));
+}
+
+// Набор замеров основных операций Library на синтетическом каталоге из book_count книг
+void benchmarkSuite(size_t book_count, uint64_t seed) {
+    const size_t author_count = std::max<size_t>(1, book_count / 20);
+    const size_t reader_count = std::max<size_t>(1, book_count / 10);
+    const size_t lookup_count = std::min<size_t>(book_count, 100000);
+    const size_t bulk_repeats = 3; // Сортировки и вывод: первый проход по неупорядоченным данным, затем по упорядоченным
+    WorkloadGenerator generator(seed);
+    Library library;
+
+    printf("Каталог: %zu книг, %zu авторов, %zu читателей, seed %llu\n", book_count, author_count, reader_count,
+        static_cast<unsigned long long>(seed));
+    printf("%s %s %s %s %s %s %s %s %s\n", pad_text("Операция", 26).c_str(), pad_text("Вызовов", 9, true).c_str(),
+        pad_text("Всего, мс", 11, true).c_str(), pad_text("Операций/с", 12, true).c_str(), pad_text("p50, мкс", 10, true).c_str(),
+        pad_text("p99, мкс", 10, true).c_str(), pad_text("p99.9, мкс", 10, true).c_str(), pad_text("Макс., мкс", 11, true).c_str(),
+        pad_text("RSS, МБ", 9, true).c_str());
+
+    std::vector<std::shared_ptr<Author>> authors(author_count);
+    for (size_t i = 0; i < author_count; i++) {
+        // Повторяющиеся ФИО различаются номером, иначе справочник их отклонит
+        authors[i] = std::make_shared<Author>(generator.person_fio() + " " + std::to_string(i + 1), generator.year(1800, 2000));
+    }
+    bench_operation("add_author", author_count, [&](size_t i) { library.add_author(authors[i]); });
+
+    std::vector<Book> books;
+    books.reserve(std::min<size_t>(book_count, 1000000));
+    size_t added_books = 0;
+    while (added_books < book_count) { // Книги готовятся пачками, чтобы не держать копию всего каталога
+        books.clear();
+        for (size_t i = added_books; i < book_count && books.size() < books.capacity(); i++) {
+            books.emplace_back(generator.book_title(), authors[generator.popular(author_count)], generator.year(1850, 2025),
+                1 + static_cast<int>(generator.uniform(5)), make_test_isbn(i));
+        }
+        bench_operation(added_books == 0 ? "add_book" : "add_book (продолжение)", books.size(),
+            [&](size_t i) { library.add_book(books[i]); });
+        added_books += books.size();
+    }
+    std::vector<Book>().swap(books);
+
+    std::vector<std::string> reader_fios(reader_count);
+    for (auto& fio : reader_fios) {
+        fio = generator.person_fio();
+    }
+    bench_operation("add_reader", reader_count, [&](size_t i) {
+        library.add_reader(Reader(reader_fios[i], static_cast<int>(i + 1)));
+    });
+    std::vector<std::string>().swap(reader_fios);
+
+    const Date issue_date = Date::from_ymd(2026, 1, 1);
+    bench_operation("checkout_book", book_count, [&](size_t i) {
+        library.checkout_book(make_test_isbn(generator.popular(book_count)), static_cast<int>(1 + generator.uniform(reader_count)),
+            issue_date + static_cast<int>(i % 365), issue_date + static_cast<int>(i % 365) + 30);
+    });
+
+    // Запросы готовятся до замеров: популярные книги спрашивают чаще
+    std::vector<std::string> isbns(lookup_count);
+    std::vector<std::string> titles(lookup_count);
+    std::vector<int> cards(lookup_count);
+    for (size_t i = 0; i < lookup_count; i++) {
+        isbns[i] = make_test_isbn(generator.popular(book_count));
+        titles[i] = library.find_book_by_isbn(isbns[i])->get_title();
+        cards[i] = static_cast<int>(1 + generator.popular(reader_count));
+    }
+    bench_operation("find_book_by_title", lookup_count, [&](size_t i) { library.find_book_by_title(titles[i]); });
+    bench_operation("find_book_by_isbn", lookup_count, [&](size_t i) { library.find_book_by_isbn(isbns[i]); });
+    bench_operation("find_reader_by_card", lookup_count, [&](size_t i) { library.find_reader_by_card(cards[i]); });
+
+    bench_operation("sort_books_by_title", bulk_repeats, [&](size_t) { library.sort_books_by_title(); });
+    bench_operation("sort_readers_by_name", bulk_repeats, [&](size_t) { library.sort_readers_by_name(); });
+    bench_operation("sort_loans_by_date", bulk_repeats, [&](size_t) { library.sort_loans_by_date(); });
+
+    FILE* null_sink = fopen(NULL_DEVICE, "wb");
+    if (!null_sink) {
+        printf("Ошибка: не удалось открыть %s для вывода каталога\n", NULL_DEVICE);
+        return;
+    }
+    bench_operation("print_Library", bulk_repeats, [&](size_t) { library.print_Library(null_sink); });
+    fclose(null_sink);
+}
+
+// Заполнение каталога одинаковыми данными из генератора с заданным seed; возвращает фонд книг по номеру
+template <typename Catalog>
+std::vector<int> fill_workload_catalog(Catalog& catalog, size_t book_count, size_t reader_count, uint64_t seed) {
+    const size_t author_count = std::max<size_t>(1, book_count / 20);
+    WorkloadGenerator generator(seed);
+    std::vector<std::shared_ptr<Author>> authors(author_count);
+    for (size_t i = 0; i < author_count; i++) {
+        authors[i] = std::make_shared<Author>(generator.person_fio() + " " + std::to_string(i + 1), generator.year(1800, 2000));
+        catalog.add_author(authors[i]);
+    }
+    std::vector<int> stock(book_count);
+    for (size_t i = 0; i < book_count; i++) {
+        stock[i] = 1 + static_cast<int>(generator.uniform(5));
+        catalog.add_book(Book(generator.book_title(), authors[generator.popular(author_count)], generator.year(1850, 2025),
+            stock[i], make_test_isbn(i)));
+    }
+    for (size_t i = 0; i < reader_count; i++) {
+        catalog.add_reader(Reader(generator.person_fio(), static_cast<int>(i + 1)));
+    }
+    return stock;
+}
+
+// Выдачи и возвраты из thread_count потоков (по operations на поток); возвращает время в мс
+template <typename Catalog>
+double run_checkout_workload(Catalog& catalog, size_t book_count, size_t reader_count, unsigned thread_count,
+    size_t operations, uint64_t seed) {
+    const Date issue_date = Date::from_ymd(2026, 1, 1);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < thread_count; t++) {
+        threads.emplace_back([&, t]() {
+            WorkloadGenerator generator(seed + t);
+            std::vector<uint64_t> issued; // Выдачи этого потока, которые можно вернуть
+            for (size_t i = 0; i < operations; i++) {
+                Date day = issue_date + static_cast<int>(i % 365);
+                if (generator.uniform(10) < 6 || issued.empty()) {
+                    LoanRef loan;
+                    if (catalog.checkout_book(make_test_isbn(generator.popular(book_count)),
+                        static_cast<int>(1 + generator.uniform(reader_count)), day, day + 30, &loan) == CHECKOUT_OK) {
+                        issued.push_back(loan->get_id());
+                    }
+                }
+                else {
+                    std::swap(issued[generator.uniform(issued.size())], issued.back());
+                    catalog.return_loan(issued.back(), day);
+                    issued.pop_back();
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Сравнение одной Library и ShardedLibrary на одинаковом каталоге и нагрузке:
+// время загрузки, многопоточные выдачи, поиск и отчеты. Затем проверяется
+// согласованность учета шардов: свободные экземпляры и открытые выдачи каждой
+// книги дают ее фонд, выдачи читателя собираются из всех шардов, а слитые
+// списки и отчет идут в порядке сортировки. Возвращает 0, если все сошлось
+int benchmarkShards(size_t book_count, size_t shard_count, unsigned thread_count) {
+    const size_t reader_count = std::max<size_t>(1, book_count / 10);
+    const size_t operations = std::max<size_t>(1, book_count / thread_count);
+    const size_t lookup_count = std::min<size_t>(book_count, 10000);
+    const uint64_t seed = 1;
+    Library single;
+    ShardedLibrary sharded(shard_count);
+
+    printf("Каталог: %zu книг, %zu читателей; шардов: %zu, потоков: %u\n", book_count, reader_count, shard_count, thread_count);
+    printf("%s %s %s\n", pad_text("Операция", 30).c_str(), pad_text("Library, мс", 14, true).c_str(),
+        pad_text("Шарды, мс", 14, true).c_str());
+    auto print_row = [](const char* name, double single_ms, double sharded_ms) {
+        printf("%s %14.1f %14.1f\n", pad_text(name, 30).c_str(), single_ms, sharded_ms);
+    };
+    auto elapsed_ms = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<int> stock = fill_workload_catalog(single, book_count, reader_count, seed);
+    double single_ms = elapsed_ms(start);
+    start = std::chrono::steady_clock::now();
+    fill_workload_catalog(sharded, book_count, reader_count, seed);
+    print_row("Загрузка каталога", single_ms, elapsed_ms(start));
+
+    print_row("Выдачи и возвраты",
+        run_checkout_workload(single, book_count, reader_count, thread_count, operations, seed),
+        run_checkout_workload(sharded, book_count, reader_count, thread_count, operations, seed));
+
+    WorkloadGenerator generator(seed + 1000);
+    std::vector<std::string> isbns(lookup_count);
+    std::vector<std::string> titles(lookup_count);
+    for (size_t i = 0; i < lookup_count; i++) {
+        isbns[i] = make_test_isbn(generator.popular(book_count));
+        titles[i] = single.find_book_by_isbn(isbns[i])->get_title();
+    }
+    bool consistent = true;
+    auto time_both = [&](const char* name, size_t count, std::function<size_t(Library&, size_t)> on_single,
+        std::function<size_t(ShardedLibrary&, size_t)> on_sharded) {
+        size_t single_found = 0;
+        size_t sharded_found = 0;
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; i++) {
+            single_found += on_single(single, i);
+        }
+        double single_time = elapsed_ms(begin);
+        begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; i++) {
+            sharded_found += on_sharded(sharded, i);
+        }
+        print_row(name, single_time, elapsed_ms(begin));
+        if (single_found != sharded_found) {
+            printf("Результаты расходятся: %s, %zu и %zu\n", name, single_found, sharded_found);
+            consistent = false;
+        }
+    };
+    time_both("find_book_by_isbn", lookup_count,
+        [&](Library& library, size_t i) { return library.find_book_by_isbn(isbns[i]) ? size_t(1) : size_t(0); },
+        [&](ShardedLibrary& library, size_t i) { return library.find_book_by_isbn(isbns[i]) ? size_t(1) : size_t(0); });
+    time_both("find_books_by_title", lookup_count,
+        [&](Library& library, size_t i) { return library.find_books_by_title(titles[i]).size(); },
+        [&](ShardedLibrary& library, size_t i) { return library.find_books_by_title(titles[i]).size(); });
+    time_both("search_books", std::min<size_t>(lookup_count, 200),
+        [&](Library& library, size_t i) { return library.search_books(titles[i], 10).size(); },
+        [&](ShardedLibrary& library, size_t i) { return library.search_books(titles[i], 10).size(); });
+    time_both("filter_books", 10,
+        [&](Library& library, size_t i) { return library.filter_books(0, 1900 + static_cast<int>(i), 2000).size(); },
+        [&](ShardedLibrary& library, size_t i) { return library.filter_books(0, 1900 + static_cast<int>(i), 2000).size(); });
+    time_both("query_books", 10,
+        [&](Library& library, size_t i) {
+            QueryResult<Book> found = library.query_books(Query::pub_year(1900 + static_cast<int>(i), 2000));
+            return static_cast<size_t>(std::distance(found.begin(), found.end()));
+        },
+        [&](ShardedLibrary& library, size_t i) { return library.query_books(Query::pub_year(1900 + static_cast<int>(i), 2000)).size(); });
+
+    // Порядок результатов у Library и шардов один и тот же - по названию
+    auto titles_of = [](const std::vector<BookRef>& books) {
+        std::vector<std::string> result;
+        for (const BookRef& book : books) {
+            result.push_back(book->get_title());
+        }
+        return result;
+    };
+    if (titles_of(single.filter_books(1, 1950, 2000)) != titles_of(sharded.filter_books(1, 1950, 2000))
+        || titles_of(single.query_books(Query::pub_year(1950, 2000)).to_vector()) != titles_of(sharded.query_books(Query::pub_year(1950, 2000)))) {
+        printf("Порядок результатов расходится: filter_books или query_books\n");
+        consistent = false;
+    }
+
+    FILE* null_sink = fopen(NULL_DEVICE, "wb");
+    if (!null_sink) {
+        printf("Ошибка: не удалось открыть %s для вывода каталога\n", NULL_DEVICE);
+        return 1;
+    }
+    start = std::chrono::steady_clock::now();
+    single.print_Library(null_sink);
+    single_ms = elapsed_ms(start);
+    start = std::chrono::steady_clock::now();
+    sharded.print_Library(null_sink);
+    print_row("print_Library", single_ms, elapsed_ms(start));
+    fclose(null_sink);
+
+    // Учет по снимкам шардов: фонд каждой книги и открытые выдачи каждого читателя
+    std::unordered_map<std::string, size_t> book_numbers;
+    for (size_t i = 0; i < book_count; i++) {
+        book_numbers[make_test_isbn(i)] = i;
+    }
+    std::vector<size_t> reader_loans(reader_count + 1);
+    size_t book_total = 0;
+    for (size_t s = 0; s < sharded.shard_count(); s++) {
+        ReadView view = sharded.shard(s).read_view();
+        std::vector<int> open(view.book_count());
+        view.for_each_open_loan([&](const Loan& loan, const LoanState&, const Book&, const Reader& reader) {
+            open[loan.get_book_handle().get_slot()]++;
+            reader_loans[reader.get_card_number()]++;
+            if (sharded.loan_shard(loan.get_id()) != s) {
+                consistent = false;
+            }
+        });
+        for (size_t row = 0; row < view.book_count(); row++) {
+            const Book& book = view.book_at(row);
+            if (sharded.book_shard(book.get_isbn()) != s || view.copies_at(row) + open[row] != stock[book_numbers[book.get_isbn()]]) {
+                printf("Несогласованный учет: %s, свободно %d, выдано %d\n", book.get_isbn().c_str(), view.copies_at(row), open[row]);
+                consistent = false;
+            }
+        }
+        book_total += view.book_count();
+    }
+    if (book_total != book_count) {
+        consistent = false;
+    }
+    for (size_t card = 1; card <= reader_count; card++) {
+        std::vector<LoanRef> loans = sharded.find_open_loans(static_cast<int>(card));
+        if (loans.size() != reader_loans[card] || !std::is_sorted(loans.begin(), loans.end(), loan_ref_before)) {
+            consistent = false;
+        }
+    }
+    // Сводка складывает открытые выдачи читателя из всех шардов
+    LibraryAnalytics summary = sharded.get_analytics(reader_count);
+    size_t open_total = 0;
+    size_t active_readers = 0;
+    for (size_t card = 1; card <= reader_count; card++) {
+        open_total += reader_loans[card];
+        active_readers += reader_loans[card] > 0 ? 1 : 0;
+    }
+    for (const auto& entry : summary.top_readers) {
+        if (entry.second != reader_loans[entry.first->get_card_number()]) {
+            consistent = false;
+        }
+    }
+    if (summary.top_readers.size() != active_readers) {
+        consistent = false;
+    }
+    // Слитые страницы и отчет идут по названию, а гостевые записи в них не попадают
+    std::vector<BookRef> page = sharded.list_books_by_title(1, 100);
+    if (page.size() != std::min<size_t>(100, book_count > 100 ? book_count - 100 : 0)
+        || !std::is_sorted(page.begin(), page.end(), book_ref_before)) {
+        consistent = false;
+    }
+    std::vector<ReaderRef> readers = sharded.list_readers_by_fio(0, reader_count + 1);
+    if (readers.size() != reader_count) {
+        consistent = false;
+    }
+    FILE* report = tmpfile();
+    if (report) {
+        sharded.export_report(REPORT_BOOKS, REPORT_CSV, report);
+        rewind(report);
+        std::vector<std::string> report_titles;
+        char line[1024];
+        fgets(line, sizeof(line), report); // Заголовок
+        while (fgets(line, sizeof(line), report)) {
+            report_titles.push_back(line);
+        }
+        fclose(report);
+        std::vector<BookRef> listed = single.list_books_by_title(0, book_count);
+        for (size_t i = 0; i < listed.size() && i < report_titles.size(); i++) {
+            if (report_titles[i].compare(0, listed[i]->get_title().size(), listed[i]->get_title()) != 0
+                && report_titles[i].compare(1, listed[i]->get_title().size(), listed[i]->get_title()) != 0) {
+                consistent = false; // Название может быть в кавычках CSV
+                break;
+            }
+        }
+        if (report_titles.size() != book_count) {
+            consistent = false;
+        }
+    }
+    // Часы переводятся во всех шардах: после всех сроков просрочены все открытые выдачи
+    std::vector<LoanRef> overdue = sharded.advance_clock(Date::from_ymd(2100, 1, 1));
+    if (overdue.size() != open_total || sharded.count_overdue_loans() != open_total
+        || !std::is_sorted(overdue.begin(), overdue.end(), loan_ref_before)) {
+        consistent = false;
+    }
+    printf(consistent ? "Учет шардов согласован\n" : "ОШИБКА: учет шардов несогласован\n");
+    return consistent ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// Сервер запросов
+// ---------------------------------------------------------------------------
+// Режим службы: операции Library доступны через локальный сокет (Unix domain)
+// по строчному протоколу. Запрос - одна строка с полями через табуляцию,
+// ответ - строка "OK n" и n строк данных (поля через табуляцию) или строка
+// "ERR сообщение". Клиент может отправлять запросы подряд, не дожидаясь
+// ответов: ответы приходят в порядке запросов. Все соединения обслуживает
+// один поток через poll: из сокета читается все, что пришло, выполняются
+// все полные строки, и ответы на них уходят одной записью. Тяжелые запросы
+// (REPORT, PRINT, IMPORT, SEARCH) выполняют рабочие потоки. Тем же языком
+// записываются трассы сеансов меню. С ключом --shards N сервер обслуживает
+// шардированный каталог (ShardedLibrary) с теми же командами. Команды:
+//   PING
+//   ADD_AUTHOR  фио  год_рождения  [произведение  наград]
+//   ADD_BOOK  название  фио_автора  год  экземпляров  isbn
+//   ADD_READER  фио  билет
+//   IMPORT  authors|books|readers  файл  -> импортировано, пропущено, создано авторов
+//           (файл - имя в каталоге --import-dir; без него импорт отключен)
+//   CHECKOUT  isbn  билет  дата_выдачи  дата_возврата  -> номер выдачи
+//   RETURN  номер_выдачи  дата
+//   RENEW  номер_выдачи  новый_срок
+//   CLOCK  дата           -> выдачи, ставшие просроченными
+//   CHECKPOINT            - контрольная точка хранилища
+//   BOOK  isbn            -> название, isbn, автор, год, свободно экземпляров
+//   TITLE  название       -> книги, как в BOOK (также PREFIX  начало_названия)
+//   SEARCH  запрос  [лимит] -> книги, как в BOOK
+//   FILTER  мин_экземпляров  год_от  год_до  -> книги, как в BOOK
+//   QUERY  начало_названия  фио_автора  год_от  год_до  мин_экземпляров  (пустое поле - любое)
+//   AUTHOR_BOOKS  fio|work|awards  значение  -> книги найденных авторов
+//   READER  билет         -> фио, билет, открытых выдач (также READERS  фио)
+//   LOANS  билет          -> номер, isbn, название, дата выдачи, срок
+//   LOANS_BETWEEN  дата_от  дата_до  -> выдачи, как в LOANS
+//   PAGE  authors|books|readers|loans  страница  размер  -> страница списка (с 1)
+//   ANALYTICS  k          -> вид (author, book, reader, decade), ключ, число
+//   REPORT  authors|books|readers|loans|operations|memory  [text|csv|jsonl]
+//   PRINT                 -> вывод print_Library
+//   QUIT                  - закрыть соединение после ответа
+// Даты - в формате дд.мм.гггг.
+
+// Добавление поля ответа: табуляции и переводы строк внутри поля заменяются пробелами
+void append_response_field(std::string& out, const std::string& field, bool last = false) {
+    size_t start = out.size();
+    out += field;
+    for (size_t i = start; i < out.size(); i++) {
+        if (out[i] == '\t' || out[i] == '\n' || out[i] == '\r') {
+            out[i] = ' ';
+        }
+    }
+    out += last ? '\n' : '\t';
+}
+
+void append_response_field(std::string& out, int64_t value, bool last = false) {
+    char buffer[24];
+    snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(value));
+    out += buffer;
+    out += last ? '\n' : '\t';
+}
+
+// Заголовок успешного ответа с n строками данных
+void append_response_header(std::string& out, size_t rows) {
+    out += "OK ";
+    out += std::to_string(rows);
+    out += '\n';
+}
+
+// Класс RequestHandler - выполнение строк протокола над библиотекой (без ввода-вывода).
+// Catalog - Library или ShardedLibrary. Состояния не хранит, поэтому один
+// обработчик можно вызывать из нескольких потоков
+template <typename Catalog>
+class RequestHandler {
+    Catalog& library;
+    bool imports_restricted; // IMPORT читает только файлы из import_dir
+    std::string import_dir;
+
+    static int int_field(const std::vector<std::string>& fields, size_t index, const char* name) {
+        int value = 0;
+        if (index >= fields.size() || !parse_import_int(fields[index], value)) {
+            throw std::invalid_argument(std::string("Некорректное поле: ") + name);
+        }
+        return value;
+    }
+
+    static uint64_t loan_id_field(const std::vector<std::string>& fields, size_t index) {
+        char* parse_end = nullptr;
+        unsigned long long value = index < fields.size() ? std::strtoull(fields[index].c_str(), &parse_end, 10) : 0;
+        if (index >= fields.size() || fields[index].empty() || *parse_end != '\0') {
+            throw std::invalid_argument("Некорректный номер выдачи.");
+        }
+        return value;
+    }
+
+    // Номер значения поля в списке имен
+    template <size_t N>
+    static size_t name_field(const std::vector<std::string>& fields, size_t index, const char* const (&names)[N], const char* what) {
+        for (size_t i = 0; i < N && index < fields.size(); i++) {
+            if (fields[index] == names[i]) {
+                return i;
+            }
+        }
+        throw std::invalid_argument(std::string("Некорректное поле: ") + what);
+    }
+
+    static void require_fields(const std::vector<std::string>& fields, size_t count) {
+        if (fields.size() < count) {
+            throw std::invalid_argument("Недостаточно полей в запросе " + fields[0] + ".");
+        }
+    }
+
+    // Путь к файлу импорта. У сервера файл задается именем без каталогов и ищется
+    // в каталоге импорта, чтобы клиент не мог прочитать произвольный файл
+    std::string import_path(const std::string& name) const {
+        if (!imports_restricted) {
+            return name;
+        }
+        if (import_dir.empty()) {
+            throw std::invalid_argument("Импорт через сервер отключен: не задан каталог импорта.");
+        }
+        if (name.empty() || name == "." || name == ".." || name.find_first_of("/\\") != std::string::npos) {
+            throw std::invalid_argument("Файл импорта задается именем в каталоге импорта.");
+        }
+        return import_dir + "/" + name;
+    }
+
+    static void append_book(std::string& out, const Book& book) {
+        static const std::string no_author;
+        append_response_field(out, book.get_title());
+        append_response_field(out, book.get_isbn());
+        append_response_field(out, book.get_author() ? book.get_author()->get_fio() : no_author);
+        append_response_field(out, book.get_pub_year());
+        append_response_field(out, book.get_copies(), true);
+    }
+
+    static void append_books(std::string& out, const std::vector<BookRef>& books) {
+        append_response_header(out, books.size());
+        for (const BookRef& book : books) {
+            append_book(out, *book);
+        }
+    }
+
+    void append_readers(std::string& out, const std::vector<ReaderRef>& readers) const {
+        append_response_header(out, readers.size());
+        for (const ReaderRef& reader : readers) {
+            append_response_field(out, reader->get_fio());
+            append_response_field(out, reader->get_card_number());
+            append_response_field(out, static_cast<int64_t>(library.find_open_loans(reader).size()), true);
+        }
+    }
+
+    void append_loans(std::string& out, const std::vector<LoanRef>& loans) const {
+        append_response_header(out, loans.size());
+        for (const LoanRef& loan : loans) {
+            BookRef book = library.book_of(*loan);
+            append_response_field(out, static_cast<int64_t>(loan->get_id()));
+            append_response_field(out, book->get_isbn());
+            append_response_field(out, book->get_title());
+            append_response_field(out, loan->get_issue_date().to_string());
+            append_response_field(out, loan->get_return_date().to_string(), true);
+        }
+    }
+
+    // Вывод в файл, собранный в ответ: строки вывода становятся строками данных
+    template <typename Fn>
+    static void append_output(std::string& out, Fn write) {
+        std::string text;
+#ifdef _WIN32
+        FILE* file = tmpfile();
+#else
+        char* data = nullptr;
+        size_t size = 0;
+        FILE* file = open_memstream(&data, &size);
+#endif
+        if (!file) {
+            throw std::runtime_error("Не удалось подготовить вывод.");
+        }
+        try {
+            write(file);
+        }
+        catch (...) {
+            fclose(file);
+#ifndef _WIN32
+            free(data);
+#endif
+            throw;
+        }
+#ifdef _WIN32
+        rewind(file);
+        char buffer[64 * 1024];
+        size_t read_size;
+        while ((read_size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            text.append(buffer, read_size);
+        }
+        fclose(file);
+#else
+        fclose(file);
+        text.assign(data, size);
+        free(data);
+#endif
+        if (!text.empty() && text.back() != '\n') {
+            text += '\n';
+        }
+        append_response_header(out, static_cast<size_t>(std::count(text.begin(), text.end(), '\n')));
+        out += text;
+    }
+
+    void dispatch(const std::vector<std::string>& fields, std::string& out) {
+        const std::string& command = fields[0];
+        if (command == "PING") {
+            append_response_header(out, 0);
+        }
+        else if (command == "ADD_AUTHOR") {
+            require_fields(fields, 3);
+            int birth_year = int_field(fields, 2, "год рождения");
+            std::shared_ptr<Author> author = fields.size() >= 5
+                ? std::make_shared<FamousAuthor>(fields[1], birth_year, fields[3], int_field(fields, 4, "наград"))
+                : std::make_shared<Author>(fields[1], birth_year);
+            if (!library.add_author(author)) {
+                throw std::invalid_argument("Автор " + fields[1] + " уже существует.");
+            }
+            append_response_header(out, 0);
+        }
+        else if (command == "ADD_BOOK") {
+            require_fields(fields, 6);
+            std::shared_ptr<Author> author = library.find_author_by_fio(fields[2]);
+            if (!author) {
+                throw std::invalid_argument("Автор " + fields[2] + " не найден.");
+            }
+            if (!library.add_book(Book(fields[1], author, int_field(fields, 3, "год"), int_field(fields, 4, "экземпляров"), fields[5]))) {
+                throw std::invalid_argument("Книга с ISBN " + fields[5] + " уже есть.");
+            }
+            append_response_header(out, 0);
+        }
+        else if (command == "ADD_READER") {
+            require_fields(fields, 3);
+            if (!library.add_reader(Reader(fields[1], int_field(fields, 2, "билет")))) {
+                throw std::invalid_argument("Номер билета " + fields[2] + " уже занят.");
+            }
+            append_response_header(out, 0);
+        }
+        else if (command == "IMPORT") {
+            require_fields(fields, 3);
+            static const char* const entities[] = { "authors", "books", "readers" };
+            ImportEntity entity = static_cast<ImportEntity>(name_field(fields, 1, entities, "сущность"));
+            ImportResult result = library.import_file(import_path(fields[2]), entity);
+            append_response_header(out, 1);
+            append_response_field(out, static_cast<int64_t>(result.imported));
+            append_response_field(out, static_cast<int64_t>(result.skipped));
+            append_response_field(out, static_cast<int64_t>(result.created_authors), true);
+        }
+        else if (command == "CHECKOUT") {
+            require_fields(fields, 5);
+            LoanRef loan;
+            switch (library.checkout_book(fields[1], int_field(fields, 2, "билет"), Date::parse(fields[3]), Date::parse(fields[4]), &loan)) {
+            case CHECKOUT_NO_BOOK:
+                throw std::invalid_argument("Книга не найдена.");
+            case CHECKOUT_NO_READER:
+                throw std::invalid_argument("Читатель не найден.");
+            case CHECKOUT_NO_COPIES:
+                throw std::runtime_error("Недостаточно экземпляров книги.");
+            case CHECKOUT_BAD_DATES:
+                throw std::invalid_argument("Дата возврата раньше даты выдачи.");
+            case CHECKOUT_OK:
+                break;
+            }
+            append_response_header(out, 1);
+            append_response_field(out, static_cast<int64_t>(loan->get_id()), true);
+        }
+        else if (command == "RETURN" || command == "RENEW") {
+            require_fields(fields, 3);
+            uint64_t loan_id = loan_id_field(fields, 1);
+            Date date = Date::parse(fields[2]);
+            if (command == "RETURN" ? !library.return_loan(loan_id, date) : !library.renew_loan(loan_id, date)) {
+                throw std::invalid_argument("Открытая выдача не найдена или срок не изменен.");
+            }
+            append_response_header(out, 0);
+        }
+        else if (command == "CLOCK") {
+            require_fields(fields, 2);
+            append_loans(out, library.advance_clock(Date::parse(fields[1])));
+        }
+        else if (command == "CHECKPOINT") {
+            library.checkpoint();
+            append_response_header(out, 0);
+        }
+        else if (command == "BOOK") {
+            require_fields(fields, 2);
+            BookRef book = library.find_book_by_isbn(fields[1]);
+            append_response_header(out, book ? 1 : 0);
+            if (book) {
+                append_book(out, *book);
+            }
+        }
+        else if (command == "TITLE" || command == "PREFIX") {
+            require_fields(fields, 2);
+            append_books(out, command == "TITLE" ? library.find_books_by_title(fields[1]) : library.find_books_by_title_prefix(fields[1]));
+        }
+        else if (command == "SEARCH") {
+            require_fields(fields, 2);
+            append_books(out, library.search_books(fields[1], fields.size() > 2 ? std::max(1, int_field(fields, 2, "лимит")) : 20));
+        }
+        else if (command == "FILTER") {
+            require_fields(fields, 4);
+            append_books(out, library.filter_books(int_field(fields, 1, "экземпляров"), int_field(fields, 2, "год от"),
+                int_field(fields, 3, "год до")));
+        }
+        else if (command == "QUERY") {
+            require_fields(fields, 6);
+            Query query = Query::pub_year(int_field(fields, 3, "год от"), int_field(fields, 4, "год до"))
+                && Query::copies(int_field(fields, 5, "экземпляров"));
+            if (!fields[1].empty()) {
+                query = query && Query::title_prefix(fields[1]);
+            }
+            if (!fields[2].empty()) {
+                query = query && Query::author(fields[2]);
+            }
+            std::vector<BookRef> books;
+            {
+                auto found = library.query_books(query); // У шардированной библиотеки - уже вектор
+                books.assign(found.begin(), found.end());
+            }
+            append_books(out, books);
+        }
+        else if (command == "AUTHOR_BOOKS") {
+            require_fields(fields, 3);
+            static const char* const modes[] = { "fio", "work", "awards" };
+            std::vector<std::shared_ptr<Author>> authors;
+            switch (name_field(fields, 1, modes, "вид поиска автора")) {
+            case 0:
+                authors = library.find_authors_by_fio_prefix(fields[2], AUTHOR_CHOICE_LIMIT);
+                break;
+            case 1:
+                authors = library.find_authors_by_famous_work(fields[2]);
+                break;
+            default:
+                authors = library.find_authors_with_awards(int_field(fields, 2, "наград"));
+                break;
+            }
+            std::vector<BookRef> books;
+            for (const auto& author : authors) {
+                std::vector<BookRef> author_books = library.find_books_by_author(author);
+                books.insert(books.end(), author_books.begin(), author_books.end());
+            }
+            append_books(out, books);
+        }
+        else if (command == "READER") {
+            require_fields(fields, 2);
+            ReaderRef reader = library.find_reader_by_card(int_field(fields, 1, "билет"));
+            append_readers(out, reader ? std::vector<ReaderRef>{ reader } : std::vector<ReaderRef>());
+        }
+        else if (command == "READERS") {
+            require_fields(fields, 2);
+            append_readers(out, library.find_readers_by_fio(fields[1]));
+        }
+        else if (command == "LOANS") {
+            require_fields(fields, 2);
+            ReaderRef reader = library.find_reader_by_card(int_field(fields, 1, "билет"));
+            append_loans(out, reader ? library.find_open_loans(reader) : std::vector<LoanRef>());
+        }
+        else if (command == "LOANS_BETWEEN") {
+            require_fields(fields, 3);
+            append_loans(out, library.find_loans_issued_between(Date::parse(fields[1]), Date::parse(fields[2])));
+        }
+        else if (command == "PAGE") {
+            require_fields(fields, 4);
+            static const char* const lists[] = { "authors", "books", "readers", "loans" };
+            size_t list = name_field(fields, 1, lists, "список");
+            int page = int_field(fields, 2, "страница");
+            int page_size = int_field(fields, 3, "размер страницы");
+            if (page < 1 || page_size < 1) {
+                throw std::invalid_argument("Некорректные параметры страницы.");
+            }
+            size_t index = static_cast<size_t>(page - 1);
+            size_t size = static_cast<size_t>(page_size);
+            if (list == 0) {
+                std::vector<std::shared_ptr<Author>> authors = library.list_authors_by_fio(index, size);
+                append_response_header(out, authors.size());
+                for (const auto& author : authors) {
+                    append_response_field(out, author->get_fio());
+                    append_response_field(out, author->get_birth_year(), true);
+                }
+            }
+            else if (list == 1) {
+                append_books(out, library.list_books_by_title(index, size));
+            }
+            else if (list == 2) {
+                append_readers(out, library.list_readers_by_fio(index, size));
+            }
+            else {
+                append_loans(out, library.list_open_loans_by_date(index, size));
+            }
+        }
+        else if (command == "ANALYTICS") {
+            require_fields(fields, 2);
+            LibraryAnalytics summary = library.get_analytics(static_cast<size_t>(std::max(0, int_field(fields, 1, "k"))));
+            append_response_header(out, summary.top_authors.size() + summary.top_books.size() + summary.top_readers.size()
+                + summary.books_per_decade.size());
+            for (const auto& entry : summary.top_authors) {
+                out += "author\t";
+                append_response_field(out, entry.first->get_fio());
+                append_response_field(out, static_cast<int64_t>(entry.second), true);
+            }
+            for (const auto& entry : summary.top_books) {
+                out += "book\t";
+                append_response_field(out, entry.first->get_isbn());
+                append_response_field(out, static_cast<int64_t>(entry.second), true);
+            }
+            for (const auto& entry : summary.top_readers) {
+                out += "reader\t";
+                append_response_field(out, entry.first->get_card_number());
+                append_response_field(out, static_cast<int64_t>(entry.second), true);
+            }
+            for (const auto& decade : summary.books_per_decade) {
+                out += "decade\t";
+                append_response_field(out, decade.first);
+                append_response_field(out, static_cast<int64_t>(decade.second), true);
+            }
+        }
+        else if (command == "REPORT") {
+            require_fields(fields, 2);
+            ReportEntity entity = static_cast<ReportEntity>(name_field(fields, 1, REPORT_ENTITY_NAMES, "отчет"));
+            ReportFormat format = fields.size() > 2
+                ? static_cast<ReportFormat>(name_field(fields, 2, REPORT_FORMAT_NAMES, "формат")) : REPORT_CSV;
+            append_output(out, [this, entity, format](FILE* file) { library.export_report(entity, format, file); });
+        }
+        else if (command == "PRINT") {
+            append_output(out, [this](FILE* file) { library.print_Library(file); });
+        }
+        else {
+            throw std::invalid_argument("Неизвестная команда: " + command);
+        }
+    }
+
+public:
+    // Обработчик для воспроизведения трасс: пути импорта берутся из запросов как есть
+    explicit RequestHandler(Catalog& library) : library(library), imports_restricted(false) {}
+
+    // Обработчик для сервера: IMPORT читает файлы только из import_dir (пустой - импорт запрещен)
+    RequestHandler(Catalog& library, const std::string& import_dir)
+        : library(library), imports_restricted(true), import_dir(import_dir) {
+    }
+
+    // Выполнение одной строки запроса; ответ дописывается в out.
+    // Возвращает false для QUIT (соединение закрывается после ответа)
+    bool execute(const std::string& line, std::string& out) {
+        std::vector<std::string> fields;
+        size_t start = 0;
+        while (true) {
+            size_t tab = line.find('\t', start);
+            fields.push_back(line.substr(start, tab == std::string::npos ? std::string::npos : tab - start));
+            if (tab == std::string::npos) {
+                break;
+            }
+            start = tab + 1;
+        }
+        if (fields[0] == "QUIT") {
+            append_response_header(out, 0);
+            return false;
+        }
+        size_t mark = out.size();
+        try {
+            dispatch(fields, out);
+        }
+        catch (const std::exception& e) {
+            out.resize(mark); // Частично записанный ответ отбрасывается
+            out += "ERR ";
+            append_response_field(out, e.what(), true);
+        }
+        return true;
+    }
+};
+
+#ifndef _WIN32
+const size_t SERVER_READ_CHUNK = 64 * 1024; // Блок чтения из сокета
+const size_t SERVER_MAX_LINE = 64 * 1024; // Предельная длина запроса
+const size_t SERVER_OUTPUT_LIMIT = 4 << 20; // При стольких неотправленных байтах соединение перестает читаться
+const int SERVER_POLL_MS = 200; // Период проверки запроса на остановку
+
+// Класс RequestServer - сервер запросов на локальном сокете с циклом событий на poll.
+// Журнал открывается без ожидания сброса (JournalOptions::wait_for_sync = false):
+// за проход цикла выполняются запросы всех соединений, затем журнал сбрасывается
+// на диск одним вызовом, и только после этого уходят ответы. Тяжелые запросы
+// (отчеты, вывод каталога, импорт, нечеткий поиск) выполняют рабочие потоки;
+// следующие строки того же соединения ждут их ответа, поэтому запросы соединения
+// выполняются и получают ответы по порядку
+class RequestServer {
+    // Тяжелый запрос, отданный рабочему потоку
+    struct BackgroundJob {
+        std::string line;
+        std::string output; // Ответ; читается циклом после done
+        std::atomic<bool> done;
+
+        explicit BackgroundJob(std::string line) : line(std::move(line)), done(false) {}
+    };
+
+    struct Connection {
+        int fd;
+        std::string input; // Прочитанные байты, еще не образующие полной строки
+        std::string output; // Ответы, ожидающие отправки
+        size_t sent; // Отправлено байт из output
+        bool closing; // Закрыть после отправки ответов (QUIT, конец ввода или ошибка протокола)
+        std::shared_ptr<BackgroundJob> job; // Выполняемый тяжелый запрос; следующие строки ждут его
+    };
+
+    std::function<bool(const std::string&, std::string&)> execute_request; // RequestHandler::execute
+    std::function<void()> sync_journal; // Сброс журнала каталога на диск
+    std::string socket_path;
+    int listen_fd;
+    int wake_pipe[2]; // Рабочий поток пишет байт, чтобы прервать poll
+    std::vector<Connection> connections;
+    std::vector<char> read_buffer;
+    std::atomic<bool> stop_requested;
+    uint64_t requests; // Выполнено запросов
+    uint64_t writes; // Записей ответов в сокеты
+    unsigned worker_count;
+    std::vector<std::thread> workers;
+    std::queue<std::shared_ptr<BackgroundJob>> jobs;
+    std::mutex job_mutex;
+    std::condition_variable job_ready;
+    bool workers_stopping; // Под job_mutex
+
+    static bool set_nonblocking(int fd) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+
+    // Тяжелые запросы выполняются вне цикла событий
+    static bool is_background_request(const std::string& line) {
+        std::string command = line.substr(0, line.find('\t'));
+        return command == "REPORT" || command == "PRINT" || command == "IMPORT" || command == "SEARCH";
+    }
+
+    // Рабочий поток: запросы из очереди до остановки сервера
+    void work() {
+        std::unique_lock<std::mutex> lock(job_mutex);
+        while (true) {
+            job_ready.wait(lock, [this]() { return workers_stopping || !jobs.empty(); });
+            if (jobs.empty()) {
+                return;
+            }
+            std::shared_ptr<BackgroundJob> job = jobs.front();
+            jobs.pop();
+            lock.unlock();
+            execute_request(job->line, job->output);
+            job->done = true;
+            char byte = 0;
+            while (write(wake_pipe[1], &byte, 1) < 0 && errno == EINTR) {
+                // EAGAIN - канал полон, цикл и так проснется
+            }
+            lock.lock();
+        }
+    }
+
+    void stop_workers() {
+        {
+            std::lock_guard<std::mutex> lock(job_mutex);
+            workers_stopping = true;
+        }
+        job_ready.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        workers.clear();
+    }
+
+    void accept_connections() {
+        while (true) {
+            int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                return; // EAGAIN - очередь пуста; прочие ошибки касаются только этого клиента
+            }
+            if (!set_nonblocking(fd)) {
+                close(fd);
+                continue;
+            }
+            connections.push_back(Connection{ fd, std::string(), std::string(), 0, false, nullptr });
+        }
+    }
+
+    // Чтение всего, что пришло; false - соединение разорвано
+    bool read_input(Connection& connection) {
+        while (true) {
+            ssize_t received = read(connection.fd, read_buffer.data(), read_buffer.size());
+            if (received > 0) {
+                connection.input.append(read_buffer.data(), static_cast<size_t>(received));
+                if (static_cast<size_t>(received) < read_buffer.size()) {
+                    return true;
+                }
+            }
+            else if (received == 0) {
+                connection.closing = true; // Клиент закончил передачу: ответить и закрыть
+                return true;
+            }
+            else if (errno == EINTR) {
+                continue;
+            }
+            else {
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+        }
+    }
+
+    // Выполнение полных строк до первого тяжелого запроса: он уходит рабочему потоку,
+    // остальные строки ждут в input его ответа
+    void execute_requests(Connection& connection) {
+        size_t start = 0;
+        size_t end;
+        while (!connection.job && (end = connection.input.find('\n', start)) != std::string::npos) {
+            size_t length = end - start;
+            if (length > 0 && connection.input[end - 1] == '\r') {
+                length--;
+            }
+            std::string line = connection.input.substr(start, length);
+            start = end + 1;
+            requests++;
+            if (is_background_request(line)) {
+                connection.job = std::make_shared<BackgroundJob>(std::move(line));
+                {
+                    std::lock_guard<std::mutex> lock(job_mutex);
+                    jobs.push(connection.job);
+                }
+                job_ready.notify_one();
+            }
+            else if (!execute_request(line, connection.output)) {
+                connection.closing = true;
+                connection.input.clear();
+                return;
+            }
+        }
+        connection.input.erase(0, start);
+        if (!connection.job && connection.input.size() > SERVER_MAX_LINE) {
+            connection.output += "ERR Слишком длинный запрос\n";
+            connection.input.clear();
+            connection.closing = true;
+        }
+    }
+
+    // Ответ завершенного тяжелого запроса и выполнение ждавших его строк; true - ответ был
+    bool finish_job(Connection& connection) {
+        if (!connection.job || !connection.job->done) {
+            return false;
+        }
+        connection.output += connection.job->output;
+        connection.job.reset();
+        execute_requests(connection);
+        return true;
+    }
+
+    // Отправка накопленных ответов; false - соединение разорвано
+    bool flush_output(Connection& connection) {
+        if (connection.sent < connection.output.size()) {
+            writes++;
+        }
+        while (connection.sent < connection.output.size()) {
+            ssize_t written = write(connection.fd, connection.output.data() + connection.sent, connection.output.size() - connection.sent);
+            if (written > 0) {
+                connection.sent += static_cast<size_t>(written);
+            }
+            else if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            else if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return true; // Остаток уйдет, когда сокет станет доступен для записи
+            }
+            else {
+                return false;
+            }
+        }
+        connection.output.clear();
+        connection.sent = 0;
+        return true;
+    }
+
+public:
+    // Сервер каталога Catalog (Library или ShardedLibrary). IMPORT читает файлы
+    // только из import_dir (пустой - импорт запрещен); тяжелые запросы выполняют
+    // worker_count рабочих потоков
+    template <typename Catalog>
+    RequestServer(Catalog& library, const std::string& socket_path, const std::string& import_dir = std::string(),
+        unsigned worker_count = std::thread::hardware_concurrency())
+        : execute_request([handler = RequestHandler<Catalog>(library, import_dir)](const std::string& line, std::string& out) mutable {
+            return handler.execute(line, out);
+        }),
+        sync_journal([&library]() { library.sync_journal(); }),
+        socket_path(socket_path), listen_fd(-1), wake_pipe{ -1, -1 }, read_buffer(SERVER_READ_CHUNK),
+        stop_requested(false), requests(0), writes(0), worker_count(std::max(1u, worker_count)), workers_stopping(false) {
+    }
+
+    RequestServer(const RequestServer&) = delete;
+    RequestServer& operator=(const RequestServer&) = delete;
+
+    ~RequestServer() {
+        stop_workers(); // Незавершенные запросы выполняются: их изменения уже начаты
+        for (const Connection& connection : connections) {
+            close(connection.fd);
+        }
+        for (int fd : wake_pipe) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+        if (listen_fd >= 0) {
+            close(listen_fd);
+            unlink(socket_path.c_str());
+        }
+    }
+
+    // Создание сокета и запуск рабочих потоков; прежний файл сокета по этому пути удаляется
+    void listen() {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument("Некорректный путь к сокету: " + socket_path);
+        }
+        std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size());
+        signal(SIGPIPE, SIG_IGN); // Разрыв соединения клиентом обрабатывается по коду ошибки записи
+        if (pipe(wake_pipe) != 0 || !set_nonblocking(wake_pipe[0]) || !set_nonblocking(wake_pipe[1])) {
+            throw std::runtime_error("Не удалось создать канал пробуждения сервера.");
+        }
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0) {
+            throw std::runtime_error("Не удалось создать сокет.");
+        }
+        unlink(socket_path.c_str());
+        if (bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+            || ::listen(listen_fd, SOMAXCONN) != 0 || !set_nonblocking(listen_fd)) {
+            close(listen_fd);
+            listen_fd = -1;
+            throw std::runtime_error("Не удалось открыть сокет " + socket_path + ": " + std::strerror(errno));
+        }
+        for (unsigned w = 0; w < worker_count; w++) {
+            workers.emplace_back(&RequestServer::work, this);
+        }
+    }
+
+    // Цикл обслуживания до вызова stop(). Ошибка сброса журнала останавливает
+    // сервер: ответы на изменения, которые могли не дойти до диска, не отправляются
+    void run() {
+        std::vector<pollfd> polled;
+        std::vector<char> alive;
+        while (!stop_requested) {
+            polled.clear();
+            polled.push_back(pollfd{ listen_fd, POLLIN, 0 });
+            polled.push_back(pollfd{ wake_pipe[0], POLLIN, 0 });
+            for (const Connection& connection : connections) {
+                short events = 0;
+                if (!connection.closing && !connection.job && connection.output.size() - connection.sent < SERVER_OUTPUT_LIMIT) {
+                    events |= POLLIN;
+                }
+                if (connection.sent < connection.output.size()) {
+                    events |= POLLOUT;
+                }
+                // Соединение, которое ждет только рабочего потока, не опрашивается:
+                // иначе разрыв с его стороны будил бы poll на каждом проходе
+                polled.push_back(pollfd{ events != 0 ? connection.fd : -1, events, 0 });
+            }
+            if (poll(polled.data(), static_cast<nfds_t>(polled.size()), SERVER_POLL_MS) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error(std::string("Ошибка poll: ") + std::strerror(errno));
+            }
+            if (polled[1].revents & POLLIN) {
+                char drain[256];
+                while (read(wake_pipe[0], drain, sizeof(drain)) > 0) {
+                }
+            }
+            // Сначала выполняются запросы всех соединений (номера в polled совпадают
+            // с номерами соединений, новые принимаются в конце прохода)
+            bool executed = false;
+            alive.assign(connections.size(), 1);
+            for (size_t i = 0; i < connections.size(); i++) {
+                Connection& connection = connections[i];
+                short revents = polled[i + 2].revents;
+                if (revents & POLLNVAL) {
+                    alive[i] = 0;
+                    continue;
+                }
+                uint64_t before = requests;
+                executed |= finish_job(connection);
+                if ((revents & (POLLIN | POLLHUP | POLLERR)) != 0 && !connection.closing && !connection.job) {
+                    alive[i] = read_input(connection);
+                    if (alive[i]) {
+                        execute_requests(connection);
+                    }
+                }
+                executed |= requests != before;
+            }
+            // Затем один сброс журнала на все изменения прохода и отправка ответов
+            if (executed) {
+                sync_journal();
+            }
+            size_t kept = 0;
+            for (size_t i = 0; i < connections.size(); i++) {
+                Connection& connection = connections[i];
+                bool keep = alive[i] && flush_output(connection); // Ответы на все прочитанные запросы - одной записью
+                if (keep && !(connection.closing && !connection.job && connection.sent == connection.output.size())) {
+                    if (kept != i) {
+                        connections[kept] = std::move(connection);
+                    }
+                    kept++;
+                }
+                else {
+                    close(connection.fd);
+                }
+            }
+            connections.resize(kept);
+            if (polled[0].revents & POLLIN) {
+                accept_connections();
+            }
+        }
+    }
+
+    // Запрос на остановку (можно вызывать из другого потока и из обработчика сигнала)
+    void stop() {
+        stop_requested = true;
+    }
+
+    uint64_t get_requests() const { return requests; }
+    uint64_t get_writes() const { return writes; }
+};
+
+RequestServer* signal_server = nullptr; // Сервер, который останавливают SIGINT и SIGTERM
+
+extern "C" void stop_server_on_signal(int) {
+    if (signal_server) {
+        signal_server->stop();
+    }
+}
+
+// Обслуживание каталога (Library или ShardedLibrary) до SIGINT или SIGTERM
+template <typename Catalog>
+int serve_catalog(Catalog& library, const std::string& socket_path, const std::string& import_dir) {
+    try {
+        JournalOptions options;
+        options.wait_for_sync = false; // Журнал сбрасывает цикл сервера перед отправкой ответов
+        size_t replayed = library.open_storage("library.snap", "library.journal", options);
+        if (replayed > 0) {
+            printf("Восстановлено операций из журнала: %zu\n", replayed);
+        }
+        RequestServer server(library, socket_path, import_dir);
+        server.listen();
+        signal_server = &server;
+        signal(SIGINT, stop_server_on_signal);
+        signal(SIGTERM, stop_server_on_signal);
+        printf("Сервер запросов слушает %s\n", socket_path.c_str());
+        fflush(stdout);
+        server.run();
+        signal_server = nullptr;
+        printf("Сервер остановлен: запросов %llu, записей ответов %llu\n",
+            static_cast<unsigned long long>(server.get_requests()), static_cast<unsigned long long>(server.get_writes()));
+        library.checkpoint();
+    }
+    catch (const std::exception& e) {
+        signal_server = nullptr;
+        std::cerr << "Ошибка сервера: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Режим службы: каталог из library.snap и library.journal, обслуживание до SIGINT или SIGTERM.
+// При shard_count > 1 - шардированный каталог, у шарда i файлы library.snap.i и library.journal.i.
+// IMPORT читает файлы только из import_dir (пустой - импорт через сервер отключен)
+int runServer(const std::string& socket_path, size_t shard_count, const std::string& import_dir) {
+    if (shard_count > 1) {
+        ShardedLibrary library(shard_count);
+        return serve_catalog(library, socket_path, import_dir);
+    }
+    Library library;
+    return serve_catalog(library, socket_path, import_dir);
+}
+
+// Класс RequestClient - блокирующее соединение с сервером запросов
+class RequestClient {
+    int fd;
+    std::string input;
+    size_t parsed; // Разобранная часть input
+
+    // Следующая строка ответа (без перевода строки)
+    std::string read_line() {
+        while (true) {
+            size_t end = input.find('\n', parsed);
+            if (end != std::string::npos) {
+                std::string line = input.substr(parsed, end - parsed);
+                parsed = end + 1;
+                if (parsed > SERVER_READ_CHUNK) {
+                    input.erase(0, parsed);
+                    parsed = 0;
+                }
+                return line;
+            }
+            char buffer[SERVER_READ_CHUNK];
+            ssize_t received = read(fd, buffer, sizeof(buffer));
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            if (received <= 0) {
+                throw std::runtime_error("Сервер закрыл соединение.");
+            }
+            input.append(buffer, static_cast<size_t>(received));
         }
-        return nullptr;
     }
 
-    // Метод для поиска книги по ISBN (используем map для быстрого поиска)
-    std::shared_ptr<Book> find_book_by_isbn(const std::string& isbn) {
-        auto it = isbn_index.find(isbn);
-        if (it != isbn_index.end()) {
-            return it->second;
+public:
+    explicit RequestClient(const std::string& socket_path) : fd(-1), parsed(0) {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument("Некорректный путь к сокету: " + socket_path);
+        }
+        std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size());
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::runtime_error("Не удалось подключиться к " + socket_path);
         }
-        return nullptr;
     }
 
-    // Метод для поиска читателя по номеру билета
-    std::shared_ptr<Reader> find_reader_by_card(int card_number) {
-        auto it = std::find_if(readers.begin(), readers.end(),
-            [card_number](const std::shared_ptr<Reader>& reader) {
-                return reader->get_card_number() == card_number;
-            });
+    RequestClient(const RequestClient&) = delete;
+    RequestClient& operator=(const RequestClient&) = delete;
 
-        if (it != readers.end()) {
-            return *it;
-        }
-        return nullptr;
+    ~RequestClient() {
+        close(fd);
     }
 
-    // Метод для вывода всей информации о библиотеке
-    void print_Library() {
-        printf("Общее количество авторов: %zu\n", authors.size());
-
-        printf("\nСписок авторов (отсортированный по ФИО):\n");
-        for (const auto& author : authors) {
-            if (author != nullptr) {
-                author->displayInfo(); // Вызов через виртуальную функцию
-                std::cout << std::endl;
+    // Отправка одного или нескольких запросов (каждый оканчивается переводом строки)
+    void send(const std::string& requests) {
+        size_t sent = 0;
+        while (sent < requests.size()) {
+            ssize_t written = write(fd, requests.data() + sent, requests.size() - sent);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                throw std::runtime_error("Ошибка отправки запроса.");
             }
+            sent += static_cast<size_t>(written);
         }
+    }
 
-        printf("\nСписок книг (отсортированный по названию):\n");
-        sort_books_by_title();
-        for (const auto& book : books) {
-            if (book != nullptr) {
-                std::cout << *book << "\n\n"; // Использование оператора <<
-            }
+    // Чтение очередного ответа: true для OK (строки данных - в rows), false для ERR (сообщение - в rows)
+    bool read_response(std::vector<std::string>& rows) {
+        rows.clear();
+        std::string header = read_line();
+        if (header.compare(0, 4, "ERR ") == 0) {
+            rows.push_back(header.substr(4));
+            return false;
         }
+        if (header.compare(0, 3, "OK ") != 0) {
+            throw std::runtime_error("Некорректный ответ сервера: " + header);
+        }
+        size_t count = std::strtoul(header.c_str() + 3, nullptr, 10);
+        for (size_t i = 0; i < count; i++) {
+            rows.push_back(read_line());
+        }
+        return true;
+    }
+};
 
-        printf("\nСписок читателей (отсортированный по ФИО):\n");
-        sort_readers_by_name();
-        for (const auto& reader : readers) {
-            if (reader != nullptr) {
-                std::cout << *reader << "\n\n"; // Использование оператора <<
+// Нагрузочный клиент: client_count соединений по request_count запросов пачками по depth
+// (запросы пачки отправляются одной записью, затем читаются все ответы). Если
+// book_count > 0, каталог сначала заполняется теми же данными, что в замерах.
+// Смесь запросов: поиск книги по ISBN и читателя по билету, выдачи и возвраты,
+// открытые выдачи читателя и изредка нечеткий поиск
+int runLoadClient(const std::string& socket_path, unsigned client_count, size_t request_count, size_t depth,
+    size_t book_count, uint64_t seed) {
+    const size_t reader_count = std::max<size_t>(1, book_count / 10);
+    try {
+        if (book_count > 0) {
+            auto start = std::chrono::steady_clock::now();
+            const size_t author_count = std::max<size_t>(1, book_count / 20);
+            WorkloadGenerator generator(seed);
+            std::vector<std::string> requests;
+            std::vector<std::string> author_fios(author_count);
+            for (size_t i = 0; i < author_count; i++) {
+                author_fios[i] = generator.person_fio() + " " + std::to_string(i + 1);
+                requests.push_back("ADD_AUTHOR\t" + author_fios[i] + "\t" + std::to_string(generator.year(1800, 2000)) + "\n");
             }
+            for (size_t i = 0; i < book_count; i++) {
+                int copies = 1 + static_cast<int>(generator.uniform(5));
+                std::string title = generator.book_title();
+                const std::string& author = author_fios[generator.popular(author_count)];
+                requests.push_back("ADD_BOOK\t" + title + "\t" + author + "\t" + std::to_string(generator.year(1850, 2025)) + "\t"
+                    + std::to_string(copies) + "\t" + make_test_isbn(i) + "\n");
+            }
+            for (size_t i = 0; i < reader_count; i++) {
+                requests.push_back("ADD_READER\t" + generator.person_fio() + "\t" + std::to_string(i + 1) + "\n");
+            }
+            RequestClient client(socket_path);
+            std::vector<std::string> rows;
+            size_t rejected = 0;
+            for (size_t from = 0; from < requests.size(); from += 1000) {
+                size_t to = std::min(requests.size(), from + 1000);
+                std::string batch;
+                for (size_t i = from; i < to; i++) {
+                    batch += requests[i];
+                }
+                client.send(batch);
+                for (size_t i = from; i < to; i++) {
+                    rejected += client.read_response(rows) ? 0 : 1; // Повторное заполнение отклоняется как дубликаты
+                }
+            }
+            printf("Каталог заполнен: %zu запросов (%zu отклонено) за %.1f мс\n", requests.size(), rejected,
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
         }
 
-        printf("\nСписок выдач (отсортированный по дате):\n");
-        sort_loans_by_date();
-        for (const auto& loan : loans) {
-            if (loan != nullptr) {
-                std::cout << *loan << "\n\n"; // Использование оператора <<
+        std::vector<std::vector<uint64_t>> batch_ns(client_count);
+        std::vector<size_t> refusals(client_count);
+        std::vector<std::string> failures(client_count);
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (unsigned c = 0; c < client_count; c++) {
+            threads.emplace_back([&, c]() {
+                try {
+                    RequestClient client(socket_path);
+                    WorkloadGenerator generator(seed + 1 + c);
+                    std::vector<uint64_t> loans; // Открытые выдачи этого клиента
+                    std::vector<std::string> rows;
+                    std::vector<bool> is_checkout;
+                    const size_t catalog = std::max<size_t>(1, book_count);
+                    for (size_t done = 0; done < request_count; ) {
+                        size_t count = std::min(depth, request_count - done);
+                        std::string batch;
+                        is_checkout.assign(count, false);
+                        for (size_t i = 0; i < count; i++) {
+                            size_t action = generator.uniform(100);
+                            int card = static_cast<int>(1 + generator.popular(reader_count));
+                            if (action < 40) {
+                                batch += "BOOK\t" + make_test_isbn(generator.popular(catalog)) + "\n";
+                            }
+                            else if (action < 60) {
+                                batch += "READER\t" + std::to_string(card) + "\n";
+                            }
+                            else if (action < 80 || loans.empty()) {
+                                batch += "CHECKOUT\t" + make_test_isbn(generator.popular(catalog)) + "\t" + std::to_string(card)
+                                    + "\t01.01.2026\t01.02.2026\n";
+                                is_checkout[i] = true;
+                            }
+                            else if (action < 95) {
+                                std::swap(loans[generator.uniform(loans.size())], loans.back());
+                                batch += "RETURN\t" + std::to_string(loans.back()) + "\t15.01.2026\n";
+                                loans.pop_back();
+                            }
+                            else if (action < 99) {
+                                batch += "LOANS\t" + std::to_string(card) + "\n";
+                            }
+                            else {
+                                batch += std::string("SEARCH\t") + WORKLOAD_NOUNS[generator.uniform(
+                                    sizeof(WORKLOAD_NOUNS) / sizeof(WORKLOAD_NOUNS[0]))].first + "\t10\n";
+                            }
+                        }
+                        auto batch_start = std::chrono::steady_clock::now();
+                        client.send(batch);
+                        for (size_t i = 0; i < count; i++) {
+                            if (!client.read_response(rows)) {
+                                refusals[c]++; // Нет экземпляров и т. п.
+                            }
+                            else if (is_checkout[i]) {
+                                loans.push_back(std::strtoull(rows[0].c_str(), nullptr, 10));
+                            }
+                        }
+                        batch_ns[c].push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - batch_start).count()));
+                        done += count;
+                    }
+                }
+                catch (const std::exception& e) {
+                    failures[c] = e.what();
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        for (const std::string& failure : failures) {
+            if (!failure.empty()) {
+                throw std::runtime_error(failure);
             }
         }
+        std::vector<uint64_t> samples;
+        size_t refused = 0;
+        for (unsigned c = 0; c < client_count; c++) {
+            samples.insert(samples.end(), batch_ns[c].begin(), batch_ns[c].end());
+            refused += refusals[c];
+        }
+        std::sort(samples.begin(), samples.end());
+        auto percentile = [&samples](double share) {
+            return samples.empty() ? 0.0 : samples[std::min(samples.size() - 1, static_cast<size_t>(share * samples.size()))] / 1000.0;
+        };
+        size_t total = request_count * client_count;
+        printf("Клиентов: %u, запросов: %zu, глубина конвейера: %zu\n", client_count, total, depth);
+        printf("Время: %.1f мс, запросов в секунду: %.0f, отказов: %zu\n", elapsed_ms,
+            elapsed_ms > 0 ? total * 1000.0 / elapsed_ms : 0.0, refused);
+        printf("Задержка пачки, мкс: p50 %.1f, p99 %.1f, p99.9 %.1f, макс. %.1f\n", percentile(0.5), percentile(0.99),
+            percentile(0.999), samples.empty() ? 0.0 : samples.back() / 1000.0);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Ошибка клиента: " << e.what() << std::endl;
+        return 1;
     }
+    return 0;
+}
 
-    // Метод для добавления автора
-    void add_Author() {
-        // Создаем FamousAuthor вместо обычного Author для демонстрации
-        auto newAuthor = std::make_shared<FamousAuthor>("", 0, "", 0);
-        newAuthor->add_Author();
-        authors.push_back(newAuthor);
+// Замер сервера в одном процессе: сервер в отдельном потоке на пустом каталоге,
+// нагрузочный клиент заполняет каталог из book_count книг и дает нагрузку
+int benchmarkServer(size_t book_count, unsigned client_count, size_t request_count, size_t depth) {
+    const std::string socket_path = "laba5_bench.sock";
+    Library library;
+    RequestServer server(library, socket_path);
+    try {
+        server.listen();
     }
+    catch (const std::exception& e) {
+        std::cerr << "Ошибка сервера: " << e.what() << std::endl;
+        return 1;
+    }
+    std::thread serving([&server]() { server.run(); });
+    int result = runLoadClient(socket_path, client_count, request_count, depth, book_count, 1);
+    server.stop();
+    serving.join();
+    printf("Сервер: запросов %llu, записей ответов %llu (%.1f ответа на запись)\n",
+        static_cast<unsigned long long>(server.get_requests()), static_cast<unsigned long long>(server.get_writes()),
+        server.get_writes() > 0 ? static_cast<double>(server.get_requests()) / server.get_writes() : 0.0);
+    return result;
+}
+#endif
 
-    // Метод для добавления книги
-    void add_Book() {
-        if (authors.empty()) {
-            printf("Ошибка: сначала добавьте хотя бы одного автора.\n");
-            return;
-        }
+// ---------------------------------------------------------------------------
+// Воспроизведение трасс
+// ---------------------------------------------------------------------------
+// Трасса (запись сеанса меню или синтетическая) выполняется обработчиком
+// запросов над отдельной библиотекой: каталог на начало записи загружается
+// из снимка <трасса>.snap, если он есть. Темп 0 - как можно быстрее, 1 - с
+// записанными паузами, 2 - вдвое быстрее записи и т. д. В нескольких потоках
+// изменения состава каталога (ADD_*, IMPORT, CLOCK) выполняются по одному,
+// после всех предыдущих операций, а операции между ними - параллельно в
+// порядке трассы. Номера выдач при этом могут разойтись с записанными, и
+// часть RETURN и RENEW завершится ошибкой - она видна в таблице. Журнал при
+// воспроизведении не ведется, поэтому CHECKPOINT пропускается.
 
-        auto newBook = std::make_shared<Book>();
-        newBook->add_Book(authors);
-        books.push_back(newBook);
-        isbn_index[newBook->get_isbn()] = newBook; // Добавляем в индекс для быстрого поиска
-    }
+// Операция трассы
+struct TraceEntry {
+    uint64_t offset_us; // Смещение от начала записи
+    std::string request; // Строка запроса
+    std::string command; // Первое поле запроса
+};
 
-    // Метод для добавления читателя
-    void add_Reader() {
-        auto newReader = std::make_shared<Reader>();
-        newReader->add_Reader();
-        readers.push_back(newReader);
+// Чтение трассы (исключение, если файл не открывается или строка повреждена)
+std::vector<TraceEntry> read_trace(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        throw std::runtime_error("Не удалось открыть трассу " + path);
+    }
+    std::string text;
+    char buffer[64 * 1024];
+    size_t read_size;
+    while ((read_size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        text.append(buffer, read_size);
     }
+    fclose(file);
 
-    // Метод для добавления выдачи книги
-    void add_Loan() {
-        if (books.empty()) {
-            printf("Ошибка: нет книг в библиотеке.\n");
-            return;
+    std::vector<TraceEntry> entries;
+    size_t line_number = 0;
+    for (size_t start = 0; start < text.size(); ) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos) {
+            end = text.size();
         }
-
-        if (readers.empty()) {
-            printf("Ошибка: нет читателей в библиотеке.\n");
-            return;
+        std::string line = text.substr(start, end - start);
+        start = end + 1;
+        line_number++;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
         }
+        size_t tab = line.find('\t');
+        char* parse_end = nullptr;
+        unsigned long long offset = std::strtoull(line.c_str(), &parse_end, 10);
+        if (tab == std::string::npos || tab == 0 || parse_end != line.c_str() + tab) {
+            throw std::runtime_error("Повреждена строка трассы " + std::to_string(line_number));
+        }
+        TraceEntry entry;
+        entry.offset_us = offset;
+        entry.request = line.substr(tab + 1);
+        entry.command = entry.request.substr(0, entry.request.find('\t'));
+        entries.push_back(std::move(entry));
+    }
+    return entries;
+}
 
-        try {
-            printf("Выберите книгу (введите номер): ");
-            for (size_t i = 0; i < books.size(); i++) {
-                if (books[i] != nullptr) {
-                    printf("%zu. %s\n", i + 1, books[i]->get_title().c_str());
-                }
-            }
-            int book_index;
-            scanf("%d", &book_index);
-            if (book_index < 1 || book_index > static_cast<int>(books.size()) || !books[book_index - 1])
-                throw std::out_of_range("Некорректный номер книги.");
+// Операция меняет состав каталога и в нескольких потоках выполняется отдельно
+bool is_trace_barrier(const std::string& command) {
+    return command == "ADD_AUTHOR" || command == "ADD_BOOK" || command == "ADD_READER" || command == "IMPORT" || command == "CLOCK";
+}
 
-            printf("Выберите читателя (введите номер): ");
-            for (size_t i = 0; i < readers.size(); i++) {
-                if (readers[i] != nullptr) {
-                    printf("%zu. %s\n", i + 1, readers[i]->get_fio().c_str());
-                }
-            }
-            int reader_index;
-            scanf("%d", &reader_index);
-            if (reader_index < 1 || reader_index > static_cast<int>(readers.size()) || !readers[reader_index - 1])
-                throw std::out_of_range("Некорректный номер читателя.");
+// Замеры одной команды трассы
+struct ReplayStats {
+    std::vector<uint64_t> samples_ns;
+    size_t errors;
 
-            if (!is_book_available(*books[book_index - 1], 1)) {
-                throw std::runtime_error("Недостаточно экземпляров книги.");
-            }
+    ReplayStats() : errors(0) {}
+};
 
-            std::string issue_date, return_date;
-            printf("Введите дату выдачи книги (дд.мм.гггг): ");
-            std::cin >> issue_date;
-            printf("Введите дату возврата книги (дд.мм.гггг): ");
-            std::cin >> return_date;
+typedef std::map<std::string, ReplayStats> ReplayTable;
 
-            auto newLoan = std::make_shared<Loan>(books[book_index - 1], readers[reader_index - 1], issue_date, return_date);
-            loans.push_back(newLoan);
-            readers[reader_index - 1]->add_borrowed_book(books[book_index - 1], issue_date);
-        }
-        catch (const std::exception& e) {
-            std::cerr << "Ошибка при создании выдачи: " << e.what() << std::endl;
+// Воспроизведение трассы; печатает по командам число вызовов, ошибок и задержки.
+// Возвращает 0, если трасса прочитана и выполнена
+int replayTrace(const std::string& path, unsigned thread_count, double speed) {
+    std::vector<TraceEntry> entries;
+    Library library;
+    try {
+        entries = read_trace(path);
+        if (library.load_snapshot(path + ".snap")) {
+            printf("Каталог на начало записи загружен из %s.snap\n", path.c_str());
         }
     }
+    catch (const std::exception& e) {
+        std::cerr << "Ошибка: " << e.what() << std::endl;
+        return 1;
+    }
+    RequestHandler<Library> handler(library);
+    std::vector<ReplayTable> tables(thread_count);
+    size_t skipped = 0;
+    auto start = std::chrono::steady_clock::now();
 
-    // Метод для поиска и вывода информации о книге
-    void search_and_print_book() {
-        printf("Выберите тип поиска:\n");
-        printf("1. По названию\n");
-        printf("2. По ISBN\n");
-        int choice;
-        scanf("%d", &choice);
-
-        std::string search_term;
-        printf("Введите поисковый запрос: ");
-        while (getchar() != '\n'); // Очистка буфера
-        std::getline(std::cin, search_term);
-
-        std::shared_ptr<Book> found_book;
-        switch (choice) {
-        case 1:
-            found_book = find_book_by_title(search_term);
-            break;
-        case 2:
-            found_book = find_book_by_isbn(search_term);
-            break;
-        default:
-            printf("Неверный выбор.\n");
-            return;
+    // Выполнение операции с ожиданием ее времени по записи (при темпе > 0)
+    auto run = [&](const TraceEntry& entry, ReplayTable& table, std::string& out) {
+        if (speed > 0) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(static_cast<int64_t>(entry.offset_us / speed)));
         }
+        out.clear();
+        auto call_start = std::chrono::steady_clock::now();
+        handler.execute(entry.request, out);
+        ReplayStats& stats = table[entry.command];
+        stats.samples_ns.push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - call_start).count()));
+        if (out.compare(0, 4, "ERR ") == 0) {
+            stats.errors++;
+        }
+    };
 
-        if (found_book) {
-            std::cout << "\nНайдена книга:\n" << *found_book << std::endl;
+    std::string out;
+    size_t i = 0;
+    while (i < entries.size()) {
+        if (entries[i].command == "CHECKPOINT") {
+            skipped++;
+            i++;
+            continue;
         }
-        else {
-            printf("Книга не найдена.\n");
+        size_t end = i;
+        while (end < entries.size() && !is_trace_barrier(entries[end].command) && entries[end].command != "CHECKPOINT") {
+            end++;
+        }
+        if (end == i) { // Изменение состава каталога - в текущем потоке после всех предыдущих операций
+            run(entries[i], tables[0], out);
+            i++;
+            continue;
+        }
+        if (thread_count == 1 || end - i < 2 * thread_count) {
+            for (; i < end; i++) {
+                run(entries[i], tables[0], out);
+            }
+            continue;
+        }
+        // Операции между изменениями состава разбирают потоки по общему счетчику
+        std::atomic<size_t> next(i);
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < thread_count; t++) {
+            threads.emplace_back([&, t]() {
+                std::string thread_out;
+                for (size_t k = next++; k < end; k = next++) {
+                    run(entries[k], tables[t], thread_out);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
         }
+        i = end;
     }
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 
-    // Метод для поиска и вывода информации о читателе
-    void search_and_print_reader() {
-        printf("Выберите тип поиска:\n");
-        printf("1. По номеру билета\n");
-        printf("2. По ФИО\n");
-        int choice;
-        scanf("%d", &choice);
+    ReplayTable total;
+    for (ReplayTable& table : tables) {
+        for (auto& entry : table) {
+            ReplayStats& stats = total[entry.first];
+            stats.samples_ns.insert(stats.samples_ns.end(), entry.second.samples_ns.begin(), entry.second.samples_ns.end());
+            stats.errors += entry.second.errors;
+        }
+    }
+    printf("Трасса: %zu операций, потоков: %u, темп: %s\n", entries.size(), thread_count,
+        speed > 0 ? (std::to_string(speed) + "x").c_str() : "без пауз");
+    printf("%s %s %s %s %s %s %s %s\n", pad_text("Команда", 16).c_str(), pad_text("Вызовов", 9, true).c_str(),
+        pad_text("Ошибок", 8, true).c_str(), pad_text("Всего, мс", 11, true).c_str(), pad_text("Сред., мкс", 11, true).c_str(),
+        pad_text("p50, мкс", 10, true).c_str(), pad_text("p99, мкс", 10, true).c_str(), pad_text("Макс., мкс", 11, true).c_str());
+    for (auto& entry : total) {
+        std::vector<uint64_t>& samples = entry.second.samples_ns;
+        std::sort(samples.begin(), samples.end());
+        uint64_t sum = 0;
+        for (uint64_t sample : samples) {
+            sum += sample;
+        }
+        auto percentile = [&samples](double share) {
+            return samples[std::min(samples.size() - 1, static_cast<size_t>(share * samples.size()))] / 1000.0;
+        };
+        printf("%s %9zu %8zu %11.1f %11.1f %10.1f %10.1f %11.1f\n", pad_text(entry.first, 16).c_str(), samples.size(),
+            entry.second.errors, sum / 1e6, sum / 1000.0 / samples.size(), percentile(0.5), percentile(0.99), samples.back() / 1000.0);
+    }
+    if (skipped > 0) {
+        printf("Пропущено контрольных точек: %zu\n", skipped);
+    }
+    printf("Время: %.1f мс, операций в секунду: %.0f\n", elapsed_ms,
+        elapsed_ms > 0 ? (entries.size() - skipped) * 1000.0 / elapsed_ms : 0.0);
+    return 0;
+}
 
-        if (choice == 1) {
-            printf("Введите номер читательского билета: ");
-            int card_number;
-            scanf("%d", &card_number);
-            auto reader = find_reader_by_card(card_number);
-            if (reader) {
-                std::cout << "\nНайден читатель:\n" << *reader << std::endl;
+// Синтетическая трасса для проверки воспроизведения: заполнение каталога из
+// book_count книг и operation_count операций той же смеси, что у нагрузочного
+// клиента (операции идут с шагом 10 мкс). Генератор ведет свободные экземпляры
+// и открытые выдачи, поэтому номер получает только состоявшаяся выдача, а RETURN
+// закрывает выдачу, открытую при последовательном воспроизведении
+void write_workload_trace(const std::string& path, size_t book_count, size_t operation_count, uint64_t seed) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Не удалось создать трассу " + path);
+    }
+    const size_t author_count = std::max<size_t>(1, book_count / 20);
+    const size_t reader_count = std::max<size_t>(1, book_count / 10);
+    WorkloadGenerator generator(seed);
+    uint64_t offset = 0;
+    auto write = [&file, &offset](std::initializer_list<std::string> fields) {
+        fprintf(file, "%llu\t%s\n", static_cast<unsigned long long>(offset), make_request_line(fields).c_str());
+        offset += 10;
+    };
+    std::vector<std::string> author_fios(author_count);
+    for (size_t i = 0; i < author_count; i++) {
+        author_fios[i] = generator.person_fio() + " " + std::to_string(i + 1);
+        write({ "ADD_AUTHOR", author_fios[i], std::to_string(generator.year(1800, 2000)) });
+    }
+    std::vector<int> stock(book_count); // Свободные экземпляры книг
+    for (size_t i = 0; i < book_count; i++) {
+        stock[i] = static_cast<int>(1 + generator.uniform(5));
+        std::string title = generator.book_title();
+        const std::string& author = author_fios[generator.popular(author_count)];
+        write({ "ADD_BOOK", title, author, std::to_string(generator.year(1850, 2025)), std::to_string(stock[i]), make_test_isbn(i) });
+    }
+    for (size_t i = 0; i < reader_count; i++) {
+        write({ "ADD_READER", generator.person_fio(), std::to_string(i + 1) });
+    }
+    uint64_t next_loan = 1; // Номер следующей выдачи при последовательном воспроизведении
+    std::vector<std::pair<uint64_t, size_t>> open_loans; // Номер открытой выдачи и книга
+    for (size_t i = 0; i < operation_count; i++) {
+        size_t action = generator.uniform(100);
+        std::string card = std::to_string(1 + generator.popular(reader_count));
+        if (action < 40) {
+            write({ "BOOK", make_test_isbn(generator.popular(book_count)) });
+        }
+        else if (action < 60) {
+            write({ "READER", card });
+        }
+        else if (action < 80) {
+            size_t book = generator.popular(book_count);
+            write({ "CHECKOUT", make_test_isbn(book), card, "01.01.2026", "01.02.2026" });
+            if (stock[book] > 0) { // Иначе выдача отклоняется и номера не получает
+                stock[book]--;
+                open_loans.emplace_back(next_loan++, book);
             }
-            else {
-                printf("Читатель не найден.\n");
+        }
+        else if (action < 95) {
+            if (open_loans.empty()) {
+                write({ "BOOK", make_test_isbn(generator.popular(book_count)) }); // Возвращать нечего
+                continue;
             }
+            size_t chosen = generator.uniform(open_loans.size());
+            write({ "RETURN", std::to_string(open_loans[chosen].first), "15.01.2026" });
+            stock[open_loans[chosen].second]++;
+            open_loans[chosen] = open_loans.back();
+            open_loans.pop_back();
         }
-        else if (choice == 2) {
-            printf("Введите ФИО читателя: ");
-            std::string name;
-            while (getchar() != '\n'); // Очистка буфера
-            std::getline(std::cin, name);
+        else if (action < 99) {
+            write({ "LOANS", card });
+        }
+        else {
+            write({ "SEARCH", WORKLOAD_NOUNS[generator.uniform(sizeof(WORKLOAD_NOUNS) / sizeof(WORKLOAD_NOUNS[0]))].first, "10" });
+        }
+    }
+    if (fclose(file) != 0) {
+        throw std::runtime_error("Ошибка записи трассы " + path);
+    }
+}
 
-            // Линейный поиск по ФИО (можно было бы использовать сортировку и binary_search)
-            bool found = false;
-            for (const auto& reader : readers) {
-                if (reader && reader->get_fio() == name) {
-                    std::cout << "\nНайден читатель:\n" << *reader << std::endl;
-                    found = true;
-                    break;
+// Замер воспроизведения: синтетическая трасса выполняется в одном потоке и в thread_count потоках
+int benchmarkReplay(size_t book_count, unsigned thread_count) {
+    const std::string trace_path = "bench_replay.trace";
+    std::remove((trace_path + ".snap").c_str()); // Трасса сама заполняет каталог
+    try {
+        write_workload_trace(trace_path, book_count, book_count * 5, 1);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Ошибка: " << e.what() << std::endl;
+        return 1;
+    }
+    int result = replayTrace(trace_path, 1, 0);
+    if (result == 0 && thread_count > 1) {
+        printf("\n");
+        result = replayTrace(trace_path, thread_count, 0);
+    }
+    std::remove(trace_path.c_str());
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+#ifdef _WIN32
+    // Установка кодировки для корректного отображения кириллицы
+    SetConsoleCP(1251);
+    SetConsoleOutputCP(1251);
+#endif
+
+    // Набор замеров на синтетическом каталоге: LABA5 --bench-suite N [seed]
+    if (argc >= 3 && std::string(argv[1]) == "--bench-suite") {
+        benchmarkSuite(std::max<size_t>(1, std::strtoul(argv[2], nullptr, 10)),
+            argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 1);
+        return 0;
+    }
+
+    // Сравнение одной библиотеки с шардированной: LABA5 --bench-shards N [шардов] [потоков]
+    if (argc >= 3 && std::string(argv[1]) == "--bench-shards") {
+        size_t shard_count = argc >= 4 ? std::strtoul(argv[3], nullptr, 10) : 4;
+        unsigned thread_count = argc >= 5 ? static_cast<unsigned>(std::strtoul(argv[4], nullptr, 10)) : std::thread::hardware_concurrency();
+        return benchmarkShards(std::max<size_t>(1, std::strtoul(argv[2], nullptr, 10)), std::max<size_t>(1, shard_count),
+            std::max(1u, thread_count));
+    }
+
+    // Режим службы и нагрузочный клиент (только POSIX):
+    // LABA5 --serve [сокет] [--shards N] [--import-dir каталог]
+    // LABA5 --load-client сокет [клиентов] [запросов на клиента] [глубина конвейера] [книг для заполнения]
+    // LABA5 --bench-server N [клиентов] [запросов на клиента] [глубина конвейера]
+    if (argc >= 2 && (std::string(argv[1]) == "--serve" || std::string(argv[1]) == "--load-client"
+        || std::string(argv[1]) == "--bench-server")) {
+#ifdef _WIN32
+        printf("Ошибка: сервер запросов доступен только в POSIX-системах.\n");
+        return 1;
+#else
+        std::string mode = argv[1];
+        if (mode == "--serve") {
+            std::string socket_path = "library.sock";
+            std::string import_dir;
+            size_t shard_count = 1;
+            for (int i = 2; i < argc; i++) {
+                if (std::string(argv[i]) == "--shards" && i + 1 < argc) {
+                    shard_count = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+                }
+                else if (std::string(argv[i]) == "--import-dir" && i + 1 < argc) {
+                    import_dir = argv[++i];
+                }
+                else {
+                    socket_path = argv[i];
                 }
             }
-            if (!found) {
-                printf("Читатель не найден.\n");
-            }
+            return runServer(socket_path, shard_count, import_dir);
         }
-        else {
-            printf("Неверный выбор.\n");
+        if (argc < 3) {
+            printf("Ошибка: не указан %s.\n", mode == "--load-client" ? "сокет" : "размер каталога");
+            return 1;
         }
+        unsigned client_count = argc >= 4 ? static_cast<unsigned>(std::strtoul(argv[3], nullptr, 10)) : 4;
+        size_t request_count = argc >= 5 ? std::strtoul(argv[4], nullptr, 10) : 100000;
+        size_t depth = argc >= 6 ? std::strtoul(argv[5], nullptr, 10) : 32;
+        if (mode == "--load-client") {
+            return runLoadClient(argv[2], std::max(1u, client_count), request_count, std::max<size_t>(1, depth),
+                argc >= 7 ? std::strtoul(argv[6], nullptr, 10) : 0, 1);
+        }
+        return benchmarkServer(std::max<size_t>(1, std::strtoul(argv[2], nullptr, 10)), std::max(1u, client_count), request_count,
+            std::max<size_t>(1, depth));
+#endif
     }
-};
 
-// Функция для демонстрации виртуальных функций
-void demonstrateVirtualFunctions() {
-    // Создаем объекты базового и производного классов
-    Author* author = new Author("Лев Толстой", 1828);
-    FamousAuthor* famousAuthor = new FamousAuthor("Фёдор Достоевский", 1821, "Преступление и наказание", 5);
+    // Воспроизведение трассы сеанса: LABA5 --replay трасса [потоков] [темп: 0 - без пауз, 1 - как записано]
+    if (argc >= 3 && std::string(argv[1]) == "--replay") {
+        unsigned thread_count = argc >= 4 ? static_cast<unsigned>(std::strtoul(argv[3], nullptr, 10)) : 1;
+        return replayTrace(argv[2], std::max(1u, thread_count), argc >= 5 ? std::max(0.0, std::atof(argv[4])) : 0.0);
+    }
 
-    // Демонстрация работы виртуальной функции
-    std::cout << "\nДемонстрация виртуальных функций:\n";
-    Author* ptr = author;
-    ptr->displayInfo(); // Вызовется Author::print_Author()
+    // Замер воспроизведения синтетической трассы: LABA5 --bench-replay N [потоков]
+    if (argc >= 3 && std::string(argv[1]) == "--bench-replay") {
+        unsigned thread_count = argc >= 4 ? static_cast<unsigned>(std::strtoul(argv[3], nullptr, 10)) : std::thread::hardware_concurrency();
+        return benchmarkReplay(std::max<size_t>(1, std::strtoul(argv[2], nullptr, 10)), std::max(1u, thread_count));
+    }
 
-    ptr = famousAuthor;
-    ptr->displayInfo(); // Вызовется FamousAuthor::print_Author()
+    // Режим замера скорости восстановления: LABA5 --bench-recovery N
+    if (argc >= 3 && std::string(argv[1]) == "--bench-recovery") {
+        benchmarkJournalRecovery(std::strtoul(argv[2], nullptr, 10));
+        return 0;
+    }
 
-    // Демонстрация без виртуальной функции
-    std::cout << "\nДемонстрация без виртуальной функции:\n";
-    ptr = author;
-    ptr->print_Author(); // Вызовется Author::print_Author()
+    // Замер открытия снимка: LABA5 --bench-snapshot N
+    if (argc >= 3 && std::string(argv[1]) == "--bench-snapshot") {
+        benchmarkSnapshotOpen(std::max<size_t>(1, std::strtoul(argv[2], nullptr, 10)));
+        return 0;
+    }
 
-    ptr = famousAuthor;
-    ptr->print_Author(); // Вызовется FamousAuthor::print_Author()
+    // Замер поиска по ISBN: LABA5 --bench-isbn N
+    if (argc >= 3 && std::string(argv[1]) == "--bench-isbn") {
+        benchmarkIsbnLookup(std::strtoul(argv[2], nullptr, 10));
+        return 0;
+    }
 
-    // Освобождение памяти
-    delete author;
-    delete famousAuthor;
-}
+    // Замер составных запросов: LABA5 --bench-query N
+    if (argc >= 3 && std::string(argv[1]) == "--bench-query") {
+        benchmarkQueries(std::max<size_t>(1, std::strtoul(argv[2], nullptr, 10)));
+        return 0;
+    }
 
-// Функция для демонстрации абстрактного класса
-void demonstrateAbstractClass() {
-    // AbstractPerson* person = new AbstractPerson(); // Ошибка - нельзя создать экземпляр абстрактного класса
-    AbstractPerson* person = new Reader();
-    person->displayInfo(); // Вызовется Reader::print_Reader()
-    delete person;
-}
+    // Замер сводки по выдачам: LABA5 --bench-analytics N [выдач]
+    if (argc >= 3 && std::string(argv[1]) == "--bench-analytics") {
+        size_t book_count = std::max<size_t>(1, std::strtoul(argv[2], nullptr, 10));
+        benchmarkAnalytics(book_count, argc >= 4 ? std::strtoul(argv[3], nullptr, 10) : book_count * 2);
+        return 0;
+    }
 
-// Функция для демонстрации шаблона класса
-void demonstrateTemplateClass() {
-    // Создаем карточки с разными типами идентификаторов
-    LibraryCard<int> intCard(12345, "01.01.2023", "31.12.2025");
-    LibraryCard<std::string> stringCard("ABC-123", "01.01.2023", "31.12.2025");
+    // Замер справочника авторов: LABA5 --bench-authors N
+    if (argc >= 3 && std::string(argv[1]) == "--bench-authors") {
+        benchmarkAuthorDirectory(std::max<size_t>(1, std::strtoul(argv[2], nullptr, 10)));
+        return 0;
+    }
 
-    std::cout << "\nДемонстрация шаблонного класса:\n";
-    std::cout << "Карточка с числовым ID:\n";
-    intCard.display();
-    std::cout << "\nКарточка со строковым ID:\n";
-    stringCard.display();
-}
+    // Замер операций со счетчиками и гистограммами: LABA5 --bench-metrics N
+    if (argc >= 3 && std::string(argv[1]) == "--bench-metrics") {
+        benchmarkMetrics(std::max<size_t>(1, std::strtoul(argv[2], nullptr, 10)));
+        return 0;
+    }
 
-int main() {
-    // Установка кодировки для корректного отображения кириллицы
-    SetConsoleCP(1251);
-    SetConsoleOutputCP(1251);
+    // Замер выгрузки отчета: LABA5 --bench-export N
+    if (argc >= 3 && std::string(argv[1]) == "--bench-export") {
+        benchmarkReportExport(std::strtoul(argv[2], nullptr, 10));
+        return 0;
+    }
+
+    // Замер нечеткого поиска: LABA5 --bench-search N [запросов]
+    if (argc >= 3 && std::string(argv[1]) == "--bench-search") {
+        size_t query_count = argc >= 4 ? std::strtoul(argv[3], nullptr, 10) : 1000;
+        benchmarkFuzzySearch(std::strtoul(argv[2], nullptr, 10), query_count);
+        return 0;
+    }
+
+    // Замер скорости пакетного возврата: LABA5 --bench-returns N [размер пакета]
+    if (argc >= 3 && std::string(argv[1]) == "--bench-returns") {
+        size_t batch_size = argc >= 4 ? std::strtoul(argv[3], nullptr, 10) : 1000;
+        benchmarkBatchReturns(std::strtoul(argv[2], nullptr, 10), batch_size == 0 ? 1 : batch_size);
+        return 0;
+    }
+
+    // Нагрузочная проверка выдачи: LABA5 --stress-checkout [потоков] [операций на поток]
+    if (argc >= 2 && std::string(argv[1]) == "--stress-checkout") {
+        unsigned thread_count = argc >= 3 ? static_cast<unsigned>(std::strtoul(argv[2], nullptr, 10)) : std::thread::hardware_concurrency();
+        size_t operations = argc >= 4 ? std::strtoul(argv[3], nullptr, 10) : 100000;
+        return stressTestCheckout(thread_count == 0 ? 1 : thread_count, operations);
+    }
 
+#ifdef LIBRARY_BENCH_ONLY
+    // Сборка только для замеров: без флага запускается набор замеров, LABA5 [N] [seed]
+    benchmarkSuite(argc >= 2 ? std::max<size_t>(1, std::strtoul(argv[1], nullptr, 10)) : 100000,
+        argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 1);
+    return 0;
+#else
     // Демонстрационные функции
     demonstrateVirtualFunctions();
     demonstrateAbstractClass();
@@ -753,9 +11920,42 @@ int main() {
 
     // Создание объекта библиотеки
     Library library;
+    const std::string snapshot_path = "library.snap";
+    const std::string journal_path = "library.journal";
 
     printf("БИБЛИОТЕЧНЫЙ УЧЁТ\n");
 
+    // Загрузка сохраненного каталога и воспроизведение журнала изменений
+    try {
+        size_t replayed = library.open_storage(snapshot_path, journal_path);
+        if (replayed > 0) {
+            printf("Восстановлено операций из журнала: %zu\n", replayed);
+        }
+    }
+    catch (const std::exception& e) {
+        // Без открытого хранилища изменения не сохранялись бы - завершаем работу,
+        // файлы каталога остаются нетронутыми
+        std::cerr << "Ошибка при загрузке каталога: " << e.what() << std::endl;
+        std::cerr << "Проверьте файлы " << snapshot_path << " и " << journal_path << "." << std::endl;
+        return 1;
+    }
+    library.advance_clock(Date::today()); // Отмечаем выдачи, просроченные на сегодня
+
+    // Запись сеанса в трассу: LABA5 --record трасса (каталог на начало записи - в <трасса>.snap)
+    std::unique_ptr<SessionRecorder> recorder;
+    if (argc >= 3 && std::string(argv[1]) == "--record") {
+        try {
+            library.save_snapshot(std::string(argv[2]) + ".snap");
+            recorder.reset(new SessionRecorder(argv[2]));
+            library.set_recorder(recorder.get());
+            library.record_request({ "CLOCK", Date::today().to_string() });
+            printf("Сеанс записывается в %s\n", argv[2]);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Ошибка при включении записи сеанса: " << e.what() << std::endl;
+        }
+    }
+
     // Основное меню программы
     int choice;
     do {
@@ -768,6 +11968,16 @@ int main() {
         printf("6. Поиск книги\n");
         printf("7. Поиск читателя\n");
         printf("8. Выход\n");
+        printf("9. Импорт из файла\n");
+        printf("10. Поиск выдач за период\n");
+        printf("11. Просроченные выдачи (перевести дату)\n");
+        printf("12. Вернуть книгу\n");
+        printf("13. Продлить выдачу\n");
+        printf("14. Просмотр каталога по страницам\n");
+        printf("15. Выгрузка отчета\n");
+        printf("16. Статистика выдач\n");
+        printf("17. Метрики и память\n");
+        printf("18. Сохранить каталог\n");
         printf("Выберите действие: ");
         scanf("%d", &choice);
 
@@ -785,6 +11995,7 @@ int main() {
             library.add_Loan();
             break;
         case 5:
+            library.record_request({ "PRINT" });
             library.print_Library();
             break;
         case 6:
@@ -793,6 +12004,43 @@ int main() {
         case 7:
             library.search_and_print_reader();
             break;
+        case 9:
+            library.import_from_file();
+            break;
+        case 10:
+            library.search_and_print_loans();
+            break;
+        case 11:
+            library.advance_clock_and_print_overdue();
+            break;
+        case 12:
+            library.return_Loan();
+            break;
+        case 13:
+            library.renew_Loan();
+            break;
+        case 14:
+            library.browse_Catalog();
+            break;
+        case 15:
+            library.export_Report();
+            break;
+        case 16:
+            library.print_Analytics();
+            break;
+        case 17:
+            library.print_Metrics();
+            break;
+        case 18:
+            library.record_request({ "CHECKPOINT" });
+            try {
+                library.checkpoint();
+                printf("Каталог сохранен в файл %s\n", snapshot_path.c_str());
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Ошибка при сохранении каталога: " << e.what() << std::endl;
+            }
+            break;
         case 8:
             printf("Выход из программы.\n");
             break;
@@ -801,5 +12049,10 @@ int main() {
         }
     } while (choice != 8);
 
+    if (recorder) {
+        library.set_recorder(nullptr);
+        printf("Записано операций: %zu\n", recorder->size());
+    }
     return 0;
+#endif
 }
\ No newline at end of file